@@ -26,12 +26,15 @@ public:
 									const BString& checksum = BString());
 	virtual						~DownloadFileRequest();
 
+			void				SetBasisEntry(const BEntry& basisEntry);
+
 	virtual	status_t			CreateInitialJobs();
 
 private:
 			BString				fFileURL;
 			BEntry				fTargetEntry;
 			BString				fChecksum;
+			BEntry				fBasisEntry;
 };
 
 
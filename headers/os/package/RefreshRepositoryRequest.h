@@ -40,6 +40,7 @@ protected:
 
 private:
 			status_t			_FetchRepositoryCache();
+			void				_StoreRepositoryCacheChecksum();
 
 			BEntry				fFetchedChecksumFile;
 			BRepositoryConfig	fRepoConfig;
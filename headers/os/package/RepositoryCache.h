@@ -29,15 +29,13 @@ public:
 			const BRepositoryInfo&	Info() const;
 			const BEntry&		Entry() const;
 			bool				IsUserSpecific() const;
+			status_t			GetChecksum(BString& _checksum) const;
 
 			void				SetIsUserSpecific(bool isUserSpecific);
 
 			uint32				CountPackages() const;
 			Iterator			GetIterator() const;
 
-private:
-			struct RepositoryContentHandler;
-
 private:
 			BEntry				fEntry;
 			BRepositoryInfo		fInfo;
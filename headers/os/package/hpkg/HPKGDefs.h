@@ -18,7 +18,7 @@ namespace BHPKG {
 enum {
 	B_HPKG_MAGIC				= 'hpkg',
 	B_HPKG_VERSION				= 2,
-	B_HPKG_MINOR_VERSION		= 1,
+	B_HPKG_MINOR_VERSION		= 2,
 	//
 	B_HPKG_REPO_MAGIC			= 'hpkr',
 	B_HPKG_REPO_VERSION			= 2,
@@ -99,7 +99,9 @@ enum BHPKGAttributeID {
 enum {
 	B_HPKG_COMPRESSION_NONE	= 0,
 	B_HPKG_COMPRESSION_ZLIB	= 1,
-	B_HPKG_COMPRESSION_ZSTD	= 2
+	B_HPKG_COMPRESSION_ZSTD	= 2,
+	B_HPKG_COMPRESSION_ZSTD_DICTIONARY = 3
+		// zstd with a dictionary stored between header and heap
 };
 
 
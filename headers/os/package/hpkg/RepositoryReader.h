@@ -11,6 +11,9 @@
 
 namespace BPackageKit {
 
+class BPackageInfo;
+class BRepositoryInfo;
+
 namespace BHPKG {
 
 
@@ -30,9 +33,17 @@ public:
 								~BRepositoryReader();
 
 			status_t			Init(const char* fileName);
+			status_t			GetRepositoryInfo(
+									BRepositoryInfo* _repositoryInfo) const;
 			status_t			ParseContent(
 									BRepositoryContentHandler* contentHandler);
 
+			status_t			InitPackageIndex();
+			int32				CountPackages() const;
+			const char*			PackageNameAt(int32 index) const;
+			status_t			GetPackageInfo(int32 index,
+									BPackageInfo& _info);
+
 private:
 			RepositoryReaderImpl*	fImpl;
 };
@@ -59,6 +59,7 @@ public:
 								~BRepositoryWriter();
 
 			status_t			Init(const char* fileName);
+			void				SetWriteChunkIndices(bool write);
 			status_t			AddPackage(const BEntry& packageEntry);
 			status_t			AddPackageInfo(const BPackageInfo& packageInfo);
 			status_t			Finish();
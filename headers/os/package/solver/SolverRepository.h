@@ -12,6 +12,9 @@
 #include <String.h>
 
 
+class BEntry;
+
+
 namespace BPackageKit {
 
 
@@ -70,8 +73,18 @@ public:
 
 			uint64				ChangeCount() const;
 
+			status_t			GetCache(BEntry& _entry,
+									BString& _checksum) const;
+									// only set as long as the packages are
+									// those of the repository cache
+
 private:
 			typedef BObjectList<BSolverPackage> PackageList;
+			struct CacheInfo;
+
+private:
+			void				_SetCache(const BRepositoryCache& cache);
+			void				_UnsetCache();
 
 private:
 			BString				fName;
@@ -79,6 +92,7 @@ private:
 			bool				fIsInstalled;
 			PackageList			fPackages;
 			uint64				fChangeCount;
+			CacheInfo*			fCacheInfo;
 };
 
 
@@ -64,6 +64,14 @@
 #define atomic_or			fssh_atomic_or
 #define atomic_get			fssh_atomic_get
 
+#define atomic_set64		fssh_atomic_set64
+#define atomic_get_and_set64	fssh_atomic_get_and_set64
+#define atomic_test_and_set64	fssh_atomic_test_and_set64
+#define atomic_add64		fssh_atomic_add64
+#define atomic_and64		fssh_atomic_and64
+#define atomic_or64			fssh_atomic_or64
+#define atomic_get64		fssh_atomic_get64
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // #pragma mark - fssh_bytes_order.h
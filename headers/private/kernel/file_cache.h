@@ -14,8 +14,10 @@
 // temporary/optional cache syscall API
 #define CACHE_SYSCALLS "cache"
 
-#define CACHE_CLEAR			1	// takes no parameters
-#define CACHE_SET_MODULE	2	// gets the module name as parameter
+#define CACHE_CLEAR					1	// takes no parameters
+#define CACHE_SET_MODULE			2	// gets the module name as parameter
+#define CACHE_GET_WRITE_BACK_LIMITS	3	// gets a cache_write_back_limits
+#define CACHE_SET_WRITE_BACK_LIMITS	4	// sets a cache_write_back_limits
 
 #define CACHE_MODULES_NAME	"file_cache"
 
@@ -23,6 +25,21 @@
 #define FILE_CACHE_LOADED_COMPLETELY	0x02
 #define FILE_CACHE_NO_IO				0x04
 
+struct cache_write_back_limits {
+	uint32	dirty_ratio;
+		// percentage of memory that may be occupied by dirty file pages
+	uint32	device_dirty_seconds;
+		// how many seconds worth of write-back a device may fall behind
+	uint32	device_min_dirty_pages;
+		// dirty pages a device may always have, regardless of its speed
+	uint32	max_writer_pause;
+		// maximum time (in ms) a writer is paused to let write-back catch up
+	uint32	cluster_pages;
+		// number of sequential pages the page writer tries to write at once
+};
+
+struct file_cache_device;
+
 struct cache_module_info {
 	module_info	info;
 
@@ -45,6 +62,13 @@ extern void cache_node_launched(size_t argCount, char * const *args);
 extern void cache_prefetch_vnode(struct vnode *vnode, off_t offset, size_t size);
 extern void cache_prefetch(dev_t mountID, ino_t vnodeID, off_t offset, size_t size);
 
+extern void file_cache_device_pages_modified(struct file_cache_device *device,
+				int32 count);
+extern void file_cache_device_pages_written(struct file_cache_device *device,
+				int32 count);
+extern void file_cache_put_device(struct file_cache_device *device);
+extern uint32 file_cache_write_back_cluster_pages(void);
+
 extern status_t file_map_init(void);
 extern status_t file_cache_init_post_boot_device(void);
 extern status_t file_cache_init(void);
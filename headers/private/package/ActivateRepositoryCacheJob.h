@@ -26,6 +26,7 @@ public:
 									const BContext& context,
 									const BString& title,
 									const BEntry& fetchedRepoCacheEntry,
+									const BEntry& fetchedChecksumEntry,
 									const BString& repositoryName,
 									const BDirectory& targetDirectory);
 	virtual						~ActivateRepositoryCacheJob();
@@ -35,6 +36,7 @@ protected:
 
 private:
 			BEntry				fFetchedRepoCacheEntry;
+			BEntry				fFetchedChecksumEntry;
 			BString				fRepositoryName;
 			BDirectory			fTargetDirectory;
 };
@@ -0,0 +1,14 @@
+/*
+ * Copyright 2026, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef _PACKAGE__PRIVATE__REPOSITORY_CACHE_DEFS_H_
+#define _PACKAGE__PRIVATE__REPOSITORY_CACHE_DEFS_H_
+
+
+// attribute of a repository cache file holding the checksum the repository
+// published for it (its "repo.sha256")
+#define REPOSITORY_CACHE_CHECKSUM_ATTRIBUTE	"PKG:repository_checksum"
+
+
+#endif	// _PACKAGE__PRIVATE__REPOSITORY_CACHE_DEFS_H_
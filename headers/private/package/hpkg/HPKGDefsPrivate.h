@@ -45,6 +45,15 @@ struct hpkg_header {
 };
 
 
+// maximum size of a heap compression dictionary (it is stored between the
+// header and the heap, so the header size must still fit into 16 bits)
+static const size_t kMaxHeapDictionarySize = 32 * 1024;
+
+// minor version written for packages that don't use the heap dictionary; only
+// B_HPKG_COMPRESSION_ZSTD_DICTIONARY requires B_HPKG_MINOR_VERSION (2)
+static const uint16 kHPKGMinorVersionWithoutDictionary = 1;
+
+
 // repository file header
 struct hpkg_repo_header {
 	uint32	magic;							// "hpkr"
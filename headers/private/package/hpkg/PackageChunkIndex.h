@@ -0,0 +1,99 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef _PACKAGE__HPKG__PRIVATE__PACKAGE_CHUNK_INDEX_H_
+#define _PACKAGE__HPKG__PRIVATE__PACKAGE_CHUNK_INDEX_H_
+
+
+#include <Array.h>
+#include <SupportDefs.h>
+
+
+class BDataIO;
+class BPositionIO;
+
+
+namespace BPackageKit {
+
+namespace BHPKG {
+
+namespace BPrivate {
+
+
+// A chunk index splits a file into content-defined chunks and lists their
+// sizes and SHA-256 hashes. Repositories can provide one for each package
+// (as "<package file>.chunks"), so that a client can create an updated
+// package from the chunks of the package it already has, downloading only
+// the chunks that are missing.
+
+static const uint32 kChunkIndexMagic = 'hpkc';
+static const uint16 kChunkIndexVersion = 1;
+static const size_t kChunkHashSize = 32;
+
+
+struct hpkg_chunk_index_header {
+	uint32	magic;							// "hpkc"
+	uint16	header_size;
+	uint16	version;
+	uint64	file_size;
+	uint32	chunk_count;
+	uint32	reserved;
+};
+
+
+struct hpkg_chunk_index_entry {
+	uint32	size;
+	uint8	hash[kChunkHashSize];
+};
+
+
+class PackageChunkIndex {
+public:
+			struct Chunk {
+				off_t	offset;
+				uint32	size;
+				uint8	hash[kChunkHashSize];
+			};
+
+public:
+								PackageChunkIndex();
+								~PackageChunkIndex();
+
+			status_t			Compute(BPositionIO* file);
+			status_t			Read(const void* data, size_t size);
+			status_t			Write(BDataIO* output) const;
+
+			off_t				FileSize() const
+									{ return fFileSize; }
+			int32				CountChunks() const
+									{ return fChunks.Count(); }
+			const Chunk&		ChunkAt(int32 index) const
+									{ return fChunks[index]; }
+
+			const Chunk*		FindChunk(const uint8* hash) const;
+
+	static	void				ComputeHash(const void* data, size_t size,
+									uint8* hash);
+
+private:
+			status_t			_AddChunk(off_t offset, uint32 size,
+									const uint8* hash);
+			status_t			_CreateLookupTable();
+
+private:
+			Array<Chunk>		fChunks;
+			Array<int32>		fSortedChunks;
+				// chunk indices sorted by hash
+			off_t				fFileSize;
+};
+
+
+}	// namespace BPrivate
+
+}	// namespace BHPKG
+
+}	// namespace BPackageKit
+
+
+#endif	// _PACKAGE__HPKG__PRIVATE__PACKAGE_CHUNK_INDEX_H_
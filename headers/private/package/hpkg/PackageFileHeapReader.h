@@ -39,11 +39,25 @@ public:
 			const OffsetArray&	Offsets() const
 									{ return fOffsets; }
 
+			status_t			ReadCompressedChunk(size_t chunkIndex,
+									void* buffer, size_t& _compressedSize,
+									size_t& _uncompressedSize);
+									// buffer must hold ChunkSize() bytes
+			status_t			DecompressChunk(size_t chunkIndex,
+									const void* compressedData,
+									size_t compressedSize, void* buffer);
+									// the data ReadCompressedChunk() returned
+
 protected:
 	virtual	status_t			ReadAndDecompressChunk(size_t chunkIndex,
 									void* compressedDataBuffer,
 									void* uncompressedDataBuffer);
 
+private:
+			void				_GetChunkSizes(size_t chunkIndex,
+									uint64& _offset, size_t& _compressedSize,
+									size_t& _uncompressedSize) const;
+
 private:
 			OffsetArray			fOffsets;
 };
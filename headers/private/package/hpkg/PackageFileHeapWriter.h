@@ -6,6 +6,8 @@
 #define _PACKAGE__HPKG__PRIVATE__PACKAGE_FILE_HEAP_WRITER_H_
 
 
+#include <pthread.h>
+
 #include <Array.h>
 #include <package/hpkg/PackageFileHeapAccessorBase.h>
 
@@ -45,6 +47,18 @@ public:
 			void				Init();
 			void				Reinit(PackageFileHeapReader* heapReader);
 
+			int32				ThreadCount() const
+									{ return fThreadCount; }
+			void				SetThreadCount(int32 count);
+									// before adding any data
+			void				SetHeapOffset(off_t heapOffset)
+									{ fHeapOffset = heapOffset; }
+									// before adding any data
+			status_t			SetDictionary(const void* dictionary,
+									size_t size);
+									// before adding or reading any data;
+									// zstd compression only
+
 			status_t			AddData(BDataReader& dataReader, off_t size,
 									uint64& _offset);
 			void				AddDataThrows(const void* buffer, size_t size);
@@ -63,6 +77,7 @@ private:
 			struct Chunk;
 			struct ChunkSegment;
 			struct ChunkBuffer;
+			struct CompressionJob;
 
 			friend struct ChunkBuffer;
 
@@ -72,11 +87,24 @@ private:
 			status_t			_FlushPendingData();
 			status_t			_WriteChunk(const void* data, size_t size,
 									bool mayCompress);
-			status_t			_WriteDataCompressed(const void* data,
-									size_t size);
+			status_t			_WriteChunkData(const void* data, size_t size,
+									status_t compressionStatus,
+									const void* compressedData,
+									size_t compressedSize);
+			status_t			_CompressChunk(const void* data, size_t size,
+									void* compressedDataBuffer,
+									size_t& _compressedSize) const;
 			status_t			_WriteDataUncompressed(const void* data,
 									size_t size);
 
+			status_t			_StartThreads();
+			void				_StopThreads();
+			status_t			_QueueChunk();
+			status_t			_WriteQueuedChunks(int64 waitUntil);
+			status_t			_WriteAllQueuedChunks();
+			uint64				_MaxCompressedHeapSize() const;
+	static	void*				_CompressionThread(void* _writer);
+
 			void				_PushChunks(ChunkBuffer& chunkBuffer,
 									uint64 startOffset, uint64 endOffset);
 			void				_UnwriteLastPartialChunk();
@@ -87,6 +115,19 @@ private:
 			size_t				fPendingDataSize;
 			Array<uint64>		fOffsets;
 			CompressionAlgorithmOwner* fCompressionAlgorithm;
+
+			int32				fThreadCount;
+			pthread_t*			fThreads;
+			int32				fRunningThreads;
+			CompressionJob*		fJobs;
+			int32				fJobCount;
+			pthread_mutex_t		fJobLock;
+			pthread_cond_t		fJobQueuedCondition;
+			pthread_cond_t		fJobDoneCondition;
+			int64				fQueuedChunks;
+			int64				fNextChunkToCompress;
+			int64				fWrittenChunks;
+			bool				fQuitThreads;
 };
 
 
@@ -40,6 +40,9 @@ public:
 									BPackageContentHandler* contentHandler);
 			status_t			ParseContent(BLowLevelPackageContentHandler*
 										contentHandler);
+			status_t			ParsePackageAttributes(
+									BPackageContentHandler* contentHandler);
+									// skips the TOC
 
 			BPositionIO*		PackageFile() const;
 
@@ -50,6 +53,8 @@ public:
 									{ return inherited::RawHeapReader(); }
 			BAbstractBufferedDataReader* HeapReader() const
 									{ return inherited::HeapReader(); }
+			const void*			HeapDictionary(size_t& _size) const
+									{ return inherited::HeapDictionary(_size); }
 
 	inline	const PackageFileSection& TOCSection() const
 									{ return fTOCSection; }
@@ -64,6 +64,7 @@ private:
 			struct Entry;
 			struct SubPathAdder;
 			struct HeapAttributeOffsetter;
+			struct DictionarySamples;
 
 			typedef DoublyLinkedList<Entry> EntryList;
 
@@ -106,6 +107,14 @@ private:
 			void				_AddDirectoryChildren(Entry* entry, int fd,
 									char* pathBuffer);
 
+			void				_TrainHeapDictionary();
+			void				_CollectDictionarySamples(int dirFD,
+									Entry* entry, const char* fileName,
+									DictionarySamples& samples);
+			void				_SetHeapDictionary(const void* dictionary,
+									size_t size);
+			uint16				_MinorFormatVersion() const;
+
 			Attribute*			_AddAttribute(BHPKGAttributeID attributeID,
 									const AttributeValue& value);
 
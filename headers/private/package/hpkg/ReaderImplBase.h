@@ -50,19 +50,22 @@ struct PackageFileSection {
 	uint64			stringsCount;
 	char**			strings;
 	const char*		name;
+	bool			ownsData;
 
 	PackageFileSection(const char* _name)
 		:
 		data(NULL),
 		strings(NULL),
-		name(_name)
+		name(_name),
+		ownsData(true)
 	{
 	}
 
 	~PackageFileSection()
 	{
 		delete[] strings;
-		delete[] data;
+		if (ownsData)
+			delete[] data;
 	}
 };
 
@@ -102,6 +105,14 @@ protected:
 									// object and Init() has been called with
 									// keepFile == true.
 
+			const void*			HeapDictionary(size_t& _size) const
+									{
+										_size = fHeapDictionarySize;
+										return fHeapDictionary;
+									}
+									// NULL, if the heap has been compressed
+									// without a dictionary
+
 protected:
 			class AttributeHandlerContext;
 			class AttributeHandler;
@@ -125,7 +136,8 @@ protected:
 			status_t			Init(BPositionIO* file, bool keepFile,
 									Header& header, uint32 flags);
 			status_t			InitHeapReader(uint32 compression,
-									uint32 chunkSize, off_t offset,
+									uint32 chunkSize, size_t headerSize,
+									off_t offset,
 									uint64 compressedSize,
 									uint64 uncompressedSize);
 	virtual	status_t			CreateCachedHeapReader(
@@ -137,12 +149,19 @@ protected:
 									uint64 maxSaneLength, uint64 stringsLength,
 									uint64 stringsCount);
 			status_t			PrepareSection(PackageFileSection& section);
+			status_t			PrepareSection(PackageFileSection& section,
+									const void* data);
+									// uses the given data in place
 
 			status_t			ParseStrings();
 
 			status_t			ParsePackageAttributesSection(
 									AttributeHandlerContext* context,
 									AttributeHandler* rootAttributeHandler);
+			status_t			ParsePackageAttributesSubTree(
+									AttributeHandlerContext* context,
+									AttributeHandler* rootAttributeHandler,
+									uint64 offset);
 			status_t			ParseAttributeTree(
 									AttributeHandlerContext* context,
 									bool& _sectionHandled);
@@ -197,6 +216,8 @@ private:
 
 			PackageFileHeapReader* fRawHeapReader;
 			BAbstractBufferedDataReader* fHeapReader;
+			uint8*				fHeapDictionary;
+			size_t				fHeapDictionarySize;
 
 			PackageFileSection*	fCurrentSection;
 
@@ -515,8 +536,8 @@ ReaderImplBase::Init(BPositionIO* file, bool keepFile, Header& header, uint32 fl
 
 	error = InitHeapReader(
 		B_BENDIAN_TO_HOST_INT16(header.heap_compression),
-		B_BENDIAN_TO_HOST_INT32(header.heap_chunk_size), heapOffset,
-		compressedHeapSize,
+		B_BENDIAN_TO_HOST_INT32(header.heap_chunk_size), sizeof(header),
+		heapOffset, compressedHeapSize,
 		B_BENDIAN_TO_HOST_INT64(header.heap_size_uncompressed));
 	if (error != B_OK)
 		return error;
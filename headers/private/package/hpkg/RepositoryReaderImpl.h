@@ -13,6 +13,8 @@
 
 namespace BPackageKit {
 
+class BPackageInfo;
+
 namespace BHPKG {
 
 
@@ -38,12 +40,39 @@ public:
 			status_t			ParseContent(
 									BRepositoryContentHandler* contentHandler);
 
+			status_t			InitPackageIndex();
+			int32				CountPackages() const
+									{ return fPackageCount; }
+			const char*			PackageNameAt(int32 index) const;
+									// points into the mapped file or the
+									// decompressed package attributes, valid
+									// as long as this object
+			status_t			GetPackageInfo(int32 index,
+									BPackageInfo& _info);
+
 private:
 			class PackagesAttributeHandler;
 			class PackageContentHandlerAdapter;
+			class PackageIndexAttributeHandler;
+
+			struct PackageIndexEntry {
+				const char*	name;
+				uint64		offset;
+					// of the package's attributes in the package
+					// attributes section
+			};
+
+private:
+			void				_RewindPackageAttributesSection();
+			status_t			_AddPackageIndexEntry(const char* name);
 
 private:
 			BRepositoryInfo		fRepositoryInfo;
+			uint8*				fMappedFile;
+			size_t				fMappedFileSize;
+			PackageIndexEntry*	fPackageIndex;
+			int32				fPackageCount;
+			int32				fPackageIndexCapacity;
 };
 
 
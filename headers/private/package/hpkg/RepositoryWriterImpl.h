@@ -7,6 +7,7 @@
 
 
 #include <Entry.h>
+#include <Path.h>
 
 #include <package/hpkg/PackageContentHandler.h>
 #include <package/hpkg/RepositoryWriter.h>
@@ -40,6 +41,8 @@ public:
 								~RepositoryWriterImpl();
 
 			status_t			Init(const char* fileName);
+			void				SetWriteChunkIndices(bool write)
+									{ fWriteChunkIndices = write; }
 			status_t			AddPackage(const BEntry& packageEntry);
 			status_t			AddPackageInfo(const BPackageInfo& packageInfo);
 			status_t			Finish();
@@ -51,6 +54,7 @@ private:
 									const BPackageInfo& packageInfo);
 			status_t			_Finish();
 
+			status_t			_WriteChunkIndex(const BPath& packagePath);
 			status_t			_RegisterCurrentPackageInfo();
 			status_t			_WriteRepositoryInfo(hpkg_repo_header& header,
 									uint64& _length);
@@ -67,6 +71,7 @@ private:
 			BPackageInfo		fPackageInfo;
 			uint32				fPackageCount;
 			PackageNameSet*		fPackageNames;
+			bool				fWriteChunkIndices;
 };
 
 
@@ -109,7 +109,8 @@ public:
 
 	virtual	status_t			DownloadPackage(const BString& fileURL,
 									const BEntry& targetEntry,
-									const BString& checksum);
+									const BString& checksum,
+									const BEntry* basisEntry = NULL);
 	virtual	status_t			RefreshRepository(
 									const BRepositoryConfig& repoConfig);
 
@@ -24,7 +24,8 @@ enum PackageFSMountType {
 enum {
 	PACKAGE_FS_OPERATION_GET_VOLUME_INFO		= B_DEVICE_OP_CODES_END + 1,
 	PACKAGE_FS_OPERATION_GET_PACKAGE_INFOS,
-	PACKAGE_FS_OPERATION_CHANGE_ACTIVATION
+	PACKAGE_FS_OPERATION_CHANGE_ACTIVATION,
+	PACKAGE_FS_OPERATION_GET_CACHE_STATISTICS
 };
 
 
@@ -104,4 +105,28 @@ struct PackageFSActivationChangeRequest {
 };
 
 
+// PACKAGE_FS_OPERATION_GET_CACHE_STATISTICS
+
+struct PackageFSCacheStatistics {
+	// All counters are summed up over the packages of the volume. A chunk is
+	// 64 KB of uncompressed package heap data.
+	uint64							chunkHits;
+										// read chunks that were cached
+	uint64							chunkMisses;
+										// read chunks that had to be read in
+	uint64							readAheadChunks;
+										// chunks read in ahead of time
+	uint64							droppedReadAheads;
+										// read-ahead requests that were
+										// dropped, since the queue was full
+	uint64							decompressedBytes;
+	bigtime_t						decompressionTime;
+										// time spent reading and
+										// decompressing chunks
+	uint64							deduplicatedChunks;
+										// chunks whose cached data is shared
+										// with identical chunks
+};
+
+
 #endif	// _PACKAGE__PRIVATE__PACKAGE_FS_H_
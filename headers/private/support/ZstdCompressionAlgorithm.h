@@ -10,6 +10,10 @@
 #include <CompressionAlgorithm.h>
 
 
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+
 // compression level
 enum {
 	B_ZSTD_COMPRESSION_NONE		= 0,
@@ -32,9 +36,15 @@ public:
 			size_t				BufferSize() const;
 			void				SetBufferSize(size_t size);
 
+			status_t			SetDictionary(const void* dictionary,
+									size_t size);
+			ZSTD_CDict_s*		Dictionary() const
+									{ return fDictionary; }
+
 private:
 			int32				fCompressionLevel;
 			size_t				fBufferSize;
+			ZSTD_CDict_s*		fDictionary;
 };
 
 
@@ -46,8 +56,14 @@ public:
 			size_t				BufferSize() const;
 			void				SetBufferSize(size_t size);
 
+			status_t			SetDictionary(const void* dictionary,
+									size_t size);
+			ZSTD_DDict_s*		Dictionary() const
+									{ return fDictionary; }
+
 private:
 			size_t				fBufferSize;
+			ZSTD_DDict_s*		fDictionary;
 };
 
 
@@ -81,6 +97,11 @@ public:
 									const BDecompressionParameters* parameters
 										= NULL);
 
+	static	status_t			TrainDictionary(const void* samples,
+									const size_t* sampleSizes,
+									uint32 sampleCount, void* dictionary,
+									size_t& _dictionarySize);
+
 private:
 			struct CompressionStrategy;
 			struct DecompressionStrategy;
@@ -7,8 +7,22 @@
 
 
 enum {
+	B_WATCH_BATCHED	= 0x0080,
+		// Events are coalesced, and delivered in B_BATCHED_EVENTS messages.
+		// Should be used for all nodes watched by the same target.
 	B_WATCH_VOLUME	= 0xF000
 };
 
+// The maximum latency of batched events in 10 ms units; 0 selects the
+// default of 50 ms.
+#define B_WATCH_BATCH_LATENCY_SHIFT		16
+#define B_WATCH_BATCH_LATENCY_MASK		0x00ff0000
+#define B_WATCH_BATCH_LATENCY(ms) \
+	((((ms) / 10) << B_WATCH_BATCH_LATENCY_SHIFT) & B_WATCH_BATCH_LATENCY_MASK)
 
-#endif	/* _NODE_MONITOR_PRIVATE_H */ 
+// The "opcode" of a B_NODE_MONITOR message that contains the original
+// notification messages in its "event" field.
+#define B_BATCHED_EVENTS	0x100
+
+
+#endif	/* _NODE_MONITOR_PRIVATE_H */
@@ -272,6 +272,8 @@ BFSPartitionHandle::Repair(bool checkOnly)
 					printf(", names don't match");
 				if ((result.errors & BFS_INVALID_BPLUSTREE) != 0)
 					printf(", invalid b+tree");
+				if ((result.errors & BFS_INVALID_INLINE_DATA) != 0)
+					printf(", invalid inline data");
 				putchar('\n');
 			}
 
@@ -321,6 +323,11 @@ BFSPartitionHandle::Repair(bool checkOnly)
 		result.stats.double_indirect_array_blocks,
 		size_string(1.0 * result.stats.blocks_in_double_indirect
 			* result.stats.block_size).String());
+	printf("\tinline files\t\t\t%" B_PRIu64 "\n", result.stats.inline_files);
+	if (result.stats.checksum_errors != 0) {
+		printf("\n\t%" B_PRIu64 " blocks did not match their checksum\n",
+			result.stats.checksum_errors);
+	}
 	// TODO: this is currently not maintained correctly
 	//printf("\tpartial block runs\t%" B_PRIu64 "\n",
 	//	result.stats.partial_block_runs);
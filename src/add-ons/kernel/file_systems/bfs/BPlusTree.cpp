@@ -18,6 +18,7 @@
 #include "Utility.h"
 
 #if !_BOOT_MODE
+#	include "Checksum.h"
 #	include "Inode.h"
 #else
 #	include "Stream.h"
@@ -31,6 +32,10 @@ namespace BFS {
 #endif
 
 
+static const uint32 kCompactBatchSize = 64;
+	// the number of nodes BPlusTree::Compact() merges per transaction
+
+
 /*!	Simple array used for the duplicate handling in the B+Tree. This is an
 	on disk structure.
 */
@@ -275,6 +280,11 @@ CachedNode::Unset()
 			// BPlusTrees copy of it, as well.
 			memcpy(&fTree->fHeader, fNode, sizeof(bplustree_header));
 		}
+		if (fWritable && fTree->_HasChecksums()) {
+			// the node might have been changed
+			*fTree->_ChecksumOf(fNode) = HOST_ENDIAN_TO_BFS_INT32(
+				fTree->_NodeChecksum(fNode, fOffset));
+		}
 
 		block_cache_put(fTree->fStream->GetVolume()->BlockCache(),
 			fBlockNumber);
@@ -313,9 +323,14 @@ CachedNode::SetTo(off_t offset, const bplustree_node** _node, bool check)
 		RETURN_ERROR(B_BAD_VALUE);
 	}
 
-	if (InternalSetTo(NULL, offset) != NULL && check) {
+	if (InternalSetTo(NULL, offset) != NULL) {
+#if !_BOOT_MODE
+		if (!IsChecksumValid())
+			return B_BAD_DATA;
+#endif
+
 		// sanity checks (links, all_key_count)
-		if (!fTree->fHeader.CheckNode(fNode)) {
+		if (check && !fTree->fHeader.CheckNode(fNode)) {
 			FATAL(("invalid node [%p] read from offset %" B_PRIdOFF " (block %"
 				B_PRIdOFF "), inode at %" B_PRIdINO "\n", fNode, offset,
 				fBlockNumber, fTree->fStream->ID()));
@@ -348,6 +363,13 @@ CachedNode::SetToWritable(Transaction& transaction, off_t offset, bool check)
 		return NULL;
 
 	if (InternalSetTo(&transaction, offset) != NULL && check) {
+		// Nodes that are not checked are about to be initialized
+		if (!IsChecksumValid()) {
+			// don't hide the damage behind a new checksum
+			fWritable = false;
+			return NULL;
+		}
+
 		// sanity checks (links, all_key_count)
 		if (!fTree->fHeader.CheckNode(fNode)) {
 			FATAL(("invalid node [%p] read from offset %" B_PRIdOFF " (block %"
@@ -368,6 +390,7 @@ CachedNode::MakeWritable(Transaction& transaction)
 
 	if (block_cache_make_writable(transaction.GetVolume()->BlockCache(),
 			fBlockNumber, transaction.ID()) == B_OK) {
+		fWritable = true;
 		return fNode;
 	}
 
@@ -387,6 +410,10 @@ CachedNode::SetToHeader()
 	Unset();
 
 	InternalSetTo(NULL, 0LL);
+#if !_BOOT_MODE
+	if (fNode != NULL && !IsChecksumValid())
+		return NULL;
+#endif
 	return (bplustree_header*)fNode;
 }
 
@@ -476,6 +503,20 @@ CachedNode::InternalSetTo(Transaction* transaction, off_t offset)
 }
 
 
+#if !_BOOT_MODE
+bool
+CachedNode::IsChecksumValid() const
+{
+	if (!fTree->_HasChecksums())
+		return true;
+
+	return fTree->fStream->GetVolume()->IsChecksumValid(fBlockNumber,
+		BFS_ENDIAN_TO_HOST_INT32(*fTree->_ChecksumOf(fNode)),
+		fTree->_NodeChecksum(fNode, fOffset));
+}
+#endif // !_BOOT_MODE
+
+
 #if !_BOOT_MODE
 status_t
 CachedNode::Free(Transaction& transaction, off_t offset)
@@ -607,6 +648,7 @@ BPlusTree::BPlusTree()
 	:
 	fStream(NULL),
 	fNodeSize(BPLUSTREE_NODE_SIZE),
+	fUsableNodeSize(BPLUSTREE_NODE_SIZE),
 	fAllowDuplicates(true),
 	fInTransaction(false),
 	fStatus(B_NO_INIT)
@@ -645,6 +687,7 @@ BPlusTree::SetTo(Transaction& transaction, Inode* stream, int32 nodeSize)
 	// initializes in-memory B+Tree
 
 	fStream = stream;
+	_SetNodeSize(nodeSize);
 
 	CachedNode cached(this);
 	bplustree_header* header = cached.SetToWritableHeader(transaction);
@@ -662,8 +705,6 @@ BPlusTree::SetTo(Transaction& transaction, Inode* stream, int32 nodeSize)
 	fAllowDuplicates = stream->IsIndex()
 		|| (stream->Mode() & S_ALLOW_DUPS) != 0;
 
-	fNodeSize = nodeSize;
-
 	// initialize b+tree header
  	header->magic = HOST_ENDIAN_TO_BFS_INT32(BPLUSTREE_MAGIC);
  	header->node_size = HOST_ENDIAN_TO_BFS_INT32(fNodeSize);
@@ -695,6 +736,9 @@ BPlusTree::SetTo(Inode* stream)
 		RETURN_ERROR(fStatus = B_BAD_VALUE);
 
 	fStream = stream;
+	fNodeSize = fUsableNodeSize = BPLUSTREE_NODE_SIZE;
+		// the checksum of the header can only be verified once we know
+		// the node size
 
 	// get on-disk B+Tree header
 
@@ -721,7 +765,11 @@ BPlusTree::SetTo(Inode* stream)
 		RETURN_ERROR(fStatus = B_BAD_DATA);
 	}
 
-	fNodeSize = fHeader.NodeSize();
+	_SetNodeSize(fHeader.NodeSize());
+#if !_BOOT_MODE
+	if (!cached.IsChecksumValid())
+		RETURN_ERROR(fStatus = B_BAD_DATA);
+#endif
 
 	// validity check
 	static const uint32 kToMode[] = {S_STR_INDEX, S_INT_INDEX, S_UINT_INDEX,
@@ -758,6 +806,35 @@ BPlusTree::InitCheck()
 }
 
 
+void
+BPlusTree::_SetNodeSize(int32 nodeSize)
+{
+	fNodeSize = nodeSize;
+	fUsableNodeSize = nodeSize;
+
+#if !_BOOT_MODE
+	// The checksum is stored at the end of each node; duplicate nodes
+	// therefore hold one value less, and fragment nodes one fragment less.
+	if (fStream->GetVolume()->HasChecksums())
+		fUsableNodeSize -= sizeof(uint32);
+#endif
+}
+
+
+#if !_BOOT_MODE
+/*!	Returns the checksum of the \a node at \a offset; it includes the
+	offset, so that nodes written to the wrong place are noticed, too.
+*/
+uint32
+BPlusTree::_NodeChecksum(const bplustree_node* node, off_t offset) const
+{
+	off_t diskOffset = HOST_ENDIAN_TO_BFS_INT64(offset);
+	uint32 crc = crc32c(0, &diskOffset, sizeof(off_t));
+	return crc32c(crc, node, fUsableNodeSize);
+}
+#endif // !_BOOT_MODE
+
+
 #if !_BOOT_MODE
 status_t
 BPlusTree::Validate(bool repair, bool& _errorsFound)
@@ -892,6 +969,80 @@ BPlusTree::MakeEmpty()
 }
 
 
+/*!	Merges neighbouring nodes that fit into a single node, and gives the
+	free nodes at the end of the tree back to the file system.
+	A node is only merged with its right sibling if both have the same
+	parent; this is done for the leaves first, and then level by level up
+	to the root. If the root ends up with a single child, the tree loses
+	a level.
+	The work is split into several transactions, so this must be called
+	without a running transaction, and without holding the inode lock.
+	The number of nodes that were removed by merging is returned in
+	\a _mergedNodes.
+*/
+status_t
+BPlusTree::Compact(uint32& _mergedNodes)
+{
+	_mergedNodes = 0;
+
+	uint8 key[BPLUSTREE_MAX_KEY_LENGTH];
+	uint16 keyLength;
+	bool done;
+
+	for (uint32 height = 0; height + 1 < fHeader.MaxNumberOfLevels();
+			height++) {
+		keyLength = 0;
+		done = false;
+
+		while (!done) {
+			Transaction transaction(fStream->GetVolume(),
+				fStream->BlockNumber());
+			fStream->WriteLockInTransaction(transaction);
+
+			status_t status = _MergeLevel(transaction, height, key,
+				&keyLength, &done, &_mergedNodes);
+			if (status != B_OK)
+				return status;
+
+			status = transaction.Done();
+			if (status != B_OK)
+				return status;
+		}
+	}
+
+	// Move the nodes that are located after the space the tree actually
+	// needs into the free nodes in front of it, so that the end of the
+	// tree can be truncated
+
+	off_t end;
+	status_t status = _UsedSize(end);
+	if (status != B_OK)
+		return status;
+
+	for (uint32 height = 0; height < fHeader.MaxNumberOfLevels(); height++) {
+		keyLength = 0;
+		done = false;
+
+		while (!done) {
+			Transaction transaction(fStream->GetVolume(),
+				fStream->BlockNumber());
+			fStream->WriteLockInTransaction(transaction);
+
+			status = _RelocateLevel(transaction, height, end, key,
+				&keyLength, &done);
+			if (status != B_OK)
+				return status;
+
+			status = transaction.Done();
+			if (status != B_OK)
+				return status;
+		}
+	}
+
+	return _TruncateFreeNodes();
+}
+
+
 int32
 BPlusTree::TypeCodeToKeyType(type_code code)
 {
@@ -998,6 +1149,18 @@ BPlusTree::_AddIterator(TreeIterator* iterator)
 }
 
 
+void
+BPlusTree::_MoveIterators(off_t offset, off_t nextOffset, uint16 keyOffset)
+{
+	MutexLocker _(fIteratorLock);
+
+	SinglyLinkedList<TreeIterator>::Iterator iterator
+		= fIterators.GetIterator();
+	while (iterator.HasNext())
+		iterator.Next()->Move(offset, nextOffset, keyOffset);
+}
+
+
 void
 BPlusTree::_RemoveIterator(TreeIterator* iterator)
 {
@@ -1149,6 +1312,50 @@ BPlusTree::_SeekDown(Stack<node_and_key>& stack, const uint8* key,
 }
 
 
+/*!	Copies the first key of the leftmost leaf below the node at \a offset
+	into \a key. Returns B_ENTRY_NOT_FOUND if that leaf is empty, which can
+	only happen if the tree is empty.
+*/
+status_t
+BPlusTree::_FirstLeafKey(off_t offset, uint8* key, uint16* _keyLength)
+{
+	CachedNode cached(this);
+
+	for (uint32 level = 0; level < fHeader.MaxNumberOfLevels(); level++) {
+		const bplustree_node* node = cached.SetTo(offset);
+		if (node == NULL)
+			return B_IO_ERROR;
+
+		if (!node->IsLeaf()) {
+			offset = node->NumKeys() > 0
+				? BFS_ENDIAN_TO_HOST_INT64(node->Values()[0])
+				: node->OverflowLink();
+			continue;
+		}
+
+		if (node->NumKeys() == 0)
+			return B_ENTRY_NOT_FOUND;
+
+		uint16 length;
+		uint8* firstKey = node->KeyAt(0, &length);
+		if (firstKey + length + sizeof(off_t) + sizeof(uint16)
+				> (uint8*)node + fNodeSize
+			|| length > BPLUSTREE_MAX_KEY_LENGTH) {
+			fStream->GetVolume()->Panic();
+			RETURN_ERROR(B_BAD_DATA);
+		}
+
+		memcpy(key, firstKey, length);
+		*_keyLength = length;
+		return B_OK;
+	}
+
+	FATAL(("BPlusTree::_FirstLeafKey() node walked too deep, inode %"
+		B_PRIdOFF "\n", fStream->ID()));
+	RETURN_ERROR(B_BAD_DATA);
+}
+
+
 /*!	This will find a free duplicate fragment in the given bplustree_node.
 	The CachedNode will be set to the writable fragment on success.
 */
@@ -1174,7 +1381,7 @@ BPlusTree::_FindFreeDuplicateFragment(Transaction& transaction,
 		}
 
 		// see if there is some space left for us
-		uint32 num = bplustree_node::MaxFragments(fNodeSize);
+		uint32 num = bplustree_node::MaxFragments(fUsableNodeSize);
 		for (uint32 j = 0; j < num; j++) {
 			duplicate_array* array = fragment->FragmentAt(j);
 
@@ -1232,7 +1439,7 @@ BPlusTree::_InsertDuplicate(Transaction& transaction, CachedNode& cached,
 			} else {
 				// Test if the fragment will be empty if we remove this key's
 				// values
-				if (duplicate->FragmentsUsed(fNodeSize) < 2) {
+				if (duplicate->FragmentsUsed(fUsableNodeSize) < 2) {
 					// The node will be empty without our values, so let us
 					// reuse it as a duplicate node
 					offset = bplustree_node::FragmentOffset(oldValue);
@@ -1245,14 +1452,12 @@ BPlusTree::_InsertDuplicate(Transaction& transaction, CachedNode& cached,
 					array = duplicate->DuplicateArray();
 					array->Insert(value);
 				} else {
-					// Create a new duplicate node
-
-					cachedDuplicate.UnsetUnchanged(transaction);
-						// The old duplicate has not been touched, so we can
-						// reuse it
+					// Create a new duplicate node; the fragment stays writable,
+					// as its entry is freed below
 
+					CachedNode cachedNewDuplicate(this);
 					bplustree_node* newDuplicate;
-					status = cachedDuplicate.Allocate(transaction,
+					status = cachedNewDuplicate.Allocate(transaction,
 						&newDuplicate, &offset);
 					if (status != B_OK)
 						RETURN_ERROR(status);
@@ -1301,7 +1506,7 @@ BPlusTree::_InsertDuplicate(Transaction& transaction, CachedNode& cached,
 					duplicateOffset, arrayCount, fStream->ID()));
 				return B_BAD_DATA;
 			}
-		} while (arrayCount >= NUM_DUPLICATE_VALUES
+		} while (arrayCount >= _MaxDuplicateValues()
 				&& (oldValue = duplicate->RightLink()) != BPLUSTREE_NULL);
 
 		bplustree_node* writableDuplicate
@@ -1309,14 +1514,16 @@ BPlusTree::_InsertDuplicate(Transaction& transaction, CachedNode& cached,
 		if (writableDuplicate == NULL)
 			return B_IO_ERROR;
 
-		if (arrayCount < NUM_DUPLICATE_VALUES) {
+		if (arrayCount < _MaxDuplicateValues()) {
 			array = writableDuplicate->DuplicateArray();
 			array->Insert(value);
 		} else {
-			// no space left - add a new duplicate node
+			// no space left - add a new duplicate node; the old one must stay
+			// writable until it is linked to the new one
 
+			CachedNode cachedNewDuplicate(this);
 			bplustree_node* newDuplicate;
-			status = cachedDuplicate.Allocate(transaction, &newDuplicate,
+			status = cachedNewDuplicate.Allocate(transaction, &newDuplicate,
 				&offset);
 			if (status != B_OK)
 				RETURN_ERROR(status);
@@ -1412,11 +1619,16 @@ BPlusTree::_InsertKey(bplustree_node* node, uint16 index, uint8* key,
 /*!	Splits the \a node into two halves - the other half will be put into
 	\a other. It also takes care to create a new overflow link if the node
 	to split is an index node.
+	If \a sorted is true, the keys are expected to be inserted in ascending
+	order; instead of splitting the node in the middle, all keys in front
+	of the new key will then stay in the left node, if that is at least
+	half of them. That way, a tree filled in order ends up with full nodes
+	instead of half empty ones.
 */
 status_t
 BPlusTree::_SplitNode(bplustree_node* node, off_t nodeOffset,
 	bplustree_node* other, off_t otherOffset, uint16* _keyIndex, uint8* key,
-	uint16* _keyLength, off_t* _value)
+	uint16* _keyLength, off_t* _value, bool sorted)
 {
 	if (*_keyIndex > node->NumKeys() + 1)
 		return B_BAD_VALUE;
@@ -1442,7 +1654,19 @@ BPlusTree::_SplitNode(bplustree_node* node, off_t nodeOffset,
 	// "bytesAfter" are the bytes after the new key, if any
 	int32 bytes = 0, bytesBefore = 0, bytesAfter = 0;
 
-	size_t size = fNodeSize >> 1;
+	size_t size = fUsableNodeSize >> 1;
+	if (sorted) {
+		// index nodes have to drop the last of these keys into the parent
+		int32 keep = keyIndex - (node->IsLeaf() ? 0 : 1);
+		if (keep > 0) {
+			size_t keepSize = key_align(sizeof(bplustree_node)
+					+ BFS_ENDIAN_TO_HOST_INT16(inKeyLengths[keep - 1]))
+				+ keep * (sizeof(uint16) + sizeof(off_t));
+			if (keepSize > size)
+				size = keepSize;
+		}
+	}
+
 	int32 out, in;
 	size_t keyLengths = 0;
 	for (in = out = 0; in < node->NumKeys() + 1;) {
@@ -1677,6 +1901,30 @@ BPlusTree::_SplitNode(bplustree_node* node, off_t nodeOffset,
 status_t
 BPlusTree::Insert(Transaction& transaction, const uint8* key, uint16 keyLength,
 	off_t value)
+{
+	return _Insert(transaction, key, keyLength, value, false);
+}
+
+
+/*!	Works like Insert(), but is meant to be used when many keys are inserted
+	in ascending order, like when an index is rebuilt. Nodes that have to be
+	split keep all keys in front of the new one, so that they stay filled
+	completely, instead of only to one half.
+	The tree stays valid if the keys aren't sorted, but it will be packed
+	less tightly.
+	You need to have the inode write locked.
+*/
+status_t
+BPlusTree::InsertSorted(Transaction& transaction, const uint8* key,
+	uint16 keyLength, off_t value)
+{
+	return _Insert(transaction, key, keyLength, value, true);
+}
+
+
+status_t
+BPlusTree::_Insert(Transaction& transaction, const uint8* key,
+	uint16 keyLength, off_t value, bool sorted)
 {
 	if (keyLength < BPLUSTREE_MIN_KEY_LENGTH
 		|| keyLength > BPLUSTREE_MAX_KEY_LENGTH)
@@ -1731,7 +1979,7 @@ BPlusTree::Insert(Transaction& transaction, const uint8* key, uint16 keyLength,
 		if (int32(key_align(sizeof(bplustree_node)
 				+ writableNode->AllKeyLength() + keyLength)
 				+ (writableNode->NumKeys() + 1) * (sizeof(uint16)
-				+ sizeof(off_t))) < fNodeSize) {
+				+ sizeof(off_t))) < fUsableNodeSize) {
 			_InsertKey(writableNode, nodeAndKey.keyIndex,
 				keyBuffer, keyLength, value);
 			_UpdateIterators(nodeAndKey.nodeOffset, BPLUSTREE_NULL,
@@ -1772,7 +2020,7 @@ BPlusTree::Insert(Transaction& transaction, const uint8* key, uint16 keyLength,
 
 			if (_SplitNode(writableNode, nodeAndKey.nodeOffset, other,
 					otherOffset, &nodeAndKey.keyIndex, keyBuffer, &keyLength,
-					&value) != B_OK) {
+					&value, sorted) != B_OK) {
 				// free root node & other node here
 				cachedOther.Free(transaction, otherOffset);
 				cachedNewRoot.Free(transaction, newRoot);
@@ -1869,7 +2117,7 @@ BPlusTree::_RemoveDuplicate(Transaction& transaction,
 
 			// Remove the whole fragment node, if this was the only array,
 			// otherwise free just the array
-			if (duplicate->FragmentsUsed(fNodeSize) == 1) {
+			if (duplicate->FragmentsUsed(fUsableNodeSize) == 1) {
 				status_t status = cachedDuplicate.Free(transaction,
 					duplicateOffset);
 				if (status != B_OK)
@@ -2259,6 +2507,790 @@ BPlusTree::Replace(Transaction& transaction, const uint8* key, uint16 keyLength,
 	}
 	RETURN_ERROR(B_ERROR);
 }
+
+
+/*!	Finds the node \a height levels above the leaves on the path to \a key,
+	and its parent. The node is child \a _index of the parent.
+	Returns B_ENTRY_NOT_FOUND if the node has no parent.
+*/
+status_t
+BPlusTree::_SeekLevel(const uint8* key, uint16 keyLength, uint32 height,
+	off_t* _parentOffset, uint16* _index, off_t* _nodeOffset)
+{
+	Stack<node_and_key> stack;
+	status_t status = _SeekDown(stack, key, keyLength);
+	if (status != B_OK)
+		return status;
+
+	int32 levels = stack.CountItems();
+	if ((int32)height + 1 >= levels)
+		return B_ENTRY_NOT_FOUND;
+
+	node_and_key* path = stack.Array();
+	*_parentOffset = path[levels - 2 - height].nodeOffset;
+	*_index = path[levels - 2 - height].keyIndex;
+	*_nodeOffset = path[levels - 1 - height].nodeOffset;
+	return B_OK;
+}
+
+
+/*!	Sets \a key to the first key below the right sibling of the node at
+	\a offset. Returns B_ENTRY_NOT_FOUND if the node is the last one on
+	its level.
+*/
+status_t
+BPlusTree::_NextSiblingKey(off_t offset, uint8* key, uint16* _keyLength)
+{
+	CachedNode cached(this);
+	const bplustree_node* node = cached.SetTo(offset);
+	if (node == NULL)
+		return B_IO_ERROR;
+
+	off_t nextOffset = node->RightLink();
+	cached.Unset();
+
+	if (nextOffset == BPLUSTREE_NULL)
+		return B_ENTRY_NOT_FOUND;
+
+	return _FirstLeafKey(nextOffset, key, _keyLength);
+}
+
+
+/*!	Merges up to kCompactBatchSize nodes \a height levels above the leaves,
+	starting with the node on the path to \a key, or the leftmost node, if
+	\a _keyLength is 0.
+	On return, \a key is set to where the next call should continue, or
+	\a _done is set to true if the end of the level has been reached.
+*/
+status_t
+BPlusTree::_MergeLevel(Transaction& transaction, uint32 height, uint8* key,
+	uint16* _keyLength, bool* _done, uint32* _mergedNodes)
+{
+	status_t status = B_OK;
+	if (*_keyLength == 0)
+		status = _FirstLeafKey(fHeader.RootNode(), key, _keyLength);
+
+	uint32 merged = 0;
+
+	while (status == B_OK) {
+		off_t parentOffset;
+		uint16 index;
+		off_t nodeOffset;
+		status = _SeekLevel(key, *_keyLength, height, &parentOffset, &index,
+			&nodeOffset);
+		if (status != B_OK)
+			break;
+
+		// merge the node with its right siblings as long as they fit, and
+		// belong to the same parent
+
+		while (true) {
+			CachedNode cachedParent(this);
+			CachedNode cachedNode(this);
+			CachedNode cachedRight(this);
+
+			const bplustree_node* parent = cachedParent.SetTo(parentOffset);
+			const bplustree_node* node = cachedNode.SetTo(nodeOffset);
+			if (parent == NULL || node == NULL)
+				return B_IO_ERROR;
+
+			if (index >= parent->NumKeys())
+				break;
+
+			off_t rightOffset = index + 1 < parent->NumKeys()
+				? BFS_ENDIAN_TO_HOST_INT64(parent->Values()[index + 1])
+				: parent->OverflowLink();
+			if (node->RightLink() != rightOffset) {
+				FATAL(("BPlusTree::_MergeLevel() right link doesn't match "
+					"parent, inode %" B_PRIdOFF "\n", fStream->ID()));
+				break;
+			}
+
+			const bplustree_node* right = cachedRight.SetTo(rightOffset);
+			if (right == NULL)
+				return B_IO_ERROR;
+
+			uint16 separatorLength = 0;
+			if (!node->IsLeaf())
+				parent->KeyAt(index, &separatorLength);
+
+			size_t size = key_align(sizeof(bplustree_node)
+					+ node->AllKeyLength() + separatorLength
+					+ right->AllKeyLength())
+				+ (node->NumKeys() + right->NumKeys()
+					+ (node->IsLeaf() ? 0 : 1))
+					* (sizeof(uint16) + sizeof(off_t));
+			if (size > (size_t)fUsableNodeSize) {
+				// doesn't fit, continue with the sibling
+				nodeOffset = rightOffset;
+				index++;
+				continue;
+			}
+
+			cachedParent.Unset();
+			cachedNode.Unset();
+			cachedRight.Unset();
+
+			status = _MergeNodes(transaction, parentOffset, index,
+				&nodeOffset, rightOffset);
+			if (status != B_OK)
+				return status;
+
+			(*_mergedNodes)++;
+
+			if (nodeOffset == fHeader.RootNode()) {
+				// the parent was the root, and has been removed
+				*_done = true;
+				return B_OK;
+			}
+			if (++merged == kCompactBatchSize)
+				return _FirstLeafKey(nodeOffset, key, _keyLength);
+		}
+
+		status = _NextSiblingKey(nodeOffset, key, _keyLength);
+	}
+
+	if (status == B_ENTRY_NOT_FOUND) {
+		*_done = true;
+		return B_OK;
+	}
+	return status;
+}
+
+
+/*!	Moves up to kCompactBatchSize nodes \a height levels above the leaves
+	that are located at or after \a end in the stream to free nodes in front
+	of it, starting with the node on the path to \a key, or the leftmost
+	node, if \a _keyLength is 0.
+	If the root is located after \a end, it is moved, too, once \a height
+	reaches the root's level. On the leaf level, the duplicate nodes of the
+	leaves are moved as well (see _RelocateDuplicates()).
+	On return, \a key is set to where the next call should continue, or
+	\a _done is set to true if the end of the level has been reached.
+*/
+status_t
+BPlusTree::_RelocateLevel(Transaction& transaction, uint32 height,
+	off_t end, uint8* key, uint16* _keyLength, bool* _done)
+{
+	off_t freeNodes[kCompactBatchSize];
+	uint32 freeCount = kCompactBatchSize;
+	status_t status = _TakeFreeNodes(transaction, end, freeNodes, freeCount);
+	if (status != B_OK)
+		return status;
+	if (freeCount == 0) {
+		*_done = true;
+		return B_OK;
+	}
+
+	uint32 used = 0;
+
+	if (height + 1 == fHeader.MaxNumberOfLevels()) {
+		// this is the root level
+		off_t rootOffset = fHeader.RootNode();
+		if (rootOffset >= end) {
+			status = _MoveNode(transaction, BPLUSTREE_NULL, 0, rootOffset,
+				freeNodes[used]);
+			rootOffset = freeNodes[used++];
+		}
+		if (status == B_OK && height == 0) {
+			status = _RelocateDuplicates(transaction, rootOffset, end,
+				freeNodes, used, freeCount);
+		}
+
+		*_done = used < freeCount;
+	} else {
+		if (*_keyLength == 0)
+			status = _FirstLeafKey(fHeader.RootNode(), key, _keyLength);
+
+		while (status == B_OK) {
+			off_t parentOffset;
+			uint16 index;
+			off_t nodeOffset;
+			status = _SeekLevel(key, *_keyLength, height, &parentOffset,
+				&index, &nodeOffset);
+			if (status != B_OK)
+				break;
+
+			// move all children of this parent that are in the way
+
+			CachedNode cached(this);
+			const bplustree_node* parent = cached.SetTo(parentOffset);
+			if (parent == NULL) {
+				status = B_IO_ERROR;
+				break;
+			}
+
+			uint16 count = parent->NumKeys();
+			for (; index <= count && used < freeCount; index++) {
+				nodeOffset = index < count
+					? BFS_ENDIAN_TO_HOST_INT64(parent->Values()[index])
+					: parent->OverflowLink();
+				if (nodeOffset < end && height > 0)
+					continue;
+
+				cached.Unset();
+				if (nodeOffset >= end) {
+					status = _MoveNode(transaction, parentOffset, index,
+						nodeOffset, freeNodes[used]);
+					if (status != B_OK)
+						break;
+
+					nodeOffset = freeNodes[used++];
+				}
+				if (height == 0) {
+					status = _RelocateDuplicates(transaction, nodeOffset, end,
+						freeNodes, used, freeCount);
+					if (status != B_OK)
+						break;
+				}
+
+				if ((parent = cached.SetTo(parentOffset)) == NULL) {
+					status = B_IO_ERROR;
+					break;
+				}
+			}
+			cached.Unset();
+
+			if (status != B_OK)
+				break;
+			if (used == freeCount) {
+				// continue at this node in the next transaction
+				status = _FirstLeafKey(nodeOffset, key, _keyLength);
+				break;
+			}
+
+			status = _NextSiblingKey(nodeOffset, key, _keyLength);
+		}
+
+		if (status == B_ENTRY_NOT_FOUND) {
+			*_done = true;
+			status = B_OK;
+		}
+	}
+
+	// give back the free nodes that weren't needed
+	for (uint32 i = used; i < freeCount; i++) {
+		CachedNode cached(this);
+		if (cached.SetToWritable(transaction, freeNodes[i], false) == NULL)
+			return B_IO_ERROR;
+
+		status_t freeStatus = cached.Free(transaction, freeNodes[i]);
+		if (freeStatus != B_OK)
+			return freeStatus;
+	}
+
+	return status;
+}
+
+
+/*!	Merges the node at \a _nodeOffset, child \a index of the node at
+	\a parentOffset, with its right sibling at \a rightOffset. The caller
+	must have made sure that the keys of both fit into a single node.
+	The merged node keeps the lower of both offsets, so that free nodes
+	collect at the end of the tree, where _TruncateFreeNodes() can remove
+	them; its offset is returned in \a _nodeOffset.
+	If the parent is the root, and is left without keys, the merged node
+	becomes the new root.
+*/
+status_t
+BPlusTree::_MergeNodes(Transaction& transaction, off_t parentOffset,
+	uint16 index, off_t* _nodeOffset, off_t rightOffset)
+{
+	off_t nodeOffset = *_nodeOffset;
+
+	CachedNode cachedParent(this);
+	CachedNode cachedNode(this);
+	CachedNode cachedRight(this);
+
+	bplustree_node* parent = cachedParent.SetToWritable(transaction,
+		parentOffset);
+	bplustree_node* node = cachedNode.SetToWritable(transaction, nodeOffset);
+	bplustree_node* right = cachedRight.SetToWritable(transaction,
+		rightOffset);
+	if (parent == NULL || node == NULL || right == NULL)
+		return B_IO_ERROR;
+
+	uint16 nodeKeys = node->NumKeys();
+	bool isLeaf = node->IsLeaf();
+
+	if (!isLeaf) {
+		// the key that separates both nodes in the parent has to move
+		// down, and leads to what was the overflow link of the node
+		uint16 length;
+		uint8* separator = parent->KeyAt(index, &length);
+		_InsertKey(node, node->NumKeys(), separator, length,
+			node->OverflowLink());
+		node->overflow_link = right->overflow_link;
+	}
+
+	for (uint16 i = 0; i < right->NumKeys(); i++) {
+		uint16 length;
+		uint8* key = right->KeyAt(i, &length);
+		_InsertKey(node, node->NumKeys(), key, length,
+			BFS_ENDIAN_TO_HOST_INT64(right->Values()[i]));
+	}
+	node->right_link = right->right_link;
+
+	if (isLeaf)
+		_MoveIterators(rightOffset, nodeOffset, nodeKeys);
+
+	off_t offset = nodeOffset;
+	off_t freeOffset = rightOffset;
+	CachedNode* cachedFree = &cachedRight;
+
+	if (rightOffset < nodeOffset) {
+		memcpy(right, node, fNodeSize);
+		if (isLeaf)
+			_MoveIterators(nodeOffset, rightOffset, 0);
+
+		offset = rightOffset;
+		freeOffset = nodeOffset;
+		cachedFree = &cachedNode;
+	}
+
+	// update the links of the siblings
+
+	CachedNode cachedOther(this);
+	bplustree_node* other;
+	if (offset != nodeOffset && (other = cachedOther.SetToWritable(
+			transaction, node->LeftLink())) != NULL) {
+		other->right_link = HOST_ENDIAN_TO_BFS_INT64(offset);
+	}
+	if ((other = cachedOther.SetToWritable(transaction, node->RightLink()))
+			!= NULL) {
+		other->left_link = HOST_ENDIAN_TO_BFS_INT64(offset);
+	}
+
+	// the parent loses the key between both nodes, and the merged node
+	// takes the place of the right one
+
+	_RemoveKey(parent, index);
+
+	if (index < parent->NumKeys())
+		parent->Values()[index] = HOST_ENDIAN_TO_BFS_INT64(offset);
+	else
+		parent->overflow_link = HOST_ENDIAN_TO_BFS_INT64(offset);
+
+	status_t status = cachedFree->Free(transaction, freeOffset);
+	if (status != B_OK)
+		return status;
+
+	*_nodeOffset = offset;
+
+	if (parentOffset != fHeader.RootNode() || parent->NumKeys() > 0)
+		return B_OK;
+
+	CachedNode cachedHeader(this);
+	bplustree_header* header = cachedHeader.SetToWritableHeader(transaction);
+	if (header == NULL)
+		return B_IO_ERROR;
+
+	header->root_node_pointer = HOST_ENDIAN_TO_BFS_INT64(offset);
+	header->max_number_of_levels = HOST_ENDIAN_TO_BFS_INT32(
+		header->MaxNumberOfLevels() - 1);
+	cachedHeader.Unset();
+
+	return cachedParent.Free(transaction, parentOffset);
+}
+
+
+/*!	Returns the size the tree would have without any free nodes in
+	\a _size.
+*/
+status_t
+BPlusTree::_UsedSize(off_t& _size)
+{
+	InodeReadLocker locker(fStream);
+
+	CachedNode cached(this);
+	off_t offset = fHeader.FreeNode();
+	off_t freeNodes = 0;
+
+	while (offset != BPLUSTREE_NULL) {
+		if (freeNodes > fHeader.MaximumSize() / fNodeSize) {
+			FATAL(("BPlusTree::_UsedSize() free list loops, inode %"
+				B_PRIdOFF "\n", fStream->ID()));
+			RETURN_ERROR(B_BAD_DATA);
+		}
+
+		const bplustree_node* node = cached.SetTo(offset, false);
+		if (node == NULL)
+			return B_IO_ERROR;
+
+		freeNodes++;
+		offset = node->LeftLink();
+	}
+
+	_size = fHeader.MaximumSize() - freeNodes * fNodeSize;
+	return B_OK;
+}
+
+
+/*!	Removes up to \a _count nodes located in front of \a end from the free
+	list, and stores their offsets in \a offsets. On return, \a _count is
+	set to the number of nodes that were found.
+*/
+status_t
+BPlusTree::_TakeFreeNodes(Transaction& transaction, off_t end, off_t* offsets,
+	uint32& _count)
+{
+	CachedNode cachedHeader(this);
+	bplustree_header* header = NULL;
+
+	CachedNode cached(this);
+	off_t previousOffset = BPLUSTREE_NULL;
+	off_t offset = fHeader.FreeNode();
+	uint32 count = 0;
+
+	for (off_t visited = 0; offset != BPLUSTREE_NULL && count < _count;
+			visited++) {
+		if (visited > fHeader.MaximumSize() / fNodeSize) {
+			FATAL(("BPlusTree::_TakeFreeNodes() free list loops, inode %"
+				B_PRIdOFF "\n", fStream->ID()));
+			RETURN_ERROR(B_BAD_DATA);
+		}
+
+		const bplustree_node* node = cached.SetTo(offset, false);
+		if (node == NULL)
+			return B_IO_ERROR;
+
+		off_t nextOffset = node->LeftLink();
+
+		if (offset >= end)
+			previousOffset = offset;
+		else {
+			if (previousOffset == BPLUSTREE_NULL) {
+				if (header == NULL) {
+					header = cachedHeader.SetToWritableHeader(transaction);
+					if (header == NULL)
+						return B_IO_ERROR;
+				}
+				header->free_node_pointer
+					= HOST_ENDIAN_TO_BFS_INT64(nextOffset);
+			} else {
+				bplustree_node* previous = cached.SetToWritable(transaction,
+					previousOffset, false);
+				if (previous == NULL)
+					return B_IO_ERROR;
+
+				previous->left_link = HOST_ENDIAN_TO_BFS_INT64(nextOffset);
+			}
+			offsets[count++] = offset;
+		}
+
+		offset = nextOffset;
+	}
+
+	_count = count;
+	return B_OK;
+}
+
+
+/*!	Copies the node at \a offset, child \a index of the node at
+	\a parentOffset, to the unused node at \a newOffset, and frees it.
+	If \a parentOffset is BPLUSTREE_NULL, the node is the root.
+*/
+status_t
+BPlusTree::_MoveNode(Transaction& transaction, off_t parentOffset,
+	uint16 index, off_t offset, off_t newOffset)
+{
+	CachedNode cachedNode(this);
+	CachedNode cachedNew(this);
+
+	bplustree_node* node = cachedNode.SetToWritable(transaction, offset);
+	bplustree_node* newNode = cachedNew.SetToWritable(transaction, newOffset,
+		false);
+	if (node == NULL || newNode == NULL)
+		return B_IO_ERROR;
+
+	memcpy(newNode, node, fNodeSize);
+
+	CachedNode cachedOther(this);
+	bplustree_node* other;
+	if ((other = cachedOther.SetToWritable(transaction, node->LeftLink()))
+			!= NULL) {
+		other->right_link = HOST_ENDIAN_TO_BFS_INT64(newOffset);
+	}
+	if ((other = cachedOther.SetToWritable(transaction, node->RightLink()))
+			!= NULL) {
+		other->left_link = HOST_ENDIAN_TO_BFS_INT64(newOffset);
+	}
+
+	if (parentOffset == BPLUSTREE_NULL) {
+		bplustree_header* header
+			= cachedOther.SetToWritableHeader(transaction);
+		if (header == NULL)
+			return B_IO_ERROR;
+
+		header->root_node_pointer = HOST_ENDIAN_TO_BFS_INT64(newOffset);
+	} else {
+		bplustree_node* parent = cachedOther.SetToWritable(transaction,
+			parentOffset);
+		if (parent == NULL)
+			return B_IO_ERROR;
+
+		if (index < parent->NumKeys())
+			parent->Values()[index] = HOST_ENDIAN_TO_BFS_INT64(newOffset);
+		else
+			parent->overflow_link = HOST_ENDIAN_TO_BFS_INT64(newOffset);
+	}
+	cachedOther.Unset();
+
+	if (newNode->IsLeaf())
+		_MoveIterators(offset, newOffset, 0);
+
+	return cachedNode.Free(transaction, offset);
+}
+
+
+/*!	Moves the duplicate nodes and fragments that the leaf at \a leafOffset
+	links to, and that are located at or after \a end, to the free nodes in
+	\a freeNodes, starting at index \a _used.
+	Duplicate fragments are copied one array at a time, so that each one
+	only has to be updated in this leaf; the fragment node they came from
+	is freed once its last array is gone.
+	If there are not enough free nodes left, \a _used equals \a freeCount
+	on return, and the leaf needs to be processed again.
+*/
+status_t
+BPlusTree::_RelocateDuplicates(Transaction& transaction, off_t leafOffset,
+	off_t end, const off_t* freeNodes, uint32& _used, uint32 freeCount)
+{
+	CachedNode cachedLeaf(this);
+	const bplustree_node* leaf = cachedLeaf.SetTo(leafOffset);
+	if (leaf == NULL)
+		return B_IO_ERROR;
+
+	CachedNode cachedTarget(this);
+	bplustree_node* target = NULL;
+	off_t targetOffset = BPLUSTREE_NULL;
+	uint32 maxFragments = bplustree_node::MaxFragments(fUsableNodeSize);
+
+	for (uint16 i = 0; i < leaf->NumKeys(); i++) {
+		off_t link = BFS_ENDIAN_TO_HOST_INT64(leaf->Values()[i]);
+		if (!bplustree_node::IsDuplicate(link))
+			continue;
+
+		if (bplustree_node::LinkType(link) == BPLUSTREE_DUPLICATE_NODE) {
+			// move the nodes of the list that are in the way
+			off_t previousOffset = BPLUSTREE_NULL;
+			off_t offset = bplustree_node::FragmentOffset(link);
+
+			while (offset != BPLUSTREE_NULL) {
+				CachedNode cached(this);
+				const bplustree_node* duplicate = cached.SetTo(offset, false);
+				if (duplicate == NULL)
+					return B_IO_ERROR;
+
+				off_t nextOffset = duplicate->RightLink();
+				if (offset >= end) {
+					if (_used == freeCount)
+						return B_OK;
+
+					off_t newOffset = freeNodes[_used++];
+					CachedNode cachedNew(this);
+					bplustree_node* newDuplicate = cachedNew.SetToWritable(
+						transaction, newOffset, false);
+					if (newDuplicate == NULL
+						|| cached.MakeWritable(transaction) == NULL)
+						return B_IO_ERROR;
+
+					memcpy(newDuplicate, duplicate, fNodeSize);
+					cachedNew.Unset();
+
+					CachedNode cachedOther(this);
+					if (previousOffset == BPLUSTREE_NULL) {
+						bplustree_node* writableLeaf
+							= cachedLeaf.MakeWritable(transaction);
+						if (writableLeaf == NULL)
+							return B_IO_ERROR;
+
+						writableLeaf->Values()[i] = HOST_ENDIAN_TO_BFS_INT64(
+							bplustree_node::MakeLink(BPLUSTREE_DUPLICATE_NODE,
+								newOffset));
+						leaf = writableLeaf;
+					} else {
+						bplustree_node* previous = cachedOther.SetToWritable(
+							transaction, previousOffset, false);
+						if (previous == NULL)
+							return B_IO_ERROR;
+
+						previous->right_link
+							= HOST_ENDIAN_TO_BFS_INT64(newOffset);
+					}
+					if (nextOffset != BPLUSTREE_NULL) {
+						bplustree_node* next = cachedOther.SetToWritable(
+							transaction, nextOffset, false);
+						if (next == NULL)
+							return B_IO_ERROR;
+
+						next->left_link = HOST_ENDIAN_TO_BFS_INT64(newOffset);
+					}
+					cachedOther.Unset();
+
+					_MoveIterators(offset, newOffset, 0);
+
+					status_t status = cached.Free(transaction, offset);
+					if (status != B_OK)
+						return status;
+
+					offset = newOffset;
+				}
+
+				previousOffset = offset;
+				offset = nextOffset;
+			}
+			continue;
+		}
+
+		off_t fragmentOffset = bplustree_node::FragmentOffset(link);
+		if (fragmentOffset < end)
+			continue;
+
+		// find an unused array in the current target node, or start a new
+		// one
+
+		uint32 index = 0;
+		if (target != NULL) {
+			while (index < maxFragments
+				&& !target->FragmentAt(index)->IsEmpty()) {
+				index++;
+			}
+		}
+		if (target == NULL || index == maxFragments) {
+			if (_used == freeCount)
+				return B_OK;
+
+			targetOffset = freeNodes[_used++];
+			target = cachedTarget.SetToWritable(transaction, targetOffset,
+				false);
+			if (target == NULL)
+				return B_IO_ERROR;
+
+			memset(target, 0, fNodeSize);
+			index = 0;
+		}
+
+		CachedNode cached(this);
+		bplustree_node* fragment = cached.SetToWritable(transaction,
+			fragmentOffset, false);
+		if (fragment == NULL)
+			return B_IO_ERROR;
+
+		duplicate_array* array = fragment->FragmentAt(
+			bplustree_node::FragmentIndex(link));
+		memcpy(target->FragmentAt(index), array,
+			(NUM_FRAGMENT_VALUES + 1) * sizeof(off_t));
+		memset(array, 0, (NUM_FRAGMENT_VALUES + 1) * sizeof(off_t));
+
+		bplustree_node* writableLeaf = cachedLeaf.MakeWritable(transaction);
+		if (writableLeaf == NULL)
+			return B_IO_ERROR;
+
+		off_t newLink = bplustree_node::MakeLink(BPLUSTREE_DUPLICATE_FRAGMENT,
+			targetOffset, index);
+		writableLeaf->Values()[i] = HOST_ENDIAN_TO_BFS_INT64(newLink);
+		leaf = writableLeaf;
+
+		_MoveIterators(link, newLink, 0);
+
+		if (fragment->FragmentsUsed(fUsableNodeSize) == 0) {
+			status_t status = cached.Free(transaction, fragmentOffset);
+			if (status != B_OK)
+				return status;
+		}
+	}
+
+	return B_OK;
+}
+
+
+/*!	Removes the free nodes at the end of the tree from the free list, and
+	shrinks the stream of the tree accordingly.
+*/
+status_t
+BPlusTree::_TruncateFreeNodes()
+{
+	Transaction transaction(fStream->GetVolume(), fStream->BlockNumber());
+	fStream->WriteLockInTransaction(transaction);
+
+	off_t maximumSize = fHeader.MaximumSize();
+	off_t size = maximumSize;
+
+	CachedNode cached(this);
+	while (size > 2 * (off_t)fNodeSize) {
+		const bplustree_node* node = cached.SetTo(size - fNodeSize, false);
+		if (node == NULL)
+			return B_IO_ERROR;
+		if (node->OverflowLink() != BPLUSTREE_FREE)
+			break;
+
+		size -= fNodeSize;
+	}
+	cached.Unset();
+
+	if (size == maximumSize)
+		return B_OK;
+
+	CachedNode cachedHeader(this);
+	bplustree_header* header = cachedHeader.SetToWritableHeader(transaction);
+	if (header == NULL)
+		return B_IO_ERROR;
+
+	off_t previousOffset = BPLUSTREE_NULL;
+	off_t offset = header->FreeNode();
+	off_t removed = 0;
+
+	for (off_t visited = 0; offset != BPLUSTREE_NULL; visited++) {
+		if (visited > maximumSize / fNodeSize) {
+			FATAL(("BPlusTree::_TruncateFreeNodes() free list loops, inode %"
+				B_PRIdOFF "\n", fStream->ID()));
+			RETURN_ERROR(B_BAD_DATA);
+		}
+
+		const bplustree_node* node = cached.SetTo(offset, false);
+		if (node == NULL)
+			return B_IO_ERROR;
+
+		off_t nextOffset = node->LeftLink();
+
+		if (offset < size)
+			previousOffset = offset;
+		else {
+			if (previousOffset == BPLUSTREE_NULL) {
+				header->free_node_pointer
+					= HOST_ENDIAN_TO_BFS_INT64(nextOffset);
+			} else {
+				bplustree_node* previous = cached.SetToWritable(transaction,
+					previousOffset, false);
+				if (previous == NULL)
+					return B_IO_ERROR;
+
+				previous->left_link = HOST_ENDIAN_TO_BFS_INT64(nextOffset);
+			}
+			removed++;
+		}
+
+		offset = nextOffset;
+	}
+
+	if (removed != (maximumSize - size) / fNodeSize) {
+		// Some of the nodes marked as free are not in the free list -
+		// better leave the tree alone
+		INFORM(("BPlusTree::_TruncateFreeNodes() free list doesn't match, "
+			"inode %" B_PRIdOFF "\n", fStream->ID()));
+		return B_OK;
+	}
+
+	status_t status = fStream->SetFileSize(transaction, size);
+	if (status != B_OK)
+		return status;
+
+	header->maximum_size = HOST_ENDIAN_TO_BFS_INT64(size);
+	cachedHeader.Unset();
+
+	return transaction.Done();
+}
 #endif // !_BOOT_MODE
 
 
@@ -2326,6 +3358,83 @@ BPlusTree::Find(const uint8* key, uint16 keyLength, off_t* _value)
 }
 
 
+#if !_BOOT_MODE
+/*!	Checks whether the tree contains the \a key with the given \a value.
+	Unlike Find(), this also works for trees that allow duplicates.
+	Returns B_OK if the pair could be found, B_ENTRY_NOT_FOUND if not.
+	You need to have the inode read or write locked.
+*/
+status_t
+BPlusTree::Contains(const uint8* key, uint16 keyLength, off_t value)
+{
+	if (key == NULL || keyLength < BPLUSTREE_MIN_KEY_LENGTH
+		|| keyLength > BPLUSTREE_MAX_KEY_LENGTH)
+		RETURN_ERROR(B_BAD_VALUE);
+
+	ASSERT_READ_LOCKED_INODE(fStream);
+
+	off_t nodeOffset = fHeader.RootNode();
+	CachedNode cached(this);
+	const bplustree_node* node;
+
+	while ((node = cached.SetTo(nodeOffset)) != NULL) {
+		uint16 keyIndex = 0;
+		off_t nextOffset;
+		status_t status = _FindKey(node, key, keyLength, &keyIndex,
+			&nextOffset);
+
+		if (node->OverflowLink() != BPLUSTREE_NULL) {
+			if (nextOffset == nodeOffset)
+				RETURN_ERROR(B_ERROR);
+
+			nodeOffset = nextOffset;
+			continue;
+		}
+
+		if (status != B_OK)
+			return status;
+
+		off_t link = BFS_ENDIAN_TO_HOST_INT64(node->Values()[keyIndex]);
+		if (!fAllowDuplicates || !bplustree_node::IsDuplicate(link))
+			return link == value ? B_OK : B_ENTRY_NOT_FOUND;
+
+		const bplustree_node* duplicate = cached.SetTo(
+			bplustree_node::FragmentOffset(link), false);
+		if (bplustree_node::LinkType(link) == BPLUSTREE_DUPLICATE_FRAGMENT) {
+			if (duplicate == NULL)
+				RETURN_ERROR(B_IO_ERROR);
+
+			duplicate_array* array = duplicate->FragmentAt(
+				bplustree_node::FragmentIndex(link));
+			if (array->Count() > NUM_FRAGMENT_VALUES)
+				RETURN_ERROR(B_BAD_DATA);
+
+			return array->Find(value) >= 0 ? B_OK : B_ENTRY_NOT_FOUND;
+		}
+
+		// walk the duplicate node list
+		while (duplicate != NULL) {
+			duplicate_array* array = duplicate->DuplicateArray();
+			if (array->Count() > NUM_DUPLICATE_VALUES)
+				RETURN_ERROR(B_BAD_DATA);
+			if (array->Find(value) >= 0)
+				return B_OK;
+
+			off_t nextDuplicate = duplicate->RightLink();
+			if (nextDuplicate == BPLUSTREE_NULL)
+				return B_ENTRY_NOT_FOUND;
+
+			duplicate = cached.SetTo(nextDuplicate, false);
+		}
+		RETURN_ERROR(B_IO_ERROR);
+	}
+	FATAL(("b+tree node at %" B_PRIdOFF " could not be loaded, inode %"
+		B_PRIdOFF "\n", nodeOffset, fStream->ID()));
+	RETURN_ERROR(B_ERROR);
+}
+#endif // !_BOOT_MODE
+
+
 #if !_BOOT_MODE
 status_t
 BPlusTree::_ValidateChildren(TreeCheck& check, uint32 level, off_t offset,
@@ -2876,6 +3985,25 @@ TreeIterator::Update(off_t offset, off_t nextOffset, uint16 keyIndex,
 }
 
 
+/*!	Called when the keys of the node at \a offset have been moved into the
+	node at \a nextOffset, starting at \a keyOffset.
+	It's also used when duplicates have been moved; \a offset and
+	\a nextOffset are then the old and new duplicate link.
+*/
+void
+TreeIterator::Move(off_t offset, off_t nextOffset, uint16 keyOffset)
+{
+	if (fDuplicateNode != BPLUSTREE_NULL && offset == fDuplicateNode)
+		fDuplicateNode = nextOffset;
+
+	if (offset != fCurrentNodeOffset)
+		return;
+
+	fCurrentNodeOffset = nextOffset;
+	fCurrentKey += keyOffset;
+}
+
+
 void
 TreeIterator::Stop()
 {
@@ -232,6 +232,9 @@ public:
 
 			bool				IsWritable() const { return fWritable; }
 			bplustree_node*		Node() const { return fNode; }
+#if !_BOOT_MODE
+			bool				IsChecksumValid() const;
+#endif
 
 protected:
 			bplustree_node*		InternalSetTo(Transaction* transaction,
@@ -274,6 +277,7 @@ public:
 #if !_BOOT_MODE
 			status_t			Validate(bool repair, bool& _errorsFound);
 			status_t			MakeEmpty();
+			status_t			Compact(uint32& _mergedNodes);
 
 			status_t			Remove(Transaction& transaction,
 									const uint8* key, uint16 keyLength,
@@ -281,6 +285,9 @@ public:
 			status_t			Insert(Transaction& transaction,
 									const uint8* key, uint16 keyLength,
 									off_t value);
+			status_t			InsertSorted(Transaction& transaction,
+									const uint8* key, uint16 keyLength,
+									off_t value);
 
 			status_t			Remove(Transaction& transaction, const char* key,
 									off_t value);
@@ -308,6 +315,9 @@ public:
 									off_t* value);
 
 #if !_BOOT_MODE
+			status_t			Contains(const uint8* key, uint16 keyLength,
+									off_t value);
+
 	static	int32				TypeCodeToKeyType(type_code code);
 	static	int32				ModeToKeyType(mode_t mode);
 
@@ -329,6 +339,8 @@ private:
 #if !_BOOT_MODE
 			status_t			_SeekDown(Stack<node_and_key>& stack,
 									const uint8* key, uint16 keyLength);
+			status_t			_FirstLeafKey(off_t offset, uint8* key,
+									uint16* _keyLength);
 
 			status_t			_FindFreeDuplicateFragment(
 									Transaction& transaction,
@@ -345,7 +357,10 @@ private:
 									off_t nodeOffset, bplustree_node* other,
 									off_t otherOffset, uint16* _keyIndex,
 									uint8* key, uint16* _keyLength,
-									off_t* _value);
+									off_t* _value, bool sorted);
+			status_t			_Insert(Transaction& transaction,
+									const uint8* key, uint16 keyLength,
+									off_t value, bool sorted);
 
 			status_t			_RemoveDuplicate(Transaction& transaction,
 									const bplustree_node* node,
@@ -353,9 +368,40 @@ private:
 									off_t value);
 			void				_RemoveKey(bplustree_node* node, uint16 index);
 
+			status_t			_SeekLevel(const uint8* key,
+									uint16 keyLength, uint32 height,
+									off_t* _parentOffset, uint16* _index,
+									off_t* _nodeOffset);
+			status_t			_NextSiblingKey(off_t offset, uint8* key,
+									uint16* _keyLength);
+			status_t			_MergeLevel(Transaction& transaction,
+									uint32 height, uint8* key,
+									uint16* _keyLength, bool* _done,
+									uint32* _mergedNodes);
+			status_t			_MergeNodes(Transaction& transaction,
+									off_t parentOffset, uint16 index,
+									off_t* _nodeOffset, off_t rightOffset);
+			status_t			_RelocateLevel(Transaction& transaction,
+									uint32 height, off_t end, uint8* key,
+									uint16* _keyLength, bool* _done);
+			status_t			_UsedSize(off_t& _size);
+			status_t			_TakeFreeNodes(Transaction& transaction,
+									off_t end, off_t* offsets,
+									uint32& _count);
+			status_t			_MoveNode(Transaction& transaction,
+									off_t parentOffset, uint16 index,
+									off_t offset, off_t newOffset);
+			status_t			_RelocateDuplicates(Transaction& transaction,
+									off_t leafOffset, off_t end,
+									const off_t* freeNodes, uint32& _used,
+									uint32 freeCount);
+			status_t			_TruncateFreeNodes();
+
 			void				_UpdateIterators(off_t offset, off_t nextOffset,
 									uint16 keyIndex, uint16 splitAt,
 									int8 change);
+			void				_MoveIterators(off_t offset, off_t nextOffset,
+									uint16 keyOffset);
 			void				_AddIterator(TreeIterator* iterator);
 			void				_RemoveIterator(TreeIterator* iterator);
 
@@ -370,6 +416,21 @@ private:
 									uint16 keyLength);
 #endif // !_BOOT_MODE
 
+			void				_SetNodeSize(int32 nodeSize);
+			bool				_HasChecksums() const
+									{ return fUsableNodeSize != fNodeSize; }
+#if !_BOOT_MODE
+			uint32				_NodeChecksum(const bplustree_node* node,
+									off_t offset) const;
+#endif
+			uint32*				_ChecksumOf(const bplustree_node* node) const
+									{ return (uint32*)((uint8*)node
+										+ fUsableNodeSize); }
+			int32				_MaxDuplicateValues() const
+									{ return _HasChecksums()
+										? NUM_DUPLICATE_VALUES - 1
+										: NUM_DUPLICATE_VALUES; }
+
 private:
 			friend class TreeIterator;
 			friend class CachedNode;
@@ -378,6 +439,8 @@ private:
 			Inode*				fStream;
 			bplustree_header	fHeader;
 			int32				fNodeSize;
+			int32				fUsableNodeSize;
+				// the node size without the space reserved for its checksum
 			bool				fAllowDuplicates;
 			bool				fInTransaction;
 			status_t			fStatus;
@@ -425,6 +488,8 @@ private:
 			void				Update(off_t offset, off_t nextOffset,
 									uint16 keyIndex, uint16 splitAt,
 									int8 change);
+			void				Move(off_t offset, off_t nextOffset,
+									uint16 keyOffset);
 			void				Stop();
 
 private:
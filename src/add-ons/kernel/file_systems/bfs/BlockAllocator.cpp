@@ -10,6 +10,7 @@
 #include "BlockAllocator.h"
 
 #include "Debug.h"
+#include "DiscardQueue.h"
 #include "Inode.h"
 #include "Volume.h"
 
@@ -722,10 +723,15 @@ BlockAllocator::Uninitialize()
 
 	The number of allocated blocks is always a multiple of \a minimum which
 	has to be a power of two value.
+
+	The blocks that have been reserved for delayed allocations (see
+	Volume::ReserveBlocks()) are not available, except for the \a reserved
+	blocks the caller reserved itself.
 */
 status_t
 BlockAllocator::AllocateBlocks(Transaction& transaction, int32 groupIndex,
-	uint16 start, uint16 maximum, uint16 minimum, block_run& run)
+	uint16 start, uint16 maximum, uint16 minimum, block_run& run,
+	off_t reserved)
 {
 	if (maximum == 0)
 		return B_BAD_VALUE;
@@ -737,6 +743,15 @@ BlockAllocator::AllocateBlocks(Transaction& transaction, int32 groupIndex,
 	AllocationBlock cached(fVolume);
 	RecursiveLocker lock(fLock);
 
+	off_t available = fVolume->AvailableBlocks() + reserved;
+	if (available <= 0 || available < minimum)
+		return B_DEVICE_FULL;
+	if (available < maximum) {
+		maximum = (uint16)available;
+		if (minimum > 1)
+			maximum = round_down(maximum, minimum);
+	}
+
 	uint32 bitsPerFullBlock = fVolume->BlockSize() << 3;
 
 	// Find the block_run that can fulfill the request best
@@ -902,6 +917,11 @@ BlockAllocator::AllocateBlocks(Transaction& transaction, int32 groupIndex,
 		// If the value is not correct at mount time, it will be
 		// fixed anyway.
 
+	// The blocks must not be discarded anymore once they are in use again
+	DiscardQueue* discardQueue = fVolume->GetDiscardQueue();
+	if (discardQueue != NULL)
+		discardQueue->Cancel(fVolume->ToBlock(run), run.Length());
+
 	// We need to flush any remaining blocks in the new allocation to make sure
 	// they won't interfere with the file cache.
 	block_cache_discard(fVolume->BlockCache(), fVolume->ToBlock(run),
@@ -962,7 +982,7 @@ BlockAllocator::Allocate(Transaction& transaction, Inode* inode,
 
 	// Are there already allocated blocks? (then just try to allocate near the
 	// last one)
-	if (inode->Size() > 0) {
+	if (inode->StreamSize() > 0) {
 		const data_stream& data = inode->Node().data;
 		// TODO: we currently don't care for when the data stream
 		// is already grown into the indirect ranges
@@ -986,7 +1006,8 @@ BlockAllocator::Allocate(Transaction& transaction, Inode* inode,
 		group = inode->BlockRun().AllocationGroup() + 1;
 	}
 
-	return AllocateBlocks(transaction, group, start, numBlocks, minimum, run);
+	return AllocateBlocks(transaction, group, start, numBlocks, minimum, run,
+		inode->ReservedBlocks());
 }
 
 
@@ -1037,6 +1058,12 @@ BlockAllocator::Free(Transaction& transaction, block_run run)
 
 	CHECK_ALLOCATION_GROUP(group);
 
+	// Let the device know about the freed blocks once this transaction is
+	// safely on disk
+	DiscardQueue* discardQueue = fVolume->GetDiscardQueue();
+	if (discardQueue != NULL)
+		discardQueue->Add(fVolume->ToBlock(run), length);
+
 #ifdef DEBUG
 	if (CheckBlockRun(run, NULL, false) != B_OK) {
 		DEBUGGER(("CheckBlockRun() reports allocated blocks (which were just "
@@ -1235,6 +1262,73 @@ BlockAllocator::Trim(uint64 offset, uint64 size, uint64& trimmedSize)
 }
 
 
+static void
+add_free_extent(uint64 length, uint64& count, uint64& largest,
+	uint64* histogram, uint32 bucketCount)
+{
+	uint32 bucket = 0;
+	while (bucket < bucketCount - 1 && (length >> (bucket + 1)) != 0)
+		bucket++;
+
+	histogram[bucket]++;
+	count++;
+	if (length > largest)
+		largest = length;
+}
+
+
+/*!	Walks the whole block bitmap, and counts the ranges of free blocks on
+	the volume. The \a histogram array gets the number of free ranges per
+	size class: index i counts the ranges of 2^i to 2^(i + 1) - 1 blocks,
+	while the last entry also counts all larger ranges.
+*/
+status_t
+BlockAllocator::GetFreeExtents(uint64& _count, uint64& _largest,
+	uint64* histogram, uint32 bucketCount)
+{
+	if (histogram == NULL || bucketCount == 0)
+		return B_BAD_VALUE;
+
+	memset(histogram, 0, bucketCount * sizeof(uint64));
+	_count = 0;
+	_largest = 0;
+
+	RecursiveLocker locker(fLock);
+
+	AllocationBlock cached(fVolume);
+	uint64 freeLength = 0;
+
+	for (int32 groupIndex = 0; groupIndex < fNumGroups; groupIndex++) {
+		AllocationGroup& group = fGroups[groupIndex];
+
+		for (uint32 block = 0; block < group.NumBlocks(); block++) {
+			if (cached.SetTo(group, block) != B_OK)
+				RETURN_ERROR(B_IO_ERROR);
+
+			for (uint32 i = 0; i < cached.NumBlockBits(); i++) {
+				if (!cached.IsUsed(i)) {
+					freeLength++;
+					continue;
+				}
+
+				if (freeLength > 0) {
+					add_free_extent(freeLength, _count, _largest, histogram,
+						bucketCount);
+					freeLength = 0;
+				}
+			}
+		}
+	}
+
+	if (freeLength > 0) {
+		add_free_extent(freeLength, _count, _largest, histogram,
+			bucketCount);
+	}
+
+	return B_OK;
+}
+
+
 //	#pragma mark -
 
 
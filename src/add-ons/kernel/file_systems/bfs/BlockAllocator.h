@@ -41,10 +41,13 @@ public:
 
 			status_t		AllocateBlocks(Transaction& transaction,
 								int32 group, uint16 start, uint16 numBlocks,
-								uint16 minimum, block_run& run);
+								uint16 minimum, block_run& run,
+								off_t reserved = 0);
 
 			status_t		Trim(uint64 offset, uint64 size,
 								uint64& trimmedSize);
+			status_t		GetFreeExtents(uint64& _count, uint64& _largest,
+								uint64* histogram, uint32 bucketCount);
 
 			status_t		CheckBlocks(off_t start, off_t length,
 								bool allocated = true,
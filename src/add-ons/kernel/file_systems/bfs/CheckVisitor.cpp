@@ -32,7 +32,8 @@ struct check_index {
 CheckVisitor::CheckVisitor(Volume* volume)
 	:
 	FileSystemVisitor(volume),
-	fCheckBitmap(NULL)
+	fCheckBitmap(NULL),
+	fChecksumErrors(0)
 {
 }
 
@@ -72,6 +73,7 @@ CheckVisitor::StartBitmapPass()
 
 	Control().pass = BFS_CHECK_PASS_BITMAP;
 	Control().stats.block_size = GetVolume()->BlockSize();
+	fChecksumErrors = GetVolume()->ChecksumErrors();
 
 	// TODO: check reserved area in bitmap!
 
@@ -190,6 +192,9 @@ CheckVisitor::StopChecking()
 	if (Control().status != B_ENTRY_NOT_FOUND)
 		FATAL(("CheckVisitor didn't run through\n"));
 
+	Control().stats.checksum_errors = GetVolume()->ChecksumErrors()
+		- fChecksumErrors;
+
 	_FreeIndices();
 
 	recursive_lock_unlock(&GetVolume()->Allocator().Lock());
@@ -479,6 +484,14 @@ CheckVisitor::_CheckInodeBlocks(Inode* inode, const char* name)
 		return B_OK;
 	}
 
+	if (inode->IsInline()) {
+		// The data is in the small_data section, the data stream must be
+		// empty, though
+		_CheckInlineData(inode);
+		Control().stats.inline_files++;
+		return B_OK;
+	}
+
 	data_stream* data = &inode->Node().data;
 
 	// check the direct range
@@ -602,6 +615,29 @@ CheckVisitor::_CheckInodeBlocks(Inode* inode, const char* name)
 }
 
 
+void
+CheckVisitor::_CheckInlineData(Inode* inode)
+{
+	const data_stream& data = inode->Node().data;
+	if (!inode->IsFile() || data.MaxDirectRange() != 0
+		|| data.MaxIndirectRange() != 0 || data.MaxDoubleIndirectRange() != 0
+		|| !data.direct[0].IsZero()
+		|| inode->Size() > GetVolume()->MaxInlineDataSize()) {
+		Control().errors |= BFS_INVALID_INLINE_DATA;
+		return;
+	}
+
+	if (inode->Size() == 0)
+		return;
+
+	// ReadInlineData() makes sure the data matches the file size
+	uint8 buffer[1];
+	size_t length = sizeof(buffer);
+	if (inode->ReadInlineData(0, buffer, &length) != B_OK)
+		Control().errors |= BFS_INVALID_INLINE_DATA;
+}
+
+
 status_t
 CheckVisitor::_CheckAllocated(block_run run, const char* type)
 {
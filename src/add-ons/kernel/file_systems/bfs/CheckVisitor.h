@@ -56,6 +56,7 @@ private:
 			void				_SetCheckBitmapAt(off_t block);
 			status_t			_CheckInodeBlocks(Inode* inode,
 									const char* name);
+			void				_CheckInlineData(Inode* inode);
 			status_t			_CheckAllocated(block_run run,
 									const char* type);
 
@@ -70,6 +71,8 @@ private:
 			IndexStack			indices;
 
 			uint32*				fCheckBitmap;
+			off_t				fChecksumErrors;
+				// the checksum errors of the volume before the check
 };
 
 
@@ -0,0 +1,16 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * This file may be used under the terms of the MIT License.
+ */
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+
+#include "system_dependencies.h"
+
+
+uint32 crc32c(uint32 crc, const void* buffer, size_t length);
+bool crc32c_is_hardware_accelerated();
+
+
+#endif	// CHECKSUM_H
@@ -57,7 +57,9 @@ dump_super_block(const disk_super_block* superBlock)
 	kprintf("  inode_size     = %u\n", (unsigned)superBlock->InodeSize());
 	kprintf("  magic2         = %#08x (%s) %s\n", (int)superBlock->Magic2(),
 		get_tupel(superBlock->magic2),
-		(superBlock->magic2 == (int)SUPER_BLOCK_MAGIC2 ? "valid" : "INVALID"));
+		(superBlock->magic2 == (int)SUPER_BLOCK_MAGIC2
+			|| superBlock->magic2 == (int)SUPER_BLOCK_MAGIC2_INCOMPAT
+			? "valid" : "INVALID"));
 	kprintf("  blocks_per_ag  = %u\n",
 		(unsigned)superBlock->BlocksPerAllocationGroup());
 	kprintf("  ag_shift       = %u (%ld bytes)\n",
@@ -136,8 +138,8 @@ dump_inode(const bfs_inode* inode)
 		S_ISLNK(inode->Mode()) && (inode->Flags() & INODE_LONG_SYMLINK) == 0
 			? inode->short_symlink : "-");
 	dump_data_stream(&(inode->data));
-	kprintf("  --\n  pad[0]             = %08x\n", (int)inode->pad[0]);
-	kprintf("  pad[1]             = %08x\n", (int)inode->pad[1]);
+	kprintf("  checksum           = %08" B_PRIx32 "\n", inode->Checksum());
+	kprintf("  --\n  pad                = %08x\n", (int)inode->pad);
 }
 
 
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * This file may be used under the terms of the MIT License.
+ */
+
+
+//! Defragments the volume in the background
+
+
+#include "DefragmentVisitor.h"
+
+#include "Debug.h"
+#include "Inode.h"
+#include "Journal.h"
+#include "Volume.h"
+
+
+DefragmentVisitor::DefragmentVisitor(Volume* volume)
+	:
+	FileSystemVisitor(volume),
+	fThread(-1),
+	fQuit(false)
+{
+	mutex_init(&fLock, "bfs defragmenter");
+	memset(&fStatus, 0, sizeof(fStatus));
+	fStatus.status = B_NO_INIT;
+}
+
+
+DefragmentVisitor::~DefragmentVisitor()
+{
+	StopDefragmenting();
+	mutex_destroy(&fLock);
+}
+
+
+status_t
+DefragmentVisitor::StartDefragmenting(uint32 flags)
+{
+	MutexLocker locker(fLock);
+
+	if (fStatus.running)
+		return B_BUSY;
+
+	if (fThread >= 0) {
+		// the last run is over already, but has not been waited for yet
+		wait_for_thread(fThread, NULL);
+		fThread = -1;
+	}
+
+	uint32 visitFlags = 0;
+	if ((flags & (BFS_DEFRAGMENT_FILES | BFS_DEFRAGMENT_DIRECTORIES)) != 0)
+		visitFlags |= VISIT_REGULAR | VISIT_ATTRIBUTE_DIRECTORIES;
+	if ((flags & BFS_DEFRAGMENT_INDICES) != 0)
+		visitFlags |= VISIT_INDICES;
+	if (visitFlags == 0)
+		return B_BAD_VALUE;
+
+	memset(&fStatus, 0, sizeof(fStatus));
+	fStatus.flags = flags;
+	fStatus.running = true;
+	fStatus.status = B_BUSY;
+	fStatus.used_blocks = GetVolume()->UsedBlocks();
+
+	Start(visitFlags);
+	fQuit = false;
+
+	fThread = spawn_kernel_thread(&DefragmentVisitor::_Run,
+		"bfs defragmenter", B_LOW_PRIORITY, this);
+	if (fThread < 0) {
+		// there are no threads in the fs_shell, just do it right away
+		fThread = -1;
+		locker.Unlock();
+		return _Run(this);
+	}
+
+	resume_thread(fThread);
+	return B_OK;
+}
+
+
+void
+DefragmentVisitor::StopDefragmenting()
+{
+	MutexLocker locker(fLock);
+
+	thread_id thread = fThread;
+	fThread = -1;
+	fQuit = true;
+
+	locker.Unlock();
+
+	if (thread >= 0)
+		wait_for_thread(thread, NULL);
+}
+
+
+status_t
+DefragmentVisitor::GetStatus(bfs_defragment_status& status)
+{
+	MutexLocker locker(fLock);
+	status = fStatus;
+	locker.Unlock();
+
+	uint64 histogram[BFS_FREE_EXTENT_BUCKETS];
+	return GetVolume()->Allocator().GetFreeExtents(status.free_extents,
+		status.largest_free_extent, histogram, BFS_FREE_EXTENT_BUCKETS);
+}
+
+
+status_t
+DefragmentVisitor::VisitInode(Inode* inode, const char* treeName)
+{
+	if (fQuit)
+		return B_INTERRUPTED;
+
+	_Defragment(inode);
+	return B_OK;
+}
+
+
+/*static*/ status_t
+DefragmentVisitor::_Run(void* _self)
+{
+	DefragmentVisitor* self = (DefragmentVisitor*)_self;
+
+	status_t status;
+	while ((status = self->Next()) == B_OK)
+		;
+
+	if (status == B_ENTRY_NOT_FOUND)
+		status = B_OK;
+
+	// release the nodes that have not been visited yet
+	self->Stop();
+
+	MutexLocker locker(self->fLock);
+	self->fStatus.running = false;
+	self->fStatus.status = status;
+
+	INFORM(("defragmenting done: %s, moved %" B_PRIu64 " nodes\n",
+		strerror(status), self->fStatus.moved_nodes));
+	return B_OK;
+}
+
+
+void
+DefragmentVisitor::_Defragment(Inode* inode)
+{
+	uint32 type = BFS_DEFRAGMENT_FILES;
+	if ((inode->Mode() & S_INDEX_DIR) != 0)
+		type = BFS_DEFRAGMENT_INDICES;
+	else if (inode->IsContainer())
+		type = BFS_DEFRAGMENT_DIRECTORIES;
+
+	uint64 runs, extents, blocks;
+	status_t status = inode->CountExtents(runs, extents, blocks);
+
+	MutexLocker locker(fLock);
+	fStatus.visited_nodes++;
+	if (status == B_OK)
+		fStatus.visited_blocks += blocks + 1;
+			// including the inode itself
+	locker.Unlock();
+
+	if (status != B_OK || (fStatus.flags & type) == 0 || inode->IsDeleted())
+		return;
+
+	// Directories might also need to be moved closer to their inode, which
+	// Inode::Defragment() decides
+	if (extents <= 1 && !inode->IsContainer())
+		return;
+
+	// Data of files is moved on disk directly, so it must be written back
+	// first
+	if (inode->NeedsFileCache())
+		inode->Sync();
+
+	off_t movedBlocks = 0;
+	{
+		Transaction transaction(GetVolume(), inode->BlockNumber());
+		inode->WriteLockInTransaction(transaction);
+
+		status = inode->Defragment(transaction, movedBlocks);
+		if (status == B_OK && movedBlocks > 0)
+			status = transaction.Done();
+	}
+
+	uint64 newExtents = 0;
+	if (status == B_OK && movedBlocks > 0)
+		inode->CountExtents(runs, newExtents, blocks);
+
+	locker.Lock();
+
+	if (status != B_OK) {
+		fStatus.skipped_nodes++;
+		return;
+	}
+	if (movedBlocks > 0) {
+		fStatus.moved_nodes++;
+		fStatus.moved_blocks += movedBlocks;
+		fStatus.extents_before += extents;
+		fStatus.extents_after += newExtents;
+	}
+}
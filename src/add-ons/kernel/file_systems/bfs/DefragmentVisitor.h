@@ -0,0 +1,38 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * This file may be used under the terms of the MIT License.
+ */
+#ifndef DEFRAGMENT_VISITOR_H
+#define DEFRAGMENT_VISITOR_H
+
+
+#include "system_dependencies.h"
+
+#include "bfs_control.h"
+#include "FileSystemVisitor.h"
+
+
+class DefragmentVisitor : public FileSystemVisitor {
+public:
+								DefragmentVisitor(Volume* volume);
+	virtual						~DefragmentVisitor();
+
+			status_t			StartDefragmenting(uint32 flags);
+			void				StopDefragmenting();
+			status_t			GetStatus(bfs_defragment_status& status);
+
+	virtual status_t			VisitInode(Inode* inode, const char* treeName);
+
+private:
+	static	status_t			_Run(void* _self);
+			void				_Defragment(Inode* inode);
+
+private:
+			mutex				fLock;
+			bfs_defragment_status fStatus;
+			thread_id			fThread;
+			volatile bool		fQuit;
+};
+
+
+#endif	// DEFRAGMENT_VISITOR_H
@@ -0,0 +1,473 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * This file may be used under the terms of the MIT License.
+ */
+
+
+//! Reports freed blocks to the device in the background
+
+
+#include "DiscardQueue.h"
+
+#include "Debug.h"
+#include "Volume.h"
+
+
+// Freed blocks may only be discarded once their transaction has been written
+// to the log; until then, a crash would bring their old contents back.
+// The Journal therefore tells the queue when a transaction is done, and when
+// the log has been written. Blocks that are allocated again before they have
+// been discarded are removed from the queue.
+
+static const int32 kMaxRanges = 65536;
+	// per list, about 1 MB of memory
+static const int32 kMaxBatchRanges = 128;
+static const off_t kMaxBatchBytes = 64LL * 1024 * 1024;
+static const off_t kMaxBytesPerSecond = 256LL * 1024 * 1024;
+static const bigtime_t kDiscardDelay = 1000000;
+	// collect freed blocks for a second before discarding them
+
+
+DiscardRangeList::DiscardRangeList()
+	:
+	fRanges(NULL),
+	fCount(0),
+	fCapacity(0),
+	fBlocks(0)
+{
+}
+
+
+DiscardRangeList::~DiscardRangeList()
+{
+	free(fRanges);
+}
+
+
+/*!	Adds the range, and merges it with its neighbours, if possible.
+	Returns \c false if there was no space left for it.
+*/
+bool
+DiscardRangeList::Add(off_t start, off_t length)
+{
+	off_t end = start + length;
+	int32 first = _FirstAfter(start);
+	int32 last = first;
+
+	while (last < fCount && fRanges[last].start <= end) {
+		start = min_c(start, fRanges[last].start);
+		end = max_c(end, fRanges[last].start + fRanges[last].length);
+		last++;
+	}
+
+	if (first == last) {
+		if (fCount == fCapacity && !_Resize(fCount + 1))
+			return false;
+
+		memmove(&fRanges[first + 1], &fRanges[first],
+			(fCount - first) * sizeof(discard_range));
+		fCount++;
+	} else {
+		for (int32 i = first; i < last; i++)
+			fBlocks -= fRanges[i].length;
+
+		memmove(&fRanges[first + 1], &fRanges[last],
+			(fCount - last) * sizeof(discard_range));
+		fCount -= last - first - 1;
+	}
+
+	fRanges[first].start = start;
+	fRanges[first].length = end - start;
+	fBlocks += end - start;
+	return true;
+}
+
+
+/*!	Adds all ranges of \a other, and returns the number of blocks that did not
+	fit anymore.
+*/
+off_t
+DiscardRangeList::AddAll(const DiscardRangeList& other)
+{
+	off_t dropped = 0;
+	for (int32 i = 0; i < other.Count(); i++) {
+		const discard_range& range = other.RangeAt(i);
+		if (!Add(range.start, range.length))
+			dropped += range.length;
+	}
+	return dropped;
+}
+
+
+/*!	Removes the given range from the list, and returns how many blocks were
+	part of it.
+*/
+off_t
+DiscardRangeList::Remove(off_t start, off_t length)
+{
+	off_t end = start + length;
+	off_t removed = 0;
+	int32 index = _FirstAfter(start + 1);
+
+	while (index < fCount && fRanges[index].start < end) {
+		discard_range& range = fRanges[index];
+		off_t rangeEnd = range.start + range.length;
+
+		if (range.start < start && rangeEnd > end) {
+			// split the range in two
+			range.length = start - range.start;
+			fBlocks -= rangeEnd - start;
+
+			if (!Add(end, rangeEnd - end)) {
+				// we're only losing a discard, not data
+				return rangeEnd - start;
+			}
+			return end - start;
+		}
+		if (range.start < start) {
+			removed += rangeEnd - start;
+			range.length = start - range.start;
+			index++;
+		} else if (rangeEnd > end) {
+			removed += end - range.start;
+			range.length = rangeEnd - end;
+			range.start = end;
+			break;
+		} else {
+			removed += range.length;
+			memmove(&fRanges[index], &fRanges[index + 1],
+				(fCount - index - 1) * sizeof(discard_range));
+			fCount--;
+		}
+	}
+
+	fBlocks -= removed;
+	return removed;
+}
+
+
+bool
+DiscardRangeList::Intersects(off_t start, off_t length) const
+{
+	int32 index = _FirstAfter(start + 1);
+	return index < fCount && fRanges[index].start < start + length;
+}
+
+
+void
+DiscardRangeList::RemoveFirst(int32 count)
+{
+	for (int32 i = 0; i < count; i++)
+		fBlocks -= fRanges[i].length;
+
+	memmove(fRanges, &fRanges[count],
+		(fCount - count) * sizeof(discard_range));
+	fCount -= count;
+}
+
+
+void
+DiscardRangeList::MakeEmpty()
+{
+	fCount = 0;
+	fBlocks = 0;
+}
+
+
+/*!	Returns the index of the first range that ends at or after \a block. */
+int32
+DiscardRangeList::_FirstAfter(off_t block) const
+{
+	int32 first = 0;
+	int32 last = fCount;
+
+	while (first < last) {
+		int32 middle = (first + last) / 2;
+		if (fRanges[middle].start + fRanges[middle].length < block)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	return first;
+}
+
+
+bool
+DiscardRangeList::_Resize(int32 count)
+{
+	if (count > kMaxRanges)
+		return false;
+
+	int32 capacity = max_c(16, fCapacity * 2);
+	while (capacity < count)
+		capacity *= 2;
+	capacity = min_c(capacity, kMaxRanges);
+
+	discard_range* ranges = (discard_range*)realloc(fRanges,
+		capacity * sizeof(discard_range));
+	if (ranges == NULL)
+		return false;
+
+	fRanges = ranges;
+	fCapacity = capacity;
+	return true;
+}
+
+
+//	#pragma mark -
+
+
+DiscardQueue::DiscardQueue(Volume* volume)
+	:
+	fVolume(volume),
+	fWakeUp(-1),
+	fThread(-1),
+	fEnabled(false),
+	fQuit(false),
+	fDiscardedBytes(0),
+	fCanceledBlocks(0),
+	fDroppedBlocks(0)
+{
+	mutex_init(&fLock, "bfs discard queue");
+	mutex_init(&fDiscardLock, "bfs discard");
+}
+
+
+DiscardQueue::~DiscardQueue()
+{
+	Stop();
+
+	mutex_destroy(&fDiscardLock);
+	mutex_destroy(&fLock);
+}
+
+
+status_t
+DiscardQueue::Start()
+{
+	fWakeUp = create_sem(0, "bfs discard wake up");
+	if (fWakeUp < 0)
+		return fWakeUp;
+
+	fEnabled = true;
+
+	fThread = spawn_kernel_thread(&DiscardQueue::_Run, "bfs discarder",
+		B_LOW_PRIORITY, this);
+	if (fThread < 0) {
+		// there are no threads in the fs_shell, LogWritten() will discard
+		// the blocks right away
+		fThread = -1;
+		return B_OK;
+	}
+
+	resume_thread(fThread);
+	return B_OK;
+}
+
+
+/*!	Stops the discarder thread, and discards all blocks that are left in the
+	queue. The journal must have been flushed before.
+*/
+void
+DiscardQueue::Stop()
+{
+	if (fWakeUp < 0)
+		return;
+
+	fQuit = true;
+	delete_sem(fWakeUp);
+	fWakeUp = -1;
+
+	if (fThread >= 0) {
+		wait_for_thread(fThread, NULL);
+		fThread = -1;
+	}
+
+	off_t bytes;
+	while (_DiscardNext(false, bytes) == B_OK)
+		;
+}
+
+
+/*!	Called by the BlockAllocator for every run that has been freed in the
+	current transaction.
+*/
+void
+DiscardQueue::Add(off_t start, off_t length)
+{
+	MutexLocker locker(fLock);
+	if (!fEnabled)
+		return;
+
+	if (!fPending.Add(start, length))
+		fDroppedBlocks += length;
+}
+
+
+/*!	Called by the BlockAllocator for every run that is about to be allocated.
+	If a part of it is just being discarded, this waits until that's done, so
+	that no new data can be lost.
+*/
+void
+DiscardQueue::Cancel(off_t start, off_t length)
+{
+	MutexLocker locker(fLock);
+
+	fCanceledBlocks += fPending.Remove(start, length)
+		+ fCommitted.Remove(start, length) + fQueue.Remove(start, length);
+
+	if (!fBatch.Intersects(start, length))
+		return;
+
+	locker.Unlock();
+
+	MutexLocker discardLocker(fDiscardLock);
+}
+
+
+/*!	Called by the Journal when the current transaction has been finished.
+	The blocks it freed can only be discarded after the next log write.
+*/
+void
+DiscardQueue::TransactionDone(bool success)
+{
+	MutexLocker locker(fLock);
+
+	if (success)
+		fDroppedBlocks += fCommitted.AddAll(fPending);
+
+	fPending.MakeEmpty();
+}
+
+
+/*!	Called by the Journal after it has written the finished transactions to
+	the log.
+*/
+void
+DiscardQueue::LogWritten()
+{
+	MutexLocker locker(fLock);
+
+	if (fCommitted.Count() == 0)
+		return;
+
+	fDroppedBlocks += fQueue.AddAll(fCommitted);
+	fCommitted.MakeEmpty();
+
+	if (fThread < 0) {
+		locker.Unlock();
+
+		off_t bytes;
+		while (_DiscardNext(false, bytes) == B_OK)
+			;
+		return;
+	}
+
+	if (fQueue.Count() >= kMaxBatchRanges)
+		release_sem_etc(fWakeUp, 1, B_DO_NOT_RESCHEDULE);
+}
+
+
+void
+DiscardQueue::GetStatus(bfs_discard_status& status)
+{
+	MutexLocker locker(fLock);
+	uint32 shift = fVolume->BlockShift();
+
+	status.enabled = fEnabled;
+	status.pending_bytes = (fPending.Blocks() + fCommitted.Blocks()) << shift;
+	status.queued_bytes = (fQueue.Blocks() + fBatch.Blocks()) << shift;
+	status.discarded_bytes = fDiscardedBytes;
+	status.canceled_bytes = fCanceledBlocks << shift;
+	status.dropped_bytes = fDroppedBlocks << shift;
+}
+
+
+/*static*/ status_t
+DiscardQueue::_Run(void* _self)
+{
+	DiscardQueue* self = (DiscardQueue*)_self;
+
+	while (!self->fQuit) {
+		status_t status = acquire_sem_etc(self->fWakeUp, 1, B_RELATIVE_TIMEOUT,
+			kDiscardDelay);
+		if (status != B_OK && status != B_TIMED_OUT)
+			break;
+
+		off_t bytes;
+		while (!self->fQuit && self->_DiscardNext(true, bytes) == B_OK) {
+			// don't let the device get too busy with discarding
+			snooze(bytes * 1000000 / kMaxBytesPerSecond + 1);
+		}
+	}
+
+	return B_OK;
+}
+
+
+/*!	Discards the next batch of ranges from the queue, and returns the number
+	of bytes that were in it. If \a limit is \c true, the batch will contain
+	not much more than kMaxBatchBytes.
+*/
+status_t
+DiscardQueue::_DiscardNext(bool limit, off_t& _bytes)
+{
+	MutexLocker discardLocker(fDiscardLock);
+	MutexLocker locker(fLock);
+
+	if (!fEnabled || fQueue.Count() == 0)
+		return B_ENTRY_NOT_FOUND;
+
+	uint32 shift = fVolume->BlockShift();
+	int32 count = 0;
+	off_t bytes = 0;
+	while (count < fQueue.Count() && count < kMaxBatchRanges
+		&& (!limit || bytes < kMaxBatchBytes)) {
+		bytes += fQueue.RangeAt(count++).length << shift;
+	}
+
+	fs_trim_data* trimData = (fs_trim_data*)malloc(sizeof(fs_trim_data)
+		+ 2 * sizeof(uint64) * (count - 1));
+	if (trimData == NULL)
+		return B_NO_MEMORY;
+
+	MemoryDeleter deleter(trimData);
+
+	for (int32 i = 0; i < count; i++) {
+		const discard_range& range = fQueue.RangeAt(i);
+		trimData->ranges[i].offset = range.start << shift;
+		trimData->ranges[i].size = range.length << shift;
+		fBatch.Add(range.start, range.length);
+	}
+	trimData->range_count = count;
+	trimData->trimmed_size = 0;
+	fQueue.RemoveFirst(count);
+
+	// Allocations that overlap with the batch will wait for the discard lock
+	locker.Unlock();
+
+	status_t status = B_OK;
+	if (ioctl(fVolume->Device(), B_TRIM_DEVICE, trimData,
+			sizeof(fs_trim_data) + 2 * sizeof(uint64) * (count - 1)) != 0)
+		status = errno;
+
+	locker.Lock();
+
+	fBatch.MakeEmpty();
+
+	if (status != B_OK) {
+		INFORM(("discarding failed, disabled: %s\n", strerror(status)));
+		fEnabled = false;
+		fDroppedBlocks += (bytes >> shift) + fPending.Blocks()
+			+ fCommitted.Blocks() + fQueue.Blocks();
+		fPending.MakeEmpty();
+		fCommitted.MakeEmpty();
+		fQueue.MakeEmpty();
+		return status;
+	}
+
+	fDiscardedBytes += trimData->trimmed_size;
+	_bytes = bytes;
+	return B_OK;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * This file may be used under the terms of the MIT License.
+ */
+#ifndef DISCARD_QUEUE_H
+#define DISCARD_QUEUE_H
+
+
+#include "system_dependencies.h"
+
+#include "bfs_control.h"
+
+
+class Volume;
+
+
+struct discard_range {
+	off_t	start;
+	off_t	length;
+};
+
+
+class DiscardRangeList {
+public:
+							DiscardRangeList();
+							~DiscardRangeList();
+
+			int32			Count() const { return fCount; }
+			off_t			Blocks() const { return fBlocks; }
+			const discard_range& RangeAt(int32 index) const
+								{ return fRanges[index]; }
+
+			bool			Add(off_t start, off_t length);
+			off_t			AddAll(const DiscardRangeList& other);
+			off_t			Remove(off_t start, off_t length);
+			bool			Intersects(off_t start, off_t length) const;
+			void			RemoveFirst(int32 count);
+			void			MakeEmpty();
+
+private:
+			int32			_FirstAfter(off_t block) const;
+			bool			_Resize(int32 count);
+
+private:
+			discard_range*	fRanges;
+			int32			fCount;
+			int32			fCapacity;
+			off_t			fBlocks;
+};
+
+
+class DiscardQueue {
+public:
+							DiscardQueue(Volume* volume);
+							~DiscardQueue();
+
+			status_t		Start();
+			void			Stop();
+
+			void			Add(off_t start, off_t length);
+			void			Cancel(off_t start, off_t length);
+
+			void			TransactionDone(bool success);
+			void			LogWritten();
+
+			void			GetStatus(bfs_discard_status& status);
+
+private:
+	static	status_t		_Run(void* _self);
+			status_t		_DiscardNext(bool limit, off_t& _bytes);
+
+private:
+			Volume*			fVolume;
+			mutex			fLock;
+			mutex			fDiscardLock;
+				// held while a batch is being discarded
+			DiscardRangeList fPending;
+				// freed by the running transaction
+			DiscardRangeList fCommitted;
+				// freed by finished transactions not yet in the log
+			DiscardRangeList fQueue;
+				// can be discarded
+			DiscardRangeList fBatch;
+				// is being discarded right now
+			sem_id			fWakeUp;
+			thread_id		fThread;
+			bool			fEnabled;
+			volatile bool	fQuit;
+
+			uint64			fDiscardedBytes;
+			uint64			fCanceledBlocks;
+			uint64			fDroppedBlocks;
+};
+
+
+#endif	// DISCARD_QUEUE_H
@@ -11,12 +11,217 @@
 
 #include <file_systems/QueryParserUtils.h>
 
+#include "bfs_control.h"
 #include "Debug.h"
+#include "IndexCache.h"
 #include "Volume.h"
 #include "Inode.h"
 #include "BPlusTree.h"
 
 
+static const int32 kTrigramBatchSize = 256;
+	// the number of names that are added to a new trigram index per
+	// transaction
+static const uint32 kAddNodesBatchSize = 256;
+	// the number of nodes Index::AddNodes() inserts per transaction
+
+
+struct index_value {
+	Inode*	inode;
+	uint16	length;
+	uint8	key[MAX_INDEX_KEY_LENGTH];
+};
+
+
+static inline uint8
+fold_case(uint8 c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A' + 'a';
+	return c;
+}
+
+
+/*!	Returns the character at the start of the \a pattern, and moves the
+	pattern past it. Wildcards, and sets that don't only consist of the
+	upper and lower case version of a single character (like "[Hh]")
+	are returned as -1, as they may match more than one character.
+*/
+static int32
+next_pattern_character(const char** _pattern)
+{
+	const char* pattern = *_pattern;
+	int32 c = -1;
+
+	switch (*pattern) {
+		case '*':
+		case '?':
+			pattern++;
+			break;
+
+		case '\\':
+			pattern++;
+			if (*pattern != '\0')
+				c = fold_case(*pattern++);
+			break;
+
+		case '[':
+		{
+			pattern++;
+			bool usable = true;
+			if (*pattern == '^' || *pattern == '!') {
+				usable = false;
+				pattern++;
+			}
+
+			while (*pattern != '\0' && *pattern != ']') {
+				if (*pattern == '\\' && pattern[1] != '\0')
+					pattern++;
+
+				uint8 member = fold_case(*pattern++);
+				if (member >= 0x80 || *pattern == '-') {
+					// multi-byte characters and ranges are not supported
+					usable = false;
+				}
+				if (c < 0)
+					c = member;
+				else if (c != member)
+					usable = false;
+			}
+			if (*pattern == ']')
+				pattern++;
+			if (!usable)
+				c = -1;
+			break;
+		}
+
+		default:
+			c = fold_case(*pattern++);
+			break;
+	}
+
+	*_pattern = pattern;
+	return c;
+}
+
+
+//	#pragma mark -
+
+
+TrigramSet::TrigramSet()
+	:
+	fCount(0)
+{
+}
+
+
+/*!	Collects the trigrams of the string \a value. The value does not need
+	to be null terminated, but it ends at the first null byte if it is.
+*/
+void
+TrigramSet::SetTo(const uint8* value, uint16 length)
+{
+	fCount = 0;
+	length = strnlen((const char*)value, length);
+
+	for (int32 i = 0; i + kTrigramLength <= length; i++) {
+		uint8 trigram[kTrigramLength];
+		for (int32 j = 0; j < kTrigramLength; j++)
+			trigram[j] = fold_case(value[i + j]);
+
+		_Add(trigram);
+	}
+}
+
+
+/*!	Collects the trigrams every string matching the \a pattern must
+	contain.
+*/
+void
+TrigramSet::SetToPattern(const char* pattern)
+{
+	fCount = 0;
+
+	uint8 trigram[kTrigramLength];
+	int32 length = 0;
+
+	while (*pattern != '\0') {
+		int32 c = next_pattern_character(&pattern);
+		if (c < 0) {
+			length = 0;
+			continue;
+		}
+
+		if (length == kTrigramLength) {
+			memmove(trigram, trigram + 1, kTrigramLength - 1);
+			length--;
+		}
+		trigram[length++] = c;
+
+		if (length == kTrigramLength)
+			_Add(trigram);
+	}
+}
+
+
+bool
+TrigramSet::Contains(const uint8* trigram) const
+{
+	bool found;
+	_IndexOf(trigram, found);
+	return found;
+}
+
+
+/*!	Returns the index of the \a trigram in the sorted array, or the index
+	where it would need to be inserted, if it's not part of the set.
+*/
+int32
+TrigramSet::_IndexOf(const uint8* trigram, bool& _found) const
+{
+	int32 low = 0;
+	int32 high = fCount - 1;
+
+	while (low <= high) {
+		int32 middle = (low + high) / 2;
+		int compare = memcmp(fTrigrams[middle], trigram, kTrigramLength);
+		if (compare == 0) {
+			_found = true;
+			return middle;
+		}
+
+		if (compare < 0)
+			low = middle + 1;
+		else
+			high = middle - 1;
+	}
+
+	_found = false;
+	return low;
+}
+
+
+void
+TrigramSet::_Add(const uint8* trigram)
+{
+	if (fCount == MAX_INDEX_KEY_LENGTH)
+		return;
+
+	bool found;
+	int32 index = _IndexOf(trigram, found);
+	if (found)
+		return;
+
+	memmove(fTrigrams[index + 1], fTrigrams[index],
+		(fCount - index) * kTrigramLength);
+	memcpy(fTrigrams[index], trigram, kTrigramLength);
+	fCount++;
+}
+
+
+//	#pragma mark -
+
+
 Index::Index(Volume* volume)
 	:
 	fVolume(volume),
@@ -246,34 +451,37 @@ Index::Update(Transaction& transaction, const char* name, int32 type,
 	fVolume->UpdateLiveQueries(inode, name, type, oldKey, oldLength,
 		newKey, newLength);
 
+	if (type == B_STRING_TYPE && fVolume->HasTrigramIndices()) {
+		status_t status = _UpdateTrigrams(transaction, name, oldKey,
+			oldLength, newKey, newLength, inode);
+		if (status != B_OK && status != B_BAD_INDEX)
+			return status;
+	}
+
 	if (((name != fName || strcmp(name, fName)) && SetTo(name) != B_OK)
 		|| fNode == NULL)
 		return B_BAD_INDEX;
 
-	BPlusTree* tree = Node()->Tree();
-	if (tree == NULL)
+	if (Node()->Tree() == NULL)
 		return B_BAD_VALUE;
 
-	// remove the old key from the tree
+	// The tree is only changed when the transaction is done, see IndexCache;
+	// it stays locked until then.
 
 	Node()->WriteLockInTransaction(transaction);
 
+	IndexCache& cache = fVolume->GetIndexCache();
 	status_t status = B_OK;
 
 	if (oldKey != NULL) {
-		status = tree->Remove(transaction, (const uint8*)oldKey, oldLength,
+		status = cache.Remove(transaction, Node(), Type(), oldKey, oldLength,
 			inode->ID());
-		if (status == B_ENTRY_NOT_FOUND) {
-			// That's not nice, but no reason to let the whole thing fail
-			INFORM(("Could not find value in index \"%s\"!\n", name));
-		} else if (status != B_OK)
+		if (status != B_OK)
 			return status;
 	}
 
-	// add the new key to the tree
-
 	if (newKey != NULL) {
-		status = tree->Insert(transaction, (const uint8*)newKey, newLength,
+		status = cache.Insert(transaction, Node(), Type(), newKey, newLength,
 			inode->ID());
 	}
 
@@ -396,3 +604,311 @@ Index::UpdateLastModified(Transaction& transaction, Inode* inode,
 	return status;
 }
 
+
+
+/*!	Adds the names of all existing entries to this index, which must be
+	the trigram index of the "name" attribute.
+	Other trigram indices start out empty, like any other index, but since
+	all names are already in the "name" index, there is no reason not to
+	make them available to queries right away.
+	A new transaction is started every kTrigramBatchSize names, so that
+	large volumes don't overflow the log.
+*/
+status_t
+Index::AddExistingNames()
+{
+	if (fNode == NULL || fNode->Tree() == NULL)
+		return B_BAD_VALUE;
+
+	Index nameIndex(fVolume);
+	status_t status = nameIndex.SetTo("name");
+	if (status != B_OK)
+		return status == B_ENTRY_NOT_FOUND ? B_OK : status;
+
+	BPlusTree* nameTree = nameIndex.Node()->Tree();
+	if (nameTree == NULL)
+		return B_BAD_VALUE;
+
+	TrigramSet* trigrams = new(std::nothrow) TrigramSet;
+	if (trigrams == NULL)
+		return B_NO_MEMORY;
+
+	ObjectDeleter<TrigramSet> trigramsDeleter(trigrams);
+	TreeIterator iterator(nameTree);
+	BPlusTree* tree = fNode->Tree();
+	bool done = false;
+
+	while (!done) {
+		Transaction transaction(fVolume, fNode->BlockNumber());
+		fNode->WriteLockInTransaction(transaction);
+
+		for (int32 count = 0; count < kTrigramBatchSize; count++) {
+			char name[B_FILE_NAME_LENGTH];
+			uint16 length;
+			uint16 duplicate;
+			off_t id;
+			status = iterator.GetNextEntry(name, &length, sizeof(name), &id,
+				&duplicate);
+			if (status == B_ENTRY_NOT_FOUND) {
+				done = true;
+				break;
+			}
+			if (status != B_OK)
+				return status;
+
+			trigrams->SetTo((uint8*)name, length);
+
+			for (int32 i = 0; i < trigrams->CountTrigrams(); i++) {
+				status = tree->Insert(transaction, trigrams->TrigramAt(i),
+					kTrigramLength, id);
+				if (status != B_OK)
+					return status;
+			}
+		}
+
+		status = transaction.Done();
+		if (status != B_OK)
+			return status;
+	}
+
+	return B_OK;
+}
+
+
+static void
+sift_down(index_value** values, uint32 index, uint32 count, type_code type)
+{
+	while (true) {
+		uint32 child = 2 * index + 1;
+		if (child >= count)
+			return;
+
+		if (child + 1 < count && QueryParser::compareKeys(type,
+				values[child + 1]->key, values[child + 1]->length,
+				values[child]->key, values[child]->length) > 0) {
+			child++;
+		}
+		if (QueryParser::compareKeys(type, values[index]->key,
+				values[index]->length, values[child]->key,
+				values[child]->length) >= 0) {
+			return;
+		}
+
+		index_value* value = values[index];
+		values[index] = values[child];
+		values[child] = value;
+		index = child;
+	}
+}
+
+
+/*!	Adds the nodes in \a ids to this index, using the current value of the
+	attribute the index is named after; nodes without that attribute are
+	skipped. A node that is already in the index with that value is not
+	added again.
+	The values are sorted before they are inserted, so that the B+tree can
+	fill its nodes completely (see BPlusTree::InsertSorted()). This is meant
+	to add many nodes at once, like after creating an index for an attribute
+	that is already in use.
+	The "name", "size", and "last_modified" indices, as well as the trigram
+	indices, are maintained by the file system itself, and are refused.
+	The number of nodes that were added is returned in \a _added.
+*/
+status_t
+Index::AddNodes(const ino_t* ids, uint32 count, uint32& _added)
+{
+	_added = 0;
+
+	if (fNode == NULL || fNode->Tree() == NULL)
+		return B_BAD_VALUE;
+	if (!strcmp(fName, "name") || !strcmp(fName, "size")
+		|| !strcmp(fName, "last_modified") || IsTrigramIndex(fName))
+		return B_NOT_ALLOWED;
+
+	index_value* values = (index_value*)malloc(count * sizeof(index_value));
+	index_value** sorted = (index_value**)malloc(
+		count * sizeof(index_value*));
+	Vnode* vnodes = new(std::nothrow) Vnode[count];
+	MemoryDeleter valuesDeleter(values);
+	MemoryDeleter sortedDeleter(sorted);
+	ArrayDeleter<Vnode> vnodesDeleter(vnodes);
+	if (values == NULL || sorted == NULL || vnodes == NULL)
+		return B_NO_MEMORY;
+
+	// The vnodes are kept until the keys have been inserted, so that the
+	// inodes cannot go away in the mean time
+	uint32 valueCount = 0;
+	for (uint32 i = 0; i < count; i++) {
+		Vnode& vnode = vnodes[valueCount];
+		Inode* inode;
+		if (vnode.SetTo(fVolume, ids[i]) != B_OK
+			|| vnode.Get(&inode) != B_OK || !inode->IsRegularNode()) {
+			vnode.Unset();
+			continue;
+		}
+
+		index_value& value = values[valueCount];
+		size_t length = MAX_INDEX_KEY_LENGTH;
+		if (inode->ReadAttribute(fName, B_ANY_TYPE, 0, value.key, &length)
+				!= B_OK || length == 0) {
+			vnode.Unset();
+			continue;
+		}
+
+		value.inode = inode;
+		value.length = length;
+		sorted[valueCount++] = &value;
+	}
+
+	// heap sort the values by key
+
+	type_code type = Type();
+	for (uint32 index = valueCount / 2; index-- > 0;)
+		sift_down(sorted, index, valueCount, type);
+
+	for (uint32 last = valueCount; last-- > 1;) {
+		index_value* value = sorted[0];
+		sorted[0] = sorted[last];
+		sorted[last] = value;
+		sift_down(sorted, 0, last, type);
+	}
+
+	BPlusTree* tree = fNode->Tree();
+	uint32 index = 0;
+
+	while (index < valueCount) {
+		Transaction transaction(fVolume, fNode->BlockNumber());
+		fNode->WriteLockInTransaction(transaction);
+
+		uint32 end = min_c(index + kAddNodesBatchSize, valueCount);
+		for (; index < end; index++) {
+			const index_value& value = *sorted[index];
+
+			// The attribute may have been changed after it has been read,
+			// and then Index::Update() would not remove our key again.
+			// Since no other transaction can run now, the value cannot
+			// change until the key has been inserted.
+			if (!_AttributeHasValue(value.inode, value.key, value.length))
+				continue;
+
+			// don't add nodes to the index twice
+			status_t status = tree->Contains(value.key, value.length,
+				value.inode->ID());
+			if (status == B_OK)
+				continue;
+			if (status != B_ENTRY_NOT_FOUND)
+				return status;
+
+			status = tree->InsertSorted(transaction, value.key, value.length,
+				value.inode->ID());
+			if (status != B_OK)
+				return status;
+
+			_added++;
+		}
+
+		status_t status = transaction.Done();
+		if (status != B_OK)
+			return status;
+	}
+
+	return B_OK;
+}
+
+
+/*!	Returns whether the indexed attribute of the \a inode currently has the
+	given \a key.
+*/
+bool
+Index::_AttributeHasValue(Inode* inode, const uint8* key, uint16 length)
+{
+	uint8 buffer[MAX_INDEX_KEY_LENGTH];
+	size_t bufferLength = MAX_INDEX_KEY_LENGTH;
+	if (inode->ReadAttribute(fName, B_ANY_TYPE, 0, buffer, &bufferLength)
+			!= B_OK) {
+		return false;
+	}
+
+	return bufferLength == length && memcmp(buffer, key, length) == 0;
+}
+
+
+/*static*/ bool
+Index::IsTrigramIndex(const char* name)
+{
+	return !strncmp(name, BFS_TRIGRAM_INDEX_PREFIX,
+		strlen(BFS_TRIGRAM_INDEX_PREFIX));
+}
+
+
+/*static*/ status_t
+Index::GetTrigramIndexName(const char* attribute, char* buffer, size_t size)
+{
+	if (strlcpy(buffer, BFS_TRIGRAM_INDEX_PREFIX, size) >= size
+		|| strlcat(buffer, attribute, size) >= size)
+		return B_NAME_TOO_LONG;
+
+	return B_OK;
+}
+
+
+/*!	Updates the trigram index of the attribute \a name, if there is one.
+	Only the trigrams that are not part of both keys are touched.
+*/
+status_t
+Index::_UpdateTrigrams(Transaction& transaction, const char* name,
+	const uint8* oldKey, uint16 oldLength, const uint8* newKey,
+	uint16 newLength, Inode* inode)
+{
+	char indexName[B_FILE_NAME_LENGTH];
+	if (GetTrigramIndexName(name, indexName, sizeof(indexName)) != B_OK)
+		return B_BAD_INDEX;
+
+	Index index(fVolume);
+	if (index.SetTo(indexName) != B_OK)
+		return B_BAD_INDEX;
+
+	if (index.Node()->Tree() == NULL)
+		return B_BAD_VALUE;
+
+	TrigramSet* trigrams = new(std::nothrow) TrigramSet[2];
+	if (trigrams == NULL)
+		return B_NO_MEMORY;
+
+	ArrayDeleter<TrigramSet> trigramsDeleter(trigrams);
+	TrigramSet& oldTrigrams = trigrams[0];
+	TrigramSet& newTrigrams = trigrams[1];
+
+	if (oldKey != NULL)
+		oldTrigrams.SetTo(oldKey, oldLength);
+	if (newKey != NULL)
+		newTrigrams.SetTo(newKey, newLength);
+
+	index.Node()->WriteLockInTransaction(transaction);
+
+	IndexCache& cache = fVolume->GetIndexCache();
+
+	for (int32 i = 0; i < oldTrigrams.CountTrigrams(); i++) {
+		const uint8* trigram = oldTrigrams.TrigramAt(i);
+		if (newTrigrams.Contains(trigram))
+			continue;
+
+		status_t status = cache.Remove(transaction, index.Node(),
+			B_STRING_TYPE, trigram, kTrigramLength, inode->ID());
+		if (status != B_OK)
+			return status;
+	}
+
+	for (int32 i = 0; i < newTrigrams.CountTrigrams(); i++) {
+		const uint8* trigram = newTrigrams.TrigramAt(i);
+		if (oldTrigrams.Contains(trigram))
+			continue;
+
+		status_t status = cache.Insert(transaction, index.Node(),
+			B_STRING_TYPE, trigram, kTrigramLength, inode->ID());
+		if (status != B_OK)
+			return status;
+	}
+
+	return B_OK;
+}
@@ -8,12 +8,43 @@
 
 #include "system_dependencies.h"
 
+#include "bfs.h"
+
 
 class Transaction;
 class Volume;
 class Inode;
 
 
+static const int32 kTrigramLength = 3;
+
+
+/*!	The distinct trigrams of a string value, as they are stored in a trigram
+	index. ASCII letters are folded to lower case, so that the index can be
+	used for case insensitive matches, too.
+*/
+class TrigramSet {
+public:
+							TrigramSet();
+
+			void			SetTo(const uint8* value, uint16 length);
+			void			SetToPattern(const char* pattern);
+
+			int32			CountTrigrams() const { return fCount; }
+			const uint8*	TrigramAt(int32 index) const
+								{ return fTrigrams[index]; }
+			bool			Contains(const uint8* trigram) const;
+
+private:
+			int32			_IndexOf(const uint8* trigram, bool& _found) const;
+			void			_Add(const uint8* trigram);
+
+private:
+			int32			fCount;
+			uint8			fTrigrams[MAX_INDEX_KEY_LENGTH][kTrigramLength];
+};
+
+
 class Index {
 public:
 							Index(Volume* volume);
@@ -53,11 +84,26 @@ public:
 			status_t		UpdateLastModified(Transaction& transaction,
 								Inode* inode, bigtime_t modified = -1);
 
+			status_t		AddExistingNames();
+			status_t		AddNodes(const ino_t* ids, uint32 count,
+								uint32& _added);
+
+	static	bool			IsTrigramIndex(const char* name);
+	static	status_t		GetTrigramIndexName(const char* attribute,
+								char* buffer, size_t size);
+
 private:
 							Index(const Index& other);
 							Index& operator=(const Index& other);
 								// no implementation
 
+			bool			_AttributeHasValue(Inode* inode,
+								const uint8* key, uint16 length);
+			status_t		_UpdateTrigrams(Transaction& transaction,
+								const char* name, const uint8* oldKey,
+								uint16 oldLength, const uint8* newKey,
+								uint16 newLength, Inode* inode);
+
 private:
 			Volume*			fVolume;
 			Inode*			fNode;
@@ -0,0 +1,303 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * This file may be used under the terms of the MIT License.
+ */
+
+
+//! Collects the index changes of a transaction
+
+
+#include "IndexCache.h"
+
+#include <file_systems/QueryParserUtils.h>
+
+#include "BPlusTree.h"
+#include "Debug.h"
+#include "Inode.h"
+#include "Journal.h"
+
+
+// Instead of changing the B+trees of the indices for every single attribute
+// update, Index::Update() only records the change here. The changes are
+// applied when the transaction is done, sorted by key, so that each B+tree
+// node is only visited once for all keys it contains, and changes that undo
+// each other (like the "last_modified" value of a file that is changed
+// several times) never touch the tree at all.
+//
+// The index nodes stay write locked in the transaction until the changes
+// have been applied. Queries read the trees under a read lock, so they wait
+// for the transaction to finish, and always see all of its changes, just
+// like before.
+//
+// All access is protected by the journal lock, as only the thread owning the
+// current transaction may change the cache.
+
+static const int32 kMaxDeltas = 1024;
+	// when more changes are pending, they are applied right away
+
+
+IndexCache::IndexCache(Volume* volume)
+	:
+	fVolume(volume),
+	fDeltas(NULL),
+	fCount(0),
+	fCapacity(0)
+{
+}
+
+
+IndexCache::~IndexCache()
+{
+	_RemoveRange(0, fCount);
+	free(fDeltas);
+}
+
+
+/*!	Records that \a key with \a id is to be inserted into the \a index. */
+status_t
+IndexCache::Insert(Transaction& transaction, Inode* index, type_code type,
+	const uint8* key, uint16 length, off_t id)
+{
+	return _Add(transaction, index, type, key, length, id, 1);
+}
+
+
+/*!	Records that \a key with \a id is to be removed from the \a index. */
+status_t
+IndexCache::Remove(Transaction& transaction, Inode* index, type_code type,
+	const uint8* key, uint16 length, off_t id)
+{
+	return _Add(transaction, index, type, key, length, id, -1);
+}
+
+
+/*!	Applies all changes of the current transaction to the index B+trees.
+	The keys are removed first, so that their space can be reused by the
+	keys that are inserted.
+	All changes of the transaction are gone afterwards, even if applying
+	them failed; the transaction must be aborted in this case.
+*/
+status_t
+IndexCache::Flush(Transaction& transaction)
+{
+	int32 first, last;
+	_GetRange(_Owner(transaction), first, last);
+
+	status_t status = B_OK;
+	for (int32 i = first; i < last && status == B_OK; i++) {
+		if (fDeltas[i]->count < 0)
+			status = _Apply(transaction, *fDeltas[i]);
+	}
+	for (int32 i = first; i < last && status == B_OK; i++) {
+		if (fDeltas[i]->count > 0)
+			status = _Apply(transaction, *fDeltas[i]);
+	}
+
+	_RemoveRange(first, last);
+	return status;
+}
+
+
+/*!	Forgets about the changes of the current transaction, as it has been
+	aborted.
+*/
+void
+IndexCache::Drop(Transaction& transaction)
+{
+	int32 first, last;
+	_GetRange(_Owner(transaction), first, last);
+	_RemoveRange(first, last);
+}
+
+
+status_t
+IndexCache::_Add(Transaction& transaction, Inode* index, type_code type,
+	const uint8* key, uint16 length, off_t id, int32 count)
+{
+	if (length > MAX_INDEX_KEY_LENGTH)
+		return B_BAD_VALUE;
+
+	Transaction* owner = _Owner(transaction);
+	bool found;
+	int32 position = _Find(owner, index, type, key, length, id, found);
+	if (found) {
+		fDeltas[position]->count += count;
+		if (fDeltas[position]->count == 0)
+			_RemoveRange(position, position + 1);
+		return B_OK;
+	}
+
+	if (fCount >= kMaxDeltas) {
+		status_t status = Flush(transaction);
+		if (status != B_OK)
+			return status;
+
+		position = _Find(owner, index, type, key, length, id, found);
+	}
+
+	index_delta* delta = NULL;
+	if (fCount < kMaxDeltas)
+		delta = (index_delta*)malloc(sizeof(index_delta));
+
+	if (delta != NULL && fCount == fCapacity) {
+		int32 capacity = max_c(64, fCapacity * 2);
+		index_delta** deltas = (index_delta**)realloc(fDeltas,
+			capacity * sizeof(index_delta*));
+		if (deltas != NULL) {
+			fDeltas = deltas;
+			fCapacity = capacity;
+		} else {
+			free(delta);
+			delta = NULL;
+		}
+	}
+
+	if (delta == NULL) {
+		// there are no pending changes for this key, so it can also be
+		// changed in the tree directly
+		index_delta direct;
+		direct.index = index;
+		direct.id = id;
+		direct.count = count;
+		direct.length = length;
+		memcpy(direct.key, key, length);
+		return _Apply(transaction, direct);
+	}
+
+	delta->owner = owner;
+	delta->index = index;
+	delta->id = id;
+	delta->count = count;
+	delta->type = type;
+	delta->length = length;
+	memcpy(delta->key, key, length);
+
+	memmove(&fDeltas[position + 1], &fDeltas[position],
+		(fCount - position) * sizeof(index_delta*));
+	fDeltas[position] = delta;
+	fCount++;
+	return B_OK;
+}
+
+
+int32
+IndexCache::_Compare(const index_delta& delta, Transaction* owner,
+	Inode* index, type_code type, const uint8* key, uint16 length,
+	off_t id) const
+{
+	if (delta.owner != owner)
+		return (addr_t)delta.owner < (addr_t)owner ? -1 : 1;
+	if (delta.index != index)
+		return delta.index->ID() < index->ID() ? -1 : 1;
+
+	int32 compare = QueryParser::compareKeys(type, delta.key, delta.length,
+		key, length);
+	if (compare != 0)
+		return compare;
+
+	if (delta.id != id)
+		return delta.id < id ? -1 : 1;
+
+	return 0;
+}
+
+
+/*!	Returns the position of the given delta, or where it would have to be
+	inserted, if it doesn't exist yet.
+*/
+int32
+IndexCache::_Find(Transaction* owner, Inode* index, type_code type,
+	const uint8* key, uint16 length, off_t id, bool& _found) const
+{
+	int32 first = 0;
+	int32 last = fCount;
+
+	while (first < last) {
+		int32 middle = (first + last) / 2;
+		int32 compare = _Compare(*fDeltas[middle], owner, index, type, key,
+			length, id);
+		if (compare == 0) {
+			_found = true;
+			return middle;
+		}
+		if (compare < 0)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	_found = false;
+	return first;
+}
+
+
+void
+IndexCache::_GetRange(Transaction* owner, int32& _first, int32& _last) const
+{
+	int32 first = 0;
+	int32 last = fCount;
+	while (first < last) {
+		int32 middle = (first + last) / 2;
+		if ((addr_t)fDeltas[middle]->owner < (addr_t)owner)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	_first = first;
+	_last = first;
+	while (_last < fCount && fDeltas[_last]->owner == owner)
+		_last++;
+}
+
+
+void
+IndexCache::_RemoveRange(int32 first, int32 last)
+{
+	for (int32 i = first; i < last; i++)
+		free(fDeltas[i]);
+
+	memmove(&fDeltas[first], &fDeltas[last],
+		(fCount - last) * sizeof(index_delta*));
+	fCount -= last - first;
+}
+
+
+status_t
+IndexCache::_Apply(Transaction& transaction, const index_delta& delta)
+{
+	BPlusTree* tree = delta.index->Tree();
+	if (tree == NULL)
+		return B_BAD_VALUE;
+
+	for (int32 i = delta.count; i < 0; i++) {
+		status_t status = tree->Remove(transaction, delta.key, delta.length,
+			delta.id);
+		if (status == B_ENTRY_NOT_FOUND) {
+			// That's not nice, but no reason to let the whole thing fail
+			INFORM(("Could not find value in index %" B_PRIdINO "!\n",
+				delta.index->ID()));
+		} else if (status != B_OK)
+			RETURN_ERROR(status);
+	}
+
+	for (int32 i = 0; i < delta.count; i++) {
+		status_t status = tree->Insert(transaction, delta.key, delta.length,
+			delta.id);
+		if (status != B_OK)
+			RETURN_ERROR(status);
+	}
+
+	return B_OK;
+}
+
+
+/*!	Nested transactions are part of the transaction that owns the journal,
+	and their changes are only applied when that one is done.
+*/
+Transaction*
+IndexCache::_Owner(Transaction& transaction) const
+{
+	Transaction* owner = fVolume->GetJournal(0)->CurrentTransaction();
+	return owner != NULL ? owner : &transaction;
+}
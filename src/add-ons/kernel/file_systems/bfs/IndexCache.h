@@ -0,0 +1,75 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * This file may be used under the terms of the MIT License.
+ */
+#ifndef INDEX_CACHE_H
+#define INDEX_CACHE_H
+
+
+#include "system_dependencies.h"
+
+#include "bfs.h"
+
+
+class Inode;
+class Transaction;
+class Volume;
+
+
+struct index_delta {
+	Transaction*	owner;
+	Inode*			index;
+	off_t			id;
+	int32			count;
+		// the number of times the key is inserted, negative if it's removed
+	type_code		type;
+	uint16			length;
+	uint8			key[MAX_INDEX_KEY_LENGTH];
+};
+
+
+class IndexCache {
+public:
+							IndexCache(Volume* volume);
+							~IndexCache();
+
+			status_t		Insert(Transaction& transaction, Inode* index,
+								type_code type, const uint8* key,
+								uint16 length, off_t id);
+			status_t		Remove(Transaction& transaction, Inode* index,
+								type_code type, const uint8* key,
+								uint16 length, off_t id);
+
+			status_t		Flush(Transaction& transaction);
+			void			Drop(Transaction& transaction);
+
+			int32			CountDeltas() const { return fCount; }
+
+private:
+			status_t		_Add(Transaction& transaction, Inode* index,
+								type_code type, const uint8* key,
+								uint16 length, off_t id, int32 count);
+			int32			_Compare(const index_delta& delta,
+								Transaction* owner, Inode* index,
+								type_code type, const uint8* key,
+								uint16 length, off_t id) const;
+			int32			_Find(Transaction* owner, Inode* index,
+								type_code type, const uint8* key,
+								uint16 length, off_t id, bool& _found) const;
+			void			_GetRange(Transaction* owner, int32& _first,
+								int32& _last) const;
+			void			_RemoveRange(int32 first, int32 last);
+			status_t		_Apply(Transaction& transaction,
+								const index_delta& delta);
+			Transaction*	_Owner(Transaction& transaction) const;
+
+private:
+			Volume*			fVolume;
+			index_delta**	fDeltas;
+				// sorted by owner, index, key, and ID
+			int32			fCount;
+			int32			fCapacity;
+};
+
+
+#endif	// INDEX_CACHE_H
@@ -10,6 +10,7 @@
 #include "Debug.h"
 #include "Inode.h"
 #include "BPlusTree.h"
+#include "Checksum.h"
 #include "Index.h"
 
 
@@ -134,6 +135,14 @@ private:
 #endif
 
 
+static const bigtime_t kTransactionTimeout = 100000;
+	// how long the page writer tries to get hold of the journal to allocate
+	// the blocks for a file that delayed its allocation, or to write back
+	// the data of a file that is stored in its inode
+
+static const char kInlineDataName[] = {INLINE_DATA_NAME, '\0'};
+
+
 /*!	A helper class used by Inode::Create() to keep track of the belongings
 	of an inode creation in progress.
 	This class will make sure everything is cleaned up properly.
@@ -334,6 +343,93 @@ bfs_inode::InitCheck(Volume* volume) const
 }
 
 
+/*!	Returns the checksum of the whole inode block, without its checksum
+	field.
+*/
+uint32
+bfs_inode::CalculateChecksum(Volume* volume) const
+{
+	const uint8* start = (const uint8*)this;
+	const size_t offset = offsetof(bfs_inode, checksum);
+	const size_t end = offset + sizeof(checksum);
+
+	uint32 crc = crc32c(0, start, offset);
+	return crc32c(crc, start + end, volume->InodeSize() - end);
+}
+
+
+//	#pragma mark - NodeGetter
+
+
+status_t
+NodeGetter::SetTo(const Inode* inode)
+{
+	Unset();
+
+	status_t status = CachedBlock::SetTo(fVolume->VnodeToBlock(inode->ID()));
+	if (status != B_OK)
+		return status;
+
+	if (fVolume->HasChecksums() && !fVolume->IsChecksumValid(fBlockNumber,
+			Node()->Checksum(), Node()->CalculateChecksum(fVolume))) {
+		return B_BAD_DATA;
+	}
+
+	return B_OK;
+}
+
+
+status_t
+NodeGetter::SetToWritable(Transaction& transaction, const Inode* inode,
+	bool empty)
+{
+	Unset();
+
+	status_t status = CachedBlock::SetToWritable(transaction,
+		fVolume->VnodeToBlock(inode->ID()), empty);
+	if (status != B_OK)
+		return status;
+
+	// The checksum will be updated in any case, so it must not hide any
+	// corruption that was there before
+	if (!empty && fVolume->HasChecksums()
+		&& !fVolume->IsChecksumValid(fBlockNumber, Node()->Checksum(),
+			Node()->CalculateChecksum(fVolume))) {
+		return B_BAD_DATA;
+	}
+
+	fWritable = true;
+	return B_OK;
+}
+
+
+status_t
+NodeGetter::MakeWritable(Transaction& transaction)
+{
+	status_t status = CachedBlock::MakeWritable(transaction);
+	if (status == B_OK)
+		fWritable = true;
+
+	return status;
+}
+
+
+/*!	Releases the inode block; if it might have been changed, its checksum is
+	updated first.
+*/
+void
+NodeGetter::Unset()
+{
+	if (fWritable && fBlock != NULL && fVolume->HasChecksums()) {
+		WritableNode()->checksum = HOST_ENDIAN_TO_BFS_INT32(
+			Node()->CalculateChecksum(fVolume));
+	}
+
+	fWritable = false;
+	CachedBlock::Unset();
+}
+
+
 //	#pragma mark - Inode
 
 
@@ -344,7 +440,9 @@ Inode::Inode(Volume* volume, ino_t id)
 	fTree(NULL),
 	fAttributes(NULL),
 	fCache(NULL),
-	fMap(NULL)
+	fMap(NULL),
+	fDelayedSize(0),
+	fReservedBlocks(0)
 {
 	PRINT(("Inode::Inode(volume = %p, id = %" B_PRIdINO ") @ %p\n",
 		volume, id, this));
@@ -354,6 +452,8 @@ Inode::Inode(Volume* volume, ino_t id)
 
 	if (UpdateNodeFromDisk() != B_OK) {
 		// TODO: the error code gets eaten
+		memset(&fNode, 0, sizeof(bfs_inode));
+			// lets InitCheck() fail
 		return;
 	}
 
@@ -378,7 +478,9 @@ Inode::Inode(Volume* volume, Transaction& transaction, ino_t id, mode_t mode,
 	fTree(NULL),
 	fAttributes(NULL),
 	fCache(NULL),
-	fMap(NULL)
+	fMap(NULL),
+	fDelayedSize(0),
+	fReservedBlocks(0)
 {
 	PRINT(("Inode::Inode(volume = %p, transaction = %p, id = %" B_PRIdINO
 		") @ %p\n", volume, &transaction, id, this));
@@ -424,6 +526,9 @@ Inode::~Inode()
 	file_map_delete(Map());
 	delete fTree;
 
+	if (fReservedBlocks != 0)
+		fVolume->UnreserveBlocks(fReservedBlocks);
+
 	rw_lock_destroy(&fLock);
 	recursive_lock_destroy(&fSmallDataLock);
 }
@@ -568,7 +673,9 @@ Inode::_MakeSpaceForSmallData(Transaction& transaction, bfs_inode* node,
 		int32 index = 0, maxIndex = 0;
 		for (; !item->IsLast(node); item = item->Next(), index++) {
 			// should not remove those
-			if (*item->Name() == FILE_NAME_NAME || !strcmp(name, item->Name()))
+			if (*item->Name() == FILE_NAME_NAME
+				|| *item->Name() == INLINE_DATA_NAME
+				|| !strcmp(name, item->Name()))
 				continue;
 
 			if (max == NULL || max->Size() < item->Size()) {
@@ -1265,6 +1372,10 @@ Inode::WriteAttribute(Transaction& transaction, const char* name, int32 type,
 status_t
 Inode::RemoveAttribute(Transaction& transaction, const char* name)
 {
+	// the file data of an inline file is not an attribute
+	if (!strcmp(name, kInlineDataName))
+		return B_NOT_ALLOWED;
+
 	Index index(fVolume);
 	bool hasIndex = index.SetTo(name) == B_OK;
 	NodeGetter node(fVolume);
@@ -1601,42 +1712,63 @@ Inode::WriteAt(Transaction& transaction, off_t pos, const uint8* buffer,
 
 	locker.Unlock();
 
-	// the transaction doesn't have to be started already
-	if (changeSize && !transaction.IsStarted())
-		transaction.Start(fVolume, BlockNumber());
+	WriteLocker writeLocker;
+	off_t oldSize = -1;
 
-	WriteLocker writeLocker(fLock);
+	if (changeSize && _CanDelayAllocation()) {
+		// Only grow the file in memory: the blocks are allocated for all
+		// of it at once when its pages are written back, or when it's closed
+		writeLocker.SetTo(fLock, false);
 
-	// Work around possible race condition: Someone might have shrunken the file
-	// while we had no lock.
-	if (!transaction.IsStarted()
-		&& (uint64)pos + (uint64)length > (uint64)Size()) {
-		writeLocker.Unlock();
-		transaction.Start(fVolume, BlockNumber());
-		writeLocker.Lock();
+		oldSize = Size();
+		if ((uint64)pos + (uint64)length > (uint64)oldSize
+			&& (IsInline() || _DelayAllocation(pos + length) != B_OK)) {
+			// There is not enough space left to reserve the blocks, or the
+			// data has been moved into the inode in the mean time; let the
+			// regular path below deal with it
+			writeLocker.Unlock();
+			oldSize = -1;
+		}
 	}
 
-	off_t oldSize = Size();
+	if (oldSize < 0) {
+		// the transaction doesn't have to be started already
+		if (changeSize && !transaction.IsStarted())
+			transaction.Start(fVolume, BlockNumber());
 
-	if ((uint64)pos + (uint64)length > (uint64)oldSize) {
-		// let's grow the data stream to the size needed
-		status_t status = SetFileSize(transaction, pos + length);
-		if (status != B_OK) {
-			*_length = 0;
-			WriteLockInTransaction(transaction);
-			RETURN_ERROR(status);
+		writeLocker.SetTo(fLock, false);
+
+		// Work around possible race condition: Someone might have shrunken
+		// the file while we had no lock.
+		if (!transaction.IsStarted()
+			&& (uint64)pos + (uint64)length > (uint64)Size()) {
+			writeLocker.Unlock();
+			transaction.Start(fVolume, BlockNumber());
+			writeLocker.Lock();
 		}
-		// TODO: In theory we would need to update the file size
-		// index here as part of the current transaction - this might just
-		// be a bit too expensive, but worth a try.
 
-		// we need to write back the inode here because it has to
-		// go into this transaction (we cannot wait until the file
-		// is closed)
-		status = WriteBack(transaction);
-		if (status != B_OK) {
-			WriteLockInTransaction(transaction);
-			return status;
+		oldSize = Size();
+
+		if ((uint64)pos + (uint64)length > (uint64)oldSize) {
+			// let's grow the data stream to the size needed
+			status_t status = SetFileSize(transaction, pos + length);
+			if (status != B_OK) {
+				*_length = 0;
+				WriteLockInTransaction(transaction);
+				RETURN_ERROR(status);
+			}
+			// TODO: In theory we would need to update the file size
+			// index here as part of the current transaction - this might
+			// just be a bit too expensive, but worth a try.
+
+			// we need to write back the inode here because it has to
+			// go into this transaction (we cannot wait until the file
+			// is closed)
+			status = WriteBack(transaction);
+			if (status != B_OK) {
+				WriteLockInTransaction(transaction);
+				return status;
+			}
 		}
 	}
 
@@ -1686,6 +1818,308 @@ Inode::FillGapWithZeros(off_t pos, off_t newSize)
 }
 
 
+/*!	Reads the data of a file that is stored in its inode (see IsInline()),
+	and is used to fill the file cache for it. Like ReadAt(), this does not
+	read beyond the end of the file, and sets \a _length to the number of
+	bytes read; \a buffer must be a kernel buffer.
+	The inode must be at least read locked.
+*/
+status_t
+Inode::ReadInlineData(off_t pos, uint8* buffer, size_t* _length)
+{
+	if (!IsInline() || pos < 0)
+		return B_BAD_VALUE;
+
+	off_t size = Size();
+	size_t length = *_length;
+	if (pos >= size) {
+		*_length = 0;
+		return B_OK;
+	}
+	if ((uint64)pos + length > (uint64)size)
+		length = size - pos;
+
+	NodeGetter node(fVolume);
+	status_t status = node.SetTo(this);
+	if (status != B_OK)
+		return status;
+
+	RecursiveLocker locker(fSmallDataLock);
+
+	small_data* smallData = FindSmallData(node.Node(), kInlineDataName);
+	if (smallData == NULL || smallData->DataSize() != size)
+		RETURN_ERROR(B_BAD_DATA);
+
+	memcpy(buffer, smallData->Data() + pos, length);
+	*_length = length;
+	return B_OK;
+}
+
+
+/*!	Writes back the data of a file that is stored in its inode, coming from
+	the file cache. Anything beyond the end of the file is ignored.
+	The inode must be write locked in \a transaction.
+*/
+status_t
+Inode::WriteInlineData(Transaction& transaction, off_t pos,
+	const uint8* buffer, size_t length)
+{
+	if (!IsInline() || pos < 0)
+		return B_BAD_VALUE;
+
+	off_t size = Size();
+	if (pos >= size)
+		return B_OK;
+	if ((uint64)pos + length > (uint64)size)
+		length = size - pos;
+
+	NodeGetter node(fVolume);
+	status_t status = node.SetToWritable(transaction, this);
+	if (status != B_OK)
+		return status;
+
+	RecursiveLocker locker(fSmallDataLock);
+
+	small_data* smallData = FindSmallData(node.WritableNode(),
+		kInlineDataName);
+	if (smallData == NULL || smallData->DataSize() != size)
+		RETURN_ERROR(B_BAD_DATA);
+
+	memcpy(smallData->Data() + pos, buffer, length);
+	return B_OK;
+}
+
+
+/*!	Resizes the data of a file that is stored in its inode; the data of
+	a file that is not empty always has exactly the size of the file.
+	Returns \c B_DEVICE_FULL if there is not enough space left for it in
+	the small_data section.
+	The inode must be write locked in \a transaction.
+*/
+status_t
+Inode::_SetInlineDataSize(Transaction& transaction, off_t size)
+{
+	off_t oldSize = Size();
+
+	NodeGetter node(fVolume);
+	status_t status = node.SetToWritable(transaction, this);
+	if (status != B_OK)
+		return status;
+
+	if (size == 0) {
+		if (oldSize > 0) {
+			status = _RemoveSmallData(transaction, node, kInlineDataName);
+			if (status != B_OK)
+				return status;
+		}
+	} else {
+		uint8* buffer = (uint8*)malloc(size);
+		if (buffer == NULL)
+			return B_NO_MEMORY;
+
+		MemoryDeleter bufferDeleter(buffer);
+		memset(buffer, 0, size);
+
+		if (oldSize > 0) {
+			size_t length = min_c(oldSize, size);
+			status = ReadInlineData(0, buffer, &length);
+			if (status != B_OK)
+				return status;
+		}
+
+		status = _AddSmallData(transaction, node, kInlineDataName,
+			INLINE_DATA_TYPE, 0, buffer, size);
+		if (status != B_OK)
+			return status;
+	}
+
+	Node().data.size = HOST_ENDIAN_TO_BFS_INT64(size);
+	return B_OK;
+}
+
+
+/*!	Moves the data of a small file from its data stream into its inode, if
+	there is enough space left in the small_data section for it.
+	The data is taken from the disk; pages of the file cache that are still
+	modified will be written to the inode when they are written back.
+	The inode must be write locked in \a transaction.
+*/
+status_t
+Inode::MoveDataToInode(Transaction& transaction)
+{
+	if (IsInline())
+		return B_OK;
+	if (!IsFile())
+		return B_BAD_TYPE;
+	if (HasDelayedAllocation())
+		return B_BUSY;
+
+	off_t size = Size();
+	if (size > fVolume->MaxInlineDataSize())
+		return B_DEVICE_FULL;
+
+	status_t status;
+
+	if (size > 0) {
+		uint32 blockSize = fVolume->BlockSize();
+		uint8* buffer = (uint8*)malloc(blockSize);
+		if (buffer == NULL)
+			return B_NO_MEMORY;
+
+		MemoryDeleter bufferDeleter(buffer);
+
+		block_run run;
+		off_t offset;
+		status = FindBlockRun(0, run, offset);
+		if (status != B_OK)
+			return status;
+
+		if (read_pos(fVolume->Device(), fVolume->ToOffset(run), buffer,
+				blockSize) != (ssize_t)blockSize)
+			return B_IO_ERROR;
+
+		NodeGetter node(fVolume);
+		status = node.SetToWritable(transaction, this);
+		if (status != B_OK)
+			return status;
+
+		status = _AddSmallData(transaction, node, kInlineDataName,
+			INLINE_DATA_TYPE, 0, buffer, size);
+		if (status != B_OK)
+			return status;
+	}
+
+	status = _ShrinkStream(transaction, 0);
+	if (status != B_OK)
+		return status;
+
+	Node().flags |= HOST_ENDIAN_TO_BFS_INT32(INODE_INLINE_DATA);
+	Node().data.size = HOST_ENDIAN_TO_BFS_INT64(size);
+
+	file_map_invalidate(Map(), 0, -1);
+	return WriteBack(transaction);
+}
+
+
+/*!	Moves the data of a file that is stored in its inode into a regular data
+	stream. The data is written to its new block right away, as the file
+	cache might only have clean pages for it.
+	The inode must be write locked in \a transaction.
+*/
+status_t
+Inode::MoveDataToStream(Transaction& transaction)
+{
+	if (!IsInline())
+		return B_OK;
+
+	off_t size = Size();
+	uint32 blockSize = fVolume->BlockSize();
+
+	uint8* buffer = (uint8*)malloc(blockSize);
+	if (buffer == NULL)
+		return B_NO_MEMORY;
+
+	MemoryDeleter bufferDeleter(buffer);
+	memset(buffer, 0, blockSize);
+
+	status_t status;
+
+	if (size > 0) {
+		size_t length = size;
+		status = ReadInlineData(0, buffer, &length);
+		if (status != B_OK)
+			return status;
+
+		NodeGetter node(fVolume);
+		status = node.SetToWritable(transaction, this);
+		if (status != B_OK)
+			return status;
+
+		status = _RemoveSmallData(transaction, node, kInlineDataName);
+		if (status != B_OK)
+			return status;
+	}
+
+	Node().flags &= ~HOST_ENDIAN_TO_BFS_INT32(INODE_INLINE_DATA);
+	Node().data.size = 0;
+
+	if (size > 0) {
+		status = _GrowStream(transaction, size);
+		if (status != B_OK)
+			return status;
+
+		block_run run;
+		off_t offset;
+		status = FindBlockRun(0, run, offset);
+		if (status != B_OK)
+			return status;
+
+		if (write_pos(fVolume->Device(), fVolume->ToOffset(run), buffer,
+				blockSize) != (ssize_t)blockSize)
+			return B_IO_ERROR;
+	}
+
+	file_map_invalidate(Map(), 0, -1);
+	return WriteBack(transaction);
+}
+
+
+//!	Like CountExtents(), but doesn't lock the inode
+status_t
+Inode::_CountExtents(uint64& _runs, uint64& _extents, uint64& _blocks)
+{
+	_runs = 0;
+	_extents = 0;
+	_blocks = 0;
+
+	off_t size = StreamSize();
+	off_t pos = 0;
+	off_t nextBlock = -1;
+
+	while (pos < size) {
+		block_run run;
+		off_t offset;
+		status_t status = FindBlockRun(pos, run, offset);
+		if (status != B_OK)
+			return status;
+
+		off_t block = fVolume->ToBlock(run);
+		if (block != nextBlock)
+			_extents++;
+
+		_runs++;
+		_blocks += run.Length();
+		nextBlock = block + run.Length();
+		pos = offset + ((off_t)run.Length() << fVolume->BlockShift());
+	}
+
+	return B_OK;
+}
+
+
+/*!	Allocates up to \a numBlocks blocks for the inode's data stream. If
+	the inode has reserved blocks for a delayed allocation, those are used
+	first.
+*/
+status_t
+Inode::_Allocate(Transaction& transaction, off_t numBlocks, block_run& run,
+	uint16 minimum)
+{
+	status_t status = fVolume->Allocate(transaction, this, numBlocks, run,
+		minimum);
+	if (status != B_OK)
+		return status;
+
+	// the blocks are in use now, they don't need to be reserved anymore
+	off_t used = min_c(fReservedBlocks, (off_t)run.Length());
+	if (used > 0) {
+		fVolume->UnreserveBlocks(used);
+		fReservedBlocks -= used;
+	}
+	return B_OK;
+}
+
+
 /*!	Allocates \a length blocks, and clears their contents. Growing
 	the indirect and double indirect range uses this method.
 	The allocated block_run is saved in "run"
@@ -1697,7 +2131,7 @@ Inode::_AllocateBlockArray(Transaction& transaction, block_run& run,
 	if (!run.IsZero())
 		return B_BAD_VALUE;
 
-	status_t status = fVolume->Allocate(transaction, this, length, run,
+	status_t status = _Allocate(transaction, length, run,
 		variableSize ? 1 : length);
 	if (status != B_OK)
 		return status;
@@ -1752,10 +2186,12 @@ Inode::_GrowStream(Transaction& transaction, off_t size)
 			minimum = data->double_indirect.Length();
 	}
 
-	// do we have enough free blocks on the disk?
+	// do we have enough free blocks on the disk? (the blocks other files
+	// reserved for their delayed allocations are not ours to take)
+	off_t freeBlocks = fVolume->AvailableBlocks() + fReservedBlocks;
 	off_t blocksNeeded = (bytes + fVolume->BlockSize() - 1)
 		>> fVolume->BlockShift();
-	if (blocksNeeded > fVolume->FreeBlocks())
+	if (blocksNeeded > freeBlocks)
 		return B_DEVICE_FULL;
 
 	off_t blocksRequested = blocksNeeded;
@@ -1769,7 +2205,7 @@ Inode::_GrowStream(Transaction& transaction, off_t size)
 	// counterproductive.
 	// Also, if free disk space is tight, don't preallocate.
 	if (!IsAttribute() && !IsAttributeDirectory() && !IsSymLink()
-		&& fVolume->FreeBlocks() > 128) {
+		&& freeBlocks > 128) {
 		off_t roundTo = 0;
 		if (IsFile()) {
 			// Request preallocated blocks depending on the file size and growth
@@ -1809,8 +2245,8 @@ Inode::_GrowStream(Transaction& transaction, off_t size)
 		}
 
 		block_run run;
-		status_t status = fVolume->Allocate(transaction, this, blocksRequested,
-			run, minimum);
+		status_t status = _Allocate(transaction, blocksRequested, run,
+			minimum);
 		if (status != B_OK)
 			return status;
 
@@ -2266,6 +2702,80 @@ Inode::_ShrinkStream(Transaction& transaction, off_t size)
 }
 
 
+bool
+Inode::_CanDelayAllocation() const
+{
+#ifdef FS_SHELL
+	return false;
+#else
+	// Only the contents of regular files bypass the log, and are written
+	// back through the file cache
+	return IsFile() && (Flags() & (INODE_LOGGED | INODE_INLINE_DATA)) == 0
+		&& FileCache() != NULL;
+#endif
+}
+
+
+/*!	Grows the file to \a size in memory only. No blocks are allocated for
+	the new part of the file yet, but enough of them are reserved on the
+	volume so that no one else can take them away. Only the blocks needed
+	for indirect block arrays are not part of the reservation.
+	Until then, the file map reports that part of the file as sparse.
+	The inode must be write locked.
+*/
+status_t
+Inode::_DelayAllocation(off_t size)
+{
+	uint32 blockShift = fVolume->BlockShift();
+	off_t blockSize = fVolume->BlockSize();
+	off_t blocks = ((size + blockSize - 1) >> blockShift)
+		- ((StreamSize() + blockSize - 1) >> blockShift);
+
+	if (blocks > fReservedBlocks) {
+		status_t status = fVolume->ReserveBlocks(blocks - fReservedBlocks);
+		if (status != B_OK)
+			return status;
+
+		fReservedBlocks = blocks;
+	}
+
+	fDelayedSize = size;
+
+	file_cache_set_size(FileCache(), size);
+	file_map_set_size(Map(), size);
+	return B_OK;
+}
+
+
+/*!	Is called as soon as the data stream covers the whole file again.
+	\a oldSize is the size of the data stream before.
+*/
+void
+Inode::_DelayedAllocationDone(off_t oldSize)
+{
+	fVolume->UnreserveBlocks(fReservedBlocks);
+	fReservedBlocks = 0;
+	fDelayedSize = 0;
+
+	// the file map still has the new part cached as being sparse
+	file_map_invalidate(Map(), round_up(oldSize, fVolume->BlockSize()), -1);
+}
+
+
+/*!	Is called when growing the data stream of a file with a delayed
+	allocation failed, and the stream has been shrunk again. Reserves the
+	blocks that have been used up in the meantime again, so that the
+	allocation can be retried later.
+*/
+void
+Inode::_RestoreReservation(off_t reserved)
+{
+	if (fReservedBlocks < reserved
+		&& fVolume->ReserveBlocks(reserved - fReservedBlocks) == B_OK)
+		fReservedBlocks = reserved;
+}
+
+
 status_t
 Inode::SetFileSize(Transaction& transaction, off_t size)
 {
@@ -2279,14 +2789,39 @@ Inode::SetFileSize(Transaction& transaction, off_t size)
 
 	T(Resize(this, oldSize, size, false));
 
-	// should the data stream grow or shrink?
+	if (IsInline()) {
+		// The data stays in the inode as long as it fits, otherwise it's
+		// moved into the data stream, which is then resized as usual
+		if (size <= fVolume->MaxInlineDataSize()) {
+			status_t status = _SetInlineDataSize(transaction, size);
+			if (status != B_DEVICE_FULL) {
+				if (status != B_OK)
+					return status;
+
+				file_cache_set_size(FileCache(), size);
+				file_map_set_size(Map(), size);
+
+				return WriteBack(transaction);
+			}
+		}
+
+		status_t status = MoveDataToStream(transaction);
+		if (status != B_OK)
+			return status;
+	}
+
+	// should the data stream grow or shrink? (if the file has only been
+	// grown in memory so far, this settles that part, too)
+	off_t streamSize = StreamSize();
+	off_t reserved = fReservedBlocks;
 	status_t status;
-	if (size > oldSize) {
+	if (size > streamSize) {
 		status = _GrowStream(transaction, size);
 		if (status < B_OK) {
 			// if the growing of the stream fails, the whole operation
 			// fails, so we should shrink the stream to its former size
-			_ShrinkStream(transaction, oldSize);
+			_ShrinkStream(transaction, streamSize);
+			_RestoreReservation(reserved);
 		}
 	} else
 		status = _ShrinkStream(transaction, size);
@@ -2294,6 +2829,9 @@ Inode::SetFileSize(Transaction& transaction, off_t size)
 	if (status < B_OK)
 		return status;
 
+	if (HasDelayedAllocation())
+		_DelayedAllocationDone(streamSize);
+
 	file_cache_set_size(FileCache(), size);
 	file_map_set_size(Map(), size);
 
@@ -2319,7 +2857,9 @@ Inode::NeedsTrimming() const
 	// possible. There are only few indices anyway, so this doesn't hurt.
 	// Also, if an inode is already in deleted state, we don't bother trimming
 	// it.
-	if (IsIndex() || IsDeleted()
+	// Files that are still waiting for their blocks to be allocated will be
+	// trimmed once that happened.
+	if (IsIndex() || IsDeleted() || HasDelayedAllocation()
 		|| (IsSymLink() && (Flags() & INODE_LONG_SYMLINK) == 0))
 		return false;
 
@@ -2331,6 +2871,58 @@ Inode::NeedsTrimming() const
 }
 
 
+/*!	Allocates the blocks for the part of the file that has only been grown
+	in memory so far (see _DelayAllocation()). Since this covers everything
+	that has been written since the last allocation, the block allocator
+	usually finds a single contiguous block_run for it.
+	The inode must be write locked in \a transaction.
+*/
+status_t
+Inode::AllocateDelayedBlocks(Transaction& transaction)
+{
+	if (!HasDelayedAllocation())
+		return B_OK;
+
+	off_t oldSize = StreamSize();
+	off_t size = fDelayedSize;
+	off_t reserved = fReservedBlocks;
+
+	T(Resize(this, oldSize, size, false));
+
+	status_t status = _GrowStream(transaction, size);
+	if (status != B_OK) {
+		_ShrinkStream(transaction, oldSize);
+		_RestoreReservation(reserved);
+		return status;
+	}
+
+	fVolume->DelayedBlocksAllocated(reserved);
+	_DelayedAllocationDone(oldSize);
+
+	return WriteBack(transaction);
+}
+
+
+//!	Like the above, but starts its own transaction, see StartTransaction().
+status_t
+Inode::AllocateDelayedBlocks(bool wait)
+{
+	if (!HasDelayedAllocation())
+		return B_OK;
+
+	Transaction transaction;
+	status_t status = StartTransaction(transaction, wait);
+	if (status != B_OK)
+		return status;
+
+	status = AllocateDelayedBlocks(transaction);
+	if (status == B_OK)
+		status = transaction.Done();
+
+	return status;
+}
+
+
 status_t
 Inode::TrimPreallocation(Transaction& transaction)
 {
@@ -2345,6 +2937,218 @@ Inode::TrimPreallocation(Transaction& transaction)
 }
 
 
+/*!	Counts the block_runs of the data stream, and how many contiguous
+	extents they form on disk - runs that directly follow each other are
+	counted as a single extent.
+*/
+status_t
+Inode::CountExtents(uint64& _runs, uint64& _extents, uint64& _blocks)
+{
+	_runs = 0;
+	_extents = 0;
+	_blocks = 0;
+
+	if (IsSymLink() && (Flags() & INODE_LONG_SYMLINK) == 0)
+		return B_OK;
+
+	InodeReadLocker locker(this);
+
+	if (IsInline())
+		return B_OK;
+
+	return _CountExtents(_runs, _extents, _blocks);
+}
+
+
+/*!	Moves the data stream into as few contiguous runs as possible, if that
+	reduces the number of its extents. The stream of a directory is also
+	moved when it is not in the allocation group of its inode, which is where
+	its children are allocated, too.
+	\a _movedBlocks is set to the number of blocks moved, which is 0 if the
+	stream was left alone. Returns \c B_DEVICE_FULL if there is no better
+	place for it, and \c B_FILE_TOO_LARGE if it cannot be moved at once.
+	File data is copied on disk directly, so the file cache must have been
+	synchronized before.
+	The inode must be write locked in \a transaction.
+*/
+status_t
+Inode::Defragment(Transaction& transaction, off_t& _movedBlocks)
+{
+	_movedBlocks = 0;
+
+	if (IsInline() || (IsSymLink() && !IsLongSymLink()))
+		return B_OK;
+	if (HasDelayedAllocation())
+		return B_BUSY;
+
+	off_t size = StreamSize();
+	if (size == 0)
+		return B_OK;
+
+	uint64 runCount, extents, blocks;
+	status_t status = _CountExtents(runCount, extents, blocks);
+	if (status != B_OK)
+		return status;
+
+	uint32 blockShift = fVolume->BlockShift();
+	off_t numBlocks = (size + fVolume->BlockSize() - 1) >> blockShift;
+	int32 inodeGroup = BlockRun().AllocationGroup();
+
+	// B+tree nodes are accessed through the block cache, and are therefore
+	// copied in the transaction
+	bool logged = IsContainer();
+	if (logged && numBlocks > fVolume->Log().Length() / 4)
+		return B_FILE_TOO_LARGE;
+
+	block_run oldRun;
+	off_t offset;
+	status = FindBlockRun(0, oldRun, offset);
+	if (status != B_OK)
+		return status;
+
+	bool misplaced = IsContainer() && oldRun.AllocationGroup() != inodeGroup;
+	if (extents <= 1 && !misplaced)
+		return B_OK;
+
+	// Allocate the new stream using the same policy BlockAllocator::Allocate()
+	// uses for a new one, but only accept runs that cover the rest of it, or
+	// fill up an allocation group
+	block_run runs[NUM_DIRECT_BLOCKS];
+	int32 count = 0;
+	int32 group = inodeGroup;
+	uint16 start = 0;
+	if (IsContainer() || IsSymLink())
+		start = BlockRun().Start();
+	else
+		group++;
+
+	off_t maxLength = min_c(MAX_BLOCK_RUN_LENGTH,
+		1L << fVolume->AllocationGroupShift());
+	off_t blocksLeft = numBlocks;
+	uint64 newExtents = 0;
+	off_t nextBlock = -1;
+
+	while (blocksLeft > 0) {
+		if (count == NUM_DIRECT_BLOCKS) {
+			status = B_FILE_TOO_LARGE;
+			break;
+		}
+
+		uint16 length = min_c(blocksLeft, maxLength);
+		block_run& run = runs[count];
+		status = fVolume->Allocator().AllocateBlocks(transaction, group, start,
+			length, 1, run);
+		if (status != B_OK)
+			break;
+
+		count++;
+		if (run.Length() < length && run.Start() + run.Length()
+				< (1L << fVolume->AllocationGroupShift())) {
+			status = B_DEVICE_FULL;
+			break;
+		}
+
+		if (fVolume->ToBlock(run) != nextBlock)
+			newExtents++;
+
+		group = run.AllocationGroup();
+		start = run.Start() + run.Length();
+		nextBlock = fVolume->ToBlock(run) + run.Length();
+		blocksLeft -= run.Length();
+	}
+
+	if (status == B_OK && newExtents >= extents
+		&& (!misplaced || runs[0].AllocationGroup() != inodeGroup)) {
+		// this would not be any better
+		status = B_DEVICE_FULL;
+	}
+
+	// Copy the data over
+
+	uint32 bufferBlocks = logged ? 1 : max_c(1, 65536 >> blockShift);
+	uint8* buffer = NULL;
+	if (status == B_OK && !logged) {
+		buffer = (uint8*)malloc(bufferBlocks << blockShift);
+		if (buffer == NULL)
+			status = B_NO_MEMORY;
+	}
+
+	MemoryDeleter bufferDeleter(buffer);
+	int32 index = 0;
+	off_t runOffset = 0;
+	off_t pos = 0;
+
+	while (status == B_OK && pos < (numBlocks << blockShift)) {
+		status = FindBlockRun(pos, oldRun, offset);
+		if (status != B_OK)
+			break;
+
+		off_t oldBlock = fVolume->ToBlock(oldRun) + ((pos - offset)
+			>> blockShift);
+		off_t newBlock = fVolume->ToBlock(runs[index]) + runOffset;
+		off_t length = min_c(fVolume->ToBlock(oldRun) + oldRun.Length()
+			- oldBlock, runs[index].Length() - runOffset);
+		if (length > bufferBlocks)
+			length = bufferBlocks;
+
+		if (logged) {
+			CachedBlock source(fVolume);
+			CachedBlock target(fVolume);
+			status = source.SetTo(oldBlock);
+			if (status == B_OK)
+				status = target.SetToWritable(transaction, newBlock, true);
+			if (status == B_OK) {
+				memcpy(target.WritableBlock(), source.Block(),
+					fVolume->BlockSize());
+			}
+		} else {
+			size_t bytes = length << blockShift;
+			if (read_pos(fVolume->Device(), oldBlock << blockShift, buffer,
+					bytes) != (ssize_t)bytes
+				|| write_pos(fVolume->Device(), newBlock << blockShift, buffer,
+					bytes) != (ssize_t)bytes)
+				status = B_IO_ERROR;
+		}
+
+		pos += length << blockShift;
+		runOffset += length;
+		if (runOffset == runs[index].Length()) {
+			index++;
+			runOffset = 0;
+		}
+	}
+
+	if (status != B_OK) {
+		for (int32 i = 0; i < count; i++)
+			fVolume->Free(transaction, runs[i]);
+
+		return status;
+	}
+
+	// Replace the old stream with the new one
+
+	status = _ShrinkStream(transaction, 0);
+	if (status != B_OK)
+		return status;
+
+	data_stream& data = Node().data;
+	for (int32 i = 0; i < count; i++)
+		data.direct[i] = runs[i];
+
+	data.max_direct_range = HOST_ENDIAN_TO_BFS_INT64(numBlocks << blockShift);
+	data.size = HOST_ENDIAN_TO_BFS_INT64(size);
+
+	if (Map() != NULL)
+		file_map_invalidate(Map(), 0, -1);
+
+	status = WriteBack(transaction);
+	if (status == B_OK)
+		_movedBlocks = numBlocks;
+
+	return status;
+}
+
+
 //!	Frees the file's data stream and removes all attributes
 status_t
 Inode::Free(Transaction& transaction)
@@ -2382,12 +3186,43 @@ Inode::Free(Transaction& transaction)
 }
 
 
+/*!	Starts \a transaction, and write locks the inode in it. If \a wait is
+	\c false, this gives up with \c B_WOULD_BLOCK if the journal stays busy
+	for too long: the page writer must not wait for a transaction that might
+	in turn be waiting for the very pages it is writing.
+*/
+status_t
+Inode::StartTransaction(Transaction& transaction, bool wait)
+{
+	bigtime_t timeout = system_time() + kTransactionTimeout;
+	status_t status;
+
+	while (true) {
+		status = transaction.Start(fVolume, BlockNumber(), wait);
+		if (status != B_WOULD_BLOCK || system_time() >= timeout)
+			break;
+
+		snooze(5000);
+	}
+	if (status != B_OK)
+		return status;
+
+	WriteLockInTransaction(transaction);
+	return B_OK;
+}
+
+
 //!	Synchronizes (writes back to disk) the file stream of the inode.
 status_t
 Inode::Sync()
 {
-	if (FileCache())
+	if (FileCache()) {
+		status_t status = AllocateDelayedBlocks(true);
+		if (status != B_OK)
+			return status;
+
 		return file_cache_sync(FileCache());
+	}
 
 	// We may also want to flush the attribute's data stream to
 	// disk here... (do we?)
@@ -2742,6 +3577,11 @@ Inode::Create(Transaction& transaction, Inode* parent, const char* name,
 
 	node->type = HOST_ENDIAN_TO_BFS_INT32(type);
 
+	// new files start out with their data in the inode, if the volume
+	// wants that; it's moved into a data stream once it grows too large
+	if (volume->UsesInlineData() && inode->IsFile())
+		node->flags |= HOST_ENDIAN_TO_BFS_INT32(INODE_INLINE_DATA);
+
 	inode->WriteBack(transaction);
 		// make sure the initialized node is available to others
 
@@ -2895,8 +3735,10 @@ AttributeIterator::GetNext(char* name, size_t* _length, uint32* _type,
 
 		int32 index = 0;
 		for (; !item->IsLast(node); item = item->Next(), index++) {
-			if (item->NameSize() == FILE_NAME_NAME_LENGTH
-				&& *item->Name() == FILE_NAME_NAME)
+			if ((item->NameSize() == FILE_NAME_NAME_LENGTH
+					&& *item->Name() == FILE_NAME_NAME)
+				|| (item->NameSize() == INLINE_DATA_NAME_LENGTH
+					&& *item->Name() == INLINE_DATA_NAME))
 				continue;
 
 			if (index >= fCurrentSmallData)
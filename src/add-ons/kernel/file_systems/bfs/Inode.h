@@ -75,6 +75,11 @@ public:
 			bool				IsLongSymLink() const
 									{ return (Flags() & INODE_LONG_SYMLINK)
 										!= 0; }
+			bool				IsInline() const
+									{ return (Flags() & INODE_INLINE_DATA)
+										!= 0; }
+									// the file data is in the small_data
+									// section, and not in the data stream
 
 			bool				HasUserAccessableStream() const
 									{ return IsFile(); }
@@ -91,7 +96,17 @@ public:
 			uint32				Type() const { return fNode.Type(); }
 			int32				Flags() const { return fNode.Flags(); }
 
-			off_t				Size() const { return fNode.data.Size(); }
+			off_t				Size() const
+									{ return fDelayedSize != 0
+										? fDelayedSize : StreamSize(); }
+			off_t				StreamSize() const
+									{ return fNode.data.Size(); }
+									// the size of the file that has blocks
+									// allocated for it, and is on disk
+			bool				HasDelayedAllocation() const
+									{ return fDelayedSize != 0; }
+			off_t				ReservedBlocks() const
+									{ return fReservedBlocks; }
 			off_t				AllocatedSize() const;
 			off_t				LastModified() const
 									{ return fNode.LastModifiedTime(); }
@@ -146,6 +161,13 @@ public:
 									off_t& offset);
 
 			status_t			ReadAt(off_t pos, uint8* buffer, size_t* length);
+			status_t			ReadInlineData(off_t pos, uint8* buffer,
+									size_t* _length);
+			status_t			WriteInlineData(Transaction& transaction,
+									off_t pos, const uint8* buffer,
+									size_t length);
+			status_t			MoveDataToInode(Transaction& transaction);
+			status_t			MoveDataToStream(Transaction& transaction);
 			status_t			WriteAt(Transaction& transaction, off_t pos,
 									const uint8* buffer, size_t* length);
 			status_t			FillGapWithZeros(off_t oldSize, off_t newSize);
@@ -155,10 +177,20 @@ public:
 			status_t			Append(Transaction& transaction, off_t bytes);
 			status_t			TrimPreallocation(Transaction& transaction);
 			bool				NeedsTrimming() const;
+			status_t			AllocateDelayedBlocks(
+									Transaction& transaction);
+			status_t			AllocateDelayedBlocks(bool wait);
+			status_t			CountExtents(uint64& _runs, uint64& _extents,
+									uint64& _blocks);
+			status_t			Defragment(Transaction& transaction,
+									off_t& _movedBlocks);
 
 			status_t			Free(Transaction& transaction);
 			status_t			Sync();
 
+			status_t			StartTransaction(Transaction& transaction,
+									bool wait);
+
 			bfs_inode&			Node() { return fNode; }
 			const bfs_inode&	Node() const { return fNode; }
 
@@ -235,6 +267,8 @@ private:
 			status_t			_RemoveAttribute(Transaction& transaction,
 									const char* name, bool hasIndex,
 									Index* index);
+			status_t			_SetInlineDataSize(Transaction& transaction,
+									off_t size);
 
 			void				_AddIterator(AttributeIterator* iterator);
 			void				_RemoveIterator(AttributeIterator* iterator);
@@ -246,6 +280,9 @@ private:
 			status_t			_FreeStreamArray(Transaction& transaction,
 									block_run* array, uint32 arrayLength,
 									off_t size, off_t& offset, off_t& max);
+			status_t			_Allocate(Transaction& transaction,
+									off_t numBlocks, block_run& run,
+									uint16 minimum);
 			status_t			_AllocateBlockArray(Transaction& transaction,
 									block_run& run, size_t length,
 									bool variableSize = false);
@@ -253,6 +290,13 @@ private:
 									off_t size);
 			status_t			_ShrinkStream(Transaction& transaction,
 									off_t size);
+			status_t			_CountExtents(uint64& _runs,
+									uint64& _extents, uint64& _blocks);
+
+			bool				_CanDelayAllocation() const;
+			status_t			_DelayAllocation(off_t size);
+			void				_DelayedAllocationDone(off_t oldSize);
+			void				_RestoreReservation(off_t reserved);
 
 private:
 			rw_lock				fLock;
@@ -269,6 +313,11 @@ private:
 				// we need those values to ensure we will remove
 				// the correct keys from the indices
 
+			off_t				fDelayedSize;
+			off_t				fReservedBlocks;
+				// the file size if it has been grown beyond its data
+				// stream, and the blocks reserved for the difference
+
 			mutable recursive_lock fSmallDataLock;
 			SinglyLinkedList<AttributeIterator> fIterators;
 };
@@ -339,28 +388,27 @@ class NodeGetter : public CachedBlock {
 public:
 	NodeGetter(Volume* volume)
 		:
-		CachedBlock(volume)
+		CachedBlock(volume),
+		fWritable(false)
 	{
 	}
 
 	~NodeGetter()
 	{
+		Unset();
 	}
 
-	status_t SetTo(const Inode* inode)
-	{
-		return CachedBlock::SetTo(fVolume->VnodeToBlock(inode->ID()));
-	}
-
+	status_t SetTo(const Inode* inode);
 	status_t SetToWritable(Transaction& transaction, const Inode* inode,
-		bool empty = false)
-	{
-		return CachedBlock::SetToWritable(transaction,
-			fVolume->VnodeToBlock(inode->ID()), empty);
-	}
+		bool empty = false);
+	status_t MakeWritable(Transaction& transaction);
+	void Unset();
 
 	const bfs_inode* Node() const { return (const bfs_inode*)Block(); }
 	bfs_inode* WritableNode() const { return (bfs_inode*)Block();  }
+
+private:
+	bool fWritable;
 };
 
 
@@ -12,6 +12,7 @@
 #include "Journal.h"
 
 #include "Debug.h"
+#include "DiscardQueue.h"
 #include "Inode.h"
 
 
@@ -893,6 +894,10 @@ Journal::_WriteTransactionToLog()
 	// If that call fails, we can't do anything about it anyway
 	ioctl(fVolume->Device(), B_FLUSH_DRIVE_CACHE);
 
+	// the blocks freed by the finished transactions are now safe to discard
+	if (fVolume->GetDiscardQueue() != NULL)
+		fVolume->GetDiscardQueue()->LogWritten();
+
 	// at this point, we can finally end the transaction - we're in
 	// a guaranteed valid state
 
@@ -967,9 +972,10 @@ Journal::FlushLogAndBlocks()
 
 
 status_t
-Journal::Lock(Transaction* owner, bool separateSubTransactions)
+Journal::Lock(Transaction* owner, bool separateSubTransactions, bool wait)
 {
-	status_t status = recursive_lock_lock(&fLock);
+	status_t status = wait
+		? recursive_lock_lock(&fLock) : recursive_lock_trylock(&fLock);
 	if (status != B_OK)
 		return status;
 
@@ -1021,7 +1027,24 @@ Journal::Unlock(Transaction* owner, bool success)
 		// TODO: what about failing transactions that do not unlock?
 		// (they must make the parent fail, too)
 		if (owner != NULL) {
+			// Apply the index changes collected during the transaction, so
+			// that they are part of it
+			IndexCache& indexCache = fVolume->GetIndexCache();
+			if (success) {
+				status_t status = indexCache.Flush(*owner);
+				if (status != B_OK)
+					return status;
+			} else
+				indexCache.Drop(*owner);
+
 			status_t status = _TransactionDone(success);
+
+			// The blocks freed by this transaction will only be discarded
+			// after the next log write
+			if (fVolume->GetDiscardQueue() != NULL) {
+				fVolume->GetDiscardQueue()->TransactionDone(
+					success && status == B_OK);
+			}
 			if (status != B_OK)
 				return status;
 
@@ -1167,19 +1190,25 @@ TransactionListener::~TransactionListener()
 //	#pragma mark - Transaction
 
 
+/*!	Starts the transaction. If \a wait is \c false, and the journal is
+	currently in use by another thread, \c B_WOULD_BLOCK is returned instead
+	of waiting for it to become available.
+*/
 status_t
-Transaction::Start(Volume* volume, off_t refBlock)
+Transaction::Start(Volume* volume, off_t refBlock, bool wait)
 {
 	// has it already been started?
 	if (fJournal != NULL)
 		return B_OK;
 
 	fJournal = volume->GetJournal(refBlock);
-	if (fJournal != NULL && fJournal->Lock(this, false) == B_OK)
+	status_t status = fJournal != NULL
+		? fJournal->Lock(this, false, wait) : B_ERROR;
+	if (status == B_OK)
 		return B_OK;
 
 	fJournal = NULL;
-	return B_ERROR;
+	return status == B_WOULD_BLOCK ? status : B_ERROR;
 }
 
 
@@ -26,7 +26,8 @@ public:
 			status_t		InitCheck();
 
 			status_t		Lock(Transaction* owner,
-								bool separateSubTransactions);
+								bool separateSubTransactions,
+								bool wait = true);
 			status_t		Unlock(Transaction* owner, bool success);
 
 			status_t		ReplayLog();
@@ -135,7 +136,7 @@ public:
 			fJournal->Unlock(this, false);
 	}
 
-	status_t Start(Volume* volume, off_t refBlock);
+	status_t Start(Volume* volume, off_t refBlock, bool wait = true);
 	bool IsStarted() const { return fJournal != NULL; }
 
 	status_t Done()
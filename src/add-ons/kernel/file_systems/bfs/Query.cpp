@@ -70,6 +70,59 @@ union value {
 };
 
 
+static const int32 kMaxFilterEntries = 32768;
+	// the maximum number of inodes an index scan may produce to be used as
+	// a filter for another index scan
+static const int32 kDriverScore = 0x7fffffff;
+static const int32 kMaxTrigramCandidates = 131072;
+	// the maximum number of inodes a trigram index scan may produce, before
+	// the regular index is scanned instead
+
+
+/*!	A sorted set of inode IDs, as produced by an index scan. It is used to
+	intersect several index scans without having to read the inodes of all
+	candidates.
+*/
+class InodeIDSet {
+public:
+								InodeIDSet();
+								~InodeIDSet();
+
+			status_t			Add(off_t id);
+			void				Sort();
+			bool				Contains(off_t id) const;
+
+			int32				Count() const { return fCount; }
+			off_t				IDAt(int32 index) const
+									{ return fIDs[index]; }
+
+private:
+			void				_SiftDown(int32 index, int32 count);
+
+private:
+			off_t*				fIDs;
+			int32				fCount;
+			int32				fSize;
+};
+
+
+/*!	Collects the output of Query::Explain().
+*/
+class ExplainBuffer {
+public:
+								ExplainBuffer(char* buffer, size_t size);
+
+			void				Add(int32 level, const char* format, ...);
+			bool				IsTruncated() const { return fTruncated; }
+
+private:
+			char*				fBuffer;
+			size_t				fSize;
+			size_t				fLength;
+			bool				fTruncated;
+};
+
+
 /*!	Abstract base class for the operator/equation classes.
 */
 class Term {
@@ -90,9 +143,13 @@ public:
 
 	virtual	void				CalculateScore(Index& index) = 0;
 	virtual	int32				Score() const = 0;
+	virtual	int32				Cost() const = 0;
 
 	virtual	status_t			InitCheck() = 0;
 
+	virtual	void				Explain(ExplainBuffer& buffer,
+									int32 level) = 0;
+
 #ifdef DEBUG
 	virtual	void				PrintToStream() = 0;
 #endif
@@ -134,8 +191,18 @@ public:
 									TreeIterator* iterator,
 									struct dirent* dirent, size_t bufferSize);
 
+			status_t			PrepareFilter(Volume* volume, Index& index,
+									int32 maximum);
+			void				SetDriver();
+			int32				Estimate() const { return fEstimate; }
+
 	virtual	void				CalculateScore(Index &index);
 	virtual	int32				Score() const { return fScore; }
+	virtual	int32				Cost() const;
+
+	virtual	void				Explain(ExplainBuffer& buffer, int32 level);
+			void				ExplainScan(ExplainBuffer& buffer, Index& index,
+									bool queryNonIndexed);
 
 #ifdef DEBUG
 	virtual	void				PrintToStream();
@@ -146,6 +213,15 @@ private:
 								Equation& operator=(const Equation& other);
 									// no implementation
 
+			status_t			_GetNextIndexMatch(TreeIterator* iterator,
+									off_t& _id);
+			int32				_CountTrigrams(Index& index);
+			status_t			_CollectTrigramCandidates(Index& index,
+									int32 maximum,
+									InodeIDSet** _candidates);
+			bool				_IsFilteredOut(off_t id) const;
+			void				_Describe(char* buffer, size_t size) const;
+
 			status_t			_ParseQuotedString(char** _start, char** _end);
 			char*				_CopyString(char* start, char* end);
 	inline	bool				_IsEquationChar(char c) const;
@@ -165,6 +241,18 @@ private:
 
 			int32				fScore;
 			bool				fHasIndex;
+
+			int32				fEstimate;
+				// number of matching index entries, -1 if unknown
+			InodeIDSet*			fFilter;
+			bool				fFilterIsExact;
+				// a filter from a trigram index only contains candidates
+
+			bool				fUseTrigrams;
+			int32				fTrigramCount;
+			InodeIDSet*			fCandidates;
+			int32				fNextCandidate;
+				// the inodes a trigram index scan still has to match
 };
 
 
@@ -187,9 +275,12 @@ public:
 
 	virtual	void				CalculateScore(Index& index);
 	virtual	int32				Score() const;
+	virtual	int32				Cost() const;
 
 	virtual	status_t			InitCheck();
 
+	virtual	void				Explain(ExplainBuffer& buffer, int32 level);
+
 #ifdef DEBUG
 	virtual	void				PrintToStream();
 #endif
@@ -205,6 +296,224 @@ private:
 };
 
 
+static const char*
+operator_symbol(int8 op)
+{
+	switch (op) {
+		case OP_EQUAL:
+			return "==";
+		case OP_UNEQUAL:
+			return "!=";
+		case OP_GREATER_THAN:
+			return ">";
+		case OP_GREATER_THAN_OR_EQUAL:
+			return ">=";
+		case OP_LESS_THAN:
+			return "<";
+		case OP_LESS_THAN_OR_EQUAL:
+			return "<=";
+	}
+	return "???";
+}
+
+
+/*!	Collects the inodes in the trigram index \a tree that contain the given
+	\a trigram, and are part of the \a within set, if one is given.
+*/
+static status_t
+collect_trigram_entries(BPlusTree* tree, const uint8* trigram,
+	const InodeIDSet* within, int32 maximum, InodeIDSet** _set)
+{
+	InodeIDSet* set = new(std::nothrow) InodeIDSet;
+	if (set == NULL)
+		return B_NO_MEMORY;
+
+	TreeIterator iterator(tree);
+	status_t status = iterator.Find(trigram, kTrigramLength);
+
+	while (status == B_OK) {
+		uint8 key[kTrigramLength + 1];
+		uint16 keyLength;
+		off_t id;
+		status = iterator.GetNextEntry(key, &keyLength, sizeof(key), &id);
+		if (status != B_OK)
+			break;
+
+		if (keyLength != kTrigramLength
+			|| memcmp(key, trigram, kTrigramLength) != 0) {
+			status = B_ENTRY_NOT_FOUND;
+			break;
+		}
+
+		if (within != NULL && !within->Contains(id))
+			continue;
+
+		if (set->Count() >= maximum)
+			status = B_BUFFER_OVERFLOW;
+		else
+			status = set->Add(id);
+	}
+
+	if (status != B_ENTRY_NOT_FOUND) {
+		delete set;
+		return status;
+	}
+
+	set->Sort();
+	*_set = set;
+	return B_OK;
+}
+
+
+//	#pragma mark -
+
+
+InodeIDSet::InodeIDSet()
+	:
+	fIDs(NULL),
+	fCount(0),
+	fSize(0)
+{
+}
+
+
+InodeIDSet::~InodeIDSet()
+{
+	free(fIDs);
+}
+
+
+status_t
+InodeIDSet::Add(off_t id)
+{
+	if (fCount == fSize) {
+		int32 size = fSize > 0 ? fSize * 2 : 256;
+		off_t* ids = (off_t*)realloc(fIDs, size * sizeof(off_t));
+		if (ids == NULL)
+			return B_NO_MEMORY;
+
+		fIDs = ids;
+		fSize = size;
+	}
+
+	fIDs[fCount++] = id;
+	return B_OK;
+}
+
+
+/*!	Sorts the IDs (using heap sort, as the set can be large), and removes
+	any duplicates. Must be called before Contains() can be used.
+*/
+void
+InodeIDSet::Sort()
+{
+	for (int32 index = fCount / 2; index-- > 0;)
+		_SiftDown(index, fCount);
+
+	for (int32 count = fCount; count-- > 1;) {
+		off_t id = fIDs[0];
+		fIDs[0] = fIDs[count];
+		fIDs[count] = id;
+		_SiftDown(0, count);
+	}
+
+	int32 count = 0;
+	for (int32 index = 0; index < fCount; index++) {
+		if (count == 0 || fIDs[count - 1] != fIDs[index])
+			fIDs[count++] = fIDs[index];
+	}
+	fCount = count;
+}
+
+
+bool
+InodeIDSet::Contains(off_t id) const
+{
+	int32 low = 0;
+	int32 high = fCount - 1;
+
+	while (low <= high) {
+		int32 middle = (low + high) / 2;
+		if (fIDs[middle] == id)
+			return true;
+
+		if (fIDs[middle] < id)
+			low = middle + 1;
+		else
+			high = middle - 1;
+	}
+
+	return false;
+}
+
+
+void
+InodeIDSet::_SiftDown(int32 index, int32 count)
+{
+	while (true) {
+		int32 child = 2 * index + 1;
+		if (child >= count)
+			return;
+
+		if (child + 1 < count && fIDs[child + 1] > fIDs[child])
+			child++;
+		if (fIDs[index] >= fIDs[child])
+			return;
+
+		off_t id = fIDs[index];
+		fIDs[index] = fIDs[child];
+		fIDs[child] = id;
+		index = child;
+	}
+}
+
+
+//	#pragma mark -
+
+
+ExplainBuffer::ExplainBuffer(char* buffer, size_t size)
+	:
+	fBuffer(buffer),
+	fSize(size),
+	fLength(0),
+	fTruncated(false)
+{
+	if (fSize > 0)
+		fBuffer[0] = '\0';
+}
+
+
+void
+ExplainBuffer::Add(int32 level, const char* format, ...)
+{
+	if (fLength + 1 >= fSize) {
+		fTruncated = true;
+		return;
+	}
+
+	size_t length = snprintf(fBuffer + fLength, fSize - fLength, "%*s",
+		(int)level * 2, "");
+
+	va_list args;
+	va_start(args, format);
+	if (fLength + length < fSize) {
+		length += vsnprintf(fBuffer + fLength + length,
+			fSize - fLength - length, format, args);
+	}
+	va_end(args);
+
+	if (fLength + length + 1 < fSize)
+		length += snprintf(fBuffer + fLength + length,
+			fSize - fLength - length, "\n");
+
+	if (fLength + length >= fSize) {
+		fLength = fSize - 1;
+		fTruncated = true;
+	} else
+		fLength += length;
+}
+
+
 //	#pragma mark -
 
 
@@ -214,7 +523,16 @@ Equation::Equation(char** _expression)
 	fAttribute(NULL),
 	fString(NULL),
 	fType(0),
-	fIsPattern(false)
+	fIsPattern(false),
+	fScore(0),
+	fHasIndex(false),
+	fEstimate(-1),
+	fFilter(NULL),
+	fFilterIsExact(true),
+	fUseTrigrams(false),
+	fTrigramCount(0),
+	fCandidates(NULL),
+	fNextCandidate(0)
 {
 	char* string = *_expression;
 	char* start = string;
@@ -349,6 +667,8 @@ Equation::~Equation()
 {
 	free(fAttribute);
 	free(fString);
+	delete fFilter;
+	delete fCandidates;
 }
 
 
@@ -370,6 +690,15 @@ status_t
 Equation::Match(Inode* inode, const char* attributeName, int32 type,
 	const uint8* key, size_t size)
 {
+	// if we already know all matching inodes from the index, there is no
+	// need to read the inode (doesn't work for live queries, though)
+	if (attributeName == NULL && fFilter != NULL) {
+		if (!fFilter->Contains(inode->ID()))
+			return NO_MATCH;
+		if (fFilterIsExact)
+			return MATCH_OK;
+	}
+
 	// get a pointer to the attribute in question
 	NodeGetter nodeGetter(inode->GetVolume());
 	union value value;
@@ -401,11 +730,8 @@ Equation::Match(Inode* inode, const char* attributeName, int32 type,
 		type = B_STRING_TYPE;
 		size = strlen((const char*)buffer);
 	} else if (!strcmp(fAttribute, "size")) {
-#ifdef BFS_NATIVE_ENDIAN
-		buffer = (uint8*)&inode->Node().data.size;
-#else
+		// the size in the inode might not include a delayed allocation yet
 		value.Int64 = inode->Size();
-#endif
 		type = B_INT64_TYPE;
 	} else if (!strcmp(fAttribute, "last_modified")) {
 #ifdef BFS_NATIVE_ENDIAN
@@ -483,6 +809,34 @@ status_t
 Equation::PrepareQuery(Volume* /*volume*/, Index& index,
 	TreeIterator** iterator, bool queryNonIndexed)
 {
+	delete fCandidates;
+	fCandidates = NULL;
+
+	if (fUseTrigrams) {
+		// The candidates are collected from the trigram index up front, and
+		// then matched one by one. The iterator is not used then, but
+		// Query::GetNextEntry() expects one for every running scan.
+		InodeIDSet* candidates;
+		status_t status = _CollectTrigramCandidates(index,
+			kMaxTrigramCandidates, &candidates);
+		if (status == B_OK) {
+			*iterator = new(std::nothrow) TreeIterator(index.Node()->Tree());
+			if (*iterator == NULL) {
+				delete candidates;
+				return B_NO_MEMORY;
+			}
+
+			fCandidates = candidates;
+			fNextCandidate = 0;
+			fHasIndex = false;
+			return B_OK;
+		}
+		if (status != B_ENTRY_NOT_FOUND && status != B_BUFFER_OVERFLOW)
+			return status;
+
+		// fall back to scanning the regular index
+	}
+
 	status_t status = index.SetTo(fAttribute);
 
 	// if we should query attributes without an index, we can just proceed here
@@ -581,33 +935,13 @@ Equation::GetNextMatching(Volume* volume, TreeIterator* iterator,
 	struct dirent* dirent, size_t bufferSize)
 {
 	while (true) {
-		union value indexValue;
-		uint16 keyLength;
-		uint16 duplicate;
 		off_t offset;
-
-		status_t status = iterator->GetNextEntry(&indexValue, &keyLength,
-			(uint16)sizeof(indexValue), &offset, &duplicate);
+		status_t status = _GetNextIndexMatch(iterator, offset);
 		if (status != B_OK)
 			return status;
 
-		// only compare against the index entry when this is the correct
-		// index for the equation
-		if (fHasIndex && duplicate < 2
-			&& !_CompareTo((uint8*)&indexValue, keyLength)) {
-			// They aren't equal? Let the operation decide what to do. Since
-			// we always start at the beginning of the index (or the correct
-			// position), only some needs to be stopped if the entry doesn't
-			// fit.
-			if (fOp == OP_LESS_THAN
-				|| fOp == OP_LESS_THAN_OR_EQUAL
-				|| (fOp == OP_EQUAL && !fIsPattern))
-				return B_ENTRY_NOT_FOUND;
-
-			if (duplicate > 0)
-				iterator->SkipDuplicates();
+		if (_IsFilteredOut(offset))
 			continue;
-		}
 
 		Vnode vnode(volume, offset);
 		Inode* inode;
@@ -684,12 +1018,372 @@ Equation::GetNextMatching(Volume* volume, TreeIterator* iterator,
 }
 
 
+/*!	Scans the index for this equation like the query would do it, and
+	collects the IDs of all matching inodes, as long as there are not more
+	than \a maximum of them. The set is then used instead of reading the
+	inodes to match this equation, when another equation drives the query.
+*/
+status_t
+Equation::PrepareFilter(Volume* volume, Index& index, int32 maximum)
+{
+	fEstimate = -1;
+
+	if (fUseTrigrams) {
+		InodeIDSet* filter;
+		status_t status = _CollectTrigramCandidates(index, maximum, &filter);
+		if (status == B_OK) {
+			fEstimate = filter->Count();
+			fFilter = filter;
+			fFilterIsExact = false;
+			return B_OK;
+		}
+		if (status == B_BUFFER_OVERFLOW) {
+			fEstimate = maximum + 1;
+			return B_OK;
+		}
+		return status;
+	}
+
+	TreeIterator* iterator = NULL;
+	status_t status = PrepareQuery(volume, index, &iterator, false);
+	if (iterator == NULL)
+		return status;
+	if ((status != B_OK && status != B_ENTRY_NOT_FOUND) || !fHasIndex) {
+		delete iterator;
+		return status;
+	}
+
+	InodeIDSet* filter = new(std::nothrow) InodeIDSet;
+	if (filter == NULL) {
+		delete iterator;
+		return B_NO_MEMORY;
+	}
+
+	int32 count = 0;
+	off_t id;
+	while ((status = _GetNextIndexMatch(iterator, id)) == B_OK) {
+		if (++count > maximum)
+			break;
+
+		status = filter->Add(id);
+		if (status != B_OK)
+			break;
+	}
+	delete iterator;
+
+	if (count > maximum) {
+		// too many to be useful
+		fEstimate = count;
+		delete filter;
+		return B_OK;
+	}
+	if (status != B_ENTRY_NOT_FOUND) {
+		delete filter;
+		return status;
+	}
+
+	filter->Sort();
+	fEstimate = filter->Count();
+	fFilter = filter;
+	return B_OK;
+}
+
+
+/*!	This equation has been chosen to run the query; its filter is no longer
+	needed then.
+*/
+void
+Equation::SetDriver()
+{
+	delete fFilter;
+	fFilter = NULL;
+	fScore = kDriverScore;
+}
+
+
+/*!	Returns a rough estimate of how expensive it is to call Match() for
+	an inode.
+*/
+int32
+Equation::Cost() const
+{
+	if (fFilter != NULL && fFilterIsExact)
+		return 0;
+
+	// these only need the inode itself
+	if (!strcmp(fAttribute, "name") || !strcmp(fAttribute, "size")
+		|| !strcmp(fAttribute, "last_modified"))
+		return 1;
+
+	return 2;
+}
+
+
+void
+Equation::Explain(ExplainBuffer& buffer, int32 level)
+{
+	char description[B_FILE_NAME_LENGTH + MAX_INDEX_KEY_LENGTH + 16];
+	_Describe(description, sizeof(description));
+
+	if (fFilter != NULL && fFilterIsExact) {
+		buffer.Add(level, "filter by index: %s (%" B_PRId32 " entries)",
+			description, fEstimate);
+		return;
+	}
+
+	if (fFilter != NULL) {
+		buffer.Add(level, "filter by trigram index: %s (%" B_PRId32
+			" candidates)", description, fEstimate);
+	}
+	buffer.Add(level, "match: %s (%s)", description,
+		Cost() == 1 ? "reads inode" : "reads attribute");
+}
+
+
+/*!	Describes how this equation is used to run the query.
+*/
+void
+Equation::ExplainScan(ExplainBuffer& buffer, Index& index,
+	bool queryNonIndexed)
+{
+	char description[B_FILE_NAME_LENGTH + MAX_INDEX_KEY_LENGTH + 16];
+	_Describe(description, sizeof(description));
+
+	if (fUseTrigrams) {
+		buffer.Add(0, "scan trigram index: %s (%" B_PRId32 " trigrams)",
+			description, fTrigramCount);
+		Explain(buffer, 1);
+		return;
+	}
+
+	if (fOp == OP_UNEQUAL || index.SetTo(fAttribute) != B_OK) {
+		if (!queryNonIndexed) {
+			buffer.Add(0, "skip: %s (no index)", description);
+			return;
+		}
+
+		buffer.Add(0, "scan index \"name\", match: %s", description);
+		return;
+	}
+
+	if (fEstimate < 0) {
+		buffer.Add(0, "scan index: %s (score %" B_PRId32 ")", description,
+			fScore);
+	} else if (fEstimate > kMaxFilterEntries) {
+		buffer.Add(0, "scan index: %s (more than %" B_PRId32 " entries)",
+			description, kMaxFilterEntries);
+	} else {
+		buffer.Add(0, "scan index: %s (%" B_PRId32 " entries)", description,
+			fEstimate);
+	}
+}
+
+
+/*!	Returns the ID of the next inode in the index that matches this
+	equation. If the equation does not have its own index, all inodes in the
+	index are returned.
+*/
+status_t
+Equation::_GetNextIndexMatch(TreeIterator* iterator, off_t& _id)
+{
+	if (fCandidates != NULL) {
+		if (fNextCandidate >= fCandidates->Count())
+			return B_ENTRY_NOT_FOUND;
+
+		_id = fCandidates->IDAt(fNextCandidate++);
+		return B_OK;
+	}
+
+	while (true) {
+		union value indexValue;
+		uint16 keyLength;
+		uint16 duplicate;
+		off_t offset;
+
+		status_t status = iterator->GetNextEntry(&indexValue, &keyLength,
+			(uint16)sizeof(indexValue), &offset, &duplicate);
+		if (status != B_OK)
+			return status;
+
+		// only compare against the index entry when this is the correct
+		// index for the equation
+		if (fHasIndex && duplicate < 2
+			&& !_CompareTo((uint8*)&indexValue, keyLength)) {
+			// They aren't equal? Let the operation decide what to do. Since
+			// we always start at the beginning of the index (or the correct
+			// position), only some needs to be stopped if the entry doesn't
+			// fit.
+			if (fOp == OP_LESS_THAN
+				|| fOp == OP_LESS_THAN_OR_EQUAL
+				|| (fOp == OP_EQUAL && !fIsPattern))
+				return B_ENTRY_NOT_FOUND;
+
+			if (duplicate > 0)
+				iterator->SkipDuplicates();
+			continue;
+		}
+
+		_id = offset;
+		return B_OK;
+	}
+}
+
+
+/*!	Returns the number of trigrams the pattern of this equation can be
+	looked up with, or zero if there is no trigram index for its attribute.
+*/
+int32
+Equation::_CountTrigrams(Index& index)
+{
+	char indexName[B_FILE_NAME_LENGTH];
+	if (Index::GetTrigramIndexName(fAttribute, indexName, sizeof(indexName))
+			!= B_OK
+		|| index.SetTo(indexName) != B_OK)
+		return 0;
+
+	TrigramSet* trigrams = new(std::nothrow) TrigramSet;
+	if (trigrams == NULL)
+		return 0;
+
+	trigrams->SetToPattern(fString);
+	int32 count = trigrams->CountTrigrams();
+	delete trigrams;
+
+	return count;
+}
+
+
+/*!	Collects all inodes that contain every trigram of the pattern in the
+	trigram index of the attribute. They still need to be matched against
+	the pattern, as the trigrams don't need to appear in the right order,
+	or case.
+	Returns B_BUFFER_OVERFLOW if every trigram has more than \a maximum
+	entries in the index, or if more than \a maximum inodes contain all
+	of them.
+*/
+status_t
+Equation::_CollectTrigramCandidates(Index& index, int32 maximum,
+	InodeIDSet** _candidates)
+{
+	char indexName[B_FILE_NAME_LENGTH];
+	if (Index::GetTrigramIndexName(fAttribute, indexName, sizeof(indexName))
+			!= B_OK
+		|| index.SetTo(indexName) != B_OK)
+		return B_ENTRY_NOT_FOUND;
+
+	BPlusTree* tree = index.Node()->Tree();
+	if (tree == NULL)
+		return B_BAD_VALUE;
+
+	TrigramSet* trigrams = new(std::nothrow) TrigramSet;
+	if (trigrams == NULL)
+		return B_NO_MEMORY;
+
+	ObjectDeleter<TrigramSet> trigramsDeleter(trigrams);
+	trigrams->SetToPattern(fString);
+
+	int32 count = trigrams->CountTrigrams();
+	if (count == 0)
+		return B_ENTRY_NOT_FOUND;
+
+	// Start with the first trigram that doesn't have too many entries, and
+	// only keep those of the others that are already in the set
+
+	InodeIDSet* candidates = NULL;
+	int32 first = 0;
+	for (; first < count; first++) {
+		status_t status = collect_trigram_entries(tree,
+			trigrams->TrigramAt(first), NULL, maximum, &candidates);
+		if (status == B_OK)
+			break;
+		if (status != B_BUFFER_OVERFLOW)
+			return status;
+	}
+	if (candidates == NULL)
+		return B_BUFFER_OVERFLOW;
+
+	for (int32 i = 0; i < count && candidates->Count() > 0; i++) {
+		if (i == first)
+			continue;
+
+		InodeIDSet* next;
+		status_t status = collect_trigram_entries(tree,
+			trigrams->TrigramAt(i), candidates, maximum, &next);
+		delete candidates;
+		if (status != B_OK)
+			return status;
+
+		candidates = next;
+	}
+
+	*_candidates = candidates;
+	return B_OK;
+}
+
+
+/*!	Checks the filters of the equations this one is combined with via
+	&&-operators, so that inodes that cannot match are skipped without
+	reading them.
+*/
+bool
+Equation::_IsFilteredOut(off_t id) const
+{
+	const Term* term = this;
+	while (true) {
+		Operator* parent = (Operator*)term->Parent();
+		if (parent == NULL)
+			return false;
+
+		if (parent->Op() == OP_AND) {
+			Term* other = parent->Right();
+			if (other == term)
+				other = parent->Left();
+
+			if (other != NULL && other->Op() > OP_EQUATION) {
+				InodeIDSet* filter = ((Equation*)other)->fFilter;
+				if (filter != NULL && !filter->Contains(id))
+					return true;
+			}
+		}
+		term = parent;
+	}
+}
+
+
+void
+Equation::_Describe(char* buffer, size_t size) const
+{
+	snprintf(buffer, size, "\"%s\" %s \"%s\"", fAttribute,
+		operator_symbol(fOp), fString);
+}
+
+
 void
 Equation::CalculateScore(Index &index)
 {
 	// As always, these values could be tuned and refined.
 	// And the code could also need some real world testing :-)
 
+	// a filter from a previous plan is no longer valid
+	delete fFilter;
+	fFilter = NULL;
+	fFilterIsExact = true;
+	fEstimate = -1;
+
+	// a trigram index can be used for patterns that don't start with enough
+	// characters to position the iterator in the regular index
+	fUseTrigrams = false;
+	if (fIsPattern && fOp == OP_EQUAL
+		&& getFirstPatternSymbol(fString) < kTrigramLength) {
+		fTrigramCount = _CountTrigrams(index);
+		if (fTrigramCount > 0) {
+			fUseTrigrams = true;
+			fScore = ((fTrigramCount + 2) << 3)
+				* ((2048 * 1024LL) / index.Node()->Size());
+			return;
+		}
+	}
+
 	// do we have to operate on a "foreign" index?
 	if (fOp == OP_UNEQUAL || index.SetTo(fAttribute) < B_OK) {
 		fScore = 0;
@@ -916,11 +1610,19 @@ Operator::Match(Inode* inode, const char* attribute, int32 type,
 	const uint8* key, size_t size)
 {
 	if (fOp == OP_AND) {
-		status_t status = fLeft->Match(inode, attribute, type, key, size);
+		// evaluate the cheaper term first
+		Term* first = fLeft;
+		Term* second = fRight;
+		if (fRight->Cost() < fLeft->Cost()) {
+			first = fRight;
+			second = fLeft;
+		}
+
+		status_t status = first->Match(inode, attribute, type, key, size);
 		if (status != MATCH_OK)
 			return status;
 
-		return fRight->Match(inode, attribute, type, key, size);
+		return second->Match(inode, attribute, type, key, size);
 	} else {
 		// choose the term with the better score for OP_OR
 		Term* first;
@@ -982,6 +1684,13 @@ Operator::Score() const
 }
 
 
+int32
+Operator::Cost() const
+{
+	return fLeft->Cost() + fRight->Cost();
+}
+
+
 status_t
 Operator::InitCheck()
 {
@@ -994,6 +1703,28 @@ Operator::InitCheck()
 }
 
 
+void
+Operator::Explain(ExplainBuffer& buffer, int32 level)
+{
+	if (fOp == OP_AND) {
+		Term* first = fLeft;
+		Term* second = fRight;
+		if (fRight->Cost() < fLeft->Cost()) {
+			first = fRight;
+			second = fLeft;
+		}
+
+		first->Explain(buffer, level);
+		second->Explain(buffer, level);
+		return;
+	}
+
+	buffer.Add(level, "any of:");
+	fLeft->Explain(buffer, level + 1);
+	fRight->Explain(buffer, level + 1);
+}
+
+
 #if 0
 Term*
 Operator::Copy() const
@@ -1060,16 +1791,7 @@ Operator::PrintToStream()
 void
 Equation::PrintToStream()
 {
-	const char* symbol = "???";
-	switch (fOp) {
-		case OP_EQUAL: symbol = "=="; break;
-		case OP_UNEQUAL: symbol = "!="; break;
-		case OP_GREATER_THAN: symbol = ">"; break;
-		case OP_GREATER_THAN_OR_EQUAL: symbol = ">="; break;
-		case OP_LESS_THAN: symbol = "<"; break;
-		case OP_LESS_THAN_OR_EQUAL: symbol = "<="; break;
-	}
-	__out("[\"%s\" %s \"%s\"]", fAttribute, symbol, fString);
+	__out("[\"%s\" %s \"%s\"]", fAttribute, operator_symbol(fOp), fString);
 }
 
 #endif	// DEBUG
@@ -1236,7 +1958,8 @@ Query::Query(Volume* volume, Expression* expression, uint32 flags)
 	fIterator(NULL),
 	fIndex(volume),
 	fFlags(flags),
-	fPort(-1)
+	fPort(-1),
+	fPlanned(false)
 {
 	// If the expression has a valid root pointer, the whole tree has
 	// already passed the sanity check, so that we don't have to check
@@ -1273,32 +1996,15 @@ Query::Rewind()
 	fIterator = NULL;
 	fCurrent = NULL;
 
-	// put the whole expression on the stack
-
-	Stack<Term*> stack;
-	stack.Push(fExpression->Root());
-
-	Term* term;
-	while (stack.Pop(&term)) {
-		if (term->Op() < OP_EQUATION) {
-			Operator* op = (Operator*)term;
-
-			if (op->Op() == OP_OR) {
-				stack.Push(op->Left());
-				stack.Push(op->Right());
-			} else {
-				// For OP_AND, we can use the scoring system to decide which
-				// path to add
-				if (op->Right()->Score() > op->Left()->Score())
-					stack.Push(op->Right());
-				else
-					stack.Push(op->Left());
-			}
-		} else if (term->Op() == OP_EQUATION
-			|| fStack.Push((Equation*)term) != B_OK)
-			FATAL(("Unknown term on stack or stack error"));
+	if (fPlanned) {
+		// the filters may be outdated by now; they are built again when
+		// the next entry is retrieved
+		fExpression->Root()->CalculateScore(fIndex);
+		fIndex.Unset();
+		fPlanned = false;
 	}
 
+	_FillStack();
 	return B_OK;
 }
 
@@ -1306,6 +2012,8 @@ Query::Rewind()
 status_t
 Query::GetNextEntry(struct dirent* dirent, size_t size)
 {
+	_PlanIfNeeded();
+
 	// If we don't have an equation to use yet/anymore, get a new one
 	// from the stack
 	while (true) {
@@ -1341,6 +2049,43 @@ Query::GetNextEntry(struct dirent* dirent, size_t size)
 }
 
 
+/*!	Describes how the query is going to be evaluated; must be called before
+	the first entry is retrieved.
+	Every index scan is listed together with the terms that are evaluated for
+	each inode it produces.
+*/
+status_t
+Query::Explain(char* buffer, size_t size)
+{
+	_PlanIfNeeded();
+
+	ExplainBuffer explain(buffer, size);
+
+	// the stack is processed from its top
+	for (int32 i = fStack.CountItems(); i-- > 0;) {
+		Equation* equation = fStack.Array()[i];
+		equation->ExplainScan(explain, fIndex,
+			(fFlags & B_QUERY_NON_INDEXED) != 0);
+
+		Term* term = equation;
+		while (term->Parent() != NULL) {
+			Operator* parent = (Operator*)term->Parent();
+			if (parent->Op() == OP_AND) {
+				Term* other = parent->Right();
+				if (other == term)
+					other = parent->Left();
+
+				other->Explain(explain, 1);
+			}
+			term = parent;
+		}
+	}
+	fIndex.Unset();
+
+	return explain.IsTruncated() ? B_BUFFER_OVERFLOW : B_OK;
+}
+
+
 void
 Query::SetLiveMode(port_id port, int32 token)
 {
@@ -1445,3 +2190,124 @@ Query::LiveUpdateRenameMove(Inode* inode, ino_t oldDirectoryID,
 	notify_query_entry_created(fPort, fToken, fVolume->ID(),
 		newDirectoryID, newName, inode->ID());
 }
+
+
+/*!	Puts the equations that are going to be used to retrieve the entries
+	on the stack.
+*/
+void
+Query::_FillStack()
+{
+	fStack.MakeEmpty();
+
+	// put the whole expression on the stack
+
+	Stack<Term*> stack;
+	stack.Push(fExpression->Root());
+
+	Term* term;
+	while (stack.Pop(&term)) {
+		if (term->Op() < OP_EQUATION) {
+			Operator* op = (Operator*)term;
+
+			if (op->Op() == OP_OR) {
+				stack.Push(op->Left());
+				stack.Push(op->Right());
+			} else {
+				// For OP_AND, we can use the scoring system to decide which
+				// path to add
+				if (op->Right()->Score() > op->Left()->Score())
+					stack.Push(op->Right());
+				else
+					stack.Push(op->Left());
+			}
+		} else if (term->Op() == OP_EQUATION
+			|| fStack.Push((Equation*)term) != B_OK)
+			FATAL(("Unknown term on stack or stack error"));
+	}
+}
+
+
+/*!	Plans the query when its first entry is retrieved, so that the index
+	scans are only done for queries that are actually run.
+	Live queries are not planned, as they are kept open for a long time,
+	and the filters would only reflect the state of the indices when the
+	query was started.
+*/
+void
+Query::_PlanIfNeeded()
+{
+	if (fPlanned || fExpression == NULL || fExpression->Root() == NULL)
+		return;
+
+	fPlanned = true;
+	if ((fFlags & B_LIVE_QUERY) != 0)
+		return;
+
+	_Plan(fExpression->Root());
+	fIndex.Unset();
+
+	// the chosen equations have a new score
+	_FillStack();
+}
+
+
+/*!	Chooses how the terms combined by &&-operators are evaluated. If there
+	is more than one index that can be used, the index scans are run to
+	count their matches. The scan with the fewest matches will run the query,
+	while the inode IDs of the others are used to filter its results without
+	having to read the inodes.
+*/
+void
+Query::_Plan(Term* term)
+{
+	if (term->Op() > OP_EQUATION)
+		return;
+
+	Operator* op = (Operator*)term;
+	if (op->Op() == OP_OR) {
+		_Plan(op->Left());
+		_Plan(op->Right());
+		return;
+	}
+
+	// collect all equations that can use an index
+	Stack<Term*> terms;
+	Stack<Equation*> candidates;
+	if (terms.Push(term) != B_OK)
+		return;
+
+	Term* current;
+	while (terms.Pop(&current)) {
+		if (current->Op() == OP_AND) {
+			op = (Operator*)current;
+			if (terms.Push(op->Left()) != B_OK
+				|| terms.Push(op->Right()) != B_OK)
+				return;
+		} else if (current->Op() == OP_OR)
+			_Plan(current);
+		else if (current->Score() > 0) {
+			if (candidates.Push((Equation*)current) != B_OK)
+				return;
+		}
+	}
+
+	if (candidates.CountItems() < 2)
+		return;
+
+	Equation* driver = NULL;
+	Equation* equation;
+	while (candidates.Pop(&equation)) {
+		if (equation->PrepareFilter(fVolume, fIndex, kMaxFilterEntries)
+				!= B_OK
+			|| equation->Estimate() < 0
+			|| equation->Estimate() > kMaxFilterEntries)
+			continue;
+
+		if (driver == NULL || equation->Estimate() < driver->Estimate())
+			driver = equation;
+	}
+
+	if (driver != NULL)
+		driver->SetDriver();
+}
@@ -50,6 +50,7 @@ public:
 
 			status_t		Rewind();
 			status_t		GetNextEntry(struct dirent* , size_t size);
+			status_t		Explain(char* buffer, size_t size);
 
 			void			SetLiveMode(port_id port, int32 token);
 			void			LiveUpdate(Inode* inode, const char* attribute,
@@ -63,6 +64,11 @@ public:
 
 			Expression*		GetExpression() const { return fExpression; }
 
+private:
+			void			_FillStack();
+			void			_PlanIfNeeded();
+			void			_Plan(Term* term);
+
 private:
 			Volume*			fVolume;
 			Expression*		fExpression;
@@ -74,6 +80,7 @@ private:
 			uint32			fFlags;
 			port_id			fPort;
 			int32			fToken;
+			bool			fPlanned;
 };
 
 #endif	// QUERY_H
@@ -8,9 +8,13 @@
 
 
 #include "Attribute.h"
+#include "BPlusTree.h"
 #include "CheckVisitor.h"
+#include "DefragmentVisitor.h"
 #include "Debug.h"
+#include "DiscardQueue.h"
 #include "file_systems/DeviceOpener.h"
+#include "Index.h"
 #include "Inode.h"
 #include "Journal.h"
 #include "Query.h"
@@ -35,8 +39,11 @@ static const int32 kDesiredAllocationGroups = 56;
 bool
 disk_super_block::IsValid() const
 {
+	uint32 expectedMagic2 = (Features() & SUPER_BLOCK_INCOMPAT_FEATURES) != 0
+		? SUPER_BLOCK_MAGIC2_INCOMPAT : SUPER_BLOCK_MAGIC2;
+
 	if (Magic1() != (int32)SUPER_BLOCK_MAGIC1
-		|| Magic2() != (int32)SUPER_BLOCK_MAGIC2
+		|| Magic2() != (int32)expectedMagic2
 		|| Magic3() != (int32)SUPER_BLOCK_MAGIC3
 		|| (int32)block_size != inode_size
 		|| ByteOrder() != SUPER_BLOCK_FS_LENDIAN
@@ -114,6 +121,20 @@ disk_super_block::Initialize(const char* diskName, off_t numBlocks,
 }
 
 
+/*!	Sets the feature bits, and the magic that keeps implementations that
+	don't know about them from accessing the volume when any of them is
+	incompatible.
+*/
+void
+disk_super_block::SetFeatures(uint32 newFeatures)
+{
+	features = HOST_ENDIAN_TO_BFS_INT32(newFeatures);
+	magic2 = HOST_ENDIAN_TO_BFS_INT32(
+		(newFeatures & SUPER_BLOCK_INCOMPAT_FEATURES) != 0
+			? SUPER_BLOCK_MAGIC2_INCOMPAT : SUPER_BLOCK_MAGIC2);
+}
+
+
 //	#pragma mark -
 
 
@@ -124,9 +145,18 @@ Volume::Volume(fs_volume* volume)
 	fRootNode(NULL),
 	fIndicesNode(NULL),
 	fDirtyCachedBlocks(0),
+	fReservedBlocks(0),
+	fDelayedAllocations(0),
+	fDelayedAllocatedBlocks(0),
+	fTrigramIndices(0),
+	fIndexCache(this),
+	fChecksumErrors(0),
+	fLastChecksumErrorBlock(-1),
 	fFlags(0),
 	fCheckingThread(-1),
-	fCheckVisitor(NULL)
+	fCheckVisitor(NULL),
+	fDefragmenter(NULL),
+	fDiscardQueue(NULL)
 {
 	mutex_init(&fLock, "bfs volume");
 	mutex_init(&fQueryLock, "bfs queries");
@@ -168,7 +198,7 @@ Volume::Panic()
 
 
 status_t
-Volume::Mount(const char* deviceName, uint32 flags)
+Volume::Mount(const char* deviceName, uint32 flags, const char* parameters)
 {
 	// TODO: validate the FS in write mode as well!
 #if (B_HOST_IS_LENDIAN && defined(BFS_BIG_ENDIAN_ONLY)) \
@@ -192,6 +222,13 @@ Volume::Mount(const char* deviceName, uint32 flags)
 		return B_BAD_VALUE;
 	}
 
+	uint32 unknownFeatures = fSuperBlock.Features()
+		& SUPER_BLOCK_INCOMPAT_FEATURES & ~SUPER_BLOCK_KNOWN_FEATURES;
+	if (unknownFeatures != 0) {
+		FATAL(("unsupported features %#" B_PRIx32 "!\n", unknownFeatures));
+		return B_NOT_SUPPORTED;
+	}
+
 	// initialize short hands to the superblock (to save byte swapping)
 	fBlockSize = fSuperBlock.BlockSize();
 	fBlockShift = fSuperBlock.BlockShift();
@@ -268,6 +305,7 @@ Volume::Mount(const char* deviceName, uint32 flags)
 				}
 			} else {
 				// we don't use the vnode layer to access the indices node
+				_CountTrigramIndices();
 			}
 		} else {
 			FATAL(("could not create root node: publish_vnode() failed!\n"));
@@ -283,6 +321,21 @@ Volume::Mount(const char* deviceName, uint32 flags)
 		return status;
 	}
 
+	if (!IsReadOnly() && parameters != NULL) {
+		void* handle = parse_driver_settings_string(parameters);
+		if (handle != NULL) {
+			if (get_driver_boolean_parameter(handle, "discard", false, true)) {
+				fDiscardQueue = new(std::nothrow) DiscardQueue(this);
+				if (fDiscardQueue == NULL || fDiscardQueue->Start() != B_OK) {
+					INFORM(("could not start discarding freed blocks\n"));
+					delete fDiscardQueue;
+					fDiscardQueue = NULL;
+				}
+			}
+			unload_driver_settings(handle);
+		}
+	}
+
 	// all went fine
 	opener.Keep();
 	return B_OK;
@@ -292,6 +345,9 @@ Volume::Mount(const char* deviceName, uint32 flags)
 status_t
 Volume::Unmount()
 {
+	delete fDefragmenter;
+	fDefragmenter = NULL;
+
 	put_vnode(fVolume, ToVnode(Root()));
 
 	fBlockAllocator.Uninitialize();
@@ -300,6 +356,11 @@ Volume::Unmount()
 	delete fJournal;
 	fJournal = NULL;
 
+	// Now that everything is on disk, the remaining freed blocks can be
+	// discarded
+	delete fDiscardQueue;
+	fDiscardQueue = NULL;
+
 	delete fIndicesNode;
 
 	block_cache_delete(fBlockCache, !IsReadOnly());
@@ -347,6 +408,28 @@ Volume::ToBlockRun(off_t block) const
 }
 
 
+/*!	Reserves \a count blocks for a file that delays the allocation of its
+	blocks. Reserved blocks are not available to anyone else until they are
+	either released with UnreserveBlocks(), or allocated by the file that
+	reserved them.
+	The block allocator takes the reservations into account for all other
+	allocations; its lock makes sure both don't take the same free blocks.
+*/
+status_t
+Volume::ReserveBlocks(off_t count)
+{
+	RecursiveLocker locker(fBlockAllocator.Lock());
+
+	off_t reserved = atomic_add64(&fReservedBlocks, count) + count;
+	if (reserved > FreeBlocks()) {
+		atomic_add64(&fReservedBlocks, -count);
+		return B_DEVICE_FULL;
+	}
+
+	return B_OK;
+}
+
+
 status_t
 Volume::CreateIndicesRoot(Transaction& transaction)
 {
@@ -395,6 +478,81 @@ Volume::AllocateForInode(Transaction& transaction, const Inode* parent,
 }
 
 
+/*!	Enables or disables storing the data of new small files in their inode.
+	Files that already store their data inline stay that way, and therefore
+	the incompatible SUPER_BLOCK_FEATURE_INLINE_DATA feature is never
+	removed again once it has been set; disabling the feature only sets
+	the compatible SUPER_BLOCK_FEATURE_NO_NEW_INLINE_DATA feature.
+	Enabling it means that BFS implementations that don't know about inline
+	data can no longer mount the volume.
+*/
+status_t
+Volume::SetInlineData(bool enable)
+{
+	if (IsReadOnly())
+		return B_READ_ONLY_DEVICE;
+
+	MutexLocker locker(Lock());
+
+	uint32 features = fSuperBlock.Features();
+	if (enable) {
+		features |= SUPER_BLOCK_FEATURE_INLINE_DATA;
+		features &= ~SUPER_BLOCK_FEATURE_NO_NEW_INLINE_DATA;
+	} else if ((features & SUPER_BLOCK_FEATURE_INLINE_DATA) != 0)
+		features |= SUPER_BLOCK_FEATURE_NO_NEW_INLINE_DATA;
+
+	if (features == fSuperBlock.Features())
+		return B_OK;
+
+	fSuperBlock.SetFeatures(features);
+	return WriteSuperBlock();
+}
+
+
+/*!	Compares the \a checksum of a metadata block as it was read from disk
+	with the one it is \a expected to have. A mismatch is counted, and
+	reported, unless the block is part of the running transaction: its
+	checksum is only updated once it is no longer being changed.
+*/
+bool
+Volume::IsChecksumValid(off_t block, uint32 checksum, uint32 expected)
+{
+	if (checksum == expected)
+		return true;
+
+	if (fJournal != NULL && cache_has_block_in_transaction(fBlockCache,
+			fJournal->TransactionID(), block)) {
+		return true;
+	}
+
+	atomic_add64(&fChecksumErrors, 1);
+	atomic_set64(&fLastChecksumErrorBlock, block);
+
+	FATAL(("checksum mismatch in block %" B_PRIdOFF ": %08" B_PRIx32
+		", expected %08" B_PRIx32 "\n", block, checksum, expected));
+	return false;
+}
+
+
+/*!	Returns the maximum size of a file that can store its data in its inode.
+	This always leaves enough space in the small_data section for the longest
+	possible name, and for a few small attributes, like the MIME type.
+*/
+uint32
+Volume::MaxInlineDataSize() const
+{
+	const uint32 nameSpace = sizeof(small_data) + FILE_NAME_NAME_LENGTH + 3
+		+ B_FILE_NAME_LENGTH;
+	const uint32 dataSpace = sizeof(small_data) + INLINE_DATA_NAME_LENGTH + 3
+		+ 1;
+	const uint32 attributeSpace = 256;
+
+	int32 size = InodeSize() - sizeof(bfs_inode) - nameSpace - dataSpace
+		- attributeSpace;
+	return size > 0 ? size : 0;
+}
+
+
 status_t
 Volume::WriteSuperBlock()
 {
@@ -491,6 +649,66 @@ Volume::DeleteCheckVisitor()
 }
 
 
+/*!	Starts defragmenting the volume in a background thread, see
+	DefragmentVisitor. Only a single run can be active at a time.
+*/
+status_t
+Volume::StartDefragmenting(uint32 flags)
+{
+	if (IsReadOnly())
+		return B_READ_ONLY_DEVICE;
+
+	MutexLocker locker(fLock);
+
+	if (fDefragmenter == NULL) {
+		fDefragmenter = new(std::nothrow) DefragmentVisitor(this);
+		if (fDefragmenter == NULL)
+			return B_NO_MEMORY;
+	}
+
+	return fDefragmenter->StartDefragmenting(flags);
+}
+
+
+void
+Volume::StopDefragmenting()
+{
+	MutexLocker locker(fLock);
+	DefragmentVisitor* defragmenter = fDefragmenter;
+	locker.Unlock();
+
+	// the defragmenter is only deleted on unmount
+	if (defragmenter != NULL)
+		defragmenter->StopDefragmenting();
+}
+
+
+status_t
+Volume::GetDefragmentStatus(bfs_defragment_status& status)
+{
+	MutexLocker locker(fLock);
+	DefragmentVisitor* defragmenter = fDefragmenter;
+	locker.Unlock();
+
+	if (defragmenter == NULL)
+		return B_NO_INIT;
+
+	return defragmenter->GetStatus(status);
+}
+
+
+void
+Volume::GetDiscardStatus(bfs_discard_status& status)
+{
+	if (fDiscardQueue == NULL) {
+		memset(&status, 0, sizeof(status));
+		return;
+	}
+
+	fDiscardQueue->GetStatus(status);
+}
+
+
 //	#pragma mark - Disk scanning and initialization
 
 
@@ -596,6 +814,12 @@ Volume::Initialize(int fd, const char* name, uint32 blockSize,
 	if (!IsValidSuperBlock())
 		RETURN_ERROR(B_ERROR);
 
+	// all metadata needs a checksum, including the root directory
+	if ((flags & VOLUME_CHECKSUMS) != 0) {
+		fSuperBlock.SetFeatures(fSuperBlock.Features()
+			| SUPER_BLOCK_FEATURE_CHECKSUMS);
+	}
+
 	if ((fBlockCache = opener.InitCache(NumBlocks(), fBlockSize)) == NULL)
 		return B_ERROR;
 
@@ -618,6 +842,11 @@ Volume::Initialize(int fd, const char* name, uint32 blockSize,
 
 	fSuperBlock.root_dir = ToBlockRun(id);
 
+	if ((flags & VOLUME_INLINE_DATA) != 0) {
+		fSuperBlock.SetFeatures(fSuperBlock.Features()
+			| SUPER_BLOCK_FEATURE_INLINE_DATA);
+	}
+
 	if ((flags & VOLUME_NO_INDICES) == 0) {
 		// The indices root directory will be created automatically
 		// when the standard indices are created (or any other).
@@ -679,3 +908,21 @@ Volume::_EraseUnusedBootBlock()
 
 	return B_OK;
 }
+
+
+void
+Volume::_CountTrigramIndices()
+{
+	BPlusTree* tree = fIndicesNode->Tree();
+	if (tree == NULL)
+		return;
+
+	TreeIterator iterator(tree);
+	char name[B_FILE_NAME_LENGTH];
+	uint16 length;
+	off_t id;
+	while (iterator.GetNextEntry(name, &length, sizeof(name), &id) == B_OK) {
+		if (Index::IsTrigramIndex(name))
+			fTrigramIndices++;
+	}
+}
@@ -10,12 +10,17 @@
 
 #include "bfs.h"
 #include "BlockAllocator.h"
+#include "IndexCache.h"
 
 
 class CheckVisitor;
+class DefragmentVisitor;
+class DiscardQueue;
 class Journal;
 class Inode;
 class Query;
+struct bfs_defragment_status;
+struct bfs_discard_status;
 
 
 enum volume_flags {
@@ -24,6 +29,8 @@ enum volume_flags {
 
 enum volume_initialize_flags {
 	VOLUME_NO_INDICES	= 0x0001,
+	VOLUME_INLINE_DATA	= 0x0002,
+	VOLUME_CHECKSUMS	= 0x0004,
 };
 
 typedef DoublyLinkedList<Inode> InodeList;
@@ -34,7 +41,8 @@ public:
 							Volume(fs_volume* volume);
 							~Volume();
 
-			status_t		Mount(const char* device, uint32 flags);
+			status_t		Mount(const char* device, uint32 flags,
+								const char* parameters = NULL);
 			status_t		Unmount();
 			status_t		Initialize(int fd, const char* name,
 								uint32 blockSize, uint32 flags);
@@ -66,6 +74,20 @@ public:
 								{ return fSuperBlock.UsedBlocks(); }
 			off_t			FreeBlocks() const
 								{ return NumBlocks() - UsedBlocks(); }
+			off_t			ReservedBlocks() const
+								{ return atomic_get64(
+									(int64*)&fReservedBlocks); }
+			off_t			AvailableBlocks() const
+								{ return FreeBlocks() - ReservedBlocks(); }
+			status_t		ReserveBlocks(off_t count);
+			void			UnreserveBlocks(off_t count);
+			void			DelayedBlocksAllocated(off_t count);
+			off_t			DelayedAllocations() const
+								{ return atomic_get64(
+									(int64*)&fDelayedAllocations); }
+			off_t			DelayedAllocatedBlocks() const
+								{ return atomic_get64(
+									(int64*)&fDelayedAllocatedBlocks); }
 			off_t			NumBitmapBlocks() const
 								{ return (NumBlocks() + fBlockSize * 8 - 1)
 									/ (fBlockSize * 8); }
@@ -81,6 +103,25 @@ public:
 								{ return fAllocationGroupShift; }
 			disk_super_block& SuperBlock() { return fSuperBlock; }
 
+			bool			HasInlineData() const
+								{ return (fSuperBlock.Features()
+									& SUPER_BLOCK_FEATURE_INLINE_DATA) != 0; }
+			bool			UsesInlineData() const;
+			status_t		SetInlineData(bool enable);
+			uint32			MaxInlineDataSize() const;
+
+			bool			HasChecksums() const
+								{ return (fSuperBlock.Features()
+									& SUPER_BLOCK_FEATURE_CHECKSUMS) != 0; }
+			bool			IsChecksumValid(off_t block, uint32 checksum,
+								uint32 expected);
+			off_t			ChecksumErrors() const
+								{ return atomic_get64(
+									(int64*)&fChecksumErrors); }
+			off_t			LastChecksumErrorBlock() const
+								{ return atomic_get64(
+									(int64*)&fLastChecksumErrorBlock); }
+
 			off_t			ToOffset(block_run run) const
 								{ return ToBlock(run) << BlockShift(); }
 			off_t			ToBlock(block_run run) const
@@ -122,6 +163,19 @@ public:
 			void			DeleteCheckVisitor();
 			::CheckVisitor*	CheckVisitor() { return fCheckVisitor; }
 
+			// defragmenting
+			status_t		StartDefragmenting(uint32 flags);
+			void			StopDefragmenting();
+			status_t		GetDefragmentStatus(
+								bfs_defragment_status& status);
+
+			// index changes of the running transaction
+			IndexCache&		GetIndexCache() { return fIndexCache; }
+
+			// discarding freed blocks
+			DiscardQueue*	GetDiscardQueue() const { return fDiscardQueue; }
+			void			GetDiscardStatus(bfs_discard_status& status);
+
 			// cache access
 			status_t		WriteSuperBlock();
 			status_t		FlushDevice();
@@ -139,6 +193,12 @@ public:
 			void			AddQuery(Query* query);
 			void			RemoveQuery(Query* query);
 
+			bool			HasTrigramIndices() const
+								{ return atomic_get(
+									(int32*)&fTrigramIndices) > 0; }
+			void			TrigramIndicesChanged(int32 delta)
+								{ atomic_add(&fTrigramIndices, delta); }
+
 			status_t		Sync();
 			Journal*		GetJournal(off_t refBlock) const;
 
@@ -150,6 +210,7 @@ public:
 
 private:
 			status_t		_EraseUnusedBootBlock();
+			void			_CountTrigramIndices();
 
 protected:
 			fs_volume*		fVolume;
@@ -172,14 +233,29 @@ protected:
 
 			vint32			fDirtyCachedBlocks;
 
+			int64			fReservedBlocks;
+				// blocks that have been promised to files that delay
+				// their allocation until their data is written back
+			int64			fDelayedAllocations;
+			int64			fDelayedAllocatedBlocks;
+
 			mutex			fQueryLock;
 			SinglyLinkedList<Query> fQueries;
+			int32			fTrigramIndices;
+				// allows Index::Update() to skip looking for a trigram
+				// index if there isn't any
+			IndexCache		fIndexCache;
+
+			int64			fChecksumErrors;
+			int64			fLastChecksumErrorBlock;
 
 			uint32			fFlags;
 
 			void*			fBlockCache;
 			thread_id		fCheckingThread;
 			::CheckVisitor*	fCheckVisitor;
+			DefragmentVisitor* fDefragmenter;
+			DiscardQueue*	fDiscardQueue;
 
 			InodeList		fRemovedInodes;
 };
@@ -232,6 +308,31 @@ Volume::Free(Transaction& transaction, block_run run)
 }
 
 
+inline bool
+Volume::UsesInlineData() const
+{
+	// whether or not new small files should store their data inline
+	return (fSuperBlock.Features() & (SUPER_BLOCK_FEATURE_INLINE_DATA
+			| SUPER_BLOCK_FEATURE_NO_NEW_INLINE_DATA))
+		== SUPER_BLOCK_FEATURE_INLINE_DATA;
+}
+
+
+inline void
+Volume::UnreserveBlocks(off_t count)
+{
+	atomic_add64(&fReservedBlocks, -count);
+}
+
+
+inline void
+Volume::DelayedBlocksAllocated(off_t count)
+{
+	atomic_add64(&fDelayedAllocations, 1);
+	atomic_add64(&fDelayedAllocatedBlocks, count);
+}
+
+
 inline status_t
 Volume::FlushDevice()
 {
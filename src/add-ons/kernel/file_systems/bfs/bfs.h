@@ -76,7 +76,8 @@ struct disk_super_block {
 	int32		magic3;
 	inode_addr	root_dir;
 	inode_addr	indices;
-	int32		_reserved[8];
+	uint32		features;
+	int32		_reserved[7];
 	int32		pad_to_block[87];
 		// this also contains parts of the boot block
 
@@ -97,21 +98,45 @@ struct disk_super_block {
 	int32 Flags() const { return BFS_ENDIAN_TO_HOST_INT32(flags); }
 	off_t LogStart() const { return BFS_ENDIAN_TO_HOST_INT64(log_start); }
 	off_t LogEnd() const { return BFS_ENDIAN_TO_HOST_INT64(log_end); }
+	uint32 Features() const { return BFS_ENDIAN_TO_HOST_INT32(features); }
 
 	// implemented in Volume.cpp:
 	bool IsValid() const;
 	void Initialize(const char *name, off_t numBlocks, uint32 blockSize);
+	void SetFeatures(uint32 features);
 } _PACKED;
 
 #define SUPER_BLOCK_FS_LENDIAN		'BIGE'		/* BIGE */
 
 #define SUPER_BLOCK_MAGIC1			'BFS1'		/* BFS1 */
 #define SUPER_BLOCK_MAGIC2			0xdd121031
+#define SUPER_BLOCK_MAGIC2_INCOMPAT	0xdd121032
+	// replaces SUPER_BLOCK_MAGIC2 while an incompatible feature is set
 #define SUPER_BLOCK_MAGIC3			0x15b6830e
 
 #define SUPER_BLOCK_DISK_CLEAN		'CLEN'		/* CLEN */
 #define SUPER_BLOCK_DISK_DIRTY		'DIRT'		/* DIRT */
 
+// Optional features; older implementations leave the field zeroed. The
+// lower 16 bits are compatible features that can safely be ignored, while
+// a volume with any unknown incompatible feature must not be mounted.
+// Implementations that predate the features field don't look at it, so
+// as long as an incompatible feature is set, magic2 is changed to
+// SUPER_BLOCK_MAGIC2_INCOMPAT to make them refuse the volume.
+#define SUPER_BLOCK_FEATURE_NO_NEW_INLINE_DATA	0x00000001
+	// new small files no longer store their data in the small_data section
+#define SUPER_BLOCK_FEATURE_INLINE_DATA			0x00010000
+	// small files may store their data in the small_data section; this
+	// cannot be removed again once it has been set
+#define SUPER_BLOCK_FEATURE_CHECKSUMS			0x00020000
+	// inodes and B+tree nodes carry a CRC-32C checksum of their contents;
+	// this can only be set when the volume is initialized
+
+#define SUPER_BLOCK_INCOMPAT_FEATURES			0xffff0000
+#define SUPER_BLOCK_KNOWN_FEATURES				\
+	(SUPER_BLOCK_FEATURE_NO_NEW_INLINE_DATA | SUPER_BLOCK_FEATURE_INLINE_DATA \
+		| SUPER_BLOCK_FEATURE_CHECKSUMS)
+
 //**************************************
 
 #define NUM_DIRECT_BLOCKS			12
@@ -171,6 +196,11 @@ struct small_data {
 #define FILE_NAME_NAME			0x13
 #define FILE_NAME_NAME_LENGTH	1
 
+// The contents of files with INODE_INLINE_DATA set
+#define INLINE_DATA_TYPE		'RAWT'
+#define INLINE_DATA_NAME		0x14
+#define INLINE_DATA_NAME_LENGTH	1
+
 // The maximum key length of attribute data that is put  in the index.
 // This excludes a terminating null byte.
 // This must be smaller than or equal as BPLUSTREE_MAX_KEY_LENGTH.
@@ -212,9 +242,9 @@ struct bfs_inode {
 		char 			short_symlink[SHORT_SYMLINK_NAME_LENGTH];
 	};
 	bigtime_t	status_change_time;
-	int32		pad[2];
-		// on 32 bit architectures we use this member as a doubly linked list
-		// link
+	uint32		checksum;
+		// only maintained with SUPER_BLOCK_FEATURE_CHECKSUMS
+	int32		pad;
 
 	small_data	small_data_start[0];
 
@@ -231,9 +261,11 @@ struct bfs_inode {
 		{ return BFS_ENDIAN_TO_HOST_INT64(create_time); }
 	int64 StatusChangeTime() const
 		{ return BFS_ENDIAN_TO_HOST_INT64(status_change_time); }
+	uint32 Checksum() const { return BFS_ENDIAN_TO_HOST_INT32(checksum); }
 	small_data* SmallDataStart() { return small_data_start; }
 
 	status_t InitCheck(Volume* volume) const;
+	uint32 CalculateChecksum(Volume* volume) const;
 		// defined in Inode.cpp
 
 	static int64 ToInode(bigtime_t time)
@@ -258,6 +290,7 @@ enum inode_flags {
 	INODE_DELETED			= 0x00000010,
 	INODE_NOT_READY			= 0x00000020,	// used during Inode construction
 	INODE_LONG_SYMLINK		= 0x00000040,	// symlink in data stream
+	INODE_INLINE_DATA		= 0x00000080,	// file data in small_data section
 
 	INODE_PERMANENT_FLAGS	= 0x0000ffff,
 
@@ -65,6 +65,9 @@ struct check_control {
 		uint64	blocks_in_indirect;
 		uint64	blocks_in_double_indirect;
 		uint64	partial_block_runs;
+		uint64	inline_files;
+		uint64	checksum_errors;
+			/* metadata blocks that did not match their checksum */
 		uint32	block_size;
 	} stats;
 	status_t	status;
@@ -93,6 +96,7 @@ struct check_control {
 #define BFS_WRONG_TYPE			16
 #define BFS_NAMES_DONT_MATCH	32
 #define BFS_INVALID_BPLUSTREE	64
+#define BFS_INVALID_INLINE_DATA	128
 
 /* check control magic value */
 #define BFS_IOCTL_CHECK_MAGIC	'BChk'
@@ -103,5 +107,189 @@ struct check_control {
  */
 #define BFS_IOCTL_RESIZE		14205
 
+/* Retrieves fragmentation statistics for the file the ioctl is issued on,
+ * and for the volume it lives on. The parameter is a
+ * struct bfs_fragmentation_info.
+ */
+#define BFS_IOCTL_GET_FRAGMENTATION	14206
+
+#define BFS_FREE_EXTENT_BUCKETS		16
+
+struct bfs_fragmentation_info {
+	/* the file */
+	uint64		file_blocks;
+	uint64		file_block_runs;
+	uint64		file_extents;
+		/* block_runs that directly follow each other on disk are counted
+		 * as a single extent
+		 */
+	uint64		file_delayed_blocks;
+		/* blocks that have been written to, but not been allocated yet */
+
+	/* the volume */
+	uint64		free_blocks;
+	uint64		free_extents;
+	uint64		largest_free_extent;
+	uint64		free_extent_histogram[BFS_FREE_EXTENT_BUCKETS];
+		/* bucket i counts the free extents of 2^i to 2^(i + 1) - 1 blocks,
+		 * the last one also contains all larger extents
+		 */
+	uint64		reserved_blocks;
+		/* blocks reserved for delayed allocations */
+	uint64		delayed_allocations;
+	uint64		delayed_allocated_blocks;
+};
+
+/* Describes how a query would be evaluated on the volume, without running
+ * it. The parameter is a struct bfs_explain_query; the description is
+ * written as text to the "buffer" field.
+ */
+#define BFS_IOCTL_EXPLAIN_QUERY		14207
+
+struct bfs_explain_query {
+	const char*	predicate;
+	uint32		flags;
+		/* the query flags, only B_QUERY_NON_INDEXED is respected */
+	char*		buffer;
+	size_t		buffer_size;
+};
+
+/* Trigram indices allow queries for parts of a string attribute, like
+ * "name=*foo*", to be answered without looking at every value. They are
+ * created like regular string indices, using the name of the attribute
+ * with this prefix.
+ */
+#define BFS_TRIGRAM_INDEX_PREFIX	"BFS:trigram:"
+
+/* Merges the nodes of a B+tree that fit into one, and gives unused space
+ * at its end back to the volume. The parameter is a struct bfs_compact_tree;
+ * if its "index" field is NULL, the directory the ioctl is issued on is
+ * compacted. Only root may issue it.
+ */
+#define BFS_IOCTL_COMPACT_TREE		14208
+
+struct bfs_compact_tree {
+	const char*	index;
+	uint64		merged_nodes;
+	uint64		old_size;
+	uint64		new_size;
+};
+
+/* Adds nodes to an attribute index, using the current value of their
+ * attribute. The values are sorted before they are inserted, which leaves
+ * the index B+tree tightly packed, and is a lot faster than rewriting the
+ * attributes one by one. The parameter is a struct bfs_add_to_index.
+ * Only root may issue it.
+ */
+#define BFS_IOCTL_ADD_TO_INDEX		14209
+
+#define BFS_ADD_TO_INDEX_MAX_NODES	1024
+
+struct bfs_add_to_index {
+	const char*		index;
+	const ino_t*	nodes;
+	uint32			count;
+		/* at most BFS_ADD_TO_INDEX_MAX_NODES */
+	uint32			added;
+		/* set to the number of nodes that were not in the index yet */
+};
+
+/* Small files can store their data in the inode itself instead of in a block
+ * of their own. This enables or disables this for files that are created
+ * from now on; the parameter is a uint32 that is 0 to disable it.
+ * Only root may issue it.
+ */
+#define BFS_IOCTL_SET_INLINE_DATA	14210
+
+/* Moves the data of the file the ioctl is issued on into its inode, if it is
+ * small enough, or back out into a block of its own. The parameter is a uint32
+ * that is 0 to move the data out of the inode. The caller needs write access
+ * to the file.
+ */
+#define BFS_IOCTL_MOVE_INLINE_DATA	14211
+
+/* Starts defragmenting the volume in the background: the data streams of
+ * fragmented files are moved into contiguous blocks, and directory B+trees
+ * are moved near their directory, and its children. The parameter is a
+ * struct bfs_defragment_status, of which only the "flags" field is used.
+ * The volume cannot be unmounted while this is running. Only root may issue
+ * it.
+ */
+#define BFS_IOCTL_START_DEFRAGMENTING	14212
+
+/* Stops the defragmenter, if it is running; there is no parameter. Only root
+ * may issue it.
+ */
+#define BFS_IOCTL_STOP_DEFRAGMENTING	14213
+
+/* Retrieves the progress of the defragmenter, or the results of its last
+ * run. The parameter is a struct bfs_defragment_status.
+ */
+#define BFS_IOCTL_GET_DEFRAGMENT_STATUS	14214
+
+/* values for the flags field */
+#define BFS_DEFRAGMENT_FILES		1
+	/* files, symbolic links, and attributes */
+#define BFS_DEFRAGMENT_DIRECTORIES	2
+#define BFS_DEFRAGMENT_INDICES		4
+
+struct bfs_defragment_status {
+	uint32		flags;
+	bool		running;
+	status_t	status;
+		/* B_OK once a run has been completed */
+
+	uint64		visited_nodes;
+	uint64		moved_nodes;
+	uint64		moved_blocks;
+	uint64		skipped_nodes;
+		/* nodes that were in use, or could not be moved */
+	uint64		extents_before;
+	uint64		extents_after;
+		/* the number of extents of the moved nodes */
+
+	uint64		visited_blocks;
+	uint64		used_blocks;
+		/* the blocks of the nodes visited so far, and of the whole volume,
+		 * as a rough indication of the progress
+		 */
+	uint64		free_extents;
+	uint64		largest_free_extent;
+};
+
+/* Retrieves how many inodes, and B+tree nodes did not match their checksum
+ * since the volume has been mounted. The parameter is a
+ * struct bfs_checksum_status.
+ */
+#define BFS_IOCTL_GET_CHECKSUM_STATUS	14215
+
+struct bfs_checksum_status {
+	bool		enabled;
+		/* the volume has been initialized with checksums */
+	bool		hardware_accelerated;
+	uint64		errors;
+	int64		last_error_block;
+		/* -1 if there were no errors */
+};
+
+/* Volumes mounted with the "discard" parameter report freed blocks to the
+ * device in the background, once they are safely freed on disk.
+ * The parameter is a struct bfs_discard_status.
+ */
+#define BFS_IOCTL_GET_DISCARD_STATUS	14216
+
+struct bfs_discard_status {
+	bool		enabled;
+		/* false if not mounted with discard, or the device can't trim */
+	uint64		pending_bytes;
+		/* freed, but not yet written to the log */
+	uint64		queued_bytes;
+	uint64		discarded_bytes;
+	uint64		canceled_bytes;
+		/* allocated again before they could be discarded */
+	uint64		dropped_bytes;
+		/* did not fit into the queue anymore */
+};
+
 
 #endif	/* BFS_CONTROL_H */
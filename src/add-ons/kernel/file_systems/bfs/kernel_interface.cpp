@@ -9,6 +9,7 @@
 
 #include "Attribute.h"
 #include "CheckVisitor.h"
+#include "Checksum.h"
 #include "Debug.h"
 #include "Volume.h"
 #include "Inode.h"
@@ -28,6 +29,9 @@
 
 #define BFS_IO_SIZE	65536
 
+static const size_t kMaxExplainPredicateLength = 4096;
+static const size_t kMaxExplainOutputLength = 16384;
+
 #if defined(BFS_LITTLE_ENDIAN_ONLY)
 #define BFS_ENDIAN_SUFFIX ""
 #define BFS_ENDIAN_PRETTY_SUFFIX ""
@@ -178,7 +182,7 @@ bfs_mount(fs_volume* _volume, const char* device, uint32 flags,
 	if (volume == NULL)
 		return B_NO_MEMORY;
 
-	status_t status = volume->Mount(device, flags);
+	status_t status = volume->Mount(device, flags, args);
 	if (status != B_OK) {
 		delete volume;
 		RETURN_ERROR(status);
@@ -226,7 +230,7 @@ bfs_read_fs_stat(fs_volume* _volume, struct fs_info* info)
 
 	info->block_size = volume->BlockSize();
 	info->total_blocks = volume->NumBlocks();
-	info->free_blocks = volume->FreeBlocks();
+	info->free_blocks = volume->AvailableBlocks();
 
 	// Volume name
 	strlcpy(info->volume_name, volume->Name(), sizeof(info->volume_name));
@@ -407,6 +411,141 @@ bfs_can_page(fs_volume* _volume, fs_vnode* _v, void* _cookie)
 }
 
 
+/*!	Fills the pages of a file whose data is stored in its inode; whatever
+	lies beyond the end of the file is cleared.
+	The inode must be read locked.
+*/
+static status_t
+read_inline_pages(Inode* inode, off_t pos, const iovec* vecs, size_t count,
+	size_t* _numBytes)
+{
+	size_t bytesLeft = *_numBytes;
+
+	for (size_t i = 0; i < count && bytesLeft > 0; i++) {
+		size_t length = min_c(vecs[i].iov_len, bytesLeft);
+		size_t bytes = length;
+		status_t status = inode->ReadInlineData(pos,
+			(uint8*)vecs[i].iov_base, &bytes);
+		if (status != B_OK)
+			return status;
+
+		memset((uint8*)vecs[i].iov_base + bytes, 0, length - bytes);
+
+		pos += length;
+		bytesLeft -= length;
+	}
+
+	*_numBytes -= bytesLeft;
+	return B_OK;
+}
+
+
+/*!	Writes back the data of a file that is stored in its inode. Since this
+	is called by the page writer, it does not wait long for the journal.
+*/
+static status_t
+write_inline_data(Inode* inode, off_t pos, const uint8* buffer, size_t length)
+{
+	Transaction transaction;
+	status_t status = inode->StartTransaction(transaction, false);
+	if (status != B_OK)
+		return status;
+
+	if (!inode->IsInline()) {
+		// The data has been moved out of the inode in the mean time; the
+		// pages stay modified, and will be written to the data stream later
+		transaction.Done();
+		return B_BUSY;
+	}
+
+	status = inode->WriteInlineData(transaction, pos, buffer, length);
+	if (status == B_OK)
+		status = transaction.Done();
+
+	return status;
+}
+
+
+static status_t
+write_inline_pages(Inode* inode, off_t pos, const iovec* vecs, size_t count,
+	size_t* _numBytes)
+{
+	// Only the part of the pages within the file is of interest, and that
+	// always fits into a single block
+	size_t bufferSize = inode->GetVolume()->BlockSize();
+	uint8* buffer = (uint8*)malloc(bufferSize);
+	if (buffer == NULL)
+		return B_NO_MEMORY;
+
+	MemoryDeleter bufferDeleter(buffer);
+
+	size_t bytesLeft = min_c(*_numBytes, bufferSize);
+	size_t length = 0;
+
+	for (size_t i = 0; i < count && bytesLeft > 0; i++) {
+		size_t bytes = min_c(vecs[i].iov_len, bytesLeft);
+		if (vecs[i].iov_base != NULL)
+			memcpy(buffer + length, vecs[i].iov_base, bytes);
+		else {
+			// the file cache of the fs_shell passes zeros this way
+			memset(buffer + length, 0, bytes);
+		}
+
+		length += bytes;
+		bytesLeft -= bytes;
+	}
+
+	return write_inline_data(inode, pos, buffer, length);
+}
+
+
+#ifndef FS_SHELL
+/*!	Serves an I/O request for a file whose data is stored in its inode.
+	For reads, the inode must be read locked.
+*/
+static status_t
+inline_data_io(Inode* inode, io_request* request)
+{
+	off_t pos = io_request_offset(request);
+	off_t length = io_request_length(request);
+
+	size_t bufferSize = inode->GetVolume()->BlockSize();
+	uint8* buffer = (uint8*)malloc(bufferSize);
+	if (buffer == NULL)
+		return B_NO_MEMORY;
+
+	MemoryDeleter bufferDeleter(buffer);
+	status_t status = B_OK;
+
+	if (io_request_is_write(request)) {
+		// Only the first block can contain any data of the file, the rest
+		// is read from the request, and ignored
+		for (off_t offset = 0; status == B_OK && offset < length;
+				offset += bufferSize) {
+			size_t bytes = min_c(length - offset, (off_t)bufferSize);
+			status = read_from_io_request(request, buffer, bytes);
+			if (status == B_OK && offset == 0)
+				status = write_inline_data(inode, pos, buffer, bytes);
+		}
+	} else {
+		for (off_t offset = 0; status == B_OK && offset < length;
+				offset += bufferSize) {
+			size_t size = min_c(length - offset, (off_t)bufferSize);
+			size_t bytes = size;
+			status = inode->ReadInlineData(pos + offset, buffer, &bytes);
+			if (status != B_OK)
+				break;
+
+			memset(buffer + bytes, 0, size - bytes);
+			status = write_to_io_request(request, buffer, size);
+		}
+	}
+
+	return status;
+}
+#endif	// !FS_SHELL
+
+
 static status_t
 bfs_read_pages(fs_volume* _volume, fs_vnode* _node, void* _cookie,
 	off_t pos, const iovec* vecs, size_t count, size_t* _numBytes)
@@ -419,6 +558,9 @@ bfs_read_pages(fs_volume* _volume, fs_vnode* _node, void* _cookie,
 
 	InodeReadLocker _(inode);
 
+	if (inode->IsInline())
+		return read_inline_pages(inode, pos, vecs, count, _numBytes);
+
 	uint32 vecIndex = 0;
 	size_t vecOffset = 0;
 	size_t bytesLeft = *_numBytes;
@@ -462,12 +604,21 @@ bfs_write_pages(fs_volume* _volume, fs_vnode* _node, void* _cookie,
 	if (inode->FileCache() == NULL)
 		RETURN_ERROR(B_BAD_VALUE);
 
-	InodeReadLocker _(inode);
+	// the pages may belong to a part of the file that has no blocks yet
+	status_t status = inode->AllocateDelayedBlocks(false);
+	if (status != B_OK)
+		return status;
+
+	InodeReadLocker locker(inode);
+
+	if (inode->IsInline()) {
+		locker.Unlock();
+		return write_inline_pages(inode, pos, vecs, count, _numBytes);
+	}
 
 	uint32 vecIndex = 0;
 	size_t vecOffset = 0;
 	size_t bytesLeft = *_numBytes;
-	status_t status;
 
 	while (true) {
 		file_io_vec fileVecs[8];
@@ -514,9 +665,38 @@ bfs_io(fs_volume* _volume, fs_vnode* _node, void* _cookie, io_request* request)
 		RETURN_ERROR(B_BAD_VALUE);
 	}
 
+#ifndef FS_SHELL
+	if (io_request_is_write(request) && inode->HasDelayedAllocation()) {
+		// The pages may belong to a part of the file that has no blocks
+		// yet. If we cannot allocate them right now, the pages just stay
+		// modified, and we'll get another chance later.
+		status_t status = inode->AllocateDelayedBlocks(false);
+		if (status != B_OK) {
+			notify_io_request(request, status);
+			return status;
+		}
+	}
+#endif
+
 	// We lock the node here and will unlock it in the "finished" hook.
 	rw_lock_read_lock(&inode->Lock());
 
+#ifndef FS_SHELL
+	if (inode->IsInline()) {
+		// The data is stored in the inode, there is nothing to map
+		if (io_request_is_write(request))
+			rw_lock_read_unlock(&inode->Lock());
+
+		status_t status = inline_data_io(inode, request);
+
+		if (!io_request_is_write(request))
+			rw_lock_read_unlock(&inode->Lock());
+
+		notify_io_request(request, status);
+		return status;
+	}
+#endif
+
 	return do_iterative_fd_io(volume->Device(), request,
 		iterative_io_get_vecs_hook, iterative_io_finished_hook, inode);
 }
@@ -529,14 +709,31 @@ bfs_get_file_map(fs_volume* _volume, fs_vnode* _node, off_t offset, size_t size,
 	Volume* volume = (Volume*)_volume->private_volume;
 	Inode* inode = (Inode*)_node->private_node;
 
+	// files that store their data in the inode have no blocks to map
+	if (inode->IsInline())
+		return B_BAD_VALUE;
+
 	int32 blockShift = volume->BlockShift();
 	uint32 index = 0, max = *_count;
 	block_run run;
 	off_t fileOffset;
 
+	// Only the data stream has blocks allocated to it; the rest of the file
+	// is waiting for its delayed allocation, and is reported as sparse
+	off_t fileSize = inode->Size();
+	off_t streamEnd = round_up(inode->StreamSize(), volume->BlockSize());
+
 	//FUNCTION_START(("offset = %Ld, size = %lu\n", offset, size));
 
 	while (true) {
+		if (offset >= streamEnd) {
+			vecs[index].offset = -1;
+			vecs[index].length = round_up(fileSize, volume->BlockSize())
+				- offset;
+			*_count = index + 1;
+			return B_OK;
+		}
+
 		status_t status = inode->FindBlockRun(offset, run, fileOffset);
 		if (status != B_OK)
 			return status;
@@ -545,17 +742,15 @@ bfs_get_file_map(fs_volume* _volume, fs_vnode* _node, off_t offset, size_t size,
 		vecs[index].length = ((uint32)run.Length() << blockShift)
 			- offset + fileOffset;
 
+		if (offset + vecs[index].length > streamEnd) {
+			// make sure the extent ends with the last official file
+			// block (without taking any preallocations into account)
+			vecs[index].length = streamEnd - offset;
+		}
+
 		// are we already done?
 		if ((uint64)size <= (uint64)vecs[index].length
-			|| (uint64)offset + (uint64)vecs[index].length
-				>= (uint64)inode->Size()) {
-			if ((uint64)offset + (uint64)vecs[index].length
-					> (uint64)inode->Size()) {
-				// make sure the extent ends with the last official file
-				// block (without taking any preallocations into account)
-				vecs[index].length = round_up(inode->Size() - offset,
-					volume->BlockSize());
-			}
+			|| offset + vecs[index].length >= fileSize) {
 			*_count = index + 1;
 			return B_OK;
 		}
@@ -781,6 +976,297 @@ bfs_ioctl(fs_volume* _volume, fs_vnode* _node, void* _cookie, uint32 cmd,
 			ResizeVisitor resizer(volume);
 			return resizer.Resize(size, -1);
 		}
+		case BFS_IOCTL_GET_FRAGMENTATION:
+		{
+			if (bufferLength != sizeof(bfs_fragmentation_info))
+				return B_BAD_VALUE;
+
+			Inode* inode = (Inode*)_node->private_node;
+			bfs_fragmentation_info info;
+
+			status_t status = inode->CountExtents(info.file_block_runs,
+				info.file_extents, info.file_blocks);
+			if (status != B_OK)
+				return status;
+
+			{
+				InodeReadLocker locker(inode);
+				info.file_delayed_blocks = inode->HasDelayedAllocation()
+					? (round_up(inode->Size(), volume->BlockSize())
+						- round_up(inode->StreamSize(), volume->BlockSize()))
+							>> volume->BlockShift()
+					: 0;
+			}
+
+			status = volume->Allocator().GetFreeExtents(info.free_extents,
+				info.largest_free_extent, info.free_extent_histogram,
+				BFS_FREE_EXTENT_BUCKETS);
+			if (status != B_OK)
+				return status;
+
+			info.free_blocks = volume->FreeBlocks();
+			info.reserved_blocks = volume->ReservedBlocks();
+			info.delayed_allocations = volume->DelayedAllocations();
+			info.delayed_allocated_blocks = volume->DelayedAllocatedBlocks();
+
+			return user_memcpy(buffer, &info, sizeof(info));
+		}
+
+		case BFS_IOCTL_EXPLAIN_QUERY:
+		{
+			if (bufferLength != sizeof(bfs_explain_query))
+				return B_BAD_VALUE;
+
+			bfs_explain_query explain;
+			if (user_memcpy(&explain, buffer, sizeof(explain)) != B_OK)
+				return B_BAD_ADDRESS;
+			if (explain.predicate == NULL || explain.buffer == NULL
+				|| explain.buffer_size == 0)
+				return B_BAD_VALUE;
+
+			char* predicate = (char*)malloc(kMaxExplainPredicateLength);
+			if (predicate == NULL)
+				return B_NO_MEMORY;
+			MemoryDeleter predicateDeleter(predicate);
+
+			ssize_t length = user_strlcpy(predicate, explain.predicate,
+				kMaxExplainPredicateLength);
+			if (length < 0)
+				return B_BAD_ADDRESS;
+			if (length >= (ssize_t)kMaxExplainPredicateLength)
+				return B_NAME_TOO_LONG;
+
+			size_t size = min_c(explain.buffer_size, kMaxExplainOutputLength);
+			char* output = (char*)malloc(size);
+			if (output == NULL)
+				return B_NO_MEMORY;
+			MemoryDeleter outputDeleter(output);
+
+			Expression expression(predicate);
+			if (expression.InitCheck() != B_OK)
+				return B_BAD_VALUE;
+
+			Query query(volume, &expression,
+				explain.flags & B_QUERY_NON_INDEXED);
+			status_t status = query.Explain(output, size);
+			if (status != B_OK && status != B_BUFFER_OVERFLOW)
+				return status;
+
+			if (user_memcpy(explain.buffer, output, strlen(output) + 1)
+					!= B_OK)
+				return B_BAD_ADDRESS;
+
+			return status;
+		}
+
+		case BFS_IOCTL_COMPACT_TREE:
+		{
+			if (bufferLength != sizeof(bfs_compact_tree))
+				return B_BAD_VALUE;
+			if (volume->IsReadOnly())
+				return B_READ_ONLY_DEVICE;
+
+			// only root users are allowed to rewrite trees and indices
+			if (geteuid() != 0)
+				return B_NOT_ALLOWED;
+
+			bfs_compact_tree compact;
+			if (user_memcpy(&compact, buffer, sizeof(compact)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			Inode* inode = (Inode*)_node->private_node;
+			char name[B_FILE_NAME_LENGTH];
+			Index index(volume);
+
+			if (compact.index != NULL) {
+				ssize_t length = user_strlcpy(name, compact.index,
+					sizeof(name));
+				if (length < 0)
+					return B_BAD_ADDRESS;
+				if (length >= (ssize_t)sizeof(name))
+					return B_NAME_TOO_LONG;
+
+				status_t status = index.SetTo(name);
+				if (status != B_OK)
+					return status;
+
+				inode = index.Node();
+			}
+
+			if (inode->Tree() == NULL)
+				return B_NOT_A_DIRECTORY;
+
+			compact.old_size = inode->Size();
+
+			uint32 merged;
+			status_t status = inode->Tree()->Compact(merged);
+			if (status != B_OK)
+				return status;
+
+			compact.merged_nodes = merged;
+			compact.new_size = inode->Size();
+
+			return user_memcpy(buffer, &compact, sizeof(compact));
+		}
+
+		case BFS_IOCTL_ADD_TO_INDEX:
+		{
+			if (bufferLength != sizeof(bfs_add_to_index))
+				return B_BAD_VALUE;
+			if (volume->IsReadOnly())
+				return B_READ_ONLY_DEVICE;
+
+			// only root users are allowed to rewrite trees and indices
+			if (geteuid() != 0)
+				return B_NOT_ALLOWED;
+
+			bfs_add_to_index add;
+			if (user_memcpy(&add, buffer, sizeof(add)) != B_OK)
+				return B_BAD_ADDRESS;
+			if (add.index == NULL || add.nodes == NULL || add.count == 0
+				|| add.count > BFS_ADD_TO_INDEX_MAX_NODES)
+				return B_BAD_VALUE;
+
+			char name[B_FILE_NAME_LENGTH];
+			ssize_t length = user_strlcpy(name, add.index, sizeof(name));
+			if (length < 0)
+				return B_BAD_ADDRESS;
+			if (length >= (ssize_t)sizeof(name))
+				return B_NAME_TOO_LONG;
+
+			ino_t* nodes = (ino_t*)malloc(add.count * sizeof(ino_t));
+			if (nodes == NULL)
+				return B_NO_MEMORY;
+			MemoryDeleter nodesDeleter(nodes);
+
+			if (user_memcpy(nodes, add.nodes, add.count * sizeof(ino_t))
+					!= B_OK)
+				return B_BAD_ADDRESS;
+
+			Index index(volume);
+			status_t status = index.SetTo(name);
+			if (status != B_OK)
+				return status;
+
+			status = index.AddNodes(nodes, add.count, add.added);
+			if (status != B_OK)
+				return status;
+
+			return user_memcpy(buffer, &add, sizeof(add));
+		}
+
+		case BFS_IOCTL_SET_INLINE_DATA:
+		{
+			if (bufferLength != sizeof(uint32))
+				return B_BAD_VALUE;
+
+			// the feature bits of the volume can only be changed by root
+			if (geteuid() != 0)
+				return B_NOT_ALLOWED;
+
+			uint32 enable;
+			if (user_memcpy(&enable, buffer, sizeof(uint32)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return volume->SetInlineData(enable != 0);
+		}
+
+		case BFS_IOCTL_MOVE_INLINE_DATA:
+		{
+			if (bufferLength != sizeof(uint32))
+				return B_BAD_VALUE;
+			if (volume->IsReadOnly())
+				return B_READ_ONLY_DEVICE;
+
+			uint32 toInode;
+			if (user_memcpy(&toInode, buffer, sizeof(uint32)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			Inode* inode = (Inode*)_node->private_node;
+			if (!inode->IsFile())
+				return B_BAD_TYPE;
+
+			status_t status = inode->CheckPermissions(W_OK);
+			if (status != B_OK)
+				return status;
+
+			// The file cache is not written back here: as long as we hold
+			// the write lock, no pages can be written back, and the ones
+			// that are still modified afterwards go wherever the data is
+			// then. Only the blocks of the file need to be allocated.
+			Transaction transaction(volume, inode->BlockNumber());
+			inode->WriteLockInTransaction(transaction);
+
+			status = inode->AllocateDelayedBlocks(transaction);
+			if (status != B_OK)
+				return status;
+
+			if (toInode != 0)
+				status = inode->MoveDataToInode(transaction);
+			else
+				status = inode->MoveDataToStream(transaction);
+			if (status == B_OK)
+				status = transaction.Done();
+
+			return status;
+		}
+		case BFS_IOCTL_START_DEFRAGMENTING:
+		{
+			if (bufferLength != sizeof(bfs_defragment_status))
+				return B_BAD_VALUE;
+
+			// only root users are allowed to rewrite the whole volume
+			if (geteuid() != 0)
+				return B_NOT_ALLOWED;
+
+			bfs_defragment_status defragment;
+			if (user_memcpy(&defragment, buffer, sizeof(defragment)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return volume->StartDefragmenting(defragment.flags);
+		}
+		case BFS_IOCTL_STOP_DEFRAGMENTING:
+			if (geteuid() != 0)
+				return B_NOT_ALLOWED;
+
+			volume->StopDefragmenting();
+			return B_OK;
+		case BFS_IOCTL_GET_DEFRAGMENT_STATUS:
+		{
+			if (bufferLength != sizeof(bfs_defragment_status))
+				return B_BAD_VALUE;
+
+			bfs_defragment_status defragment;
+			status_t status = volume->GetDefragmentStatus(defragment);
+			if (status != B_OK)
+				return status;
+
+			return user_memcpy(buffer, &defragment, sizeof(defragment));
+		}
+
+		case BFS_IOCTL_GET_CHECKSUM_STATUS:
+		{
+			if (bufferLength != sizeof(bfs_checksum_status))
+				return B_BAD_VALUE;
+
+			bfs_checksum_status checksum;
+			checksum.enabled = volume->HasChecksums();
+			checksum.hardware_accelerated = crc32c_is_hardware_accelerated();
+			checksum.errors = volume->ChecksumErrors();
+			checksum.last_error_block = volume->LastChecksumErrorBlock();
+
+			return user_memcpy(buffer, &checksum, sizeof(checksum));
+		}
+		case BFS_IOCTL_GET_DISCARD_STATUS:
+		{
+			if (bufferLength != sizeof(bfs_discard_status))
+				return B_BAD_VALUE;
+
+			bfs_discard_status discard;
+			volume->GetDiscardStatus(discard);
+
+			return user_memcpy(buffer, &discard, sizeof(discard));
+		}
 
 #ifdef DEBUG_FRAGMENTER
 		case 56741:
@@ -1473,6 +1959,17 @@ static status_t
 bfs_close(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 {
 	FUNCTION();
+
+	file_cookie* cookie = (file_cookie*)_cookie;
+	Volume* volume = (Volume*)_volume->private_volume;
+	Inode* inode = (Inode*)_node->private_node;
+
+	// Allocate the blocks of a file that has been written to here already,
+	// so that close() can report if that fails
+	if ((cookie->open_mode & O_RWMASK) != 0 && !volume->IsReadOnly()
+		&& inode->HasDelayedAllocation())
+		RETURN_ERROR(inode->AllocateDelayedBlocks(true));
+
 	return B_OK;
 }
 
@@ -1488,6 +1985,7 @@ bfs_free_cookie(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 
 	Transaction transaction;
 	bool needsTrimming = false;
+	status_t allocationStatus = B_OK;
 
 	if (!volume->IsReadOnly() && !volume->IsCheckingThread()) {
 		InodeReadLocker locker(inode);
@@ -1495,7 +1993,7 @@ bfs_free_cookie(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 
 		if ((cookie->open_mode & O_RWMASK) != 0
 			&& !inode->IsDeleted()
-			&& (needsTrimming
+			&& (needsTrimming || inode->HasDelayedAllocation()
 				|| inode->OldLastModified() != inode->LastModified()
 				|| (inode->InSizeIndex()
 					// TODO: this can prevent the size update notification
@@ -1516,6 +2014,19 @@ bfs_free_cookie(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 		bool changedSize = false, changedTime = false;
 		Index index(volume);
 
+		if (inode->HasDelayedAllocation()) {
+			// now that the file's been written, allocate its blocks in one go
+			allocationStatus = inode->AllocateDelayedBlocks(transaction);
+			if (allocationStatus != B_OK) {
+				FATAL(("Could not allocate delayed blocks: inode %" B_PRIdINO
+					", transaction %d: %s!\n", inode->ID(),
+					(int)transaction.ID(), strerror(allocationStatus)));
+				// The rest of the transaction can still succeed, and the
+				// pages will try again when they are written back, but the
+				// error is reported
+			} else
+				needsTrimming = inode->NeedsTrimming();
+		}
 		if (needsTrimming) {
 			status = inode->TrimPreallocation(transaction);
 			if (status < B_OK) {
@@ -1563,7 +2074,7 @@ bfs_free_cookie(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 		file_cache_enable(inode->FileCache());
 
 	delete cookie;
-	return B_OK;
+	return allocationStatus;
 }
 
 
@@ -2182,6 +2693,10 @@ bfs_create_index(fs_volume* _volume, const char* name, uint32 type,
 	if (geteuid() != 0)
 		return B_NOT_ALLOWED;
 
+	bool isTrigramIndex = Index::IsTrigramIndex(name);
+	if (isTrigramIndex && type != B_STRING_TYPE && type != B_MIME_STRING_TYPE)
+		return B_BAD_TYPE;
+
 	Transaction transaction(volume, volume->Indices());
 
 	Index index(volume);
@@ -2190,6 +2705,24 @@ bfs_create_index(fs_volume* _volume, const char* name, uint32 type,
 	if (status == B_OK)
 		status = transaction.Done();
 
+	if (status == B_OK && isTrigramIndex) {
+		volume->TrigramIndicesChanged(1);
+
+		if (!strcmp(name + strlen(BFS_TRIGRAM_INDEX_PREFIX), "name")) {
+			status = index.AddExistingNames();
+			if (status != B_OK) {
+				// don't leave an incomplete index behind
+				index.Unset();
+
+				Transaction removeTransaction(volume, volume->Indices());
+				if (volume->IndicesNode()->Remove(removeTransaction, name)
+						== B_OK
+					&& removeTransaction.Done() == B_OK)
+					volume->TrigramIndicesChanged(-1);
+			}
+		}
+	}
+
 	RETURN_ERROR(status);
 }
 
@@ -2218,6 +2751,9 @@ bfs_remove_index(fs_volume* _volume, const char* name)
 	if (status == B_OK)
 		status = transaction.Done();
 
+	if (status == B_OK && Index::IsTrigramIndex(name))
+		volume->TrigramIndicesChanged(-1);
+
 	RETURN_ERROR(status);
 }
 
@@ -19,6 +19,7 @@
 
 #include "AttributeCookie.h"
 #include "AttributeDirectoryCookie.h"
+#include "CachedDataReader.h"
 #include "DebugSupport.h"
 #include "Directory.h"
 #include "Query.h"
@@ -1084,12 +1085,23 @@ packagefs_std_ops(int32 op, ...)
 				return error;
 			}
 
+			error = CachedDataReader::GlobalInit();
+			if (error != B_OK) {
+				ERROR("Failed to init CachedDataReader\n");
+				PackageFSRoot::GlobalUninit();
+				StringConstants::Cleanup();
+				StringPool::Cleanup();
+				exit_debugging();
+				return error;
+			}
+
 			return B_OK;
 		}
 
 		case B_MODULE_UNINIT:
 		{
 			PRINT("package_std_ops(): B_MODULE_UNINIT\n");
+			CachedDataReader::GlobalUninit();
 			PackageFSRoot::GlobalUninit();
 			StringConstants::Cleanup();
 			StringPool::Cleanup();
@@ -6,10 +6,15 @@
 
 #include "CachedDataReader.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <algorithm>
 
 #include <DataIO.h>
 
+#include <AutoDeleter.h>
+#include <smp.h>
 #include <util/AutoLock.h>
 #include <vm/VMCache.h>
 #include <vm/vm_page.h>
@@ -20,6 +25,9 @@
 using BPackageKit::BHPKG::BBufferDataReader;
 
 
+static const int32 kMaxQueuedReadAheads = 128;
+
+
 static inline bool
 page_physical_number_less(const vm_page* a, const vm_page* b)
 {
@@ -75,14 +83,96 @@ private:
 };
 
 
+// #pragma mark - ReadAheadJob
+
+
+struct CachedDataReader::ReadAheadJob
+	: public DoublyLinkedListLinkImpl<ReadAheadJob> {
+	CachedDataReader*	reader;
+	off_t				offset;
+	size_t				size;
+};
+
+
+// #pragma mark - SharedChunk
+
+
+/*!	A chunk whose data is cached in the shared chunk cache, on behalf of all
+	cache lines with the same chunk key. The cached data is stored at the
+	cache line with index \c slot of the shared chunk cache.
+*/
+struct CachedDataReader::SharedChunk {
+	SharedChunk*	hashNext;
+	uint8			key[kChunkKeySize];
+	uint32			slot;
+	int32			referenceCount;
+};
+
+
+struct CachedDataReader::SharedChunkHashDefinition {
+	typedef const uint8*	KeyType;
+	typedef	SharedChunk		ValueType;
+
+	size_t HashKey(const uint8* key) const
+	{
+		// the key is a cryptographic hash already
+		size_t hash;
+		memcpy(&hash, key, sizeof(hash));
+		return hash;
+	}
+
+	size_t Hash(const SharedChunk* value) const
+	{
+		return HashKey(value->key);
+	}
+
+	bool Compare(const uint8* key, const SharedChunk* value) const
+	{
+		return memcmp(value->key, key, kChunkKeySize) == 0;
+	}
+
+	SharedChunk*& GetLink(SharedChunk* value) const
+	{
+		return value->hashNext;
+	}
+};
+
+
 // #pragma mark - CachedDataReader
 
 
+mutex CachedDataReader::sReadAheadLock
+	= MUTEX_INITIALIZER("packagefs read-ahead");
+ConditionVariable CachedDataReader::sReadAheadQueuedCondition;
+ConditionVariable CachedDataReader::sReadAheadDoneCondition;
+CachedDataReader::ReadAheadJobList CachedDataReader::sReadAheadJobs;
+int32 CachedDataReader::sReadAheadJobCount = 0;
+thread_id CachedDataReader::sReadAheadThreads[kMaxReadAheadThreads];
+int32 CachedDataReader::sReadAheadThreadCount = 0;
+bool CachedDataReader::sQuitReadAheadThreads = false;
+
+mutex CachedDataReader::sSharedChunkLock
+	= MUTEX_INITIALIZER("packagefs shared chunks");
+CachedDataReader::SharedChunkTable* CachedDataReader::sSharedChunkTable = NULL;
+CachedDataReader::SharedChunk* CachedDataReader::sUnusedSharedChunks = NULL;
+uint32 CachedDataReader::sSharedChunkSlotCount = 0;
+CachedDataReader* CachedDataReader::sSharedChunkCache = NULL;
+
+
 CachedDataReader::CachedDataReader()
 	:
 	fReader(NULL),
 	fCache(NULL),
-	fCacheLineLockers()
+	fCacheLineLockers(),
+	fActiveReadAheads(0),
+	fChunkHits(0),
+	fChunkMisses(0),
+	fReadAheadChunks(0),
+	fDroppedReadAheads(0),
+	fDecompressedBytes(0),
+	fDecompressionTime(0),
+	fDeduplicatedChunks(0),
+	fSharedChunks(NULL)
 {
 	mutex_init(&fLock, "packagefs cached reader");
 }
@@ -90,6 +180,18 @@ CachedDataReader::CachedDataReader()
 
 CachedDataReader::~CachedDataReader()
 {
+	CancelReadAhead();
+
+	if (fSharedChunks != NULL) {
+		size_t lineCount = (fCache->virtual_end + kCacheLineSize - 1)
+			/ kCacheLineSize;
+		for (size_t i = 0; i < lineCount; i++) {
+			if (fSharedChunks[i] != NULL)
+				_PutSharedChunk(fSharedChunks[i]);
+		}
+		free(fSharedChunks);
+	}
+
 	if (fCache != NULL) {
 		fCache->Lock();
 		fCache->ReleaseRefAndUnlock();
@@ -99,8 +201,14 @@ CachedDataReader::~CachedDataReader()
 }
 
 
+/*!	If \a shareChunks is \c true, the data of each cache line is cached only
+	once for all cache lines of all readers that have the same chunk key, as
+	computed by ComputeChunkKey(). The data of the other cache lines is cached
+	per reader.
+*/
 status_t
-CachedDataReader::Init(BAbstractBufferedDataReader* reader, off_t size)
+CachedDataReader::Init(BAbstractBufferedDataReader* reader, off_t size,
+	bool shareChunks)
 {
 	fReader = reader;
 
@@ -119,6 +227,13 @@ CachedDataReader::Init(BAbstractBufferedDataReader* reader, off_t size)
 	if (error != B_OK)
 		RETURN_ERROR(error);
 
+	// Sharing chunks only saves memory, so we can do without it.
+	if (shareChunks && sSharedChunkCache != NULL && size > 0) {
+		fSharedChunks = (SharedChunk**)calloc(
+			(size + kCacheLineSize - 1) / kCacheLineSize,
+			sizeof(SharedChunk*));
+	}
+
 	return B_OK;
 }
 
@@ -159,6 +274,177 @@ CachedDataReader::ReadDataToOutput(off_t offset, size_t size,
 }
 
 
+/*static*/ status_t
+CachedDataReader::GlobalInit()
+{
+	// The shared chunk cache is optional as well.
+	sSharedChunkTable = new(std::nothrow) SharedChunkTable;
+	sSharedChunkCache = new(std::nothrow) CachedDataReader;
+	if (sSharedChunkTable == NULL || sSharedChunkTable->Init() != B_OK
+		|| sSharedChunkCache == NULL
+		|| sSharedChunkCache->Init(NULL, 0) != B_OK) {
+		ERROR("CachedDataReader::GlobalInit(): Failed to create the shared "
+			"chunk cache\n");
+		delete sSharedChunkTable;
+		sSharedChunkTable = NULL;
+		delete sSharedChunkCache;
+		sSharedChunkCache = NULL;
+	}
+
+	sReadAheadQueuedCondition.Init(&sReadAheadJobs, "packagefs read-ahead");
+	sReadAheadDoneCondition.Init(&sReadAheadThreads,
+		"packagefs read-ahead done");
+
+	// Read-ahead is optional, so it's fine if there are no threads at all.
+	int32 threadCount = std::min(smp_get_num_cpus(),
+		(int32)kMaxReadAheadThreads);
+	while (sReadAheadThreadCount < threadCount) {
+		thread_id thread = spawn_kernel_thread(&_ReadAheadThread,
+			"packagefs read-ahead", B_NORMAL_PRIORITY, NULL);
+		if (thread < 0)
+			break;
+
+		sReadAheadThreads[sReadAheadThreadCount++] = thread;
+		resume_thread(thread);
+	}
+
+	return B_OK;
+}
+
+
+/*static*/ void
+CachedDataReader::GlobalUninit()
+{
+	MutexLocker locker(sReadAheadLock);
+	sQuitReadAheadThreads = true;
+	sReadAheadQueuedCondition.NotifyAll();
+	locker.Unlock();
+
+	for (int32 i = 0; i < sReadAheadThreadCount; i++)
+		wait_for_thread(sReadAheadThreads[i], NULL);
+
+	sReadAheadThreadCount = 0;
+
+	// all readers are gone, so are the used shared chunks
+	delete sSharedChunkCache;
+	sSharedChunkCache = NULL;
+	delete sSharedChunkTable;
+	sSharedChunkTable = NULL;
+
+	while (SharedChunk* chunk = sUnusedSharedChunks) {
+		sUnusedSharedChunks = chunk->hashNext;
+		delete chunk;
+	}
+	sSharedChunkSlotCount = 0;
+}
+
+
+/*!	Asynchronously reads the cache lines of the given range into the cache,
+	if they aren't cached yet.
+	The caller must make sure that the underlying reader stays usable until
+	CancelReadAhead() has been called.
+*/
+void
+CachedDataReader::ReadAhead(off_t offset, size_t size)
+{
+	if (offset < 0 || offset >= fCache->virtual_end)
+		return;
+
+	size = std::min((off_t)size, fCache->virtual_end - offset);
+	if (size == 0)
+		return;
+
+	ReadAheadJob* job = new(std::nothrow) ReadAheadJob;
+	if (job == NULL)
+		return;
+
+	job->reader = this;
+	job->offset = offset;
+	job->size = size;
+
+	MutexLocker locker(sReadAheadLock);
+
+	if (sReadAheadThreadCount == 0 || sQuitReadAheadThreads
+		|| sReadAheadJobCount >= kMaxQueuedReadAheads) {
+		locker.Unlock();
+		atomic_add64(&fDroppedReadAheads, 1);
+		delete job;
+		return;
+	}
+
+	sReadAheadJobs.Add(job);
+	sReadAheadJobCount++;
+	sReadAheadQueuedCondition.NotifyOne();
+}
+
+
+/*!	Removes all pending read-ahead requests for this reader, and waits for the
+	ones that are currently being processed.
+*/
+void
+CachedDataReader::CancelReadAhead()
+{
+	MutexLocker locker(sReadAheadLock);
+
+	for (ReadAheadJobList::Iterator it = sReadAheadJobs.GetIterator();
+			ReadAheadJob* job = it.Next();) {
+		if (job->reader == this) {
+			it.Remove();
+			sReadAheadJobCount--;
+			delete job;
+		}
+	}
+
+	while (fActiveReadAheads > 0)
+		sReadAheadDoneCondition.Wait(&sReadAheadLock);
+}
+
+
+void
+CachedDataReader::AddStatistics(PackageFSCacheStatistics& statistics) const
+{
+	statistics.chunkHits += atomic_get64((int64*)&fChunkHits);
+	statistics.chunkMisses += atomic_get64((int64*)&fChunkMisses);
+	statistics.readAheadChunks += atomic_get64((int64*)&fReadAheadChunks);
+	statistics.droppedReadAheads
+		+= atomic_get64((int64*)&fDroppedReadAheads);
+	statistics.decompressedBytes
+		+= atomic_get64((int64*)&fDecompressedBytes);
+	statistics.decompressionTime
+		+= atomic_get64((int64*)&fDecompressionTime);
+	statistics.deduplicatedChunks
+		+= atomic_get64((int64*)&fDeduplicatedChunks);
+}
+
+
+/*!	Computes the key of the chunk at \a offset, which must be the offset of a
+	cache line. Cache lines with the same key must contain the same data.
+	The data the key has been computed from must be stored in \a chunkData,
+	so that ReadChunk() can read the cache line from it.
+*/
+status_t
+CachedDataReader::ComputeChunkKey(off_t offset, uint8* key, void* chunkData,
+	size_t& _chunkDataSize)
+{
+	return B_NOT_SUPPORTED;
+}
+
+
+/*!	Reads the cache line at \a offset into \a buffer, using the data stored
+	by ComputeChunkKey() for it, instead of reading it again.
+*/
+status_t
+CachedDataReader::ReadChunk(off_t offset, const void* chunkData,
+	size_t chunkDataSize, void* buffer)
+{
+	return B_NOT_SUPPORTED;
+}
+
+
+/*!	Reads the cache line at \a lineOffset, and writes the requested part of it
+	to \a output. If \a output is \c NULL, the cache line is only read into
+	the cache.
+*/
 status_t
 CachedDataReader::_ReadCacheLine(off_t lineOffset, size_t lineSize,
 	off_t requestOffset, size_t requestLength, BDataIO* output)
@@ -167,6 +453,41 @@ CachedDataReader::_ReadCacheLine(off_t lineOffset, size_t lineSize,
 		", %zu, %p\n", lineOffset, lineSize, requestOffset, requestLength,
 		output);
 
+	if (fSharedChunks != NULL) {
+		// If the key had to be computed, the chunk data it has been computed
+		// from is used to read the cache line, should it be missing.
+		void* chunkData = NULL;
+		size_t chunkDataSize = 0;
+		SharedChunk* chunk = _GetSharedChunk(lineOffset, chunkData,
+			chunkDataSize);
+		MemoryDeleter chunkDataDeleter(chunkData);
+		if (chunk != NULL) {
+			off_t sharedLineOffset = (off_t)chunk->slot * kCacheLineSize;
+			return sSharedChunkCache->_ReadCacheLine(this, lineOffset,
+				sharedLineOffset, lineSize,
+				sharedLineOffset + (requestOffset - lineOffset), requestLength,
+				output, chunkData, chunkDataSize);
+		}
+	}
+
+	return _ReadCacheLine(this, lineOffset, lineOffset, lineSize,
+		requestOffset, requestLength, output);
+}
+
+
+/*!	Reads the cache line at \a lineOffset of this object's cache, and writes
+	the requested part of it to \a output. The cache line contains the data at
+	\a readerLineOffset of \a reader, which is used to read in missing pages
+	and to which the statistics are accounted. \a requestOffset is relative to
+	this object's cache. If \a chunkData is given, missing pages are read
+	from it via \a reader's ReadChunk().
+*/
+status_t
+CachedDataReader::_ReadCacheLine(CachedDataReader* reader,
+	off_t readerLineOffset, off_t lineOffset, size_t lineSize,
+	off_t requestOffset, size_t requestLength, BDataIO* output,
+	const void* chunkData, size_t chunkDataSize)
+{
 	CacheLineLocker cacheLineLocker(this, lineOffset);
 
 	// check whether there are pages of the cache line and the mark them used
@@ -214,6 +535,12 @@ CachedDataReader::_ReadCacheLine(off_t lineOffset, size_t lineSize,
 
 	cacheLocker.Unlock();
 
+	if (output != NULL) {
+		atomic_add64(
+			missingPages > 0 ? &reader->fChunkMisses : &reader->fChunkHits, 1);
+	} else if (missingPages > 0)
+		atomic_add64(&reader->fReadAheadChunks, 1);
+
 	if (missingPages > 0) {
 // TODO: If the missing pages range doesn't intersect with the request, just
 // satisfy the request and don't read anything at all.
@@ -227,7 +554,8 @@ CachedDataReader::_ReadCacheLine(off_t lineOffset, size_t lineSize,
 			_DiscardPages(pages, firstMissing - firstPageOffset, missingPages);
 
 			// fall back to uncached transfer
-			return fReader->ReadDataToOutput(requestOffset, requestLength,
+			return reader->fReader->ReadDataToOutput(
+				readerLineOffset + (requestOffset - lineOffset), requestLength,
 				output);
 		}
 
@@ -262,8 +590,9 @@ CachedDataReader::_ReadCacheLine(off_t lineOffset, size_t lineSize,
 		cacheLocker.Unlock();
 
 		// read in the missing pages
-		status_t error = _ReadIntoPages(pages, firstMissing - firstPageOffset,
-			missingPages);
+		status_t error = _ReadIntoPages(reader, readerLineOffset, lineOffset,
+			lineSize, pages, firstMissing - firstPageOffset, missingPages,
+			chunkData, chunkDataSize);
 		if (error != B_OK) {
 			ERROR("CachedDataReader::_ReadCacheLine(): Failed to read into "
 				"cache (offset: %" B_PRIdOFF ", length: %" B_PRIuSIZE "), "
@@ -275,7 +604,8 @@ CachedDataReader::_ReadCacheLine(off_t lineOffset, size_t lineSize,
 			_DiscardPages(pages, firstMissing - firstPageOffset, missingPages);
 
 			// Try again using an uncached transfer
-			return fReader->ReadDataToOutput(requestOffset, requestLength,
+			return reader->fReader->ReadDataToOutput(
+				readerLineOffset + (requestOffset - lineOffset), requestLength,
 				output);
 		}
 	}
@@ -398,9 +728,15 @@ CachedDataReader::_WritePages(vm_page** pages, size_t pagesRelativeOffset,
 }
 
 
+/*!	Reads the data of \a pageCount pages starting with \a firstPage of the
+	cache line at \a lineOffset from \a reader, at the respective offset
+	relative to \a readerLineOffset.
+*/
 status_t
-CachedDataReader::_ReadIntoPages(vm_page** pages, size_t firstPage,
-	size_t pageCount)
+CachedDataReader::_ReadIntoPages(CachedDataReader* reader,
+	off_t readerLineOffset, off_t lineOffset, size_t lineSize, vm_page** pages,
+	size_t firstPage, size_t pageCount, const void* chunkData,
+	size_t chunkDataSize)
 {
 	PagesDataOutput output(pages + firstPage, pageCount);
 
@@ -408,10 +744,142 @@ CachedDataReader::_ReadIntoPages(vm_page** pages, size_t firstPage,
 		* B_PAGE_SIZE;
 	generic_size_t requestLength = std::min(
 			firstPageOffset + (off_t)pageCount * B_PAGE_SIZE,
-			fCache->virtual_end)
+			lineOffset + (off_t)lineSize)
 		- firstPageOffset;
 
-	return fReader->ReadDataToOutput(firstPageOffset, requestLength, &output);
+	bigtime_t startTime = system_time();
+	status_t error;
+	if (chunkData != NULL) {
+		void* buffer = malloc(kCacheLineSize);
+		MemoryDeleter bufferDeleter(buffer);
+		error = buffer != NULL ? B_OK : B_NO_MEMORY;
+		if (error == B_OK) {
+			error = reader->ReadChunk(readerLineOffset, chunkData,
+				chunkDataSize, buffer);
+		}
+		if (error == B_OK) {
+			error = output.WriteExactly(
+				(uint8*)buffer + (firstPageOffset - lineOffset), requestLength);
+		}
+	} else {
+		error = reader->fReader->ReadDataToOutput(
+			readerLineOffset + (firstPageOffset - lineOffset), requestLength,
+			&output);
+	}
+	atomic_add64(&reader->fDecompressionTime, system_time() - startTime);
+	if (error == B_OK)
+		atomic_add64(&reader->fDecompressedBytes, requestLength);
+
+	return error;
+}
+
+
+/*!	Returns the shared chunk for the cache line at \a lineOffset, creating it,
+	if this is the first cache line with its key. Returns \c NULL, if the key
+	can't be computed or the shared chunk can't be created. The cache line is
+	cached by this reader then.
+	If the key had to be computed, \a _chunkData is set to the chunk data it
+	has been computed from, which the caller has to free().
+*/
+CachedDataReader::SharedChunk*
+CachedDataReader::_GetSharedChunk(off_t lineOffset, void*& _chunkData,
+	size_t& _chunkDataSize)
+{
+	size_t index = lineOffset / kCacheLineSize;
+
+	MutexLocker locker(fLock);
+	if (fSharedChunks[index] != NULL)
+		return fSharedChunks[index];
+	locker.Unlock();
+
+	void* chunkData = malloc(kCacheLineSize);
+	if (chunkData == NULL)
+		return NULL;
+	MemoryDeleter chunkDataDeleter(chunkData);
+
+	uint8 key[kChunkKeySize];
+	size_t chunkDataSize;
+	if (ComputeChunkKey(lineOffset, key, chunkData, chunkDataSize) != B_OK)
+		return NULL;
+
+	MutexLocker sharedChunkLocker(sSharedChunkLock);
+
+	SharedChunk* chunk = sSharedChunkTable->Lookup(key);
+	bool deduplicated = chunk != NULL;
+	if (chunk == NULL) {
+		// get an unused chunk, or a new one with a new slot
+		chunk = sUnusedSharedChunks;
+		if (chunk != NULL) {
+			sUnusedSharedChunks = chunk->hashNext;
+		} else {
+			chunk = new(std::nothrow) SharedChunk;
+			if (chunk == NULL)
+				return NULL;
+
+			VMCache* cache = sSharedChunkCache->fCache;
+			AutoLocker<VMCache> cacheLocker(cache);
+			if (cache->Resize(
+					(off_t)(sSharedChunkSlotCount + 1) * kCacheLineSize,
+					VM_PRIORITY_SYSTEM) != B_OK) {
+				delete chunk;
+				return NULL;
+			}
+
+			chunk->slot = sSharedChunkSlotCount++;
+		}
+
+		memcpy(chunk->key, key, kChunkKeySize);
+		chunk->referenceCount = 0;
+		sSharedChunkTable->Insert(chunk);
+	}
+
+	chunk->referenceCount++;
+	sharedChunkLocker.Unlock();
+
+	// Another thread may have done the same for the cache line in the
+	// meantime.
+	locker.Lock();
+	if (fSharedChunks[index] != NULL) {
+		SharedChunk* otherChunk = fSharedChunks[index];
+		locker.Unlock();
+		_PutSharedChunk(chunk);
+
+		// the chunk data are the same, the cache line being the same
+		_chunkData = chunkDataDeleter.Detach();
+		_chunkDataSize = chunkDataSize;
+		return otherChunk;
+	}
+
+	fSharedChunks[index] = chunk;
+	locker.Unlock();
+
+	if (deduplicated)
+		atomic_add64(&fDeduplicatedChunks, 1);
+
+	_chunkData = chunkDataDeleter.Detach();
+	_chunkDataSize = chunkDataSize;
+	return chunk;
+}
+
+
+/*static*/ void
+CachedDataReader::_PutSharedChunk(SharedChunk* chunk)
+{
+	MutexLocker locker(sSharedChunkLock);
+
+	if (--chunk->referenceCount > 0)
+		return;
+
+	sSharedChunkTable->Remove(chunk);
+
+	// free the cached data, so the slot can be reused
+	VMCache* cache = sSharedChunkCache->fCache;
+	AutoLocker<VMCache> cacheLocker(cache);
+	cache->Discard((off_t)chunk->slot * kCacheLineSize, kCacheLineSize);
+	cacheLocker.Unlock();
+
+	chunk->hashNext = sUnusedSharedChunks;
+	sUnusedSharedChunks = chunk;
 }
 
 
@@ -446,3 +914,46 @@ CachedDataReader::_UnlockCacheLine(CacheLineLocker* lineLocker)
 		nextLineLocker->WakeUp();
 	}
 }
+
+
+/*static*/ status_t
+CachedDataReader::_ReadAheadThread(void* data)
+{
+	MutexLocker locker(sReadAheadLock);
+
+	while (!sQuitReadAheadThreads) {
+		ReadAheadJob* job = sReadAheadJobs.RemoveHead();
+		if (job == NULL) {
+			sReadAheadQueuedCondition.Wait(&sReadAheadLock);
+			continue;
+		}
+
+		sReadAheadJobCount--;
+		CachedDataReader* reader = job->reader;
+		reader->fActiveReadAheads++;
+		locker.Unlock();
+
+		off_t offset = job->offset;
+		off_t endOffset = job->offset + (off_t)job->size;
+		while (offset < endOffset) {
+			off_t lineOffset = (offset / kCacheLineSize) * kCacheLineSize;
+			off_t lineEnd = std::min(lineOffset + (off_t)kCacheLineSize,
+				reader->fCache->virtual_end);
+
+			if (reader->_ReadCacheLine(lineOffset, lineEnd - lineOffset,
+					lineOffset, 0, NULL) != B_OK) {
+				break;
+			}
+
+			offset = lineEnd;
+		}
+
+		delete job;
+
+		locker.Lock();
+		if (--reader->fActiveReadAheads == 0)
+			sReadAheadDoneCondition.NotifyAll();
+	}
+
+	return B_OK;
+}
@@ -7,6 +7,7 @@
 
 
 #include <package/hpkg/DataReader.h>
+#include <packagefs.h>
 
 #include <condition_variable.h>
 #include <util/DoublyLinkedList.h>
@@ -24,11 +25,34 @@ public:
 	virtual						~CachedDataReader();
 
 			status_t			Init(BAbstractBufferedDataReader* reader,
-									off_t size);
+									off_t size, bool shareChunks = false);
 
 	virtual	status_t			ReadDataToOutput(off_t offset, size_t size,
 									BDataIO* output);
 
+	static	status_t			GlobalInit();
+	static	void				GlobalUninit();
+
+			void				ReadAhead(off_t offset, size_t size);
+			void				CancelReadAhead();
+
+			void				AddStatistics(
+									PackageFSCacheStatistics& statistics) const;
+
+protected:
+	static	const size_t		kChunkKeySize = 32;
+	static	const size_t		kCacheLineSize = 64 * 1024;
+
+	virtual	status_t			ComputeChunkKey(off_t offset, uint8* key,
+									void* chunkData, size_t& _chunkDataSize);
+									// must be implemented, if chunks are
+									// shared; chunkData holds kCacheLineSize
+									// bytes
+	virtual	status_t			ReadChunk(off_t offset, const void* chunkData,
+									size_t chunkDataSize, void* buffer);
+									// reads the cache line at offset from the
+									// data ComputeChunkKey() returned for it
+
 private:
 			class CacheLineLocker
 				: public DoublyLinkedListLinkImpl<CacheLineLocker> {
@@ -114,11 +138,24 @@ private:
 			typedef BOpenHashTable<LockerHashDefinition> LockerTable;
 
 			struct PagesDataOutput;
+			struct ReadAheadJob;
+			typedef DoublyLinkedList<ReadAheadJob> ReadAheadJobList;
+
+			struct SharedChunk;
+			struct SharedChunkHashDefinition;
+			typedef BOpenHashTable<SharedChunkHashDefinition>
+				SharedChunkTable;
 
 private:
 			status_t			_ReadCacheLine(off_t lineOffset,
 									size_t lineSize, off_t requestOffset,
 							 		size_t requestLength, BDataIO* output);
+			status_t			_ReadCacheLine(CachedDataReader* reader,
+									off_t readerLineOffset, off_t lineOffset,
+									size_t lineSize, off_t requestOffset,
+							 		size_t requestLength, BDataIO* output,
+									const void* chunkData = NULL,
+									size_t chunkDataSize = 0);
 
 			void				_DiscardPages(vm_page** pages, size_t firstPage,
 									size_t pageCount);
@@ -127,22 +164,61 @@ private:
 			status_t			_WritePages(vm_page** pages,
 									size_t pagesRelativeOffset,
 									size_t requestLength, BDataIO* output);
-			status_t			_ReadIntoPages(vm_page** pages,
-									size_t firstPage, size_t pageCount);
+			status_t			_ReadIntoPages(CachedDataReader* reader,
+									off_t readerLineOffset, off_t lineOffset,
+									size_t lineSize, vm_page** pages,
+									size_t firstPage, size_t pageCount,
+									const void* chunkData,
+									size_t chunkDataSize);
+
+			SharedChunk*		_GetSharedChunk(off_t lineOffset,
+									void*& _chunkData,
+									size_t& _chunkDataSize);
+	static	void				_PutSharedChunk(SharedChunk* chunk);
 
 			void				_LockCacheLine(CacheLineLocker* lineLocker);
 			void				_UnlockCacheLine(CacheLineLocker* lineLocker);
 
+	static	status_t			_ReadAheadThread(void* data);
+
 private:
-			static const size_t kCacheLineSize = 64 * 1024;
 			static const size_t kPagesPerCacheLine
 				= kCacheLineSize / B_PAGE_SIZE;
+			static const int32 kMaxReadAheadThreads = 4;
 
 private:
 			mutex				fLock;
 			BAbstractBufferedDataReader* fReader;
 			VMCache*			fCache;
 			LockerTable			fCacheLineLockers;
+			int32				fActiveReadAheads;
+				// protected by the global read-ahead lock
+
+			int64				fChunkHits;
+			int64				fChunkMisses;
+			int64				fReadAheadChunks;
+			int64				fDroppedReadAheads;
+			int64				fDecompressedBytes;
+			int64				fDecompressionTime;
+			int64				fDeduplicatedChunks;
+
+			SharedChunk**		fSharedChunks;
+				// per cache line, NULL, if chunks aren't shared
+
+	static	mutex				sReadAheadLock;
+	static	ConditionVariable	sReadAheadQueuedCondition;
+	static	ConditionVariable	sReadAheadDoneCondition;
+	static	ReadAheadJobList	sReadAheadJobs;
+	static	int32				sReadAheadJobCount;
+	static	thread_id			sReadAheadThreads[kMaxReadAheadThreads];
+	static	int32				sReadAheadThreadCount;
+	static	bool				sQuitReadAheadThreads;
+
+	static	mutex				sSharedChunkLock;
+	static	SharedChunkTable*	sSharedChunkTable;
+	static	SharedChunk*		sUnusedSharedChunks;
+	static	uint32				sSharedChunkSlotCount;
+	static	CachedDataReader*	sSharedChunkCache;
 };
 
 
@@ -0,0 +1,568 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "NodeTreeCache.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
+
+#include <package/hpkg/PackageData.h>
+#include <package/hpkg/PackageEntry.h>
+#include <package/hpkg/PackageEntryAttribute.h>
+
+#include <AutoDeleter.h>
+#include <util/StringHash.h>
+
+#include "DebugSupport.h"
+
+
+using BPackageKit::BHPKG::BPackageData;
+
+
+static const size_t kMaxNodeTreeCacheSize = 64 * 1024 * 1024;
+static const uint64 kInlineDataFlag = 1ULL << 63;
+
+
+static uint32
+compute_checksum(const uint8* data, size_t size)
+{
+	// FNV-1a
+	uint32 checksum = 2166136261U;
+	for (size_t i = 0; i < size; i++)
+		checksum = (checksum ^ data[i]) * 16777619U;
+	return checksum;
+}
+
+
+static void
+set_cache_data(node_tree_cache_data& cacheData, const BPackageData& data)
+{
+	if (data.IsEncodedInline()) {
+		cacheData.size = data.Size() | kInlineDataFlag;
+		cacheData.offset = 0;
+		memcpy(&cacheData.offset, data.InlineData(), data.Size());
+	} else {
+		cacheData.size = data.Size();
+		cacheData.offset = data.Offset();
+	}
+}
+
+
+static bool
+get_cache_data(const node_tree_cache_data& cacheData, BPackageData& data)
+{
+	if ((cacheData.size & kInlineDataFlag) == 0) {
+		data.SetData(cacheData.size, cacheData.offset);
+		return true;
+	}
+
+	uint64 size = cacheData.size & ~kInlineDataFlag;
+	if (size > sizeof(cacheData.offset))
+		return false;
+
+	data.SetData((uint8)size, &cacheData.offset);
+	return true;
+}
+
+
+// #pragma mark - NodeTreeCacheWriter
+
+
+struct NodeTreeCacheWriter::StringEntry {
+	uint32			offset;
+	StringEntry*	next;
+};
+
+
+struct NodeTreeCacheWriter::StringHashDefinition {
+	typedef const char*		KeyType;
+	typedef	StringEntry		ValueType;
+
+	StringHashDefinition(const Buffer* strings)
+		:
+		fStrings(strings)
+	{
+	}
+
+	size_t HashKey(const char* key) const
+	{
+		return hash_hash_string(key);
+	}
+
+	size_t Hash(const StringEntry* value) const
+	{
+		return HashKey((const char*)fStrings->data + value->offset);
+	}
+
+	bool Compare(const char* key, const StringEntry* value) const
+	{
+		return strcmp(key, (const char*)fStrings->data + value->offset) == 0;
+	}
+
+	StringEntry*& GetLink(StringEntry* value) const
+	{
+		return value->next;
+	}
+
+private:
+	const Buffer*	fStrings;
+};
+
+
+/*!	Passes everything on to \a target, and records the entries and their
+	attributes on the way.
+*/
+NodeTreeCacheWriter::NodeTreeCacheWriter(BPackageContentHandler* target)
+	:
+	fTarget(target),
+	fStringTable(NULL),
+	fFailed(false)
+{
+	fStrings.data = NULL;
+	fStrings.size = 0;
+	fStrings.capacity = 0;
+	fRecords = fStrings;
+}
+
+
+NodeTreeCacheWriter::~NodeTreeCacheWriter()
+{
+	if (fStringTable != NULL) {
+		StringEntry* entry = fStringTable->Clear(true);
+		while (entry != NULL) {
+			StringEntry* next = entry->next;
+			delete entry;
+			entry = next;
+		}
+		delete fStringTable;
+	}
+
+	free(fStrings.data);
+	free(fRecords.data);
+}
+
+
+status_t
+NodeTreeCacheWriter::Init()
+{
+	fStringTable = new(std::nothrow) StringTable(
+		StringHashDefinition(&fStrings));
+	if (fStringTable == NULL)
+		RETURN_ERROR(B_NO_MEMORY);
+
+	status_t error = fStringTable->Init();
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
+	// offset 0 is the empty string, which also stands for no string at all
+	if (!_Append(fStrings, "", 1))
+		RETURN_ERROR(B_NO_MEMORY);
+
+	return B_OK;
+}
+
+
+/*!	Returns the complete cache file contents in a newly allocated buffer,
+	which the caller has to free().
+*/
+status_t
+NodeTreeCacheWriter::Finish(const node_tree_cache_header& identity,
+	void*& _data, size_t& _size)
+{
+	if (fFailed)
+		return B_ERROR;
+
+	size_t size = sizeof(node_tree_cache_header) + fRecords.size
+		+ fStrings.size;
+	if (size > kMaxNodeTreeCacheSize)
+		return B_BUFFER_OVERFLOW;
+
+	uint8* data = (uint8*)malloc(size);
+	if (data == NULL)
+		return B_NO_MEMORY;
+
+	uint8* records = data + sizeof(node_tree_cache_header);
+	memcpy(records, fRecords.data, fRecords.size);
+	memcpy(records + fRecords.size, fStrings.data, fStrings.size);
+
+	node_tree_cache_header* header = (node_tree_cache_header*)data;
+	*header = identity;
+	header->magic = kNodeTreeCacheMagic;
+	header->version = kNodeTreeCacheVersion;
+	header->strings_size = fStrings.size;
+	header->records_size = fRecords.size;
+	header->reserved = 0;
+	header->checksum = compute_checksum(records,
+		size - sizeof(node_tree_cache_header));
+
+	_data = data;
+	_size = size;
+	return B_OK;
+}
+
+
+status_t
+NodeTreeCacheWriter::HandleEntry(BPackageEntry* entry)
+{
+	node_tree_cache_entry record;
+	record.kind = NODE_TREE_CACHE_ENTRY;
+	record.name = _AddString(entry->Name());
+	record.mode = entry->Mode();
+	record.symlink_path = entry->SymlinkPath() != NULL
+		? _AddString(entry->SymlinkPath()) : 0;
+	record.modified_time = entry->ModifiedTime().tv_sec;
+	record.modified_time_nanos = entry->ModifiedTime().tv_nsec;
+	record.reserved = 0;
+	set_cache_data(record.data, entry->Data());
+	_AddRecord(&record, sizeof(record));
+
+	return fTarget->HandleEntry(entry);
+}
+
+
+status_t
+NodeTreeCacheWriter::HandleEntryAttribute(BPackageEntry* entry,
+	BPackageEntryAttribute* attribute)
+{
+	node_tree_cache_attribute record;
+	record.kind = NODE_TREE_CACHE_ATTRIBUTE;
+	record.name = _AddString(attribute->Name());
+	record.type = attribute->Type();
+	record.reserved = 0;
+	set_cache_data(record.data, attribute->Data());
+	_AddRecord(&record, sizeof(record));
+
+	return fTarget->HandleEntryAttribute(entry, attribute);
+}
+
+
+status_t
+NodeTreeCacheWriter::HandleEntryDone(BPackageEntry* entry)
+{
+	node_tree_cache_entry_done record;
+	record.kind = NODE_TREE_CACHE_ENTRY_DONE;
+	record.reserved = 0;
+	_AddRecord(&record, sizeof(record));
+
+	return fTarget->HandleEntryDone(entry);
+}
+
+
+status_t
+NodeTreeCacheWriter::HandlePackageAttribute(
+	const BPackageInfoAttributeValue& value)
+{
+	// package attributes are always read from the package itself
+	return fTarget->HandlePackageAttribute(value);
+}
+
+
+void
+NodeTreeCacheWriter::HandleErrorOccurred()
+{
+	fFailed = true;
+	fTarget->HandleErrorOccurred();
+}
+
+
+uint32
+NodeTreeCacheWriter::_AddString(const char* string)
+{
+	if (fFailed || string[0] == '\0')
+		return 0;
+
+	if (StringEntry* entry = fStringTable->Lookup(string))
+		return entry->offset;
+
+	StringEntry* entry = new(std::nothrow) StringEntry;
+	if (entry == NULL) {
+		fFailed = true;
+		return 0;
+	}
+
+	entry->offset = fStrings.size;
+	if (!_Append(fStrings, string, strlen(string) + 1)) {
+		delete entry;
+		return 0;
+	}
+
+	fStringTable->Insert(entry);
+	return entry->offset;
+}
+
+
+void
+NodeTreeCacheWriter::_AddRecord(const void* record, size_t size)
+{
+	if (!fFailed)
+		_Append(fRecords, record, size);
+}
+
+
+bool
+NodeTreeCacheWriter::_Append(Buffer& buffer, const void* data, size_t size)
+{
+	if (buffer.size + size > buffer.capacity) {
+		size_t capacity = buffer.capacity > 0 ? buffer.capacity * 2 : 4096;
+		while (capacity < buffer.size + size)
+			capacity *= 2;
+
+		uint8* newData = capacity <= kMaxNodeTreeCacheSize
+			? (uint8*)realloc(buffer.data, capacity) : NULL;
+		if (newData == NULL) {
+			fFailed = true;
+			return false;
+		}
+
+		buffer.data = newData;
+		buffer.capacity = capacity;
+	}
+
+	memcpy(buffer.data + buffer.size, data, size);
+	buffer.size += size;
+	return true;
+}
+
+
+// #pragma mark - NodeTreeCacheReader
+
+
+NodeTreeCacheReader::NodeTreeCacheReader()
+	:
+	fData(NULL),
+	fStrings(NULL),
+	fRecords(NULL),
+	fStringsSize(0),
+	fRecordsSize(0)
+{
+}
+
+
+NodeTreeCacheReader::~NodeTreeCacheReader()
+{
+	free(fData);
+}
+
+
+/*!	Reads the cache file \a fd refers to, and checks whether it is intact, and
+	belongs to the package file described by \a identity.
+*/
+status_t
+NodeTreeCacheReader::Init(int fd, const node_tree_cache_header& identity)
+{
+	node_tree_cache_header header;
+	ssize_t bytesRead = pread(fd, &header, sizeof(header), 0);
+	if (bytesRead < 0)
+		return errno;
+	if (bytesRead != (ssize_t)sizeof(header)
+		|| header.magic != kNodeTreeCacheMagic
+		|| header.version != kNodeTreeCacheVersion) {
+		return B_BAD_DATA;
+	}
+
+	if (header.package_node != identity.package_node
+		|| header.package_size != identity.package_size
+		|| header.package_modified_time != identity.package_modified_time
+		|| header.package_modified_time_nanos
+			!= identity.package_modified_time_nanos
+		|| header.package_toc_length != identity.package_toc_length
+		|| header.package_toc_offset != identity.package_toc_offset
+		|| header.package_heap_size != identity.package_heap_size) {
+		return B_MISMATCHED_VALUES;
+	}
+
+	size_t size = (size_t)header.records_size + header.strings_size;
+	if (size > kMaxNodeTreeCacheSize || header.strings_size == 0)
+		return B_BAD_DATA;
+
+	uint8* data = (uint8*)malloc(size);
+	if (data == NULL)
+		return B_NO_MEMORY;
+	MemoryDeleter dataDeleter(data);
+
+	bytesRead = pread(fd, data, size, sizeof(header));
+	if (bytesRead < 0)
+		return errno;
+	if ((size_t)bytesRead != size
+		|| compute_checksum(data, size) != header.checksum) {
+		return B_BAD_DATA;
+	}
+
+	fData = (uint8*)dataDeleter.Detach();
+	fRecords = fData;
+	fRecordsSize = header.records_size;
+	fStrings = (const char*)fData + header.records_size;
+	fStringsSize = header.strings_size;
+
+	return _Validate();
+}
+
+
+/*!	Passes the cached entries and their attributes to \a handler, the same way
+	PackageReaderImpl::ParseContent() would.
+*/
+status_t
+NodeTreeCacheReader::Parse(BPackageContentHandler* handler)
+{
+	BPackageEntry* entry = NULL;
+	status_t error = B_OK;
+
+	size_t offset = 0;
+	while (offset < fRecordsSize && error == B_OK) {
+		uint32 kind;
+		memcpy(&kind, fRecords + offset, sizeof(kind));
+
+		switch (kind) {
+			case NODE_TREE_CACHE_ENTRY:
+			{
+				node_tree_cache_entry record;
+				memcpy(&record, fRecords + offset, sizeof(record));
+				offset += sizeof(record);
+
+				BPackageEntry* child = new(std::nothrow) BPackageEntry(entry,
+					_String(record.name));
+				if (child == NULL) {
+					error = B_NO_MEMORY;
+					break;
+				}
+				entry = child;
+
+				entry->SetType(record.mode);
+				entry->SetPermissions(record.mode);
+				entry->SetModifiedTime(record.modified_time);
+				entry->SetModifiedTimeNanos(record.modified_time_nanos);
+				if (record.symlink_path != 0 || S_ISLNK(record.mode))
+					entry->SetSymlinkPath(_String(record.symlink_path));
+				get_cache_data(record.data, entry->Data());
+
+				error = handler->HandleEntry(entry);
+				break;
+			}
+
+			case NODE_TREE_CACHE_ATTRIBUTE:
+			{
+				node_tree_cache_attribute record;
+				memcpy(&record, fRecords + offset, sizeof(record));
+				offset += sizeof(record);
+
+				BPackageEntryAttribute attribute(_String(record.name));
+				attribute.SetType(record.type);
+				get_cache_data(record.data, attribute.Data());
+
+				error = handler->HandleEntryAttribute(entry, &attribute);
+				break;
+			}
+
+			case NODE_TREE_CACHE_ENTRY_DONE:
+			{
+				offset += sizeof(node_tree_cache_entry_done);
+
+				error = handler->HandleEntryDone(entry);
+
+				BPackageEntry* parent = (BPackageEntry*)entry->Parent();
+				delete entry;
+				entry = parent;
+				break;
+			}
+		}
+	}
+
+	while (entry != NULL) {
+		BPackageEntry* parent = (BPackageEntry*)entry->Parent();
+		delete entry;
+		entry = parent;
+	}
+
+	if (error != B_OK)
+		handler->HandleErrorOccurred();
+
+	return error;
+}
+
+
+const char*
+NodeTreeCacheReader::_String(uint32 offset) const
+{
+	return fStrings + offset;
+}
+
+
+/*!	Checks the structure of the records, so that Parse() doesn't have to. */
+status_t
+NodeTreeCacheReader::_Validate() const
+{
+	if (fStrings[fStringsSize - 1] != '\0')
+		return B_BAD_DATA;
+
+	int32 depth = 0;
+	size_t offset = 0;
+	while (offset < fRecordsSize) {
+		size_t remaining = fRecordsSize - offset;
+		uint32 kind;
+		if (remaining < sizeof(kind))
+			return B_BAD_DATA;
+		memcpy(&kind, fRecords + offset, sizeof(kind));
+
+		uint32 name;
+		uint32 symlinkPath = 0;
+		node_tree_cache_data data;
+
+		switch (kind) {
+			case NODE_TREE_CACHE_ENTRY:
+			{
+				node_tree_cache_entry record;
+				if (remaining < sizeof(record))
+					return B_BAD_DATA;
+				memcpy(&record, fRecords + offset, sizeof(record));
+				offset += sizeof(record);
+
+				name = record.name;
+				symlinkPath = record.symlink_path;
+				data = record.data;
+				depth++;
+				break;
+			}
+
+			case NODE_TREE_CACHE_ATTRIBUTE:
+			{
+				node_tree_cache_attribute record;
+				if (remaining < sizeof(record) || depth == 0)
+					return B_BAD_DATA;
+				memcpy(&record, fRecords + offset, sizeof(record));
+				offset += sizeof(record);
+
+				name = record.name;
+				data = record.data;
+				break;
+			}
+
+			case NODE_TREE_CACHE_ENTRY_DONE:
+				if (remaining < sizeof(node_tree_cache_entry_done)
+					|| depth == 0) {
+					return B_BAD_DATA;
+				}
+				offset += sizeof(node_tree_cache_entry_done);
+				depth--;
+				continue;
+
+			default:
+				return B_BAD_DATA;
+		}
+
+		BPackageData packageData;
+		if (name == 0 || name >= fStringsSize || symlinkPath >= fStringsSize
+			|| !get_cache_data(data, packageData)) {
+			return B_BAD_DATA;
+		}
+	}
+
+	return depth == 0 ? B_OK : B_BAD_DATA;
+}
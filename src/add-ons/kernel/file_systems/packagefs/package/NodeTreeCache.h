@@ -0,0 +1,162 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef NODE_TREE_CACHE_H
+#define NODE_TREE_CACHE_H
+
+
+#include <package/hpkg/PackageContentHandler.h>
+
+#include <util/OpenHashTable.h>
+
+
+using BPackageKit::BHPKG::BPackageContentHandler;
+using BPackageKit::BHPKG::BPackageEntry;
+using BPackageKit::BHPKG::BPackageEntryAttribute;
+using BPackageKit::BHPKG::BPackageInfoAttributeValue;
+
+
+// A node tree cache file contains the entries and entry attributes of a
+// package's TOC in the order they are passed to a BPackageContentHandler,
+// followed by a string table. All references are offsets, so the file can be
+// used as is, once it has been read into memory.
+
+static const uint32 kNodeTreeCacheMagic = 'pfnt';
+static const uint32 kNodeTreeCacheVersion = 1;
+
+
+struct node_tree_cache_header {
+	uint32	magic;
+	uint32	version;
+	uint32	checksum;
+		// of everything following the header
+	uint32	strings_size;
+	uint32	records_size;
+	uint32	reserved;
+
+	// identity of the package file the cache has been created from
+	int64	package_node;
+	int64	package_size;
+	int64	package_modified_time;
+	uint32	package_modified_time_nanos;
+	uint32	package_toc_length;
+	uint64	package_toc_offset;
+	uint64	package_heap_size;
+};
+
+
+enum {
+	NODE_TREE_CACHE_ENTRY		= 1,
+	NODE_TREE_CACHE_ATTRIBUTE	= 2,
+	NODE_TREE_CACHE_ENTRY_DONE	= 3
+};
+
+
+struct node_tree_cache_data {
+	uint64	size;
+		// the highest bit is set, if the data is encoded inline
+	uint64	offset;
+		// or the inline data
+};
+
+
+struct node_tree_cache_entry {
+	uint32					kind;
+	uint32					name;
+	uint32					mode;
+	uint32					symlink_path;
+		// 0, if there is none
+	int64					modified_time;
+	uint32					modified_time_nanos;
+	uint32					reserved;
+	node_tree_cache_data	data;
+};
+
+
+struct node_tree_cache_attribute {
+	uint32					kind;
+	uint32					name;
+	uint32					type;
+	uint32					reserved;
+	node_tree_cache_data	data;
+};
+
+
+struct node_tree_cache_entry_done {
+	uint32					kind;
+	uint32					reserved;
+};
+
+
+class NodeTreeCacheWriter : public BPackageContentHandler {
+public:
+								NodeTreeCacheWriter(
+									BPackageContentHandler* target);
+	virtual						~NodeTreeCacheWriter();
+
+			status_t			Init();
+
+			status_t			Finish(const node_tree_cache_header& identity,
+									void*& _data, size_t& _size);
+
+	virtual	status_t			HandleEntry(BPackageEntry* entry);
+	virtual	status_t			HandleEntryAttribute(BPackageEntry* entry,
+									BPackageEntryAttribute* attribute);
+	virtual	status_t			HandleEntryDone(BPackageEntry* entry);
+
+	virtual	status_t			HandlePackageAttribute(
+									const BPackageInfoAttributeValue& value);
+
+	virtual	void				HandleErrorOccurred();
+
+private:
+			struct StringEntry;
+			struct StringHashDefinition;
+			typedef BOpenHashTable<StringHashDefinition> StringTable;
+
+			struct Buffer {
+				uint8*	data;
+				size_t	size;
+				size_t	capacity;
+			};
+
+private:
+			uint32				_AddString(const char* string);
+			void				_AddRecord(const void* record, size_t size);
+			bool				_Append(Buffer& buffer, const void* data,
+									size_t size);
+
+private:
+			BPackageContentHandler* fTarget;
+			StringTable*		fStringTable;
+			Buffer				fStrings;
+			Buffer				fRecords;
+			bool				fFailed;
+};
+
+
+class NodeTreeCacheReader {
+public:
+								NodeTreeCacheReader();
+								~NodeTreeCacheReader();
+
+			status_t			Init(int fd,
+									const node_tree_cache_header& identity);
+
+			status_t			Parse(BPackageContentHandler* handler);
+
+private:
+			const char*			_String(uint32 offset) const;
+			status_t			_Validate() const;
+
+private:
+			uint8*				fData;
+			const char*			fStrings;
+			const uint8*		fRecords;
+			uint32				fStringsSize;
+			uint32				fRecordsSize;
+};
+
+
+#endif	// NODE_TREE_CACHE_H
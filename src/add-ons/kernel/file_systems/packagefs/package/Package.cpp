@@ -10,21 +10,27 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <package/hpkg/ErrorOutput.h>
 #include <package/hpkg/PackageDataReader.h>
 #include <package/hpkg/PackageEntry.h>
 #include <package/hpkg/PackageEntryAttribute.h>
 
 #include <AutoDeleter.h>
+#include <AutoDeleterPosix.h>
 #include <FdIO.h>
 #include <package/hpkg/PackageFileHeapReader.h>
 #include <package/hpkg/PackageReaderImpl.h>
+#include <SHA256.h>
 #include <util/AutoLock.h>
 
 #include "CachedDataReader.h"
 #include "DebugSupport.h"
+#include "NodeTreeCache.h"
 #include "PackageDirectory.h"
 #include "PackageFile.h"
 #include "PackagesDirectory.h"
@@ -148,8 +154,7 @@ struct Package::LoaderContentHandler : BPackageContentHandler {
 			if (!path.SetTo(entry->SymlinkPath()))
 				RETURN_ERROR(B_NO_MEMORY);
 
-			PackageSymlink* symlink = new(std::nothrow) PackageSymlink(
-				fPackage, mode);
+			PackageSymlink* symlink = new PackageSymlink(fPackage, mode);
 			if (symlink == NULL)
 				RETURN_ERROR(B_NO_MEMORY);
 
@@ -386,6 +391,10 @@ struct Package::HeapReader {
 
 	virtual status_t CreateDataReader(const PackageData& data,
 		BAbstractBufferedDataReader*& _reader) = 0;
+
+	virtual void ReadAhead(off_t offset, size_t size) = 0;
+	virtual void CancelReadAhead() = 0;
+	virtual void AddStatistics(PackageFSCacheStatistics& statistics) = 0;
 };
 
 
@@ -403,10 +412,12 @@ public:
 
 	~HeapReaderV2()
 	{
+		CachedDataReader::CancelReadAhead();
 		delete fHeapReader;
 	}
 
-	status_t Init(const PackageFileHeapReader* heapReader, int fd)
+	status_t Init(const PackageFileHeapReader* heapReader, int fd,
+		const void* dictionary, size_t dictionarySize)
 	{
 		fHeapReader = heapReader->Clone();
 		if (fHeapReader == NULL)
@@ -417,8 +428,23 @@ public:
 		fHeapReader->SetErrorOutput(this);
 		fHeapReader->SetFile(this);
 
+		// The same compressed chunk decompresses differently with different
+		// dictionaries, so the dictionary is part of the chunk keys.
+		memset(fDictionaryKey, 0, sizeof(fDictionaryKey));
+		if (dictionary != NULL) {
+			SHA256 sha;
+			sha.Update(dictionary, dictionarySize);
+			memcpy(fDictionaryKey, sha.Digest(), sizeof(fDictionaryKey));
+		}
+
+		// Identical chunks of different packages (e.g. of two versions of a
+		// package during an update) are cached only once. This is only done
+		// for compressed heaps, since reading an uncompressed chunk is cheaper
+		// than computing its key.
 		status_t error = CachedDataReader::Init(fHeapReader,
-			fHeapReader->UncompressedHeapSize());
+			fHeapReader->UncompressedHeapSize(),
+			(uint64)fHeapReader->CompressedHeapSize()
+				< fHeapReader->UncompressedHeapSize());
 		if (error != B_OK)
 			return error;
 
@@ -437,6 +463,57 @@ public:
 			.CreatePackageDataReader(this, data.DataV2(), _reader);
 	}
 
+	virtual void ReadAhead(off_t offset, size_t size)
+	{
+		CachedDataReader::ReadAhead(offset, size);
+	}
+
+	virtual void CancelReadAhead()
+	{
+		CachedDataReader::CancelReadAhead();
+	}
+
+	virtual void AddStatistics(PackageFSCacheStatistics& statistics)
+	{
+		CachedDataReader::AddStatistics(statistics);
+	}
+
+protected:
+	// CachedDataReader
+
+	virtual status_t ComputeChunkKey(off_t offset, uint8* key, void* chunkData,
+		size_t& _chunkDataSize)
+	{
+		// each cache line must be exactly one heap chunk
+		STATIC_ASSERT(kCacheLineSize == PackageFileHeapReader::kChunkSize);
+
+		size_t compressedSize;
+		size_t uncompressedSize;
+		status_t error = fHeapReader->ReadCompressedChunk(
+			offset / kCacheLineSize, chunkData, compressedSize,
+			uncompressedSize);
+		if (error != B_OK)
+			return error;
+
+		uint32 sizes[2] = { (uint32)compressedSize, (uint32)uncompressedSize };
+
+		SHA256 sha;
+		sha.Update(fDictionaryKey, sizeof(fDictionaryKey));
+		sha.Update(sizes, sizeof(sizes));
+		sha.Update(chunkData, compressedSize);
+		memcpy(key, sha.Digest(), kChunkKeySize);
+
+		_chunkDataSize = compressedSize;
+		return B_OK;
+	}
+
+	virtual status_t ReadChunk(off_t offset, const void* chunkData,
+		size_t chunkDataSize, void* buffer)
+	{
+		return fHeapReader->DecompressChunk(offset / kCacheLineSize,
+			chunkData, chunkDataSize, buffer);
+	}
+
 private:
 	// BErrorOutput
 
@@ -447,6 +524,7 @@ private:
 
 private:
 	PackageFileHeapReader*	fHeapReader;
+	uint8					fDictionaryKey[kChunkKeySize];
 };
 
 
@@ -480,7 +558,10 @@ struct Package::CachingPackageReader : public PackageReaderImpl {
 		if (fCachedHeapReader == NULL)
 			RETURN_ERROR(B_NO_MEMORY);
 
-		status_t error = fCachedHeapReader->Init(rawHeapReader, fFD);
+		size_t dictionarySize;
+		const void* dictionary = HeapDictionary(dictionarySize);
+		status_t error = fCachedHeapReader->Init(rawHeapReader, fFD,
+			dictionary, dictionarySize);
 		if (error != B_OK)
 			RETURN_ERROR(error);
 
@@ -527,6 +608,8 @@ Package::Package(::Volume* volume, PackagesDirectory* directory, dev_t deviceID,
 	fFD(-1),
 	fOpenCount(0),
 	fHeapReader(NULL),
+	fNodeTreeCacheData(NULL),
+	fNodeTreeCacheSize(0),
 	fNodeID(nodeID),
 	fDeviceID(deviceID)
 {
@@ -539,6 +622,7 @@ Package::Package(::Volume* volume, PackagesDirectory* directory, dev_t deviceID,
 Package::~Package()
 {
 	delete fHeapReader;
+	free(fNodeTreeCacheData);
 
 	while (PackageNode* node = fNodes.RemoveHead())
 		node->ReleaseReference();
@@ -692,6 +776,10 @@ Package::Close()
 	}
 
 	if (--fOpenCount == 0) {
+		// pending read-aheads must not use the FD after it has been closed
+		if (fHeapReader != NULL)
+			fHeapReader->CancelReadAhead();
+
 		close(fFD);
 		fFD = -1;
 
@@ -712,6 +800,102 @@ Package::CreateDataReader(const PackageData& data,
 }
 
 
+/*!	Asynchronously reads the given range of the \a data into the cache.
+	Does nothing, if the package isn't open.
+*/
+void
+Package::ReadAhead(const PackageData& data, off_t offset, size_t size)
+{
+	if (data.IsEncodedInline() || offset < 0
+		|| (uint64)offset >= data.UncompressedSize()) {
+		return;
+	}
+
+	size = std::min((uint64)size, data.UncompressedSize() - offset);
+
+	MutexLocker locker(fLock);
+	if (fHeapReader == NULL || fOpenCount == 0)
+		return;
+
+	fHeapReader->ReadAhead(data.DataV2().Offset() + offset, size);
+}
+
+
+/*!	Writes the node tree cache that has been created when loading the package
+	into \a directoryFD, if there is one.
+*/
+void
+Package::WriteNodeTreeCache(int directoryFD)
+{
+	MutexLocker locker(fLock);
+	if (fNodeTreeCacheData == NULL)
+		return;
+
+	MemoryDeleter dataDeleter(fNodeTreeCacheData);
+	fNodeTreeCacheData = NULL;
+	locker.Unlock();
+
+	FileDescriptorCloser fd(openat(directoryFD, fFileName,
+		O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+	if (!fd.IsSet()) {
+		INFORM("Failed to create node tree cache for package \"%s\": %s\n",
+			fFileName.Data(), strerror(errno));
+		return;
+	}
+
+	ssize_t bytesWritten = write(fd.Get(), dataDeleter.Get(),
+		fNodeTreeCacheSize);
+	if (bytesWritten != (ssize_t)fNodeTreeCacheSize) {
+		// an incomplete cache would be ignored, anyway
+		ftruncate(fd.Get(), 0);
+	}
+}
+
+
+static void
+add_memory_usage(PackageNode* node, PackageMemoryUsage& usage)
+{
+	usage.attributeCount += node->Attributes().Count();
+
+	if (S_ISDIR(node->Mode())) {
+		usage.directoryCount++;
+
+		PackageDirectory* directory = static_cast<PackageDirectory*>(node);
+		for (PackageNode* child = directory->FirstChild(); child != NULL;
+				child = directory->NextChild(child)) {
+			add_memory_usage(child, usage);
+		}
+	} else if (S_ISLNK(node->Mode()))
+		usage.symlinkCount++;
+	else
+		usage.fileCount++;
+}
+
+
+/*!	Adds the nodes of the package to \a usage.
+	Doesn't lock anything, and must therefore only be used from the kernel
+	debugger.
+*/
+void
+Package::AddMemoryUsage(PackageMemoryUsage& usage) const
+{
+	usage.packageCount++;
+
+	for (PackageNode* node = fNodes.First(); node != NULL;
+			node = fNodes.GetNext(node)) {
+		add_memory_usage(node, usage);
+	}
+}
+
+
+void
+Package::AddCacheStatistics(PackageFSCacheStatistics& statistics)
+{
+	if (fHeapReader != NULL)
+		fHeapReader->AddStatistics(statistics);
+}
+
+
 status_t
 Package::_Load(const PackageSettings& settings)
 {
@@ -731,12 +915,7 @@ Package::_Load(const PackageSettings& settings)
 			BHPKG::B_HPKG_READER_DONT_PRINT_VERSION_MISMATCH_MESSAGE);
 		if (error == B_OK) {
 			// parse content
-			LoaderContentHandler handler(this, settings);
-			error = handler.Init();
-			if (error != B_OK)
-				RETURN_ERROR(error);
-
-			error = packageReader.ParseContent(&handler);
+			error = _LoadContent(packageReader, fd, settings);
 			if (error != B_OK)
 				RETURN_ERROR(error);
 
@@ -754,6 +933,70 @@ Package::_Load(const PackageSettings& settings)
 }
 
 
+/*!	Builds the node tree of the package from its node tree cache, if there is
+	a valid one, and parses the TOC otherwise. In the latter case, the cache is
+	created along the way, and written when the package has been activated.
+*/
+status_t
+Package::_LoadContent(CachingPackageReader& packageReader, int fd,
+	const PackageSettings& settings)
+{
+	LoaderContentHandler handler(this, settings);
+	status_t error = handler.Init();
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
+	int cacheDirectoryFD = fVolume->NodeTreeCacheDirectoryFD();
+
+	struct stat st;
+	if (cacheDirectoryFD < 0 || fstat(fd, &st) != 0)
+		return packageReader.ParseContent(&handler);
+
+	node_tree_cache_header identity;
+	memset(&identity, 0, sizeof(identity));
+	identity.package_node = st.st_ino;
+	identity.package_size = st.st_size;
+	identity.package_modified_time = st.st_mtim.tv_sec;
+	identity.package_modified_time_nanos = st.st_mtim.tv_nsec;
+	identity.package_toc_length
+		= packageReader.TOCSection().uncompressedLength;
+	identity.package_toc_offset = packageReader.TOCSection().offset;
+	identity.package_heap_size = packageReader.HeapSize();
+
+	// try the cache
+	int cacheFD = openat(cacheDirectoryFD, fFileName, O_RDONLY);
+	if (cacheFD >= 0) {
+		NodeTreeCacheReader cacheReader;
+		error = cacheReader.Init(cacheFD, identity);
+		close(cacheFD);
+
+		if (error == B_OK) {
+			error = packageReader.ParsePackageAttributes(&handler);
+			if (error == B_OK)
+				error = cacheReader.Parse(&handler);
+			return error;
+		}
+	}
+
+	// parse the TOC, and create the cache
+	NodeTreeCacheWriter cacheWriter(&handler);
+	if (cacheWriter.Init() != B_OK)
+		return packageReader.ParseContent(&handler);
+
+	error = packageReader.ParseContent(&cacheWriter);
+	if (error != B_OK)
+		return error;
+
+	if (cacheWriter.Finish(identity, fNodeTreeCacheData, fNodeTreeCacheSize)
+			!= B_OK) {
+		fNodeTreeCacheData = NULL;
+		fNodeTreeCacheSize = 0;
+	}
+
+	return B_OK;
+}
+
+
 bool
 Package::_InitVersionedName()
 {
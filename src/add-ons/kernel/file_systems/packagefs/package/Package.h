@@ -33,6 +33,16 @@ class PackagesDirectory;
 class PackageSettings;
 class Volume;
 class Version;
+struct PackageFSCacheStatistics;
+
+
+struct PackageMemoryUsage {
+	size_t	packageCount;
+	size_t	directoryCount;
+	size_t	fileCount;
+	size_t	symlinkCount;
+	size_t	attributeCount;
+};
 
 
 class Package : public BWeakReferenceable,
@@ -100,6 +110,15 @@ public:
 
 			status_t			CreateDataReader(const PackageData& data,
 									BAbstractBufferedDataReader*& _reader);
+			void				ReadAhead(const PackageData& data,
+									off_t offset, size_t size);
+			void				AddCacheStatistics(
+									PackageFSCacheStatistics& statistics);
+
+			void				WriteNodeTreeCache(int directoryFD);
+
+			void				AddMemoryUsage(PackageMemoryUsage& usage)
+									const;
 
 			const PackageNodeList& Nodes() const	{ return fNodes; }
 			const ResolvableList& Resolvables() const
@@ -118,6 +137,8 @@ private:
 
 private:
 			status_t			_Load(const PackageSettings& settings);
+			status_t			_LoadContent(CachingPackageReader& reader,
+									int fd, const PackageSettings& settings);
 			bool				_InitVersionedName();
 
 private:
@@ -135,6 +156,8 @@ private:
 			int					fFD;
 			uint32				fOpenCount;
 			HeapReader*			fHeapReader;
+			void*				fNodeTreeCacheData;
+			size_t				fNodeTreeCacheSize;
 			Package*			fFileNameHashTableNext;
 			ino_t				fNodeID;
 			dev_t				fDeviceID;
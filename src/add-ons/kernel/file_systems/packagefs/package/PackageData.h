@@ -18,7 +18,6 @@ class PackageData {
 public:
 	explicit					PackageData(const PackageDataV2& data);
 
-			uint8				Version() const	{ return fVersion; }
 			const PackageDataV2& DataV2() const;
 
 			uint64				UncompressedSize() const;
@@ -30,18 +29,17 @@ private:
 	static	const size_t		kDataSize = sizeof(PackageDataV2);
 
 private:
+			// Only the V2 format is supported, so there is no need to store
+			// a version; this keeps the descriptor at 16 bytes.
 			union {
 				char			fData[kDataSize];
 				uint64			fAlignmentDummy;
 			};
-			uint8				fVersion;
 };
 
 
 inline
 PackageData::PackageData(const PackageDataV2& data)
-	:
-	fVersion(2)
 {
 	memcpy(&fData, &data, sizeof(data));
 }
@@ -26,6 +26,10 @@
 using namespace BPackageKit::BHPKG;
 
 
+static const size_t kMinReadAhead = 128 * 1024;
+static const size_t kMaxReadAhead = 1024 * 1024;
+
+
 // #pragma mark - class cache
 
 
@@ -60,7 +64,10 @@ struct PackageFile::DataAccessor {
 		fPackage(package),
 		fData(data),
 		fReader(NULL),
-		fFileCache(NULL)
+		fFileCache(NULL),
+		fSequentialEnd(0),
+		fReadAheadEnd(0),
+		fReadAheadSize(kMinReadAhead)
 	{
 		mutex_init(&fLock, "file data accessor");
 	}
@@ -104,10 +111,11 @@ struct PackageFile::DataAccessor {
 		size_t toRead = std::min((uint64)size,
 			fData->UncompressedSize() - offset);
 
+		_ReadAhead(offset, toRead);
+
 		if (toRead > 0) {
+			// the reader is reentrant, no need to lock
 			IORequestOutput output(request);
-			MutexLocker locker(fLock, false, fData->Version() == 1);
-				// V2 readers are reentrant
 			status_t error = fReader->ReadDataToOutput(offset, toRead, &output);
 			if (error != B_OK)
 				RETURN_ERROR(error);
@@ -116,12 +124,47 @@ struct PackageFile::DataAccessor {
 		return B_OK;
 	}
 
+private:
+	void _ReadAhead(off_t offset, size_t size)
+	{
+		// Once the file is read sequentially, let the package decompress the
+		// following chunks in the background, so that they are already
+		// cached when they are needed. The window grows as long as the reads
+		// stay sequential.
+		MutexLocker locker(fLock);
+
+		off_t end = offset + (off_t)size;
+		if (offset != fSequentialEnd) {
+			fSequentialEnd = end;
+			fReadAheadEnd = end;
+			fReadAheadSize = kMinReadAhead;
+			return;
+		}
+
+		fSequentialEnd = end;
+		if (fReadAheadEnd - end >= (off_t)fReadAheadSize / 2)
+			return;
+
+		off_t readAheadStart = std::max(fReadAheadEnd, end);
+		off_t readAheadEnd = end + (off_t)fReadAheadSize;
+		fReadAheadEnd = readAheadEnd;
+		fReadAheadSize = std::min(fReadAheadSize * 2, kMaxReadAhead);
+
+		locker.Unlock();
+
+		fPackage->ReadAhead(*fData, readAheadStart,
+			readAheadEnd - readAheadStart);
+	}
+
 private:
 	mutex							fLock;
 	Package*						fPackage;
 	PackageData*					fData;
 	BAbstractBufferedDataReader*	fReader;
 	void*							fFileCache;
+	off_t							fSequentialEnd;
+	off_t							fReadAheadEnd;
+	size_t							fReadAheadSize;
 };
 
 
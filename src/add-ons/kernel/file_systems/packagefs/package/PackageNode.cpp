@@ -19,9 +19,9 @@ PackageNode::PackageNode(Package* package, mode_t mode)
 	fPackage(package),
 	fParent(NULL),
 	fName(),
-	fMode(mode),
-	fUserID(0),
-	fGroupID(0)
+	fModifiedTime(0),
+	fModifiedTimeNanos(0),
+	fMode(mode)
 {
 }
 
@@ -132,5 +132,5 @@ PackageNode::HasPrecedenceOver(const PackageNode* other) const
 		return true;
 	if (!isSystemPkg && otherIsSystemPkg)
 		return false;
-	return fModifiedTime > other->fModifiedTime;
+	return ModifiedTime() > other->ModifiedTime();
 }
@@ -46,16 +46,12 @@ public:
 
 			mode_t				Mode() const			{ return fMode; }
 
-			uid_t				UserID() const			{ return fUserID; }
-			void				SetUserID(uid_t id)		{ fUserID = id; }
+			uid_t				UserID() const			{ return 0; }
+			gid_t				GroupID() const			{ return 0; }
+									// packages don't store owners
 
-			gid_t				GroupID() const			{ return fGroupID; }
-			void				SetGroupID(gid_t id)	{ fGroupID = id; }
-
-			void				SetModifiedTime(const timespec& time)
-									{ fModifiedTime = time; }
-			const timespec&		ModifiedTime() const
-									{ return fModifiedTime; }
+	inline	void				SetModifiedTime(const timespec& time);
+	inline	timespec			ModifiedTime() const;
 
 	virtual	off_t				FileSize() const;
 
@@ -86,14 +82,31 @@ protected:
 	mutable BWeakReference<Package> fPackage;
 			PackageDirectory*	fParent;
 			String				fName;
-			mode_t				fMode;
-			uid_t				fUserID;
-			gid_t				fGroupID;
-			timespec			fModifiedTime;
 			PackageNodeAttributeList fAttributes;
+			int64				fModifiedTime;
+			uint32				fModifiedTimeNanos;
+			mode_t				fMode;
 };
 
 
+void
+PackageNode::SetModifiedTime(const timespec& time)
+{
+	fModifiedTime = time.tv_sec;
+	fModifiedTimeNanos = time.tv_nsec;
+}
+
+
+timespec
+PackageNode::ModifiedTime() const
+{
+	timespec time;
+	time.tv_sec = fModifiedTime;
+	time.tv_nsec = fModifiedTimeNanos;
+	return time;
+}
+
+
 void*
 PackageNode::IndexCookieForAttribute(const StringKey& name) const
 {
@@ -152,3 +152,21 @@ StringPool::DumpUsageStatistics()
 	INFORM("  bytes saved:             %8zd\n",
 		(ssize_t)(totalStringSizeWithDuplicates - totalStringSize - overhead));
 }
+
+
+/*!	Returns the number of strings in the pool, and the memory they use.
+	Doesn't lock the pool, and must therefore only be used from the kernel
+	debugger.
+*/
+/*static*/ void
+StringPool::GetUsage(size_t& _stringCount, size_t& _totalSize)
+{
+	size_t totalSize = 0;
+	for (StringDataHash::Iterator it = sStrings->GetIterator(); it.HasNext();) {
+		StringData* data = it.Next();
+		totalSize += sizeof(StringData) + strlen(data->String());
+	}
+
+	_stringCount = sStrings->CountElements();
+	_totalSize = totalSize;
+}
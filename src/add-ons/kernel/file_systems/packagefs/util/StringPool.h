@@ -66,6 +66,8 @@ public:
 	static	void				LastReferenceReleased(StringData* data);
 
 	static	void				DumpUsageStatistics();
+	static	void				GetUsage(size_t& _stringCount,
+									size_t& _totalSize);
 
 private:
 	static	StringData*			_GetLocked(const StringDataKey& key);
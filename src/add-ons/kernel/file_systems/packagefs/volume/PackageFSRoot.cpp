@@ -11,8 +11,12 @@
 #include <vfs.h>
 
 #include "DebugSupport.h"
+#include "PackageDirectory.h"
+#include "PackageFile.h"
 #include "PackageLinksDirectory.h"
+#include "PackageSymlink.h"
 #include "StringConstants.h"
+#include "StringPool.h"
 
 
 //#define TRACE_DEPENDENCIES_ENABLED
@@ -50,6 +54,8 @@ PackageFSRoot::~PackageFSRoot()
 /*static*/ status_t
 PackageFSRoot::GlobalInit()
 {
+	add_debugger_command("packagefs_memory", &_DumpMemoryUsage,
+		"Prints the memory used by the package nodes of all packagefs volumes");
 	return B_OK;
 }
 
@@ -57,6 +63,7 @@ PackageFSRoot::GlobalInit()
 /*static*/ void
 PackageFSRoot::GlobalUninit()
 {
+	remove_debugger_command("packagefs_memory", &_DumpMemoryUsage);
 }
 
 
@@ -471,3 +478,69 @@ PackageFSRoot::_PutRoot(PackageFSRoot* root)
 
 	root->ReleaseReference();
 }
+
+
+static size_t
+print_memory_usage(const char* name, size_t count, size_t objectSize)
+{
+	size_t size = count * objectSize;
+	kprintf("  %-12s %8zu x %4zu bytes = %10zu bytes\n", name, count,
+		objectSize, size);
+	return size;
+}
+
+
+/*static*/ int
+PackageFSRoot::_DumpMemoryUsage(int argc, char** argv)
+{
+	if (argc != 1) {
+		kprintf("usage: %s\n", argv[0]);
+		return 0;
+	}
+
+	PackageMemoryUsage total;
+	memset(&total, 0, sizeof(total));
+
+	for (RootList::Iterator it = sRootList.GetIterator();
+			PackageFSRoot* root = it.Next();) {
+		for (VolumeList::Iterator volumeIt = root->fVolumes.GetIterator();
+				Volume* volume = volumeIt.Next();) {
+			PackageMemoryUsage usage;
+			memset(&usage, 0, sizeof(usage));
+			volume->AddMemoryUsage(usage);
+
+			kprintf("volume %p \"%s\": %zu packages, %zu nodes, %zu "
+				"attributes\n", volume, volume->RootDirectory()->Name().Data(),
+				usage.packageCount,
+				usage.directoryCount + usage.fileCount + usage.symlinkCount,
+				usage.attributeCount);
+
+			total.packageCount += usage.packageCount;
+			total.directoryCount += usage.directoryCount;
+			total.fileCount += usage.fileCount;
+			total.symlinkCount += usage.symlinkCount;
+			total.attributeCount += usage.attributeCount;
+		}
+	}
+
+	size_t stringCount;
+	size_t stringSize;
+	StringPool::GetUsage(stringCount, stringSize);
+
+	kprintf("total:\n");
+	size_t size = print_memory_usage("packages", total.packageCount,
+		sizeof(Package));
+	size += print_memory_usage("directories", total.directoryCount,
+		sizeof(PackageDirectory));
+	size += print_memory_usage("files", total.fileCount, sizeof(PackageFile));
+	size += print_memory_usage("symlinks", total.symlinkCount,
+		sizeof(PackageSymlink));
+	size += print_memory_usage("attributes", total.attributeCount,
+		sizeof(PackageNodeAttribute));
+	kprintf("  %-12s %8zu              = %10zu bytes\n", "strings",
+		stringCount, stringSize);
+	size += stringSize;
+	kprintf("  %-12s %8s                %10zu bytes\n", "sum", "", size);
+
+	return 0;
+}
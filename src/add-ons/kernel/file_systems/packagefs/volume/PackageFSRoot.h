@@ -72,6 +72,8 @@ private:
 	static	PackageFSRoot*		_FindRootLocked(dev_t deviceID, ino_t nodeID);
 	static	void				_PutRoot(PackageFSRoot* root);
 
+	static	int					_DumpMemoryUsage(int argc, char** argv);
+
 private:
 	static	mutex				sRootListLock;
 	static	RootList			sRootList;
@@ -70,6 +70,8 @@ static const char* const kActivationFileName
 static const char* const kActivationFilePath
 	= PACKAGES_DIRECTORY_ADMIN_DIRECTORY "/"
 		PACKAGES_DIRECTORY_ACTIVATION_FILE;
+static const char* const kNodeTreeCacheDirectoryPath
+	= PACKAGES_DIRECTORY_ADMIN_DIRECTORY "/packagefs-cache";
 
 
 // #pragma mark - ShineThroughDirectory
@@ -173,6 +175,7 @@ Volume::Volume(fs_volume* fsVolume)
 	fPackagesDirectories(),
 	fPackagesDirectoriesByNodeRef(),
 	fPackageSettings(),
+	fNodeTreeCacheDirectoryFD(-1),
 	fNextNodeID(kRootDirectoryID + 1)
 {
 	rw_lock_init(&fLock, "packagefs volume");
@@ -223,6 +226,9 @@ Volume::~Volume()
 	while (PackagesDirectory* directory = fPackagesDirectories.RemoveHead())
 		directory->ReleaseReference();
 
+	if (fNodeTreeCacheDirectoryFD >= 0)
+		close(fNodeTreeCacheDirectoryFD);
+
 	rw_lock_destroy(&fLock);
 }
 
@@ -424,10 +430,15 @@ Volume::Mount(const char* parameterString)
 		RETURN_ERROR(error);
 
 	// add initial packages
+	_OpenNodeTreeCacheDirectory();
+
 	error = _AddInitialPackages();
 	if (error != B_OK)
 		RETURN_ERROR(error);
 
+	_WriteNodeTreeCaches();
+	_RemoveStaleNodeTreeCaches();
+
 	// publish the root node
 	fRootDirectory->AcquireReference();
 	error = PublishVNode(fRootDirectory);
@@ -453,6 +464,20 @@ Volume::Unmount()
 }
 
 
+/*!	Adds the nodes of all activated packages to \a usage.
+	Doesn't lock anything, and must therefore only be used from the kernel
+	debugger.
+*/
+void
+Volume::AddMemoryUsage(PackageMemoryUsage& usage) const
+{
+	for (PackageFileNameHashTable::Iterator it = fPackages.GetIterator();
+		Package* package = it.Next();) {
+		package->AddMemoryUsage(usage);
+	}
+}
+
+
 status_t
 Volume::IOCtl(Node* node, uint32 operation, void* buffer, size_t size)
 {
@@ -559,6 +584,24 @@ Volume::IOCtl(Node* node, uint32 operation, void* buffer, size_t size)
 			return _ChangeActivation(request);
 		}
 
+		case PACKAGE_FS_OPERATION_GET_CACHE_STATISTICS:
+		{
+			if (size < sizeof(PackageFSCacheStatistics))
+				RETURN_ERROR(B_BAD_VALUE);
+
+			PackageFSCacheStatistics statistics = {};
+
+			VolumeReadLocker volumeReadLocker(this);
+
+			for (PackageFileNameHashTable::Iterator it
+					= fPackages.GetIterator();
+				Package* package = it.Next();) {
+				package->AddCacheStatistics(statistics);
+			}
+
+			RETURN_ERROR(user_memcpy(buffer, &statistics, sizeof(statistics)));
+		}
+
 		default:
 			return B_BAD_VALUE;
 	}
@@ -1651,9 +1694,83 @@ Volume::_ChangeActivation(ActivationChangeRequest& request)
 				_RemovePackage(package);
 			}
 		}
+
+		return error;
+	}
+
+	volumeLocker.Unlock();
+	systemVolumeLocker.Unlock();
+
+	_WriteNodeTreeCaches();
+
+	return B_OK;
+}
+
+
+/*!	Opens the directory the node tree caches of the packages are stored in,
+	creating it, if necessary. Caching is disabled, if that fails, e.g. on a
+	read-only volume.
+*/
+void
+Volume::_OpenNodeTreeCacheDirectory()
+{
+	int packagesDirectoryFD = fPackagesDirectory->DirectoryFD();
+	mkdirat(packagesDirectoryFD, kNodeTreeCacheDirectoryPath,
+		S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+
+	fNodeTreeCacheDirectoryFD = openat(packagesDirectoryFD,
+		kNodeTreeCacheDirectoryPath, O_RDONLY);
+	if (fNodeTreeCacheDirectoryFD < 0) {
+		INFORM("Node tree caching disabled, failed to open \"%s\": %s\n",
+			kNodeTreeCacheDirectoryPath, strerror(errno));
+	}
+}
+
+
+/*!	Writes the node tree caches the activated packages have created when they
+	were loaded.
+*/
+void
+Volume::_WriteNodeTreeCaches()
+{
+	if (fNodeTreeCacheDirectoryFD < 0)
+		return;
+
+	VolumeReadLocker volumeLocker(this);
+	for (PackageFileNameHashTable::Iterator it = fPackages.GetIterator();
+		Package* package = it.Next();) {
+		package->WriteNodeTreeCache(fNodeTreeCacheDirectoryFD);
+	}
+}
+
+
+/*!	Removes the node tree caches that don't belong to any activated package.
+*/
+void
+Volume::_RemoveStaleNodeTreeCaches()
+{
+	if (fNodeTreeCacheDirectoryFD < 0)
+		return;
+
+	int fd = openat(fNodeTreeCacheDirectoryFD, ".", O_RDONLY);
+	if (fd < 0)
+		return;
+
+	DirCloser dir(fdopendir(fd));
+	if (!dir.IsSet()) {
+		close(fd);
+		return;
 	}
 
-	return error;
+	VolumeReadLocker volumeLocker(this);
+	while (dirent* entry = readdir(dir.Get())) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0
+			|| _FindPackage(entry->d_name) != NULL) {
+			continue;
+		}
+
+		unlinkat(fNodeTreeCacheDirectoryFD, entry->d_name, 0);
+	}
 }
 
 
@@ -70,6 +70,12 @@ public:
 			Node*				FindNode(ino_t nodeID) const
 									{ return fNodes.Lookup(nodeID); }
 
+			int					NodeTreeCacheDirectoryFD() const
+									{ return fNodeTreeCacheDirectoryFD; }
+
+			void				AddMemoryUsage(PackageMemoryUsage& usage)
+									const;
+
 			status_t			IOCtl(Node* node, uint32 operation,
 									void* buffer, size_t size);
 
@@ -159,6 +165,10 @@ private:
 			status_t			_ChangeActivation(
 									ActivationChangeRequest& request);
 
+			void				_OpenNodeTreeCacheDirectory();
+			void				_WriteNodeTreeCaches();
+			void				_RemoveStaleNodeTreeCaches();
+
 			status_t			_InitMountType(const char* mountType);
 			status_t			_CreateShineThroughDirectory(Directory* parent,
 									const char* name, Directory*& _directory);
@@ -189,6 +199,7 @@ private:
 			PackagesDirectoryList fPackagesDirectories;
 			PackagesDirectoryHashTable fPackagesDirectoriesByNodeRef;
 			PackageSettings		fPackageSettings;
+			int					fNodeTreeCacheDirectoryFD;
 
 			struct {
 				dev_t			deviceID;
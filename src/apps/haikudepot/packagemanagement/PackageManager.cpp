@@ -269,12 +269,13 @@ PackageManager::RefreshRepository(const BRepositoryConfig& repoConfig)
 
 status_t
 PackageManager::DownloadPackage(const BString& fileURL,
-	const BEntry& targetEntry, const BString& checksum)
+	const BEntry& targetEntry, const BString& checksum,
+	const BEntry* basisEntry)
 {
 	status_t result;
 	try {
 		result = BPackageManager::DownloadPackage(fileURL, targetEntry,
-			checksum);
+			checksum, basisEntry);
 	} catch (BFatalErrorException& ex) {
 		HDERROR("Fatal error occurred while downloading package: "
 			"%s: %s (%s)", fileURL.String(), ex.Message().String(),
@@ -60,7 +60,8 @@ public:
 									const BRepositoryConfig& repoConfig);
 	virtual	status_t			DownloadPackage(const BString& fileURL,
 									const BEntry& targetEntry,
-									const BString& checksum);
+									const BString& checksum,
+									const BEntry* basisEntry = NULL);
 
 			void				AddProgressListener(
 									PackageProgressListener* listener);
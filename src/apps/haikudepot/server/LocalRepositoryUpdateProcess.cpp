@@ -7,11 +7,14 @@
 #include "LocalRepositoryUpdateProcess.h"
 
 #include <Catalog.h>
+#include <Entry.h>
 #include <Roster.h>
 #include <String.h>
 #include <StringList.h>
 
 #include <package/Context.h>
+#include <package/hpkg/RepositoryReader.h>
+#include <package/hpkg/StandardErrorOutput.h>
 #include <package/manager/Exceptions.h>
 #include <package/PackageRoster.h>
 #include <package/RefreshRepositoryRequest.h>
@@ -74,14 +77,13 @@ LocalRepositoryUpdateProcess::RunInternal()
 		DecisionProvider decisionProvider;
 		JobStateListener listener;
 		BContext context(decisionProvider, listener);
-		BRepositoryCache cache;
 
 		for (
 			int32 i = 0;
 			result == B_OK && i < repoNames.CountStrings() && !WasStopped();
 			++i) {
 			result = _RunForRepositoryName(repoNames.StringAt(i), context,
-				roster, &cache);
+				roster);
 		}
 	} else {
 		_NotifyError(strerror(result));
@@ -99,8 +101,7 @@ LocalRepositoryUpdateProcess::RunInternal()
 
 bool
 LocalRepositoryUpdateProcess::_ShouldRunForRepositoryName(
-	const BString& repoName, BPackageKit::BPackageRoster& roster,
-	BPackageKit::BRepositoryCache* cache)
+	const BString& repoName, BPackageKit::BPackageRoster& roster)
 {
 	if (fForce) {
 		HDINFO("[%s] am refreshing cache for repo [%s] as it was forced",
@@ -108,7 +109,7 @@ LocalRepositoryUpdateProcess::_ShouldRunForRepositoryName(
 		return true;
 	}
 
-	if (roster.GetRepositoryCache(repoName, cache) != B_OK) {
+	if (!_HasRepositoryCache(repoName, roster)) {
 		HDINFO("[%s] am updating cache for repo [%s] as there was no cache",
 			Name(), repoName.String());
 		return true;
@@ -127,16 +128,52 @@ LocalRepositoryUpdateProcess::_ShouldRunForRepositoryName(
 }
 
 
+/*! Checks that the repository has a readable cache. Only the package index
+    of the cache is read; creating the infos of all the packages, as
+    BPackageRoster::GetRepositoryCache() does, isn't required for this.
+*/
+
+bool
+LocalRepositoryUpdateProcess::_HasRepositoryCache(const BString& repoName,
+	BPackageKit::BPackageRoster& roster)
+{
+	// like BPackageRoster::GetRepositoryCache(), prefer the user's cache
+	BPath path;
+	if (roster.GetUserRepositoryCachePath(&path) != B_OK
+		|| path.Append(repoName) != B_OK) {
+		return false;
+	}
+	if (!BEntry(path.Path()).Exists()) {
+		if (roster.GetCommonRepositoryCachePath(&path) != B_OK
+			|| path.Append(repoName) != B_OK) {
+			return false;
+		}
+	}
+
+	BPackageKit::BHPKG::BStandardErrorOutput errorOutput;
+	BPackageKit::BHPKG::BRepositoryReader reader(&errorOutput);
+	status_t result = reader.Init(path.Path());
+	if (result == B_OK)
+		result = reader.InitPackageIndex();
+	if (result != B_OK) {
+		HDDEBUG("[%s] unable to read the cache of repo [%s]; %s", Name(),
+			repoName.String(), strerror(result));
+		return false;
+	}
+
+	return true;
+}
+
+
 status_t
 LocalRepositoryUpdateProcess::_RunForRepositoryName(const BString& repoName,
-	BPackageKit::BContext& context, BPackageKit::BPackageRoster& roster,
-	BPackageKit::BRepositoryCache* cache)
+	BPackageKit::BContext& context, BPackageKit::BPackageRoster& roster)
 {
 	status_t result = B_ERROR;
 	BRepositoryConfig repoConfig;
 	result = roster.GetRepositoryConfig(repoName, &repoConfig);
 	if (result == B_OK) {
-		if (_ShouldRunForRepositoryName(repoName, roster, cache)) {
+		if (_ShouldRunForRepositoryName(repoName, roster)) {
 			try {
 				BRefreshRepositoryRequest refreshRequest(context, repoConfig);
 				result = refreshRequest.Process();
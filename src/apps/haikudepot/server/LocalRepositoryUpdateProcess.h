@@ -17,7 +17,6 @@
 
 #include <package/Context.h>
 #include <package/PackageRoster.h>
-#include <package/RepositoryCache.h>
 
 #include "Model.h"
 #include "PackageInfo.h"
@@ -45,13 +44,13 @@ protected:
 private:
 			bool				_ShouldRunForRepositoryName(
 									const BString& repoName,
-									BPackageKit::BPackageRoster& roster,
-									BPackageKit::BRepositoryCache* cache);
+									BPackageKit::BPackageRoster& roster);
+			bool				_HasRepositoryCache(const BString& repoName,
+									BPackageKit::BPackageRoster& roster);
 
 			status_t			_RunForRepositoryName(const BString& repoName,
 									BPackageKit::BContext& context,
-									BPackageKit::BPackageRoster& roster,
-									BPackageKit::BRepositoryCache* cache);
+									BPackageKit::BPackageRoster& roster);
 
 			void				_NotifyError(const BString& error) const;
 			void				_NotifyError(const BString& error,
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * This file may be used under the terms of the MIT License.
+ */
+
+
+//!	Controls the online defragmenter of a mounted BFS volume
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <OS.h>
+
+#include "bfs_control.h"
+
+
+static const char* kProgramName = "bfsdefrag";
+
+
+static void
+usage(FILE* out)
+{
+	fprintf(out, "Usage: %s [options] <path to volume>\n"
+		"Defragments a mounted BFS volume in the background.\n\n"
+		"  -f, --files        only defragment files\n"
+		"  -d, --directories  only defragment directories\n"
+		"  -i, --indices      only defragment indices\n"
+		"  -b, --background   start defragmenting, but don't wait for it\n"
+		"  -s, --status       only show the progress of the defragmenter\n"
+		"  -S, --stop         stop the defragmenter\n"
+		"  -h, --help         show this help\n\n"
+		"The file types can be combined; by default, everything is "
+		"defragmented.\n", kProgramName);
+}
+
+
+static void
+print_status(const bfs_defragment_status& status, bool done)
+{
+	int percent = status.used_blocks > 0
+		? (int)(status.visited_blocks * 100 / status.used_blocks) : 0;
+	if (percent > 100 || done)
+		percent = 100;
+
+	printf("%3d%%: %" B_PRIu64 " nodes visited, %" B_PRIu64 " moved (%"
+		B_PRIu64 " blocks, %" B_PRIu64 " -> %" B_PRIu64 " extents), %"
+		B_PRIu64 " skipped\n", percent, status.visited_nodes,
+		status.moved_nodes, status.moved_blocks, status.extents_before,
+		status.extents_after, status.skipped_nodes);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	const struct option kLongOptions[] = {
+		{ "help", 0, NULL, 'h' },
+		{ "files", 0, NULL, 'f' },
+		{ "directories", 0, NULL, 'd' },
+		{ "indices", 0, NULL, 'i' },
+		{ "background", 0, NULL, 'b' },
+		{ "status", 0, NULL, 's' },
+		{ "stop", 0, NULL, 'S' },
+		{ NULL, 0, NULL, 0 }
+	};
+	const char* kShortOptions = "hfdibsS";
+
+	uint32 flags = 0;
+	bool background = false;
+	bool statusOnly = false;
+	bool stop = false;
+
+	while (true) {
+		int nextOption = getopt_long(argc, argv, kShortOptions, kLongOptions,
+			NULL);
+		if (nextOption == -1)
+			break;
+
+		switch (nextOption) {
+			case 'h':
+				usage(stdout);
+				return 0;
+			case 'f':
+				flags |= BFS_DEFRAGMENT_FILES;
+				break;
+			case 'd':
+				flags |= BFS_DEFRAGMENT_DIRECTORIES;
+				break;
+			case 'i':
+				flags |= BFS_DEFRAGMENT_INDICES;
+				break;
+			case 'b':
+				background = true;
+				break;
+			case 's':
+				statusOnly = true;
+				break;
+			case 'S':
+				stop = true;
+				break;
+			default:
+				usage(stderr);
+				return 1;
+		}
+	}
+
+	if (optind != argc - 1 || (statusOnly && stop)) {
+		usage(stderr);
+		return 1;
+	}
+
+	if (flags == 0) {
+		flags = BFS_DEFRAGMENT_FILES | BFS_DEFRAGMENT_DIRECTORIES
+			| BFS_DEFRAGMENT_INDICES;
+	}
+
+	const char* path = argv[optind];
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: Could not open \"%s\": %s\n", kProgramName, path,
+			strerror(errno));
+		return 1;
+	}
+
+	bfs_defragment_status status;
+	memset(&status, 0, sizeof(status));
+
+	if (stop) {
+		if (ioctl(fd, BFS_IOCTL_STOP_DEFRAGMENTING, NULL, 0) != 0) {
+			fprintf(stderr, "%s: Could not stop defragmenting: %s\n",
+				kProgramName, strerror(errno));
+			close(fd);
+			return 1;
+		}
+	} else if (!statusOnly) {
+		status.flags = flags;
+		if (ioctl(fd, BFS_IOCTL_START_DEFRAGMENTING, &status, sizeof(status))
+				!= 0) {
+			fprintf(stderr, "%s: Could not start defragmenting: %s\n",
+				kProgramName, strerror(errno));
+			close(fd);
+			return 1;
+		}
+	}
+
+	while (true) {
+		if (ioctl(fd, BFS_IOCTL_GET_DEFRAGMENT_STATUS, &status,
+				sizeof(status)) != 0) {
+			if (errno == B_NO_INIT)
+				printf("The volume has not been defragmented yet.\n");
+			else {
+				fprintf(stderr, "%s: Could not get status: %s\n", kProgramName,
+					strerror(errno));
+			}
+			close(fd);
+			return 1;
+		}
+
+		print_status(status, !status.running && status.status == B_OK);
+
+		if (!status.running || statusOnly || stop || background)
+			break;
+
+		snooze(1000000);
+	}
+
+	close(fd);
+
+	if (!status.running) {
+		if (status.status != B_OK) {
+			printf("Defragmenting did not complete: %s\n",
+				strerror(status.status));
+		}
+
+		printf("%" B_PRIu64 " free extents, the largest one has %" B_PRIu64
+			" blocks.\n", status.free_extents, status.largest_free_extent);
+	}
+
+	return stop || status.running || status.status == B_OK ? 0 : 1;
+}
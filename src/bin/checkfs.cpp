@@ -4,12 +4,23 @@
  */
 
 
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <DiskDevice.h>
 #include <DiskDeviceRoster.h>
 #include <DiskSystem.h>
+#include <Path.h>
+#include <String.h>
+#include <fs_index.h>
+
+#include "bfs_control.h"
 
 
 extern "C" const char* __progname;
@@ -25,6 +36,13 @@ usage(FILE* output)
 		"Options:\n"
 		"  -h, --help\t\t- print this help text\n"
 		"  -c, --check-only\t- do not make any changes to the file system\n"
+		"  -C, --compact\t\t- compact the indices and directories of the\n"
+		"\t\t\t  mounted volume after it has been checked (BFS only)\n"
+		"  -i, --inline-data <on|off>\n"
+		"\t\t\t- store the data of small files in their inode, or\n"
+		"\t\t\t  stop doing so, and move the data of all existing\n"
+		"\t\t\t  files accordingly (BFS only); older versions\n"
+		"\t\t\t  of BFS cannot mount the volume anymore\n"
 		"\n"
 		"Examples:\n"
 		"  %s -c /Haiku\n"
@@ -33,18 +51,191 @@ usage(FILE* output)
 }
 
 
+static status_t
+compact_tree(int fd, const char* index, const char* name)
+{
+	bfs_compact_tree compact;
+	compact.index = index;
+	compact.merged_nodes = 0;
+	compact.old_size = 0;
+	compact.new_size = 0;
+
+	if (ioctl(fd, BFS_IOCTL_COMPACT_TREE, &compact, sizeof(compact)) != 0)
+		return errno;
+
+	if (compact.new_size < compact.old_size) {
+		printf("%s: %" B_PRIu64 " -> %" B_PRIu64 " bytes\n", name,
+			compact.old_size, compact.new_size);
+	}
+	return B_OK;
+}
+
+
+static void
+compact_directory(const char* path, dev_t device)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return;
+
+	status_t status = compact_tree(fd, NULL, path);
+	close(fd);
+	if (status != B_OK) {
+		fprintf(stderr, "%s: Could not compact \"%s\": %s\n", kProgramName,
+			path, strerror(status));
+	}
+
+	DIR* dir = opendir(path);
+	if (dir == NULL)
+		return;
+
+	while (dirent* entry = readdir(dir)) {
+		if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+			continue;
+
+		BPath child(path, entry->d_name);
+		struct stat stat;
+		if (lstat(child.Path(), &stat) != 0 || !S_ISDIR(stat.st_mode)
+			|| stat.st_dev != device)
+			continue;
+
+		compact_directory(child.Path(), device);
+	}
+	closedir(dir);
+}
+
+
+/*!	Compacts the B+trees of all indices, and of all directories of the
+	volume mounted at \a mountPoint.
+*/
+static status_t
+compact_volume(const char* mountPoint)
+{
+	struct stat stat;
+	if (::stat(mountPoint, &stat) != 0)
+		return errno;
+
+	int fd = open(mountPoint, O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	DIR* indexDirectory = fs_open_index_dir(stat.st_dev);
+	if (indexDirectory == NULL) {
+		close(fd);
+		return errno;
+	}
+
+	while (dirent* index = fs_read_index_dir(indexDirectory)) {
+		BString name("index ");
+		name << index->d_name;
+
+		status_t status = compact_tree(fd, index->d_name, name.String());
+		if (status == B_DEV_INVALID_IOCTL) {
+			fs_close_index_dir(indexDirectory);
+			close(fd);
+			return status;
+		}
+		if (status != B_OK) {
+			fprintf(stderr, "%s: Could not compact index \"%s\": %s\n",
+				kProgramName, index->d_name, strerror(status));
+		}
+	}
+	fs_close_index_dir(indexDirectory);
+	close(fd);
+
+	compact_directory(mountPoint, stat.st_dev);
+	return B_OK;
+}
+
+
+static void
+move_inline_data(const char* path, dev_t device, uint32 toInode)
+{
+	DIR* dir = opendir(path);
+	if (dir == NULL)
+		return;
+
+	while (dirent* entry = readdir(dir)) {
+		if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+			continue;
+
+		BPath child(path, entry->d_name);
+		struct stat stat;
+		if (lstat(child.Path(), &stat) != 0 || stat.st_dev != device)
+			continue;
+
+		if (S_ISDIR(stat.st_mode)) {
+			move_inline_data(child.Path(), device, toInode);
+			continue;
+		}
+		if (!S_ISREG(stat.st_mode))
+			continue;
+
+		int fd = open(child.Path(), O_RDONLY);
+		if (fd < 0)
+			continue;
+
+		status_t status = B_OK;
+		if (ioctl(fd, BFS_IOCTL_MOVE_INLINE_DATA, &toInode, sizeof(uint32))
+				!= 0)
+			status = errno;
+		close(fd);
+
+		// files that are too large just keep their data where it is
+		if (status != B_OK && status != B_DEVICE_FULL) {
+			fprintf(stderr, "%s: Could not move the data of \"%s\": %s\n",
+				kProgramName, child.Path(), strerror(status));
+		}
+	}
+	closedir(dir);
+}
+
+
+/*!	Enables or disables storing the data of small files in their inode on
+	the volume mounted at \a mountPoint, and moves the data of all existing
+	files into, or out of their inode.
+*/
+static status_t
+set_inline_data(const char* mountPoint, bool enable)
+{
+	struct stat stat;
+	if (::stat(mountPoint, &stat) != 0)
+		return errno;
+
+	int fd = open(mountPoint, O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	uint32 value = enable ? 1 : 0;
+	status_t status = B_OK;
+	if (ioctl(fd, BFS_IOCTL_SET_INLINE_DATA, &value, sizeof(uint32)) != 0)
+		status = errno;
+	close(fd);
+
+	if (status != B_OK)
+		return status;
+
+	move_inline_data(mountPoint, stat.st_dev, value);
+	return B_OK;
+}
+
+
 int
 main(int argc, char** argv)
 {
 	const struct option kLongOptions[] = {
 		{ "help", 0, NULL, 'h' },
 		{ "check-only", 0, NULL, 'c' },
+		{ "compact", 0, NULL, 'C' },
+		{ "inline-data", 1, NULL, 'i' },
 		{ NULL, 0, NULL, 0 }
 	};
-	const char* kShortOptions = "hc";
+	const char* kShortOptions = "hcCi:";
 
 	// parse argument list
 	bool checkOnly = false;
+	bool compact = false;
+	const char* inlineData = NULL;
 
 	while (true) {
 		int nextOption = getopt_long(argc, argv, kShortOptions, kLongOptions,
@@ -59,6 +250,16 @@ main(int argc, char** argv)
 			case 'c':	// --check-only
 				checkOnly = true;
 				break;
+			case 'C':	// --compact
+				compact = true;
+				break;
+			case 'i':	// --inline-data
+				inlineData = optarg;
+				if (strcmp(inlineData, "on") && strcmp(inlineData, "off")) {
+					usage(stderr);
+					return 1;
+				}
+				break;
 			default:	// everything else
 				usage(stderr);
 				return 1;
@@ -66,7 +267,8 @@ main(int argc, char** argv)
 	}
 
 	// the device name should be the only non-option element
-	if (optind != argc - 1) {
+	if (optind != argc - 1
+		|| (checkOnly && (compact || inlineData != NULL))) {
 		usage(stderr);
 		return 1;
 	}
@@ -145,5 +347,35 @@ main(int argc, char** argv)
 
 	status = device.CommitModifications();
 
+	if (!compact && inlineData == NULL)
+		return 0;
+
+	BPath mountPoint;
+	if (!partition->IsMounted()
+		|| partition->GetMountPoint(&mountPoint) != B_OK) {
+		fprintf(stderr, "%s: Only mounted volumes can be compacted, or have "
+			"their inline data changed.\n", kProgramName);
+		return 1;
+	}
+
+	if (inlineData != NULL) {
+		status = set_inline_data(mountPoint.Path(),
+			!strcmp(inlineData, "on"));
+		if (status != B_OK) {
+			fprintf(stderr, "%s: Changing the inline data failed: %s\n",
+				kProgramName, strerror(status));
+			return 1;
+		}
+	}
+
+	if (compact) {
+		status = compact_volume(mountPoint.Path());
+		if (status != B_OK) {
+			fprintf(stderr, "%s: Compacting failed: %s\n", kProgramName,
+				strerror(status));
+			return 1;
+		}
+	}
+
 	return 0;
 }
@@ -38,7 +38,10 @@ print_help(bool out)
 		"Example:\n"
 		"  mkfs -t bfs -o 'block_size 4096; noindex' ./test.image Data\n"
 		"\tThis will initialize \"test.image\" with BFS with a block\n"
-		"\tsize of 4096 bytes, without index, and named \"Data\".\n",
+		"\tsize of 4096 bytes, without index, and named \"Data\".\n"
+		"\n"
+		"The BFS options \"inline_data\" and \"checksums\" create a volume that\n"
+		"older versions of BFS refuse to mount.\n",
 		kProgramName);
 }
 
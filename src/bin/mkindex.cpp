@@ -25,11 +25,14 @@
 #include <string.h>
 #include <errno.h>
 
+#include "bfs_control.h"
+
 
 static struct option const kLongOptions[] = {
 	{"volume", required_argument, 0, 'd'},
 	{"type", required_argument, 0, 't'},
 	{"copy-from", required_argument, 0, 'f'},
+	{"trigram", no_argument, 0, 'g'},
 	{"verbose", no_argument, 0, 'v'},
 	{"help", no_argument, 0, 'h'},
 	{NULL}
@@ -88,6 +91,8 @@ usage(int status)
 		"\t\t\t\"llong\", \"string\", \"float\", or \"double\".\n"
 		"\t\t\tDefaults to \"string\".\n"
 		"      --copy-from\tpath to volume to copy the indexes from.\n"
+		"      --trigram\t\tcreate a trigram index that speeds up queries for\n"
+		"\t\t\tparts of a string, like \"*foo*\" (BFS only).\n"
 		"  -v, --verbose\t\tprint information about the index being created\n",
 		kProgramName);
 
@@ -102,6 +107,7 @@ main(int argc, char **argv)
 	int indexType = B_STRING_TYPE;
 	char *indexName = NULL;
 	bool verbose = false;
+	bool trigram = false;
 	dev_t device = -1, copyFromDevice = -1;
 
 	int c;
@@ -125,6 +131,9 @@ main(int argc, char **argv)
 					return -1;
 				}
 				break;
+			case 'g':
+				trigram = true;
+				break;
 			case 'h':
 				usage(0);
 				break;
@@ -174,6 +183,20 @@ main(int argc, char **argv)
 	} else
 		usage(1);
 
+	char trigramIndexName[B_FILE_NAME_LENGTH];
+	if (trigram) {
+		if (indexType != B_STRING_TYPE) {
+			fprintf(stderr, "%s: Trigram indexes can only be created for "
+				"strings\n", kProgramName);
+			return -1;
+		}
+
+		snprintf(trigramIndexName, sizeof(trigramIndexName), "%s%s",
+			BFS_TRIGRAM_INDEX_PREFIX, indexName);
+		indexName = trigramIndexName;
+		indexTypeName = "trigram";
+	}
+
 	if (verbose) {
 		/* Get the mount point of the specified volume. */
 		BVolume volume(device);
@@ -63,7 +63,9 @@ static const char* kUsage =
 	"                 an option only for use in package building. It will cause\n"
 	"                 the package .self link to point to <path>, which is useful\n"
 	"                 to redirect a \"make install\". Only allowed with -b.\n"
-	"    -z <type>  - Specify compression method to use.\n"
+	"    -z <type>  - Specify compression method to use: \"zlib\" (default),\n"
+	"                 \"zstd\", or \"zstd-dict\" (zstd with a dictionary trained\n"
+	"                 on the package contents, for packages of many small files).\n"
 	"    -q         - Be quiet (don't show any output except for errors).\n"
 	"    -v         - Be verbose (show more info about created package).\n"
 	"\n"
@@ -109,7 +111,9 @@ static const char* kUsage =
 	"\n"
 	"    -0 ... -9  - Use compression level 0 ... 9. 0 means no, 9 best compression.\n"
 	"                 Defaults to 9.\n"
-	"    -z <type>  - Specify compression method to use.\n"
+	"    -z <type>  - Specify compression method to use: \"zlib\" (default),\n"
+	"                 \"zstd\", or \"zstd-dict\" (zstd with a dictionary trained\n"
+	"                 on the package contents, for packages of many small files).\n"
 	"    -q         - Be quiet (don't show any output except for errors).\n"
 	"    -v         - Be verbose (show more info about created package).\n"
 	"\n"
@@ -136,6 +140,8 @@ parse_compression_argument(const char* arg)
 
 	if (strcmp(arg, "zstd") == 0) {
 		return BPackageKit::BHPKG::B_HPKG_COMPRESSION_ZSTD;
+	} else if (strcmp(arg, "zstd-dict") == 0) {
+		return BPackageKit::BHPKG::B_HPKG_COMPRESSION_ZSTD_DICTIONARY;
 	} else if (strcmp(arg, "zlib") == 0) {
 		return BPackageKit::BHPKG::B_HPKG_COMPRESSION_ZLIB;
 	} else {
@@ -115,6 +115,7 @@ int
 command_create(int argc, const char* const* argv)
 {
 	const char* changeToDirectory = NULL;
+	bool writeChunkIndices = false;
 	bool quiet = false;
 	bool verbose = false;
 
@@ -127,7 +128,7 @@ command_create(int argc, const char* const* argv)
 		};
 
 		opterr = 0; // don't print errors
-		int c = getopt_long(argc, (char**)argv, "+C:hqv", sLongOptions, NULL);
+		int c = getopt_long(argc, (char**)argv, "+C:chqv", sLongOptions, NULL);
 		if (c == -1)
 			break;
 
@@ -136,6 +137,10 @@ command_create(int argc, const char* const* argv)
 				changeToDirectory = optarg;
 				break;
 
+			case 'c':
+				writeChunkIndices = true;
+				break;
+
 			case 'h':
 				print_usage_and_exit(false);
 				break;
@@ -198,6 +203,7 @@ command_create(int argc, const char* const* argv)
 			strerror(result));
 		return 1;
 	}
+	repositoryWriter.SetWriteChunkIndices(writeChunkIndices);
 
 	// change directory, if requested
 	if (changeToDirectory != NULL) {
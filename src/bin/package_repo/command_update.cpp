@@ -210,6 +210,7 @@ int
 command_update(int argc, const char* const* argv)
 {
 	const char* changeToDirectory = NULL;
+	bool writeChunkIndices = false;
 	bool quiet = false;
 	bool verbose = false;
 
@@ -222,7 +223,7 @@ command_update(int argc, const char* const* argv)
 		};
 
 		opterr = 0; // don't print errors
-		int c = getopt_long(argc, (char**)argv, "+C:hqv", sLongOptions, NULL);
+		int c = getopt_long(argc, (char**)argv, "+C:chqv", sLongOptions, NULL);
 		if (c == -1)
 			break;
 
@@ -231,6 +232,10 @@ command_update(int argc, const char* const* argv)
 				changeToDirectory = optarg;
 				break;
 
+			case 'c':
+				writeChunkIndices = true;
+				break;
+
 			case 'h':
 				print_usage_and_exit(false);
 				break;
@@ -312,6 +317,7 @@ command_update(int argc, const char* const* argv)
 			strerror(result));
 		return 1;
 	}
+	repositoryWriter.SetWriteChunkIndices(writeChunkIndices);
 
 	BEntry tempRepositoryFile(tempRepositoryFileName.String());
 	BPath targetRepositoryFilePath(targetRepositoryFileName);
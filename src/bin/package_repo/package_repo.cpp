@@ -26,6 +26,8 @@ static const char* kUsage =
 	"    <repo-info>, adding the given package files.\n"
 	"\n"
 	"    -C <dir>   - Change to directory <dir> before starting.\n"
+	"    -c         - Write a chunk index \"<package-file>.chunks\" next to\n"
+	"                 each package file, allowing delta updates.\n"
 	"    -q         - be quiet (don't show any output except for errors).\n"
 	"    -v         - be verbose (list package attributes as encountered).\n"
 	"\n"
@@ -42,6 +44,7 @@ static const char* kUsage =
 	"    <old-repo> and <new-repo> can be the same file.\n"
 	"\n"
 	"    -C <dir>   - Change to directory <dir> before starting.\n"
+	"    -c         - Write chunk indices for the newly added package files.\n"
 	"    -q         - be quiet (don't show any output except for errors).\n"
 	"    -v         - be verbose (list package attributes as encountered).\n"
 	"\n"
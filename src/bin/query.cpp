@@ -13,6 +13,7 @@
  */
 
 
+#include <Directory.h>
 #include <Entry.h>
 #include <LocaleRoster.h>
 #include <Path.h>
@@ -21,11 +22,16 @@
 #include <Volume.h>
 #include <VolumeRoster.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "bfs_control.h"
+
 
 extern const char *__progname;
 static const char *kProgramName = __progname;
@@ -35,18 +41,22 @@ static bool sAllVolumes = false;		// Query all volumes?
 static bool sEscapeMetaChars = true;	// Escape metacharacters?
 static bool sFilesOnly = false;			// Show only files?
 static bool sLocalizedAppNames = false;	// match localized names
+static bool sExplain = false;			// Only explain the query?
 
 
 void
 usage(void)
 {
-	printf("usage: %s [ -ef ] [ -a || -v <path-to-volume> ] expression\n"
+	printf("usage: %s [ -ef ] [ -a || -v <path-to-volume> ] [ --explain ] "
+			"expression\n"
 		"  -e\t\tdon't escape meta-characters\n"
 		"  -f\t\tshow only files (ie. no directories or symbolic links)\n"
 		"  -l\t\tmatch expression with localized application names\n"
 		"  -a\t\tperform the query on all volumes\n"
 		"  -v <file>\tperform the query on just one volume; <file> can be any\n"
 		"\t\tfile on that volume. Defaults to the current volume.\n"
+		"  --explain\tshow how the query would be evaluated instead of\n"
+		"\t\trunning it (BFS volumes only)\n"
 		"  Hint: '%s name=foo' will find files named \"foo\"\n",
 		kProgramName, kProgramName);
 	exit(0);
@@ -110,6 +120,75 @@ perform_query(BVolume &volume, const char *predicate)
 }
 
 
+void
+explain_query(BVolume &volume, const char *predicate)
+{
+	BDirectory root;
+	BEntry entry;
+	BPath path;
+	if (volume.GetRootDirectory(&root) != B_OK
+		|| root.GetEntry(&entry) != B_OK
+		|| entry.GetPath(&path) != B_OK) {
+		fprintf(stderr, "%s: could not get volume root\n", kProgramName);
+		return;
+	}
+
+	int fd = open(path.Path(), O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: could not open %s: %s\n", kProgramName,
+			path.Path(), strerror(errno));
+		return;
+	}
+
+	BString string = sLocalizedAppNames ? "BEOS:APP_SIG=*" : predicate;
+	char buffer[16384];
+
+	bfs_explain_query explain;
+	explain.predicate = string.String();
+	explain.flags = 0;
+	explain.buffer = buffer;
+	explain.buffer_size = sizeof(buffer);
+
+	status_t status = B_OK;
+	if (ioctl(fd, BFS_IOCTL_EXPLAIN_QUERY, &explain, sizeof(explain)) != 0)
+		status = errno;
+	if (status == B_BAD_VALUE) {
+		// the "name=" part may be omitted in our arguments
+		string.Prepend("name=");
+		explain.predicate = string.String();
+
+		status = B_OK;
+		if (ioctl(fd, BFS_IOCTL_EXPLAIN_QUERY, &explain, sizeof(explain))
+				!= 0)
+			status = errno;
+	}
+	close(fd);
+
+	if (status == B_DEV_INVALID_IOCTL) {
+		fprintf(stderr, "%s: %s does not support explaining queries\n",
+			kProgramName, path.Path());
+		return;
+	}
+	if (status != B_OK && status != B_BUFFER_OVERFLOW) {
+		fprintf(stderr, "%s: could not explain query: %s\n", kProgramName,
+			strerror(status));
+		return;
+	}
+
+	printf("%s:\n%s", path.Path(), buffer);
+}
+
+
+void
+process_volume(BVolume &volume, const char *predicate)
+{
+	if (sExplain)
+		explain_query(volume, predicate);
+	else
+		perform_query(volume, predicate);
+}
+
+
 int
 main(int argc, char **argv)
 {
@@ -123,8 +202,14 @@ main(int argc, char **argv)
 	strcpy(volumePath, ".");
 
 	// Parse command-line arguments.
+	const struct option kLongOptions[] = {
+		{"explain", no_argument, NULL, 'x'},
+		{NULL, 0, NULL, 0}
+	};
+
 	int opt;
-	while ((opt = getopt(argc, argv, "efalv:")) != -1) {
+	while ((opt = getopt_long(argc, argv, "efalv:", kLongOptions, NULL))
+			!= -1) {
 		switch(opt) {
 			case 'e':
 				sEscapeMetaChars = false;
@@ -141,6 +226,9 @@ main(int argc, char **argv)
 			case 'v':
 				strlcpy(volumePath, optarg, B_FILE_NAME_LENGTH);
 				break;
+			case 'x':
+				sExplain = true;
+				break;
 
 			default:
 				usage();
@@ -168,7 +256,7 @@ main(int argc, char **argv)
 		if (!volume.KnowsQuery())
 			fprintf(stderr, "%s: volume containing %s is not query-enabled\n", kProgramName, volumePath);
 		else
-			perform_query(volume, argv[optind]);
+			process_volume(volume, argv[optind]);
 	} else {
 		// Okay, we want to query all the disks -- so iterate over
 		// them, one by one, running the query.
@@ -177,7 +265,7 @@ main(int argc, char **argv)
 			// We don't print errors here -- this will catch /pipe and
 			// other filesystems we don't care about.
 			if (volume.KnowsQuery())
-				perform_query(volume, argv[optind]);
+				process_volume(volume, argv[optind]);
 		}
 	}
 
@@ -6,10 +6,12 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <new>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <Directory.h>
 #include <Entry.h>
@@ -18,10 +20,13 @@
 #include <Node.h>
 #include <Path.h>
 #include <String.h>
+#include <Volume.h>
 #include <fs_attr.h>
 #include <fs_index.h>
 #include <fs_info.h>
 
+#include "bfs_control.h"
+
 
 extern const char *__progname;
 static const char *kProgramName = __progname;
@@ -32,6 +37,8 @@ char *gAttrPattern;
 bool gIsPattern = false;
 bool gFromVolume = false;	// copy indices from another volume
 BList gAttrList;				// list of indices of that volume
+bool gBulk = false;			// let the file system add the files in bulk
+BList gBulkIndices;				// list of BulkIndex objects
 
 
 class Attribute {
@@ -119,6 +126,131 @@ Attribute::RemoveFromFile(BNode *node)
 //	#pragma mark -
 
 
+/*!	Collects the files that should be added to an index, and passes them
+	to the file system in chunks, instead of rewriting their attributes.
+	BFS can then sort them, and insert them into the index in one go.
+*/
+class BulkIndex {
+public:
+	BulkIndex(dev_t device, const char *name);
+
+	status_t AddNode(ino_t node);
+	status_t Flush();
+
+	dev_t		Device() const { return fDevice; }
+	const char	*Name() const { return fName.String(); }
+	uint32		Added() const { return fAdded; }
+
+protected:
+	dev_t		fDevice;
+	BString		fName;
+	ino_t		fNodes[BFS_ADD_TO_INDEX_MAX_NODES];
+	uint32		fCount;
+	uint32		fAdded;
+};
+
+
+BulkIndex::BulkIndex(dev_t device, const char *name)
+	:
+	fDevice(device),
+	fName(name),
+	fCount(0),
+	fAdded(0)
+{
+}
+
+
+status_t
+BulkIndex::AddNode(ino_t node)
+{
+	fNodes[fCount++] = node;
+	if (fCount < BFS_ADD_TO_INDEX_MAX_NODES)
+		return B_OK;
+
+	return Flush();
+}
+
+
+status_t
+BulkIndex::Flush()
+{
+	if (fCount == 0)
+		return B_OK;
+
+	BVolume volume(fDevice);
+	BDirectory root;
+	BEntry entry;
+	BPath path;
+	status_t status = volume.GetRootDirectory(&root);
+	if (status == B_OK)
+		status = root.GetEntry(&entry);
+	if (status == B_OK)
+		status = entry.GetPath(&path);
+	if (status != B_OK)
+		return status;
+
+	int fd = open(path.Path(), O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	bfs_add_to_index add;
+	add.index = fName.String();
+	add.nodes = fNodes;
+	add.count = fCount;
+	add.added = 0;
+
+	status = B_OK;
+	if (ioctl(fd, BFS_IOCTL_ADD_TO_INDEX, &add, sizeof(add)) != 0)
+		status = errno;
+	close(fd);
+
+	fCount = 0;
+	fAdded += add.added;
+	return status;
+}
+
+
+BulkIndex *
+getBulkIndex(dev_t device, const char *name)
+{
+	for (int32 index = gBulkIndices.CountItems(); index-- > 0;) {
+		BulkIndex *bulkIndex = (BulkIndex *)gBulkIndices.ItemAt(index);
+		if (bulkIndex->Device() == device && !strcmp(bulkIndex->Name(), name))
+			return bulkIndex;
+	}
+
+	BulkIndex *bulkIndex = new(std::nothrow) BulkIndex(device, name);
+	if (bulkIndex == NULL || !gBulkIndices.AddItem(bulkIndex)) {
+		fprintf(stderr, "%s: out of memory.\n", kProgramName);
+		exit(1);
+	}
+	return bulkIndex;
+}
+
+
+void
+flushBulkIndices()
+{
+	BulkIndex *bulkIndex;
+	while ((bulkIndex = (BulkIndex *)gBulkIndices.RemoveItem((int32)0))
+			!= NULL) {
+		status_t status = bulkIndex->Flush();
+		if (status != B_OK) {
+			fprintf(stderr, "%s: could not add files to index \"%s\": %s\n",
+				kProgramName, bulkIndex->Name(), strerror(status));
+		} else if (gVerbose) {
+			printf("index '%s': added %" B_PRIu32 " files\n",
+				bulkIndex->Name(), bulkIndex->Added());
+		}
+
+		delete bulkIndex;
+	}
+}
+
+
+//	#pragma mark -
+
+
 bool
 nameMatchesPattern(char *name)
 {
@@ -237,6 +369,29 @@ handleFile(BEntry *entry, BNode *node)
 		}
 	}
 
+	if (gBulk) {
+		// only remember the file for the indices, and empty the list
+		node_ref nodeRef;
+		status = node->GetNodeRef(&nodeRef);
+
+		while ((attr = static_cast<Attribute *>(list.RemoveItem((int32)0)))
+				!= NULL) {
+			if (status == B_OK) {
+				BulkIndex *bulkIndex = getBulkIndex(nodeRef.device,
+					attr->Name());
+				status_t addStatus = bulkIndex->AddNode(nodeRef.node);
+				if (addStatus != B_OK) {
+					fprintf(stderr, "%s: could not add files to index \"%s\": "
+						"%s\n", kProgramName, attr->Name(),
+						strerror(addStatus));
+				}
+			}
+
+			delete attr;
+		}
+		return;
+	}
+
 	// remove attrs
 	for (int32 i = list.CountItems(); i-- > 0;) {
 		attr = static_cast<Attribute *>(list.ItemAt(i));
@@ -306,11 +461,13 @@ copyIndicesFromVolume(const char *path, BEntry &to)
 void
 printUsage(char *cmd)
 {
-	printf("usage: %s [-rvf] attr <list of filenames and/or directories>\n"
+	printf("usage: %s [-rvfb] attr <list of filenames and/or directories>\n"
 		"  -r\tenter directories recursively\n"
 		"  -v\tverbose output\n"
 		"  -f\tcreate/update all indices from the source volume,\n\t\"attr\" is "
-			"the path to the source volume\n", cmd);
+			"the path to the source volume\n"
+		"  -b\tlet the file system add the files to the indices in bulk,\n"
+			"\tinstead of rewriting their attributes (BFS only)\n", cmd);
 }
 
 
@@ -327,6 +484,9 @@ main(int argc, char **argv)
 	while (*++argv && **argv == '-') {
 		for (int i = 1; (*argv)[i]; i++) {
 			switch ((*argv)[i]) {
+				case 'b':
+					gBulk = true;
+					break;
 				case 'f':
 					gFromVolume = true;
 					break;
@@ -358,5 +518,6 @@ main(int argc, char **argv)
 			fprintf(stderr, "%s: could not find \"%s\".\n", kProgramName, *argv);
 	}
 
+	flushBulkIndices();
 	return 0;
 }
@@ -10,8 +10,11 @@
 #include <package/ActivateRepositoryCacheJob.h>
 
 #include <File.h>
+#include <Node.h>
 
+#include <package/ChecksumAccessors.h>
 #include <package/Context.h>
+#include <package/RepositoryCacheDefs.h>
 
 
 namespace BPackageKit {
@@ -21,10 +24,12 @@ namespace BPrivate {
 
 ActivateRepositoryCacheJob::ActivateRepositoryCacheJob(const BContext& context,
 	const BString& title, const BEntry& fetchedRepoCacheEntry,
-	const BString& repositoryName, const BDirectory& targetDirectory)
+	const BEntry& fetchedChecksumEntry, const BString& repositoryName,
+	const BDirectory& targetDirectory)
 	:
 	inherited(context, title),
 	fFetchedRepoCacheEntry(fetchedRepoCacheEntry),
+	fFetchedChecksumEntry(fetchedChecksumEntry),
 	fRepositoryName(repositoryName),
 	fTargetDirectory(targetDirectory)
 {
@@ -44,6 +49,24 @@ ActivateRepositoryCacheJob::Execute()
 	if (result != B_OK)
 		return result;
 
+	// The solver's pool data cached for the old repository cache are stale
+	// now. They are recreated from the new cache when it's next used.
+	BString solvFileName(fRepositoryName);
+	solvFileName << ".solv";
+	BEntry solvFileEntry(&fTargetDirectory, solvFileName.String());
+	if (solvFileEntry.Exists())
+		solvFileEntry.Remove();
+
+	// Remember the checksum the cache has been validated against, so it
+	// doesn't have to be computed from the file again. It's only an
+	// optimization, so failing to do so is not an error.
+	BString checksum;
+	if (ChecksumFileChecksumAccessor(fFetchedChecksumEntry)
+			.GetChecksum(checksum) == B_OK) {
+		BNode(&fFetchedRepoCacheEntry).WriteAttrString(
+			REPOSITORY_CACHE_CHECKSUM_ATTRIBUTE, &checksum);
+	}
+
 	// TODO: propagate some repository attributes to file attributes
 
 	return B_OK;
@@ -12,6 +12,7 @@
 #include <package/ValidateChecksumJob.h>
 
 #include "FetchFileJob.h"
+#include "FetchPackageDeltaJob.h"
 #include "FetchUtils.h"
 
 
@@ -43,6 +44,17 @@ DownloadFileRequest::~DownloadFileRequest()
 }
 
 
+/*!	Sets an older version of the file to be downloaded. If the server provides
+	a chunk index for the file, only the parts not contained in the basis file
+	are downloaded.
+*/
+void
+DownloadFileRequest::SetBasisEntry(const BEntry& basisEntry)
+{
+	fBasisEntry = basisEntry;
+}
+
+
 status_t
 DownloadFileRequest::CreateInitialJobs()
 {
@@ -52,8 +64,15 @@ DownloadFileRequest::CreateInitialJobs()
 
 	if (!FetchUtils::IsDownloadCompleted(BNode(&fTargetEntry))) {
 		// create the download job
-		FetchFileJob* fetchJob = new (std::nothrow) FetchFileJob(fContext,
-			BString("Downloading ") << fFileURL, fFileURL, fTargetEntry);
+		FetchFileJob* fetchJob;
+		if (fBasisEntry.InitCheck() == B_OK) {
+			fetchJob = new (std::nothrow) FetchPackageDeltaJob(fContext,
+				BString("Downloading ") << fFileURL, fFileURL, fTargetEntry,
+				fBasisEntry);
+		} else {
+			fetchJob = new (std::nothrow) FetchFileJob(fContext,
+				BString("Downloading ") << fFileURL, fFileURL, fTargetEntry);
+		}
 		if (fetchJob == NULL)
 			return B_NO_MEMORY;
 
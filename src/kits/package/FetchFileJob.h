@@ -61,7 +61,7 @@ protected:
 	virtual	status_t			Execute();
 	virtual	void				Cleanup(status_t jobResult);
 
-private:
+protected:
 			BString				fFileURL;
 			BEntry				fTargetEntry;
 			BFile				fTargetFile;
@@ -0,0 +1,410 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "FetchPackageDeltaJob.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <DataIO.h>
+
+#ifdef HAIKU_TARGET_PLATFORM_HAIKU
+#	include <AutoDeleter.h>
+#	include <HttpRequest.h>
+#	include <HttpResult.h>
+#	include <Url.h>
+#	include <UrlProtocolRoster.h>
+#	include <UrlRequest.h>
+using namespace BPrivate::Network;
+#endif
+
+#include <package/hpkg/PackageChunkIndex.h>
+
+#include "FetchUtils.h"
+
+
+namespace BPackageKit {
+
+namespace BPrivate {
+
+
+using BHPKG::BPrivate::PackageChunkIndex;
+using BHPKG::BPrivate::kChunkHashSize;
+
+
+// Ranges of missing chunks are fetched with one request each, but no more than
+// this many bytes at once.
+static const off_t kMaxFetchSize = 4 * 1024 * 1024;
+
+// The chunk index of even a very large package is a lot smaller than this.
+static const off_t kMaxChunkIndexSize = 8 * 1024 * 1024;
+
+
+#ifdef HAIKU_TARGET_PLATFORM_HAIKU
+
+
+/*!	A BMallocIO that refuses to grow beyond a given size, so that a server
+	sending more than has been asked for cannot fill up the memory.
+*/
+class LimitedMallocIO : public BMallocIO {
+public:
+	LimitedMallocIO(off_t limit)
+		:
+		fLimit(limit)
+	{
+	}
+
+	virtual ssize_t WriteAt(off_t position, const void* buffer, size_t size)
+	{
+		if (position < 0 || position + (off_t)size > fLimit)
+			return B_BUFFER_OVERFLOW;
+
+		return BMallocIO::WriteAt(position, buffer, size);
+	}
+
+private:
+	off_t	fLimit;
+};
+
+
+#endif // HAIKU_TARGET_PLATFORM_HAIKU
+
+
+FetchPackageDeltaJob::FetchPackageDeltaJob(const BContext& context,
+	const BString& title, const BString& fileURL, const BEntry& targetEntry,
+	const BEntry& basisEntry)
+	:
+	inherited(context, title, fileURL, targetEntry),
+	fBasisEntry(basisEntry),
+	fFetchingDelta(false),
+	fBytesFetched(0),
+	fFetchingRange(false),
+	fStatusCode(0)
+{
+}
+
+
+FetchPackageDeltaJob::~FetchPackageDeltaJob()
+{
+}
+
+
+#ifdef HAIKU_TARGET_PLATFORM_HAIKU
+
+
+void
+FetchPackageDeltaJob::HeadersReceived(BUrlRequest* request)
+{
+	if (!fFetchingDelta) {
+		inherited::HeadersReceived(request);
+		return;
+	}
+
+	const BHttpResult* result
+		= dynamic_cast<const BHttpResult*>(&request->Result());
+	if (result == NULL)
+		return;
+
+	// A server that doesn't support range requests sends the complete file,
+	// don't wait for it to arrive; it's downloaded in one go instead.
+	fStatusCode = result->StatusCode();
+	if (fFetchingRange && fStatusCode != B_HTTP_STATUS_PARTIAL_CONTENT)
+		request->Stop();
+}
+
+
+void
+FetchPackageDeltaJob::DownloadProgress(BUrlRequest* request,
+	off_t bytesReceived, off_t bytesTotal)
+{
+	if (!fFetchingDelta) {
+		inherited::DownloadProgress(request, bytesReceived, bytesTotal);
+		return;
+	}
+
+	// only the missing chunks count, not the chunk index
+	if (fTotalBytes == 0)
+		return;
+
+	fBytes = fBytesFetched + bytesReceived;
+	fDownloadProgress = (float)fBytes / fTotalBytes;
+	NotifyStateListeners();
+}
+
+
+/*!	Creates the package from the chunks of the basis package, downloading only
+	the chunks it doesn't contain. If the repository doesn't provide a chunk
+	index for the package, or anything else goes wrong, the complete package
+	is downloaded instead.
+*/
+status_t
+FetchPackageDeltaJob::Execute()
+{
+	status_t result = fTargetFile.InitCheck();
+	if (result != B_OK)
+		return result;
+
+	fFetchingDelta = true;
+	result = _FetchDelta();
+	fFetchingDelta = false;
+
+	if (result != B_OK) {
+		if (result != B_NAME_NOT_FOUND && result != B_ENTRY_NOT_FOUND) {
+			fprintf(stderr, "failed to fetch '%s' as delta, downloading the "
+				"complete file: %s\n", DownloadFileName(), strerror(result));
+		}
+
+		fTargetFile.SetSize(0);
+		fBytes = 0;
+		fTotalBytes = 0;
+		fDownloadProgress = 0.0;
+		return inherited::Execute();
+	}
+
+	result = FetchUtils::SetFileType(fTargetFile,
+		"application/x-vnd.haiku-package");
+	if (result != B_OK) {
+		fprintf(stderr, "failed to set file type for '%s': %s\n",
+			DownloadFileName(), strerror(result));
+	}
+
+	result = FetchUtils::MarkDownloadComplete(fTargetFile);
+	if (result != B_OK) {
+		fprintf(stderr, "failed to mark download '%s' as complete: %s\n",
+			DownloadFileName(), strerror(result));
+	}
+
+	return B_OK;
+}
+
+
+status_t
+FetchPackageDeltaJob::_FetchDelta()
+{
+	// fetch the chunk index of the new package
+	BString indexURL(fFileURL);
+	indexURL << ".chunks";
+	LimitedMallocIO indexData(kMaxChunkIndexSize);
+	status_t result = _FetchRange(indexURL, 0, -1, &indexData);
+	if (result != B_OK)
+		return result;
+
+	PackageChunkIndex index;
+	result = index.Read(indexData.Buffer(), indexData.BufferLength());
+	if (result != B_OK)
+		return result;
+
+	// split the package we already have into chunks the same way
+	BFile basisFile(&fBasisEntry, B_READ_ONLY);
+	result = basisFile.InitCheck();
+	if (result != B_OK)
+		return result;
+
+	PackageChunkIndex basisIndex;
+	result = basisIndex.Compute(&basisFile);
+	if (result != B_OK)
+		return result;
+
+	off_t missingBytes = 0;
+	for (int32 i = 0; i < index.CountChunks(); i++) {
+		const PackageChunkIndex::Chunk& chunk = index.ChunkAt(i);
+		if (basisIndex.FindChunk(chunk.hash) == NULL)
+			missingBytes += chunk.size;
+	}
+
+	fBytes = 0;
+	fTotalBytes = missingBytes;
+	fBytesFetched = 0;
+
+	result = fTargetFile.SetSize(0);
+	if (result != B_OK)
+		return result;
+
+	BMallocIO buffer;
+	for (int32 i = 0; i < index.CountChunks();) {
+		const PackageChunkIndex::Chunk& chunk = index.ChunkAt(i);
+
+		const PackageChunkIndex::Chunk* basisChunk
+			= basisIndex.FindChunk(chunk.hash);
+		if (basisChunk != NULL) {
+			// copy the chunk from the basis package
+			result = buffer.SetSize(chunk.size);
+			if (result != B_OK)
+				return result;
+
+			result = basisFile.ReadAtExactly(basisChunk->offset,
+				(void*)buffer.Buffer(), chunk.size);
+			if (result == B_OK)
+				result = _WriteChunks(index, i, 1, (uint8*)buffer.Buffer());
+			if (result != B_OK)
+				return result;
+
+			i++;
+			continue;
+		}
+
+		// fetch the missing chunk, along with the missing ones following it
+		int32 count = 1;
+		off_t size = chunk.size;
+		while (i + count < index.CountChunks()) {
+			const PackageChunkIndex::Chunk& nextChunk
+				= index.ChunkAt(i + count);
+			if (size + nextChunk.size > kMaxFetchSize
+				|| basisIndex.FindChunk(nextChunk.hash) != NULL) {
+				break;
+			}
+			size += nextChunk.size;
+			count++;
+		}
+
+		LimitedMallocIO data(size);
+		result = _FetchRange(fFileURL, chunk.offset, size, &data);
+		if (result != B_OK)
+			return result;
+
+		if ((off_t)data.BufferLength() != size)
+			return B_BAD_DATA;
+
+		result = _WriteChunks(index, i, count, (const uint8*)data.Buffer());
+		if (result != B_OK)
+			return result;
+
+		fBytesFetched += size;
+		fBytes = fBytesFetched;
+		fDownloadProgress = (float)fBytes / fTotalBytes;
+		NotifyStateListeners();
+
+		i += count;
+	}
+
+	return B_OK;
+}
+
+
+/*!	Writes the given range of the file at \a url to \a output. A \a size of -1
+	means the rest of the file. Local files are read directly, since only HTTP
+	supports range requests.
+	Returns \c B_ENTRY_NOT_FOUND if the file doesn't exist, and
+	\c B_NOT_SUPPORTED if the server doesn't send just the requested range.
+*/
+status_t
+FetchPackageDeltaJob::_FetchRange(const BString& url, off_t offset, off_t size,
+	BDataIO* output)
+{
+	BUrl parsedURL(url.String());
+	if (parsedURL.Protocol() == "file") {
+		BFile file(BUrl::UrlDecode(parsedURL.Path()).String(), B_READ_ONLY);
+		status_t result = file.InitCheck();
+		if (result != B_OK)
+			return result;
+
+		if (size < 0) {
+			off_t fileSize;
+			result = file.GetSize(&fileSize);
+			if (result != B_OK)
+				return result;
+			size = fileSize - offset;
+		}
+
+		char buffer[64 * 1024];
+		while (size > 0) {
+			ssize_t bytesRead = file.ReadAt(offset, buffer,
+				std::min(size, (off_t)sizeof(buffer)));
+			if (bytesRead < 0)
+				return bytesRead;
+			if (bytesRead == 0)
+				return B_BAD_DATA;
+
+			result = output->WriteExactly(buffer, bytesRead);
+			if (result != B_OK)
+				return result;
+
+			offset += bytesRead;
+			size -= bytesRead;
+		}
+
+		return B_OK;
+	}
+
+	BUrlRequest* request = BUrlProtocolRoster::MakeRequest(parsedURL, output,
+		this);
+	if (request == NULL)
+		return B_BAD_VALUE;
+	ObjectDeleter<BUrlRequest> requestDeleter(request);
+
+	fFetchingRange = offset > 0 || size >= 0;
+	if (fFetchingRange) {
+		BHttpRequest* http = dynamic_cast<BHttpRequest*>(request);
+		if (http == NULL)
+			return B_NOT_SUPPORTED;
+
+		http->SetRangeStart(offset);
+		if (size >= 0)
+			http->SetRangeEnd(offset + size - 1);
+	}
+
+	fError = B_ERROR;
+	fStatusCode = 0;
+	thread_id thread = request->Run();
+	wait_for_thread(thread, NULL);
+
+	if (fStatusCode == B_HTTP_STATUS_NOT_FOUND
+		|| fStatusCode == B_HTTP_STATUS_GONE) {
+		return B_ENTRY_NOT_FOUND;
+	}
+	if (fFetchingRange && BHttpRequest::IsSuccessStatusCode(fStatusCode)
+		&& fStatusCode != B_HTTP_STATUS_PARTIAL_CONTENT) {
+		return B_NOT_SUPPORTED;
+	}
+
+	return fError;
+}
+
+
+/*!	Verifies \a count chunks starting with \a first in \a data against their
+	hashes and writes them to the target file.
+*/
+status_t
+FetchPackageDeltaJob::_WriteChunks(const PackageChunkIndex& index,
+	int32 first, int32 count, const uint8* data)
+{
+	for (int32 i = first; i < first + count; i++) {
+		const PackageChunkIndex::Chunk& chunk = index.ChunkAt(i);
+
+		uint8 hash[kChunkHashSize];
+		PackageChunkIndex::ComputeHash(data, chunk.size, hash);
+		if (memcmp(hash, chunk.hash, kChunkHashSize) != 0)
+			return B_BAD_DATA;
+
+		status_t result = fTargetFile.WriteAtExactly(chunk.offset, data,
+			chunk.size);
+		if (result != B_OK)
+			return result;
+
+		data += chunk.size;
+	}
+
+	return B_OK;
+}
+
+
+#else // HAIKU_TARGET_PLATFORM_HAIKU
+
+
+status_t
+FetchPackageDeltaJob::Execute()
+{
+	return inherited::Execute();
+}
+
+
+#endif // HAIKU_TARGET_PLATFORM_HAIKU
+
+}	// namespace BPrivate
+
+}	// namespace BPackageKit
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef _PACKAGE__PRIVATE__FETCH_PACKAGE_DELTA_JOB_H_
+#define _PACKAGE__PRIVATE__FETCH_PACKAGE_DELTA_JOB_H_
+
+
+#include "FetchFileJob.h"
+
+
+class BDataIO;
+
+
+namespace BPackageKit {
+
+namespace BHPKG {
+namespace BPrivate {
+	class PackageChunkIndex;
+}
+}
+
+namespace BPrivate {
+
+
+class FetchPackageDeltaJob : public FetchFileJob {
+	typedef	FetchFileJob		inherited;
+
+public:
+								FetchPackageDeltaJob(const BContext& context,
+									const BString& title,
+									const BString& fileURL,
+									const BEntry& targetEntry,
+									const BEntry& basisEntry);
+	virtual						~FetchPackageDeltaJob();
+
+#ifdef HAIKU_TARGET_PLATFORM_HAIKU
+	virtual void				HeadersReceived(BUrlRequest* request);
+	virtual void				DownloadProgress(BUrlRequest*,
+									off_t bytesReceived, off_t bytesTotal);
+#endif
+
+protected:
+	virtual	status_t			Execute();
+
+#ifdef HAIKU_TARGET_PLATFORM_HAIKU
+private:
+			status_t			_FetchDelta();
+			status_t			_FetchRange(const BString& url,
+									off_t offset, off_t size,
+									BDataIO* output);
+			status_t			_WriteChunks(
+									const BHPKG::BPrivate::PackageChunkIndex&
+										index,
+									int32 first, int32 count,
+									const uint8* data);
+#endif
+
+private:
+			BEntry				fBasisEntry;
+			bool				fFetchingDelta;
+			off_t				fBytesFetched;
+			bool				fFetchingRange;
+			int32				fStatusCode;
+};
+
+
+}	// namespace BPrivate
+
+}	// namespace BPackageKit
+
+
+#endif // _PACKAGE__PRIVATE__FETCH_PACKAGE_DELTA_JOB_H_
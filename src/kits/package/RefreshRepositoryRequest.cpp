@@ -11,6 +11,7 @@
 
 #include <Catalog.h>
 #include <Directory.h>
+#include <Node.h>
 #include <Path.h>
 
 #include <JobQueue.h>
@@ -19,6 +20,7 @@
 #include <package/ChecksumAccessors.h>
 #include <package/ValidateChecksumJob.h>
 #include <package/RepositoryCache.h>
+#include <package/RepositoryCacheDefs.h>
 #include <package/RepositoryConfig.h>
 #include <package/PackageRoster.h>
 
@@ -116,6 +118,11 @@ BRefreshRepositoryRequest::JobSucceeded(BSupportKit::BJob* job)
 		fValidateChecksumJob = NULL;
 			// don't re-trigger fetching if anything goes wrong, fail instead
 		_FetchRepositoryCache();
+	} else if (job == fValidateChecksumJob) {
+		// the repo cache is up to date, but may have been activated before
+		// its checksum was stored with it
+		fValidateChecksumJob = NULL;
+		_StoreRepositoryCacheChecksum();
 	}
 }
 
@@ -172,7 +179,8 @@ BRefreshRepositoryRequest::_FetchRepositoryCache()
 	ActivateRepositoryCacheJob* activateJob
 		= new (std::nothrow) ActivateRepositoryCacheJob(fContext,
 			BString("Activating repository cache for ") << fRepoConfig.Name(),
-			tempRepoCache, fRepoConfig.Name(), targetDirectory);
+			tempRepoCache, fFetchedChecksumFile, fRepoConfig.Name(),
+			targetDirectory);
 	if (activateJob == NULL)
 		return B_NO_MEMORY;
 	activateJob->AddDependency(validateChecksumJob);
@@ -185,4 +193,43 @@ BRefreshRepositoryRequest::_FetchRepositoryCache()
 }
 
 
+/*!	Stores the fetched checksum with the repository cache it has been
+	validated against, like ActivateRepositoryCacheJob does, if the cache
+	doesn't have it yet.
+*/
+void
+BRefreshRepositoryRequest::_StoreRepositoryCacheChecksum()
+{
+	// like BPackageRoster::GetRepositoryCache(), prefer the user's cache
+	BPath repoCachePath;
+	BPackageRoster roster;
+	status_t result = roster.GetUserRepositoryCachePath(&repoCachePath);
+	if (result == B_OK)
+		result = repoCachePath.Append(fRepoConfig.Name());
+	if (result == B_OK && !BEntry(repoCachePath.Path()).Exists()) {
+		result = roster.GetCommonRepositoryCachePath(&repoCachePath);
+		if (result == B_OK)
+			result = repoCachePath.Append(fRepoConfig.Name());
+	}
+	if (result != B_OK)
+		return;
+
+	BNode repoCacheNode(repoCachePath.Path());
+	BString checksum;
+	if (repoCacheNode.InitCheck() != B_OK
+		|| ChecksumFileChecksumAccessor(fFetchedChecksumFile)
+			.GetChecksum(checksum) != B_OK) {
+		return;
+	}
+
+	BString storedChecksum;
+	if (repoCacheNode.ReadAttrString(REPOSITORY_CACHE_CHECKSUM_ATTRIBUTE,
+			&storedChecksum) != B_OK
+		|| storedChecksum != checksum) {
+		repoCacheNode.WriteAttrString(REPOSITORY_CACHE_CHECKSUM_ATTRIBUTE,
+			&checksum);
+	}
+}
+
+
 }	// namespace BPackageKit
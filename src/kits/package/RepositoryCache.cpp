@@ -17,17 +17,16 @@
 #include <Directory.h>
 #include <File.h>
 #include <FindDirectory.h>
+#include <Node.h>
 #include <Path.h>
 
 #include <package/hpkg/ErrorOutput.h>
-#include <package/hpkg/PackageInfoAttributeValue.h>
-#include <package/hpkg/RepositoryContentHandler.h>
 #include <package/hpkg/RepositoryReader.h>
 #include <package/hpkg/StandardErrorOutput.h>
 #include <package/PackageInfo.h>
 #include <package/RepositoryInfo.h>
 
-#include <package/PackageInfoContentHandler.h>
+#include <package/RepositoryCacheDefs.h>
 
 
 namespace BPackageKit {
@@ -36,65 +35,6 @@ namespace BPackageKit {
 using namespace BHPKG;
 
 
-// #pragma mark - RepositoryContentHandler
-
-
-struct BRepositoryCache::RepositoryContentHandler : BRepositoryContentHandler {
-	RepositoryContentHandler(BRepositoryInfo& repositoryInfo,
-		BPackageInfoSet& packages, BErrorOutput* errorOutput)
-		:
-		fRepositoryInfo(repositoryInfo),
-		fPackageInfo(),
-		fPackages(packages),
-		fPackageInfoContentHandler(fPackageInfo, errorOutput)
-	{
-	}
-
-	virtual status_t HandlePackage(const char* packageName)
-	{
-		fPackageInfo.Clear();
-		return B_OK;
-	}
-
-
-	virtual status_t HandlePackageAttribute(
-		const BPackageInfoAttributeValue& value)
-	{
-		return fPackageInfoContentHandler.HandlePackageAttribute(value);
-	}
-
-	virtual status_t HandlePackageDone(const char* packageName)
-	{
-		status_t result = fPackageInfo.InitCheck();
-		if (result != B_OK)
-			return result;
-
-		result = fPackages.AddInfo(fPackageInfo);
-		if (result != B_OK)
-			return result;
-
-		return B_OK;
-	}
-
-	virtual status_t HandleRepositoryInfo(const BRepositoryInfo& repositoryInfo)
-	{
-		fRepositoryInfo = repositoryInfo;
-
-		return B_OK;
-	}
-
-	virtual void HandleErrorOccurred()
-	{
-	}
-
-private:
-	BRepositoryInfo&			fRepositoryInfo;
-	BPackageInfo				fPackageInfo;
-	BPackageInfoSet&			fPackages;
-	BPackageInfoContentHandler	fPackageInfoContentHandler;
-};
-
-
 // #pragma mark - BRepositoryCache
 
 
@@ -139,6 +79,27 @@ BRepositoryCache::SetIsUserSpecific(bool isUserSpecific)
 }
 
 
+/*!	Returns the checksum the repository published for the cache, as stored
+	with the cache when it has been fetched. Caches fetched by older versions
+	don't have it.
+*/
+status_t
+BRepositoryCache::GetChecksum(BString& _checksum) const
+{
+	BNode node(&fEntry);
+	status_t result = node.InitCheck();
+	if (result != B_OK)
+		return result;
+
+	result = node.ReadAttrString(REPOSITORY_CACHE_CHECKSUM_ATTRIBUTE,
+		&_checksum);
+	if (result != B_OK)
+		return result;
+
+	return _checksum.IsEmpty() ? B_ENTRY_NOT_FOUND : B_OK;
+}
+
+
 status_t
 BRepositoryCache::SetTo(const BEntry& entry)
 {
@@ -160,10 +121,23 @@ BRepositoryCache::SetTo(const BEntry& entry)
 	if ((result = repositoryReader.Init(repositoryCachePath.Path())) != B_OK)
 		return result;
 
-	RepositoryContentHandler handler(fInfo, fPackages, &errorOutput);
-	if ((result = repositoryReader.ParseContent(&handler)) != B_OK)
+	if ((result = repositoryReader.GetRepositoryInfo(&fInfo)) != B_OK)
+		return result;
+
+	// create the package infos via the package index, which avoids the
+	// content handler callbacks of ParseContent()
+	if ((result = repositoryReader.InitPackageIndex()) != B_OK)
 		return result;
 
+	BPackageInfo packageInfo;
+	int32 packageCount = repositoryReader.CountPackages();
+	for (int32 i = 0; i < packageCount; i++) {
+		if ((result = repositoryReader.GetPackageInfo(i, packageInfo)) != B_OK)
+			return result;
+		if ((result = fPackages.AddInfo(packageInfo)) != B_OK)
+			return result;
+	}
+
 	BPath userSettingsPath;
 	if (find_directory(B_USER_SETTINGS_DIRECTORY, &userSettingsPath) == B_OK) {
 		BDirectory userSettingsDir(userSettingsPath.Path());
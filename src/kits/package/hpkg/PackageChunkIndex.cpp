@@ -0,0 +1,301 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <package/hpkg/PackageChunkIndex.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+#include <ByteOrder.h>
+#include <DataIO.h>
+
+#include <AutoDeleter.h>
+#include <SHA256.h>
+
+
+namespace BPackageKit {
+
+namespace BHPKG {
+
+namespace BPrivate {
+
+
+// The chunk boundaries are determined with a "gear" rolling hash over the
+// last 64 bytes: a boundary follows every byte after which the upper bits of
+// the hash are all 0, so inserting or removing data only changes the chunks
+// around the change. The parameters must never change for version 1 of the
+// format, or indices created by different versions wouldn't match anymore.
+
+static const uint32 kMinChunkSize = 16 * 1024;
+static const uint32 kMaxChunkSize = 256 * 1024;
+static const uint64 kChunkBoundaryMask = 0xfffe000000000000ULL;
+	// 15 bits, i.e. on average 32 KiB after the minimum chunk size
+
+static const size_t kReadBufferSize = 1024 * 1024;
+
+
+struct GearTable {
+	GearTable()
+	{
+		// splitmix64, seeded with "hpkchunk"
+		uint64 state = 0x68706b6368756e6bULL;
+		for (int i = 0; i < 256; i++) {
+			state += 0x9e3779b97f4a7c15ULL;
+			uint64 value = state;
+			value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+			values[i] = value ^ (value >> 31);
+		}
+	}
+
+	uint64	values[256];
+};
+
+
+static const GearTable sGearTable;
+
+
+struct ChunkHashLess {
+	ChunkHashLess(const PackageChunkIndex& index)
+		:
+		fIndex(index)
+	{
+	}
+
+	bool operator()(int32 a, int32 b) const
+	{
+		return memcmp(fIndex.ChunkAt(a).hash, fIndex.ChunkAt(b).hash,
+			kChunkHashSize) < 0;
+	}
+
+private:
+	const PackageChunkIndex&	fIndex;
+};
+
+
+PackageChunkIndex::PackageChunkIndex()
+	:
+	fFileSize(0)
+{
+}
+
+
+PackageChunkIndex::~PackageChunkIndex()
+{
+}
+
+
+/*!	Splits the given file into chunks and computes their hashes. */
+status_t
+PackageChunkIndex::Compute(BPositionIO* file)
+{
+	fChunks.MakeEmpty();
+	fSortedChunks.MakeEmpty();
+	fFileSize = 0;
+
+	uint8* buffer = (uint8*)malloc(kReadBufferSize);
+	if (buffer == NULL)
+		return B_NO_MEMORY;
+	MemoryDeleter bufferDeleter(buffer);
+
+	SHA256 sha;
+	uint64 hash = 0;
+	off_t chunkOffset = 0;
+	uint32 chunkSize = 0;
+	off_t offset = 0;
+
+	while (true) {
+		ssize_t bytesRead = file->ReadAt(offset, buffer, kReadBufferSize);
+		if (bytesRead < 0)
+			return bytesRead;
+		if (bytesRead == 0)
+			break;
+
+		size_t chunkStart = 0;
+		for (size_t i = 0; i < (size_t)bytesRead; i++) {
+			hash = (hash << 1) + sGearTable.values[buffer[i]];
+			if (++chunkSize < kMinChunkSize)
+				continue;
+			if ((hash & kChunkBoundaryMask) != 0 && chunkSize < kMaxChunkSize)
+				continue;
+
+			sha.Update(buffer + chunkStart, i + 1 - chunkStart);
+			status_t error = _AddChunk(chunkOffset, chunkSize, sha.Digest());
+			if (error != B_OK)
+				return error;
+
+			chunkOffset += chunkSize;
+			chunkSize = 0;
+			hash = 0;
+			sha.Init();
+			chunkStart = i + 1;
+		}
+
+		sha.Update(buffer + chunkStart, bytesRead - chunkStart);
+		offset += bytesRead;
+	}
+
+	if (chunkSize > 0) {
+		status_t error = _AddChunk(chunkOffset, chunkSize, sha.Digest());
+		if (error != B_OK)
+			return error;
+	}
+
+	fFileSize = offset;
+	return _CreateLookupTable();
+}
+
+
+/*!	Initializes the index from the contents of a chunk index file. */
+status_t
+PackageChunkIndex::Read(const void* data, size_t size)
+{
+	fChunks.MakeEmpty();
+	fSortedChunks.MakeEmpty();
+	fFileSize = 0;
+
+	if (size < sizeof(hpkg_chunk_index_header))
+		return B_BAD_DATA;
+
+	hpkg_chunk_index_header header;
+	memcpy(&header, data, sizeof(header));
+
+	if (B_BENDIAN_TO_HOST_INT32(header.magic) != kChunkIndexMagic
+		|| B_BENDIAN_TO_HOST_INT16(header.version) != kChunkIndexVersion) {
+		return B_BAD_DATA;
+	}
+
+	size_t headerSize = B_BENDIAN_TO_HOST_INT16(header.header_size);
+	uint32 chunkCount = B_BENDIAN_TO_HOST_INT32(header.chunk_count);
+	off_t fileSize = B_BENDIAN_TO_HOST_INT64(header.file_size);
+	if (headerSize < sizeof(header) || headerSize > size
+		|| (size - headerSize) / sizeof(hpkg_chunk_index_entry)
+			!= chunkCount) {
+		return B_BAD_DATA;
+	}
+
+	const hpkg_chunk_index_entry* entries
+		= (const hpkg_chunk_index_entry*)((const uint8*)data + headerSize);
+	off_t offset = 0;
+	for (uint32 i = 0; i < chunkCount; i++) {
+		hpkg_chunk_index_entry entry;
+		memcpy(&entry, entries + i, sizeof(entry));
+
+		uint32 chunkSize = B_BENDIAN_TO_HOST_INT32(entry.size);
+		if (chunkSize == 0 || chunkSize > kMaxChunkSize)
+			return B_BAD_DATA;
+
+		status_t error = _AddChunk(offset, chunkSize, entry.hash);
+		if (error != B_OK)
+			return error;
+
+		offset += chunkSize;
+	}
+
+	if (offset != fileSize)
+		return B_BAD_DATA;
+
+	fFileSize = fileSize;
+	return _CreateLookupTable();
+}
+
+
+/*!	Writes the index in the format expected by Read(). */
+status_t
+PackageChunkIndex::Write(BDataIO* output) const
+{
+	hpkg_chunk_index_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = B_HOST_TO_BENDIAN_INT32(kChunkIndexMagic);
+	header.header_size = B_HOST_TO_BENDIAN_INT16(sizeof(header));
+	header.version = B_HOST_TO_BENDIAN_INT16(kChunkIndexVersion);
+	header.file_size = B_HOST_TO_BENDIAN_INT64(fFileSize);
+	header.chunk_count = B_HOST_TO_BENDIAN_INT32(fChunks.Count());
+
+	status_t error = output->WriteExactly(&header, sizeof(header));
+	if (error != B_OK)
+		return error;
+
+	for (int32 i = 0; i < fChunks.Count(); i++) {
+		hpkg_chunk_index_entry entry;
+		entry.size = B_HOST_TO_BENDIAN_INT32(fChunks[i].size);
+		memcpy(entry.hash, fChunks[i].hash, kChunkHashSize);
+
+		error = output->WriteExactly(&entry, sizeof(entry));
+		if (error != B_OK)
+			return error;
+	}
+
+	return B_OK;
+}
+
+
+/*!	Returns a chunk with the given hash, or \c NULL, if there is none. */
+const PackageChunkIndex::Chunk*
+PackageChunkIndex::FindChunk(const uint8* hash) const
+{
+	int32 lower = 0;
+	int32 upper = fSortedChunks.Count();
+	while (lower < upper) {
+		int32 middle = (lower + upper) / 2;
+		const Chunk& chunk = fChunks[fSortedChunks[middle]];
+		int compare = memcmp(chunk.hash, hash, kChunkHashSize);
+		if (compare == 0)
+			return &chunk;
+		if (compare < 0)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+
+	return NULL;
+}
+
+
+/*static*/ void
+PackageChunkIndex::ComputeHash(const void* data, size_t size, uint8* hash)
+{
+	SHA256 sha;
+	sha.Update(data, size);
+	memcpy(hash, sha.Digest(), kChunkHashSize);
+}
+
+
+status_t
+PackageChunkIndex::_AddChunk(off_t offset, uint32 size, const uint8* hash)
+{
+	Chunk chunk;
+	chunk.offset = offset;
+	chunk.size = size;
+	memcpy(chunk.hash, hash, kChunkHashSize);
+
+	return fChunks.Add(chunk) ? B_OK : B_NO_MEMORY;
+}
+
+
+status_t
+PackageChunkIndex::_CreateLookupTable()
+{
+	if (!fSortedChunks.AddUninitialized(fChunks.Count()))
+		return B_NO_MEMORY;
+
+	for (int32 i = 0; i < fChunks.Count(); i++)
+		fSortedChunks[i] = i;
+
+	std::sort(fSortedChunks.Elements(),
+		fSortedChunks.Elements() + fSortedChunks.Count(), ChunkHashLess(*this));
+	return B_OK;
+}
+
+
+}	// namespace BPrivate
+
+}	// namespace BHPKG
+
+}	// namespace BPackageKit
@@ -6,6 +6,8 @@
 
 #include <package/hpkg/PackageFileHeapReader.h>
 
+#include <string.h>
+
 #include <algorithm>
 #include <new>
 
@@ -151,22 +153,79 @@ PackageFileHeapReader::Clone() const
 }
 
 
+/*!	Reads the chunk with index \a chunkIndex as stored in the file, i.e.
+	without decompressing it. If the chunk isn't compressed, the returned
+	compressed and uncompressed sizes are equal.
+*/
+status_t
+PackageFileHeapReader::ReadCompressedChunk(size_t chunkIndex, void* buffer,
+	size_t& _compressedSize, size_t& _uncompressedSize)
+{
+	if ((uint64)chunkIndex * kChunkSize >= fUncompressedHeapSize)
+		return B_BAD_VALUE;
+
+	uint64 offset;
+	_GetChunkSizes(chunkIndex, offset, _compressedSize, _uncompressedSize);
+	return ReadFileData(offset, buffer, _compressedSize);
+}
+
+
+/*!	Decompresses the chunk with index \a chunkIndex into \a buffer, which must
+	hold ChunkSize() bytes, from the data ReadCompressedChunk() returned for
+	it.
+*/
+status_t
+PackageFileHeapReader::DecompressChunk(size_t chunkIndex,
+	const void* compressedData, size_t compressedSize, void* buffer)
+{
+	if ((uint64)chunkIndex * kChunkSize >= fUncompressedHeapSize)
+		return B_BAD_VALUE;
+
+	uint64 offset;
+	size_t expectedCompressedSize;
+	size_t uncompressedSize;
+	_GetChunkSizes(chunkIndex, offset, expectedCompressedSize,
+		uncompressedSize);
+	if (compressedSize != expectedCompressedSize)
+		return B_BAD_VALUE;
+
+	if (compressedSize == uncompressedSize) {
+		memcpy(buffer, compressedData, compressedSize);
+		return B_OK;
+	}
+
+	return DecompressChunkData(const_cast<void*>(compressedData),
+		compressedSize, buffer, uncompressedSize);
+}
+
+
 status_t
 PackageFileHeapReader::ReadAndDecompressChunk(size_t chunkIndex,
 	void* compressedDataBuffer, void* uncompressedDataBuffer)
+{
+	uint64 offset;
+	size_t compressedSize;
+	size_t uncompressedSize;
+	_GetChunkSizes(chunkIndex, offset, compressedSize, uncompressedSize);
+	return ReadAndDecompressChunkData(offset, compressedSize, uncompressedSize,
+		compressedDataBuffer, uncompressedDataBuffer);
+}
+
+
+void
+PackageFileHeapReader::_GetChunkSizes(size_t chunkIndex, uint64& _offset,
+	size_t& _compressedSize, size_t& _uncompressedSize) const
 {
 	uint64 offset = fOffsets[chunkIndex];
 	bool isLastChunk
 		= ((uint64)chunkIndex + 1) * kChunkSize >= fUncompressedHeapSize;
-	size_t compressedSize = isLastChunk
+	_offset = offset;
+	_compressedSize = isLastChunk
 		? fCompressedHeapSize - offset
 		: fOffsets[chunkIndex + 1] - offset;
-	size_t uncompressedSize = isLastChunk
+	_uncompressedSize = isLastChunk
 		? fUncompressedHeapSize - (uint64)chunkIndex * kChunkSize
 		: kChunkSize;
-
-	return ReadAndDecompressChunkData(offset, compressedSize, uncompressedSize,
-		compressedDataBuffer, uncompressedDataBuffer);
 }
 
 
@@ -9,6 +9,8 @@
 #include <algorithm>
 #include <new>
 
+#include <unistd.h>
+
 #include <ByteOrder.h>
 #include <List.h>
 #include <package/hpkg/ErrorOutput.h>
@@ -19,11 +21,15 @@
 #include <package/hpkg/PackageFileHeapReader.h>
 #include <RangeArray.h>
 #include <CompressionAlgorithm.h>
+#include <ZstdCompressionAlgorithm.h>
 
 
 // minimum length of data we require before trying to compress them
 static const size_t kCompressionSizeThreshold = 64;
 
+// maximum number of threads compressing chunks in parallel
+static const int32 kMaxCompressionThreads = 32;
+
 
 namespace BPackageKit {
 
@@ -47,6 +53,37 @@ struct PackageFileHeapWriter::ChunkSegment {
 };
 
 
+/*!	A chunk that is compressed by one of the compression threads. There are
+	two jobs per thread, so that a thread can continue with the next chunk
+	while the previous one is being written.
+*/
+struct PackageFileHeapWriter::CompressionJob {
+	CompressionJob()
+		:
+		data(NULL),
+		compressedData(NULL),
+		size(0),
+		compressedSize(0),
+		status(B_OK),
+		done(false)
+	{
+	}
+
+	~CompressionJob()
+	{
+		free(data);
+		free(compressedData);
+	}
+
+	void*		data;
+	void*		compressedData;
+	size_t		size;
+	size_t		compressedSize;
+	status_t	status;
+	bool		done;
+};
+
+
 struct PackageFileHeapWriter::ChunkBuffer {
 	ChunkBuffer(PackageFileHeapWriter* writer, size_t bufferSize)
 		:
@@ -205,10 +242,27 @@ PackageFileHeapWriter::PackageFileHeapWriter(BErrorOutput* errorOutput,
 	fCompressedDataBuffer(NULL),
 	fPendingDataSize(0),
 	fOffsets(),
-	fCompressionAlgorithm(compressionAlgorithm)
+	fCompressionAlgorithm(compressionAlgorithm),
+	fThreadCount(1),
+	fThreads(NULL),
+	fRunningThreads(0),
+	fJobs(NULL),
+	fJobCount(0),
+	fQueuedChunks(0),
+	fNextChunkToCompress(0),
+	fWrittenChunks(0),
+	fQuitThreads(false)
 {
 	if (fCompressionAlgorithm != NULL)
 		fCompressionAlgorithm->AcquireReference();
+
+	pthread_mutex_init(&fJobLock, NULL);
+	pthread_cond_init(&fJobQueuedCondition, NULL);
+	pthread_cond_init(&fJobDoneCondition, NULL);
+
+	long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpuCount > 1)
+		SetThreadCount(cpuCount);
 }
 
 
@@ -216,6 +270,10 @@ PackageFileHeapWriter::~PackageFileHeapWriter()
 {
 	_Uninit();
 
+	pthread_cond_destroy(&fJobDoneCondition);
+	pthread_cond_destroy(&fJobQueuedCondition);
+	pthread_mutex_destroy(&fJobLock);
+
 	if (fCompressionAlgorithm != NULL)
 		fCompressionAlgorithm->ReleaseReference();
 }
@@ -254,6 +312,49 @@ PackageFileHeapWriter::Reinit(PackageFileHeapReader* heapReader)
 }
 
 
+/*!	Sets the number of threads that compress the chunks. The chunks are
+	still written in order, so the resulting heap doesn't depend on it.
+	With a single thread, the chunks are compressed by the calling thread
+	when they are complete.
+*/
+void
+PackageFileHeapWriter::SetThreadCount(int32 count)
+{
+	if (fThreads != NULL)
+		return;
+
+	fThreadCount = std::max((int32)1,
+		std::min(count, kMaxCompressionThreads));
+}
+
+
+/*!	Sets the dictionary chunks are compressed and decompressed with. Since
+	the dictionary is needed to read any chunk, it must be set before the heap
+	is accessed in any way, including Reinit().
+*/
+status_t
+PackageFileHeapWriter::SetDictionary(const void* dictionary, size_t size)
+{
+	BZstdCompressionParameters* compressionParameters = NULL;
+	if (fCompressionAlgorithm != NULL) {
+		compressionParameters = dynamic_cast<BZstdCompressionParameters*>(
+			fCompressionAlgorithm->parameters);
+	}
+	BZstdDecompressionParameters* decompressionParameters = NULL;
+	if (fDecompressionAlgorithm != NULL) {
+		decompressionParameters = dynamic_cast<BZstdDecompressionParameters*>(
+			fDecompressionAlgorithm->parameters);
+	}
+	if (compressionParameters == NULL || decompressionParameters == NULL)
+		return B_BAD_VALUE;
+
+	status_t error = compressionParameters->SetDictionary(dictionary, size);
+	if (error == B_OK)
+		error = decompressionParameters->SetDictionary(dictionary, size);
+	return error;
+}
+
+
 status_t
 PackageFileHeapWriter::AddData(BDataReader& dataReader, off_t size,
 	uint64& _offset)
@@ -318,6 +419,8 @@ PackageFileHeapWriter::RemoveDataRanges(
 	// Before we begin flush any pending data, so we don't need any special
 	// handling and also can use the pending data buffer.
 	status_t status = _FlushPendingData();
+	if (status == B_OK)
+		status = _WriteAllQueuedChunks();
 	if (status != B_OK)
 		throw status_t(status);
 
@@ -382,12 +485,13 @@ PackageFileHeapWriter::RemoveDataRanges(
 
 		// Read more chunks. We need at least one buffered one to do anything
 		// and we want to buffer as many as necessary to ensure we don't
-		// overwrite one we haven't buffered yet.
+		// overwrite one we haven't buffered yet. The chunks that are still
+		// being compressed will be written before the next one.
 		while (chunkBuffer.HasMoreChunksToRead()
 			&& (!chunkBuffer.HasBufferedChunk()
 				|| (!copyCompressed
 					&& chunkBuffer.NextReadOffset()
-						< fCompressedHeapSize + kChunkSize))) {
+						< _MaxCompressedHeapSize() + kChunkSize))) {
 			// read chunk
 			chunkBuffer.ReadNextChunk();
 		}
@@ -395,8 +499,11 @@ PackageFileHeapWriter::RemoveDataRanges(
 		// copy compressed chunk data, if possible
 		const Chunk& chunk = chunkBuffer.ChunkAt(segment.chunkIndex);
 		if (copyCompressed) {
-			status_t error = _WriteChunk(chunk.buffer, chunk.compressedSize,
-				false);
+			status_t error = _WriteAllQueuedChunks();
+			if (error == B_OK) {
+				error = _WriteChunk(chunk.buffer, chunk.compressedSize,
+					false);
+			}
 			if (error != B_OK)
 				throw error;
 			continue;
@@ -440,6 +547,8 @@ PackageFileHeapWriter::Finish()
 {
 	// flush pending data, if any
 	status_t error = _FlushPendingData();
+	if (error == B_OK)
+		error = _WriteAllQueuedChunks();
 	if (error != B_OK)
 		return error;
 
@@ -481,6 +590,11 @@ status_t
 PackageFileHeapWriter::ReadAndDecompressChunk(size_t chunkIndex,
 	void* compressedDataBuffer, void* uncompressedDataBuffer)
 {
+	// the chunk might still be waiting to be written
+	status_t error = _WriteAllQueuedChunks();
+	if (error != B_OK)
+		return error;
+
 	if (uint64(chunkIndex + 1) * kChunkSize > fUncompressedHeapSize) {
 		// The chunk has not been written to disk yet. Its data are still in the
 		// pending data buffer.
@@ -503,6 +617,14 @@ PackageFileHeapWriter::ReadAndDecompressChunk(size_t chunkIndex,
 void
 PackageFileHeapWriter::_Uninit()
 {
+	_StopThreads();
+
+	delete[] fJobs;
+	delete[] fThreads;
+	fJobs = NULL;
+	fThreads = NULL;
+	fJobCount = 0;
+
 	free(fPendingDataBuffer);
 	free(fCompressedDataBuffer);
 	fPendingDataBuffer = NULL;
@@ -516,7 +638,17 @@ PackageFileHeapWriter::_FlushPendingData()
 	if (fPendingDataSize == 0)
 		return B_OK;
 
-	status_t error = _WriteChunk(fPendingDataBuffer, fPendingDataSize, true);
+	if (fThreadCount > 1 && fCompressionAlgorithm != NULL
+		&& _StartThreads() != B_OK) {
+		// just compress the chunks ourselves then
+		fThreadCount = 1;
+	}
+
+	status_t error;
+	if (fRunningThreads > 0)
+		error = _QueueChunk();
+	else
+		error = _WriteChunk(fPendingDataBuffer, fPendingDataSize, true);
 	if (error == B_OK)
 		fPendingDataSize = 0;
 
@@ -528,57 +660,70 @@ status_t
 PackageFileHeapWriter::_WriteChunk(const void* data, size_t size,
 	bool mayCompress)
 {
+	size_t compressedSize = 0;
+	status_t compressionStatus = B_BUFFER_OVERFLOW;
+	if (mayCompress) {
+		compressionStatus = _CompressChunk(data, size, fCompressedDataBuffer,
+			compressedSize);
+	}
+
+	return _WriteChunkData(data, size, compressionStatus,
+		fCompressedDataBuffer, compressedSize);
+}
+
+
+/*!	Adds the chunk to the heap. If \a compressionStatus is \c B_OK, the
+	compressed data is written, if it is \c B_BUFFER_OVERFLOW, the chunk is
+	written uncompressed.
+*/
+status_t
+PackageFileHeapWriter::_WriteChunkData(const void* data, size_t size,
+	status_t compressionStatus, const void* compressedData,
+	size_t compressedSize)
+{
+	if (compressionStatus != B_OK && compressionStatus != B_BUFFER_OVERFLOW) {
+		fErrorOutput->PrintError("Failed to compress chunk data: %s\n",
+			strerror(compressionStatus));
+		return compressionStatus;
+	}
+
 	// add offset
 	if (!fOffsets.Add(fCompressedHeapSize)) {
 		fErrorOutput->PrintError("Out of memory!\n");
 		return B_NO_MEMORY;
 	}
 
-	// Try to use compression only for data large enough.
-	bool compress = mayCompress && size >= (off_t)kCompressionSizeThreshold;
-	if (compress) {
-		status_t error = _WriteDataCompressed(data, size);
-		if (error != B_OK) {
-			if (error != B_BUFFER_OVERFLOW)
-				return error;
-			compress = false;
-		}
-	}
-
-	// Write uncompressed, if necessary.
-	if (!compress) {
-		status_t error = _WriteDataUncompressed(data, size);
-		if (error != B_OK)
-			return error;
-	}
+	if (compressionStatus == B_OK)
+		return _WriteDataUncompressed(compressedData, compressedSize);
 
-	return B_OK;
+	return _WriteDataUncompressed(data, size);
 }
 
 
+/*!	Compresses the chunk into \a compressedDataBuffer, which must be as large
+	as the chunk. Returns \c B_BUFFER_OVERFLOW, if the chunk should be stored
+	uncompressed.
+	May be called by several threads at the same time.
+*/
 status_t
-PackageFileHeapWriter::_WriteDataCompressed(const void* data, size_t size)
+PackageFileHeapWriter::_CompressChunk(const void* data, size_t size,
+	void* compressedDataBuffer, size_t& _compressedSize) const
 {
-	if (fCompressionAlgorithm == NULL)
+	// Try to use compression only for data large enough.
+	if (fCompressionAlgorithm == NULL || size < kCompressionSizeThreshold)
 		return B_BUFFER_OVERFLOW;
 
-	size_t compressedSize;
 	status_t error = fCompressionAlgorithm->algorithm->CompressBuffer(data,
-		size, fCompressedDataBuffer, size, compressedSize,
+		size, compressedDataBuffer, size, _compressedSize,
 		fCompressionAlgorithm->parameters);
-	if (error != B_OK) {
-		if (error != B_BUFFER_OVERFLOW) {
-			fErrorOutput->PrintError("Failed to compress chunk data: %s\n",
-				strerror(error));
-		}
+	if (error != B_OK)
 		return error;
-	}
 
 	// only use compressed data when we've actually saved space
-	if (compressedSize == size)
+	if (_compressedSize == size)
 		return B_BUFFER_OVERFLOW;
 
-	return _WriteDataUncompressed(fCompressedDataBuffer, compressedSize);
+	return B_OK;
 }
 
 
@@ -598,6 +743,163 @@ PackageFileHeapWriter::_WriteDataUncompressed(const void* data, size_t size)
 }
 
 
+status_t
+PackageFileHeapWriter::_StartThreads()
+{
+	if (fThreads != NULL)
+		return fRunningThreads > 0 ? B_OK : B_ERROR;
+
+	fThreads = new(std::nothrow) pthread_t[fThreadCount];
+	fJobCount = fThreadCount * 2;
+	fJobs = new(std::nothrow) CompressionJob[fJobCount];
+	if (fThreads == NULL || fJobs == NULL)
+		return B_NO_MEMORY;
+
+	for (int32 i = 0; i < fJobCount; i++) {
+		fJobs[i].data = malloc(kChunkSize);
+		fJobs[i].compressedData = malloc(kChunkSize);
+		if (fJobs[i].data == NULL || fJobs[i].compressedData == NULL)
+			return B_NO_MEMORY;
+	}
+
+	while (fRunningThreads < fThreadCount) {
+		if (pthread_create(&fThreads[fRunningThreads], NULL,
+				&_CompressionThread, this) != 0) {
+			break;
+		}
+		fRunningThreads++;
+	}
+
+	return fRunningThreads > 0 ? B_OK : B_ERROR;
+}
+
+
+void
+PackageFileHeapWriter::_StopThreads()
+{
+	if (fRunningThreads == 0)
+		return;
+
+	pthread_mutex_lock(&fJobLock);
+	fQuitThreads = true;
+	pthread_cond_broadcast(&fJobQueuedCondition);
+	pthread_mutex_unlock(&fJobLock);
+
+	for (int32 i = 0; i < fRunningThreads; i++)
+		pthread_join(fThreads[i], NULL);
+
+	fRunningThreads = 0;
+}
+
+
+/*!	Hands the pending data over to a compression thread. The chunks are
+	written in the order they were queued, by this thread.
+*/
+status_t
+PackageFileHeapWriter::_QueueChunk()
+{
+	// if all jobs are in use, the oldest one needs to be written first
+	if (fQueuedChunks - fWrittenChunks == fJobCount) {
+		status_t error = _WriteQueuedChunks(fWrittenChunks + 1);
+		if (error != B_OK)
+			return error;
+	}
+
+	// the job gets the pending data buffer, and we continue with its one
+	CompressionJob& job = fJobs[fQueuedChunks % fJobCount];
+	std::swap(job.data, fPendingDataBuffer);
+	job.size = fPendingDataSize;
+	job.done = false;
+
+	pthread_mutex_lock(&fJobLock);
+	fQueuedChunks++;
+	pthread_cond_signal(&fJobQueuedCondition);
+	pthread_mutex_unlock(&fJobLock);
+
+	// write all chunks that are compressed already
+	return _WriteQueuedChunks(fWrittenChunks);
+}
+
+
+/*!	Writes the queued chunks in order, as long as they have been compressed.
+	Waits for the chunks before \a waitUntil to be compressed.
+*/
+status_t
+PackageFileHeapWriter::_WriteQueuedChunks(int64 waitUntil)
+{
+	while (fWrittenChunks < fQueuedChunks) {
+		CompressionJob& job = fJobs[fWrittenChunks % fJobCount];
+
+		pthread_mutex_lock(&fJobLock);
+		while (!job.done && fWrittenChunks < waitUntil)
+			pthread_cond_wait(&fJobDoneCondition, &fJobLock);
+		bool done = job.done;
+		pthread_mutex_unlock(&fJobLock);
+
+		if (!done)
+			break;
+
+		status_t error = _WriteChunkData(job.data, job.size, job.status,
+			job.compressedData, job.compressedSize);
+		if (error != B_OK)
+			return error;
+
+		fWrittenChunks++;
+	}
+
+	return B_OK;
+}
+
+
+status_t
+PackageFileHeapWriter::_WriteAllQueuedChunks()
+{
+	return _WriteQueuedChunks(fQueuedChunks);
+}
+
+
+/*!	Returns how large the compressed heap can get, once all queued chunks
+	have been written.
+*/
+uint64
+PackageFileHeapWriter::_MaxCompressedHeapSize() const
+{
+	return fCompressedHeapSize + (fQueuedChunks - fWrittenChunks) * kChunkSize;
+}
+
+
+/*static*/ void*
+PackageFileHeapWriter::_CompressionThread(void* _writer)
+{
+	PackageFileHeapWriter* writer = (PackageFileHeapWriter*)_writer;
+
+	pthread_mutex_lock(&writer->fJobLock);
+
+	while (true) {
+		while (!writer->fQuitThreads
+			&& writer->fNextChunkToCompress == writer->fQueuedChunks) {
+			pthread_cond_wait(&writer->fJobQueuedCondition, &writer->fJobLock);
+		}
+		if (writer->fQuitThreads)
+			break;
+
+		CompressionJob& job = writer->fJobs[
+			writer->fNextChunkToCompress++ % writer->fJobCount];
+		pthread_mutex_unlock(&writer->fJobLock);
+
+		job.status = writer->_CompressChunk(job.data, job.size,
+			job.compressedData, job.compressedSize);
+
+		pthread_mutex_lock(&writer->fJobLock);
+		job.done = true;
+		pthread_cond_signal(&writer->fJobDoneCondition);
+	}
+
+	pthread_mutex_unlock(&writer->fJobLock);
+	return NULL;
+}
+
+
 void
 PackageFileHeapWriter::_PushChunks(ChunkBuffer& chunkBuffer, uint64 startOffset,
 	uint64 endOffset)
@@ -426,6 +426,23 @@ PackageReaderImpl::ParseContent(BLowLevelPackageContentHandler* contentHandler)
 }
 
 
+status_t
+PackageReaderImpl::ParsePackageAttributes(
+	BPackageContentHandler* contentHandler)
+{
+	status_t error = PrepareSection(fPackageAttributesSection);
+	if (error != B_OK)
+		return error;
+
+	AttributeHandlerContext context(ErrorOutput(), contentHandler,
+		B_HPKG_SECTION_PACKAGE_ATTRIBUTES,
+		MinorFormatVersion() > B_HPKG_MINOR_VERSION);
+	RootAttributeHandler rootAttributeHandler;
+
+	return ParsePackageAttributesSection(&context, &rootAttributeHandler);
+}
+
+
 status_t
 PackageReaderImpl::_PrepareSections()
 {
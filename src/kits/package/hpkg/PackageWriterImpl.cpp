@@ -25,6 +25,7 @@
 #include <FindDirectory.h>
 #include <fs_attr.h>
 #include <Path.h>
+#include <ZstdCompressionAlgorithm.h>
 
 #include <package/hpkg/BlockBufferPoolNoLock.h>
 #include <package/hpkg/PackageAttributeValue.h>
@@ -50,6 +51,10 @@ using BPrivate::FileDescriptorCloser;
 
 static const char* const kPublicDomainLicenseName = "Public Domain";
 
+// Only files up to this size are used to train a heap dictionary -- larger
+// ones compress well enough without one.
+static const off_t kMaxDictionarySampleFileSize = 16 * 1024;
+
 
 #include <typeinfo>
 
@@ -423,6 +428,37 @@ private:
 };
 
 
+// #pragma mark - DictionarySamples
+
+
+struct PackageWriterImpl::DictionarySamples {
+	DictionarySamples()
+		:
+		data(NULL),
+		size(0),
+		capacity(100 * kMaxHeapDictionarySize)
+			// the zstd documentation recommends about 100 times the size of
+			// the dictionary
+	{
+	}
+
+	~DictionarySamples()
+	{
+		free(data);
+	}
+
+	bool IsFull() const
+	{
+		return size >= capacity;
+	}
+
+	uint8*			data;
+	size_t			size;
+	size_t			capacity;
+	Array<size_t>	sampleSizes;
+};
+
+
 // #pragma mark - PackageWriterImpl (Inline Methods)
 
 
@@ -684,6 +720,13 @@ PackageWriterImpl::_Init(BPositionIO* file, bool keepFile, const char* fileName,
 		if (result != B_OK)
 			return result;
 
+		// The existing chunks can only be read with the dictionary they have
+		// been compressed with, so the new ones use it, too.
+		size_t dictionarySize;
+		const void* dictionary = packageReader.HeapDictionary(dictionarySize);
+		if (dictionary != NULL)
+			_SetHeapDictionary(dictionary, dictionarySize);
+
 		fHeapWriter->Reinit(packageReader.RawHeapReader());
 
 		// Remove the old packages attributes and TOC section from the heap.
@@ -710,6 +753,11 @@ PackageWriterImpl::_Init(BPositionIO* file, bool keepFile, const char* fileName,
 status_t
 PackageWriterImpl::_Finish()
 {
+	if (Parameters().Compression() == B_HPKG_COMPRESSION_ZSTD_DICTIONARY
+		&& (Flags() & B_HPKG_WRITER_UPDATE_PACKAGE) == 0) {
+		_TrainHeapDictionary();
+	}
+
 	// write entries
 	for (EntryList::ConstIterator it = fRootEntry->ChildIterator();
 			Entry* entry = it.Next();) {
@@ -762,7 +810,7 @@ PackageWriterImpl::_Finish()
 	header.header_size = B_HOST_TO_BENDIAN_INT16(fHeaderSize);
 	header.version = B_HOST_TO_BENDIAN_INT16(B_HPKG_VERSION);
 	header.total_size = B_HOST_TO_BENDIAN_INT64(totalSize);
-	header.minor_version = B_HOST_TO_BENDIAN_INT16(B_HPKG_MINOR_VERSION);
+	header.minor_version = B_HOST_TO_BENDIAN_INT16(_MinorFormatVersion());
 
 	// write the header
 	RawWriteBuffer(&header, sizeof(hpkg_header), 0);
@@ -795,8 +843,21 @@ PackageWriterImpl::_Recompress(BPositionIO* inputFile)
 		= reader.RawHeapReader()->UncompressedHeapSize();
 	uint64 compressedHeapSize = uncompressedHeapSize;
 
+	// There are no files to train a new dictionary with, but the one of the
+	// input package can be reused.
+	if (Parameters().Compression() == B_HPKG_COMPRESSION_ZSTD_DICTIONARY) {
+		size_t dictionarySize;
+		const void* dictionary = reader.HeapDictionary(dictionarySize);
+		if (dictionary != NULL)
+			_SetHeapDictionary(dictionary, dictionarySize);
+		else
+			SetCompression(B_HPKG_COMPRESSION_ZSTD);
+	}
+
 	off_t totalSize = fHeapWriter->HeapOffset() + (off_t)compressedHeapSize;
 
+	header.header_size = B_HOST_TO_BENDIAN_INT16(fHeaderSize);
+	header.minor_version = B_HOST_TO_BENDIAN_INT16(_MinorFormatVersion());
 	header.heap_compression = B_HOST_TO_BENDIAN_INT16(
 		Parameters().Compression());
 	header.heap_chunk_size = B_HOST_TO_BENDIAN_INT32(fHeapWriter->ChunkSize());
@@ -1598,6 +1659,154 @@ PackageWriterImpl::_AddDirectoryChildren(Entry* entry, int fd, char* pathBuffer)
 }
 
 
+/*!	Trains a dictionary on the small files of the package and stores it in
+	front of the heap. If that doesn't work out, the package is compressed
+	with plain zstd instead.
+*/
+void
+PackageWriterImpl::_TrainHeapDictionary()
+{
+	DictionarySamples samples;
+	samples.data = (uint8*)malloc(samples.capacity);
+	if (samples.data == NULL)
+		throw std::bad_alloc();
+
+	for (EntryList::ConstIterator it = fRootEntry->ChildIterator();
+			Entry* entry = it.Next();) {
+		_CollectDictionarySamples(AT_FDCWD, entry, entry->Name(), samples);
+	}
+
+	uint8 dictionary[kMaxHeapDictionarySize];
+	size_t dictionarySize = sizeof(dictionary);
+	status_t error = B_BAD_DATA;
+	if (!samples.sampleSizes.IsEmpty()) {
+		error = BZstdCompressionAlgorithm::TrainDictionary(samples.data,
+			samples.sampleSizes.Elements(), samples.sampleSizes.Count(),
+			dictionary, dictionarySize);
+	}
+
+	if (error != B_OK) {
+		// Usually there just aren't enough small files.
+		SetCompression(B_HPKG_COMPRESSION_ZSTD);
+		return;
+	}
+
+	_SetHeapDictionary(dictionary, dictionarySize);
+}
+
+
+/*!	Adds the contents of the small regular files in the given entry to
+	\a samples. Unlike _AddEntry(), errors are ignored; they will be reported
+	when the entry is actually added.
+*/
+void
+PackageWriterImpl::_CollectDictionarySamples(int dirFD, Entry* entry,
+	const char* fileName, DictionarySamples& samples)
+{
+	if (samples.IsFull())
+		return;
+
+	int fd;
+	FileDescriptorCloser fdCloser;
+	if (entry != NULL && entry->FD() >= 0) {
+		fd = entry->FD();
+	} else {
+		bool isImplicitEntry = entry != NULL && entry->IsImplicit();
+		fd = openat(dirFD, fileName,
+			O_RDONLY | (isImplicitEntry ? 0 : O_NOTRAVERSE));
+		if (fd < 0)
+			return;
+		fdCloser.SetTo(fd);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		return;
+
+	if (S_ISREG(st.st_mode)) {
+		if (st.st_size <= B_HPKG_MAX_INLINE_DATA_SIZE
+			|| st.st_size > kMaxDictionarySampleFileSize
+			|| (off_t)(samples.capacity - samples.size) < st.st_size) {
+			return;
+		}
+
+		ssize_t bytesRead = pread(fd, samples.data + samples.size, st.st_size,
+			0);
+		if (bytesRead <= 0)
+			return;
+		if (!samples.sampleSizes.Add(bytesRead))
+			throw std::bad_alloc();
+		samples.size += bytesRead;
+		return;
+	}
+
+	if (!S_ISDIR(st.st_mode))
+		return;
+
+	if (entry != NULL && entry->IsImplicit()) {
+		for (EntryList::ConstIterator it = entry->ChildIterator();
+				Entry* child = it.Next();) {
+			_CollectDictionarySamples(fd, child, child->Name(), samples);
+		}
+		return;
+	}
+
+	int clonedFD = dup(fd);
+	if (clonedFD < 0)
+		return;
+
+	DirCloser dir(fdopendir(clonedFD));
+	if (!dir.IsSet()) {
+		close(clonedFD);
+		return;
+	}
+
+	while (dirent* dirEntry = readdir(dir.Get())) {
+		if (strcmp(dirEntry->d_name, ".") == 0
+			|| strcmp(dirEntry->d_name, "..") == 0) {
+			continue;
+		}
+
+		_CollectDictionarySamples(fd, NULL, dirEntry->d_name, samples);
+	}
+}
+
+
+/*!	Sets the dictionary for the heap and writes it between the header and the
+	heap. Must be called before any data is added to the heap.
+*/
+void
+PackageWriterImpl::_SetHeapDictionary(const void* dictionary, size_t size)
+{
+	if (size > kMaxHeapDictionarySize)
+		throw status_t(B_BAD_VALUE);
+
+	status_t error = fHeapWriter->SetDictionary(dictionary, size);
+	if (error != B_OK) {
+		fListener->PrintError("Failed to set the heap dictionary: %s\n",
+			strerror(error));
+		throw status_t(error);
+	}
+
+	RawWriteBuffer(dictionary, size, sizeof(hpkg_header));
+
+	fHeaderSize = sizeof(hpkg_header) + size;
+	fHeapOffset = fHeaderSize;
+	fHeapWriter->SetHeapOffset(fHeapOffset);
+}
+
+
+/*!	Returns the minor format version to write. Packages that don't use a heap
+	dictionary keep the minor version older readers were written for.
+*/
+uint16
+PackageWriterImpl::_MinorFormatVersion() const
+{
+	return Parameters().Compression() == B_HPKG_COMPRESSION_ZSTD_DICTIONARY
+		? B_HPKG_MINOR_VERSION : kHPKGMinorVersionWithoutDictionary;
+}
+
+
 PackageWriterImpl::Attribute*
 PackageWriterImpl::_AddAttribute(BHPKGAttributeID id,
 	const AttributeValue& value)
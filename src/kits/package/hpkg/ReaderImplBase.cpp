@@ -776,6 +776,8 @@ ReaderImplBase::ReaderImplBase(const char* fileType, BErrorOutput* errorOutput)
 	fOwnsFile(false),
 	fRawHeapReader(NULL),
 	fHeapReader(NULL),
+	fHeapDictionary(NULL),
+	fHeapDictionarySize(0),
 	fCurrentSection(NULL)
 {
 }
@@ -787,6 +789,8 @@ ReaderImplBase::~ReaderImplBase()
 	if (fRawHeapReader != fHeapReader)
 		delete fRawHeapReader;
 
+	free(fHeapDictionary);
+
 	if (fOwnsFile)
 		delete fFile;
 }
@@ -813,7 +817,8 @@ ReaderImplBase::DetachHeapReader(PackageFileHeapReader*& _rawHeapReader)
 
 status_t
 ReaderImplBase::InitHeapReader(uint32 compression, uint32 chunkSize,
-	off_t offset, uint64 compressedSize, uint64 uncompressedSize)
+	size_t headerSize, off_t offset, uint64 compressedSize,
+	uint64 uncompressedSize)
 {
 	DecompressionAlgorithmOwner* decompressionAlgorithm = NULL;
 	BReference<DecompressionAlgorithmOwner> decompressionAlgorithmReference;
@@ -843,6 +848,47 @@ ReaderImplBase::InitHeapReader(uint32 compression, uint32 chunkSize,
 				return B_NO_MEMORY;
 			}
 			break;
+		case B_HPKG_COMPRESSION_ZSTD_DICTIONARY:
+		{
+			// the dictionary fills the space between header and heap
+			size_t dictionarySize = offset - headerSize;
+			if (dictionarySize == 0
+				|| dictionarySize > kMaxHeapDictionarySize) {
+				fErrorOutput->PrintError("Error: Invalid %s file: Invalid heap "
+					"dictionary size (%" B_PRIuSIZE ")\n", fFileType,
+					dictionarySize);
+				return B_BAD_DATA;
+			}
+
+			fHeapDictionary = (uint8*)malloc(dictionarySize);
+			if (fHeapDictionary == NULL)
+				return B_NO_MEMORY;
+			fHeapDictionarySize = dictionarySize;
+
+			status_t error = ReadBuffer(headerSize, fHeapDictionary,
+				dictionarySize);
+			if (error != B_OK)
+				return error;
+
+			BZstdDecompressionParameters* parameters
+				= new(std::nothrow) BZstdDecompressionParameters;
+			decompressionAlgorithm = DecompressionAlgorithmOwner::Create(
+				new(std::nothrow) BZstdCompressionAlgorithm, parameters);
+			decompressionAlgorithmReference.SetTo(decompressionAlgorithm, true);
+			if (decompressionAlgorithm == NULL
+				|| decompressionAlgorithm->algorithm == NULL
+				|| decompressionAlgorithm->parameters == NULL) {
+				return B_NO_MEMORY;
+			}
+
+			error = parameters->SetDictionary(fHeapDictionary, dictionarySize);
+			if (error != B_OK) {
+				fErrorOutput->PrintError("Error: Failed to load the heap "
+					"dictionary: %s\n", strerror(error));
+				return error;
+			}
+			break;
+		}
 		default:
 			fErrorOutput->PrintError("Error: Invalid heap compression\n");
 			return B_BAD_DATA;
@@ -944,6 +990,23 @@ ReaderImplBase::PrepareSection(PackageFileSection& section)
 }
 
 
+/*!	Like PrepareSection(), but uses \a data instead of reading the section.
+	The data must remain valid as long as the section is used.
+*/
+status_t
+ReaderImplBase::PrepareSection(PackageFileSection& section, const void* data)
+{
+	section.data = (uint8*)data;
+	section.ownsData = false;
+
+	// parse the section strings
+	section.currentOffset = 0;
+	SetCurrentSection(&section);
+
+	return ParseStrings();
+}
+
+
 status_t
 ReaderImplBase::ParseStrings()
 {
@@ -1049,6 +1112,43 @@ ReaderImplBase::ParsePackageAttributesSection(
 }
 
 
+/*!	Parses the children of the attribute in the package attributes section,
+	whose first child starts at \a offset.
+*/
+status_t
+ReaderImplBase::ParsePackageAttributesSubTree(AttributeHandlerContext* context,
+	AttributeHandler* rootAttributeHandler, uint64 offset)
+{
+	if (offset >= fPackageAttributesSection.uncompressedLength)
+		return B_BAD_VALUE;
+
+	SetCurrentSection(&fPackageAttributesSection);
+	fPackageAttributesSection.currentOffset = offset;
+
+	// init the attribute handler stack
+	rootAttributeHandler->SetLevel(0);
+	ClearAttributeHandlerStack();
+	PushAttributeHandler(rootAttributeHandler);
+
+	bool sectionHandled;
+	status_t error = ParseAttributeTree(context, sectionHandled);
+
+	SetCurrentSection(NULL);
+
+	// clean up on error
+	if (error != B_OK) {
+		context->ErrorOccurred();
+		while (AttributeHandler* handler = PopAttributeHandler()) {
+			if (handler != rootAttributeHandler)
+				handler->Delete(context);
+		}
+		return error;
+	}
+
+	return B_OK;
+}
+
+
 status_t
 ReaderImplBase::ParseAttributeTree(AttributeHandlerContext* context,
 	bool& _sectionHandled)
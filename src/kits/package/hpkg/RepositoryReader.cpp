@@ -41,6 +41,16 @@ BRepositoryReader::Init(const char* fileName)
 }
 
 
+status_t
+BRepositoryReader::GetRepositoryInfo(BRepositoryInfo* _repositoryInfo) const
+{
+	if (fImpl == NULL)
+		return B_NO_INIT;
+
+	return fImpl->GetRepositoryInfo(_repositoryInfo);
+}
+
+
 status_t
 BRepositoryReader::ParseContent(BRepositoryContentHandler* contentHandler)
 {
@@ -51,6 +61,50 @@ BRepositoryReader::ParseContent(BRepositoryContentHandler* contentHandler)
 }
 
 
+/*!	Prepares the reader for accessing the packages individually via
+	CountPackages(), PackageNameAt(), and GetPackageInfo(). This is cheaper
+	than ParseContent(), if only some of the packages' infos are needed.
+*/
+status_t
+BRepositoryReader::InitPackageIndex()
+{
+	if (fImpl == NULL)
+		return B_NO_INIT;
+
+	return fImpl->InitPackageIndex();
+}
+
+
+int32
+BRepositoryReader::CountPackages() const
+{
+	if (fImpl == NULL)
+		return 0;
+
+	return fImpl->CountPackages();
+}
+
+
+const char*
+BRepositoryReader::PackageNameAt(int32 index) const
+{
+	if (fImpl == NULL)
+		return NULL;
+
+	return fImpl->PackageNameAt(index);
+}
+
+
+status_t
+BRepositoryReader::GetPackageInfo(int32 index, BPackageInfo& _info)
+{
+	if (fImpl == NULL)
+		return B_NO_INIT;
+
+	return fImpl->GetPackageInfo(index, _info);
+}
+
+
 }	// namespace BHPKG
 
 }	// namespace BPackageKit
@@ -10,18 +10,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <algorithm>
 #include <new>
 
 #include <ByteOrder.h>
+#include <DataIO.h>
 #include <Message.h>
 
 #include <FdIO.h>
 
 #include <package/hpkg/HPKGDefsPrivate.h>
 #include <package/hpkg/RepositoryContentHandler.h>
+#include <package/PackageInfo.h>
+#include <package/PackageInfoContentHandler.h>
 
 
 namespace BPackageKit {
@@ -165,18 +169,70 @@ private:
 };
 
 
+// #pragma mark - PackageIndexAttributeHandler
+
+
+class RepositoryReaderImpl::PackageIndexAttributeHandler
+	: public AttributeHandler {
+public:
+	PackageIndexAttributeHandler(RepositoryReaderImpl* reader)
+		:
+		fReader(reader)
+	{
+	}
+
+	virtual status_t HandleAttribute(AttributeHandlerContext* context, uint8 id,
+		const AttributeValue& value, AttributeHandler** _handler)
+	{
+		if (id != B_HPKG_ATTRIBUTE_ID_PACKAGE) {
+			if (context->ignoreUnknownAttributes)
+				return B_OK;
+
+			context->errorOutput->PrintError(
+				"Error: Invalid package attribute section: unexpected "
+				"top level attribute id %d encountered\n", id);
+			return B_BAD_DATA;
+		}
+
+		if (_handler == NULL) {
+			context->errorOutput->PrintError(
+				"Error: Invalid package attribute section: package \"%s\" "
+				"without attributes\n", value.string);
+			return B_BAD_DATA;
+		}
+
+		// the package's attributes are skipped by the default handler
+		return fReader->_AddPackageIndexEntry(value.string);
+	}
+
+private:
+	RepositoryReaderImpl*	fReader;
+};
+
+
 // #pragma mark - RepositoryReaderImpl
 
 
 RepositoryReaderImpl::RepositoryReaderImpl(BErrorOutput* errorOutput)
 	:
-	inherited("repository", errorOutput)
+	inherited("repository", errorOutput),
+	fMappedFile(NULL),
+	fMappedFileSize(0),
+	fPackageIndex(NULL),
+	fPackageCount(0),
+	fPackageIndexCapacity(0)
 {
 }
 
 
 RepositoryReaderImpl::~RepositoryReaderImpl()
 {
+	free(fPackageIndex);
+
+	// the file and the sections referring to the mapping don't access it
+	// anymore
+	if (fMappedFile != NULL)
+		munmap(fMappedFile, fMappedFileSize);
 }
 
 
@@ -196,9 +252,33 @@ RepositoryReaderImpl::Init(const char* fileName)
 }
 
 
+/*!	Maps the file, if possible, so that it doesn't need to be read and, if its
+	heap isn't compressed, the package attributes can be used in place. A
+	compressed heap is still read from the mapping chunk by chunk and
+	decompressed into a buffer of its own.
+*/
 status_t
 RepositoryReaderImpl::Init(int fd, bool keepFD)
 {
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+		&& (off_t)(size_t)st.st_size == st.st_size) {
+		void* address = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address != MAP_FAILED) {
+			fMappedFile = (uint8*)address;
+			fMappedFileSize = st.st_size;
+			if (keepFD)
+				close(fd);
+
+			BMemoryIO* file = new(std::nothrow) BMemoryIO(address,
+				fMappedFileSize);
+			if (file == NULL)
+				return B_NO_MEMORY;
+
+			return Init(file, true);
+		}
+	}
+
 	BFdIO* file = new(std::nothrow) BFdIO(fd, keepFD);
 	if (file == NULL) {
 		if (keepFD && fd >= 0)
@@ -244,7 +324,18 @@ RepositoryReaderImpl::Init(BPositionIO* file, bool keepFile)
 	if (error != B_OK)
 		return error;
 
-	error = PrepareSection(fPackageAttributesSection);
+	if (fMappedFile != NULL && B_BENDIAN_TO_HOST_INT16(header.heap_compression)
+			== B_HPKG_COMPRESSION_NONE) {
+		// the uncompressed heap follows the header in the file
+		error = PrepareSection(fPackageAttributesSection,
+			fMappedFile + B_BENDIAN_TO_HOST_INT16(header.header_size)
+				+ fPackageAttributesSection.offset);
+	} else {
+		// Decompress the section once into a buffer owned by the section.
+		// Its strings, the package index, and the attribute values refer to
+		// that buffer, so nothing is copied after this point.
+		error = PrepareSection(fPackageAttributesSection);
+	}
 	if (error != B_OK)
 		return error;
 
@@ -289,12 +380,100 @@ RepositoryReaderImpl::ParseContent(BRepositoryContentHandler* contentHandler)
 			B_HPKG_SECTION_PACKAGE_ATTRIBUTES,
 			MinorFormatVersion() > B_HPKG_REPO_MINOR_VERSION);
 		PackagesAttributeHandler rootAttributeHandler(contentHandler);
+		_RewindPackageAttributesSection();
 		result = ParsePackageAttributesSection(&context, &rootAttributeHandler);
 	}
 	return result;
 }
 
 
+/*!	Collects the names of the packages and the locations of their attributes,
+	without creating BPackageInfos. Those can be retrieved on demand via
+	GetPackageInfo() afterwards.
+*/
+status_t
+RepositoryReaderImpl::InitPackageIndex()
+{
+	fPackageCount = 0;
+
+	AttributeHandlerContext context(ErrorOutput(), (BPackageContentHandler*)NULL,
+		B_HPKG_SECTION_PACKAGE_ATTRIBUTES,
+		MinorFormatVersion() > B_HPKG_REPO_MINOR_VERSION);
+	PackageIndexAttributeHandler rootAttributeHandler(this);
+	_RewindPackageAttributesSection();
+	status_t error = ParsePackageAttributesSection(&context,
+		&rootAttributeHandler);
+	if (error != B_OK)
+		fPackageCount = 0;
+
+	return error;
+}
+
+
+const char*
+RepositoryReaderImpl::PackageNameAt(int32 index) const
+{
+	if (index < 0 || index >= fPackageCount)
+		return NULL;
+
+	return fPackageIndex[index].name;
+}
+
+
+status_t
+RepositoryReaderImpl::GetPackageInfo(int32 index, BPackageInfo& _info)
+{
+	if (index < 0 || index >= fPackageCount)
+		return B_BAD_INDEX;
+
+	_info.Clear();
+
+	BPackageInfoContentHandler contentHandler(_info, ErrorOutput());
+	AttributeHandlerContext context(ErrorOutput(), &contentHandler,
+		B_HPKG_SECTION_PACKAGE_ATTRIBUTES,
+		MinorFormatVersion() > B_HPKG_REPO_MINOR_VERSION);
+	PackageAttributeHandler rootAttributeHandler;
+	status_t error = ParsePackageAttributesSubTree(&context,
+		&rootAttributeHandler, fPackageIndex[index].offset);
+	if (error != B_OK)
+		return error;
+
+	return _info.InitCheck();
+}
+
+
+/*!	Sets the package attributes section's offset to its first attribute, since
+	parsing the package attributes of a single package leaves it anywhere.
+*/
+void
+RepositoryReaderImpl::_RewindPackageAttributesSection()
+{
+	fPackageAttributesSection.currentOffset
+		= fPackageAttributesSection.stringsLength;
+}
+
+
+status_t
+RepositoryReaderImpl::_AddPackageIndexEntry(const char* name)
+{
+	if (fPackageCount == fPackageIndexCapacity) {
+		int32 capacity = std::max(fPackageIndexCapacity * 2, (int32)256);
+		PackageIndexEntry* index = (PackageIndexEntry*)realloc(fPackageIndex,
+			capacity * sizeof(PackageIndexEntry));
+		if (index == NULL)
+			return B_NO_MEMORY;
+
+		fPackageIndex = index;
+		fPackageIndexCapacity = capacity;
+	}
+
+	PackageIndexEntry& entry = fPackageIndex[fPackageCount++];
+	entry.name = name;
+	entry.offset = CurrentSection()->currentOffset;
+	return B_OK;
+}
+
+
 }	// namespace BPrivate
 
 }	// namespace BHPKG
@@ -41,6 +41,14 @@ BRepositoryWriter::Init(const char* fileName)
 }
 
 
+void
+BRepositoryWriter::SetWriteChunkIndices(bool write)
+{
+	if (fImpl != NULL)
+		fImpl->SetWriteChunkIndices(write);
+}
+
+
 status_t
 BRepositoryWriter::AddPackage(const BEntry& packageEntry)
 {
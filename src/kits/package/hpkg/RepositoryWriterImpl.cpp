@@ -6,10 +6,13 @@
 
 #include <package/hpkg/RepositoryWriterImpl.h>
 
+#include <string.h>
+
 #include <algorithm>
 #include <new>
 
 #include <ByteOrder.h>
+#include <File.h>
 #include <Message.h>
 #include <Path.h>
 
@@ -18,6 +21,7 @@
 
 #include <package/hpkg/BlockBufferPoolNoLock.h>
 #include <package/hpkg/HPKGDefsPrivate.h>
+#include <package/hpkg/PackageChunkIndex.h>
 #include <package/hpkg/PackageDataReader.h>
 #include <package/hpkg/PackageEntry.h>
 #include <package/hpkg/PackageFileHeapWriter.h>
@@ -190,7 +194,8 @@ RepositoryWriterImpl::RepositoryWriterImpl(BRepositoryWriterListener* listener,
 	fListener(listener),
 	fRepositoryInfo(repositoryInfo),
 	fPackageCount(0),
-	fPackageNames(NULL)
+	fPackageNames(NULL),
+	fWriteChunkIndices(false)
 {
 }
 
@@ -361,6 +366,11 @@ RepositoryWriterImpl::_AddPackage(const BEntry& packageEntry)
 	}
 	fPackageInfo.SetChecksum(checksum);
 
+	if (fWriteChunkIndices
+		&& (result = _WriteChunkIndex(packagePath)) != B_OK) {
+		return result;
+	}
+
 	// register package's attributes
 	if ((result = _RegisterCurrentPackageInfo()) != B_OK)
 		return result;
@@ -383,6 +393,44 @@ RepositoryWriterImpl::_AddPackageInfo(const BPackageInfo& packageInfo)
 }
 
 
+/*!	Writes the chunk index of the given package to "<package>.chunks", so
+	that clients can download updates of the package as deltas.
+*/
+status_t
+RepositoryWriterImpl::_WriteChunkIndex(const BPath& packagePath)
+{
+	BFile packageFile;
+	status_t result = packageFile.SetTo(packagePath.Path(), B_READ_ONLY);
+	if (result != B_OK) {
+		fListener->PrintError("can't open package file '%s'!\n",
+			packagePath.Path());
+		return result;
+	}
+
+	PackageChunkIndex chunkIndex;
+	if ((result = chunkIndex.Compute(&packageFile)) != B_OK) {
+		fListener->PrintError("can't compute chunk index of '%s': %s\n",
+			packagePath.Path(), strerror(result));
+		return result;
+	}
+
+	BString indexPath(packagePath.Path());
+	indexPath << ".chunks";
+	BFile indexFile;
+	result = indexFile.SetTo(indexPath.String(),
+		B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE);
+	if (result == B_OK)
+		result = chunkIndex.Write(&indexFile);
+	if (result != B_OK) {
+		fListener->PrintError("can't write chunk index file '%s': %s\n",
+			indexPath.String(), strerror(result));
+		return result;
+	}
+
+	return B_OK;
+}
+
+
 status_t
 RepositoryWriterImpl::_RegisterCurrentPackageInfo()
 {
@@ -329,6 +329,8 @@ WriterImplBase::InitHeapReader(size_t headerSize)
 			}
 			break;
 		case B_HPKG_COMPRESSION_ZSTD:
+		case B_HPKG_COMPRESSION_ZSTD_DICTIONARY:
+			// the dictionary is set on the heap writer later
 			compressionAlgorithm = CompressionAlgorithmOwner::Create(
 				new(std::nothrow) BZstdCompressionAlgorithm,
 				new(std::nothrow) BZstdCompressionParameters(
@@ -603,6 +603,22 @@ BPackageManager::_PreparePackageChanges(
 				}
 			}
 
+			// If the package replaces an installed version, only the parts
+			// that changed need to be downloaded.
+			BEntry basisEntry;
+			if (!reusingDownload) {
+				for (int32 k = 0; BSolverPackage* oldPackage
+						= packagesToDeactivate.ItemAt(k); k++) {
+					if (oldPackage->Info().Name() == package->Info().Name()) {
+						BPath basisPath;
+						installationRepository.GetPackagePath(oldPackage,
+							basisPath);
+						basisEntry.SetTo(basisPath.Path());
+						break;
+					}
+				}
+			}
+
 			// download the package (this will resume the download if the
 			// file already exists)
 			BString url = remoteRepository->Config().PackagesURL();
@@ -611,13 +627,23 @@ BPackageManager::_PreparePackageChanges(
 			status_t error;
 retryDownload:
 			error = DownloadPackage(url, entry,
-				package->Info().Checksum());
+				package->Info().Checksum(),
+				basisEntry.InitCheck() == B_OK ? &basisEntry : NULL);
 			if (error != B_OK) {
 				if (error == B_BAD_DATA || error == ERANGE) {
 					// B_BAD_DATA is returned when there is a checksum
 					// mismatch. Make sure this download is not re-used.
 					entry.Remove();
 
+					if (basisEntry.InitCheck() == B_OK) {
+						// The package created from the delta is broken, so
+						// the chunk index was probably outdated.
+						printf("\nPackage created from delta '%s' was invalid. "
+							"Redownloading.\n", fileName.String());
+						basisEntry.Unset();
+						goto retryDownload;
+					}
+
 					if (reusingDownload) {
 						// Maybe the download we reused had some problem.
 						// Try again, this time without reusing the download.
@@ -875,12 +901,15 @@ BPackageManager::_NextSpecificInstallationLocation()
 
 status_t
 BPackageManager::DownloadPackage(const BString& fileURL,
-	const BEntry& targetEntry, const BString& checksum)
+	const BEntry& targetEntry, const BString& checksum,
+	const BEntry* basisEntry)
 {
 	BDecisionProvider provider;
 	BContext context(provider, *this);
-	return DownloadFileRequest(context, fileURL, targetEntry, checksum)
-		.Process();
+	DownloadFileRequest request(context, fileURL, targetEntry, checksum);
+	if (basisEntry != NULL)
+		request.SetBasisEntry(*basisEntry);
+	return request.Process();
 }
 
 
@@ -9,6 +9,8 @@
 
 #include <package/solver/SolverRepository.h>
 
+#include <Entry.h>
+
 #include <package/PackageDefs.h>
 #include <package/PackageRoster.h>
 #include <package/RepositoryCache.h>
@@ -22,13 +24,20 @@ static const int32 kInitialPackageListSize = 40;
 namespace BPackageKit {
 
 
+struct BSolverRepository::CacheInfo {
+	BEntry	entry;
+	BString	checksum;
+};
+
+
 BSolverRepository::BSolverRepository()
 	:
 	fName(),
 	fPriority(0),
 	fIsInstalled(false),
 	fPackages(kInitialPackageListSize, true),
-	fChangeCount(0)
+	fChangeCount(0),
+	fCacheInfo(NULL)
 {
 }
 
@@ -39,7 +48,8 @@ BSolverRepository::BSolverRepository(const BString& name)
 	fPriority(0),
 	fIsInstalled(false),
 	fPackages(kInitialPackageListSize, true),
-	fChangeCount(0)
+	fChangeCount(0),
+	fCacheInfo(NULL)
 {
 	SetTo(name);
 }
@@ -51,7 +61,8 @@ BSolverRepository::BSolverRepository(BPackageInstallationLocation location)
 	fPriority(0),
 	fIsInstalled(false),
 	fPackages(kInitialPackageListSize, true),
-	fChangeCount(0)
+	fChangeCount(0),
+	fCacheInfo(NULL)
 {
 	SetTo(location);
 }
@@ -63,7 +74,8 @@ BSolverRepository::BSolverRepository(BAllInstallationLocations)
 	fPriority(0),
 	fIsInstalled(false),
 	fPackages(kInitialPackageListSize, true),
-	fChangeCount(0)
+	fChangeCount(0),
+	fCacheInfo(NULL)
 {
 	SetTo(B_ALL_INSTALLATION_LOCATIONS);
 }
@@ -75,7 +87,8 @@ BSolverRepository::BSolverRepository(const BRepositoryConfig& config)
 	fPriority(0),
 	fIsInstalled(false),
 	fPackages(kInitialPackageListSize, true),
-	fChangeCount(0)
+	fChangeCount(0),
+	fCacheInfo(NULL)
 {
 	SetTo(config);
 }
@@ -83,6 +96,7 @@ BSolverRepository::BSolverRepository(const BRepositoryConfig& config)
 
 BSolverRepository::~BSolverRepository()
 {
+	delete fCacheInfo;
 }
 
 
@@ -159,6 +173,7 @@ BSolverRepository::SetTo(const BRepositoryConfig& config)
 		}
 	}
 
+	_SetCache(cache);
 	return B_OK;
 }
 
@@ -184,6 +199,7 @@ BSolverRepository::SetTo(const BRepositoryCache& cache)
 		}
 	}
 
+	_SetCache(cache);
 	return B_OK;
 }
 
@@ -195,6 +211,7 @@ BSolverRepository::Unset()
 	fPriority = 0;
 	fIsInstalled = false;
 	fPackages.MakeEmpty();
+	_UnsetCache();
 	fChangeCount++;
 }
 
@@ -274,6 +291,7 @@ BSolverRepository::AddPackage(const BPackageInfo& info,
 		return B_NO_MEMORY;
 	}
 
+	_UnsetCache();
 	fChangeCount++;
 
 	if (_package != NULL)
@@ -309,6 +327,7 @@ BSolverRepository::RemovePackage(BSolverPackage* package)
 	if (!fPackages.RemoveItem(package, false))
 		return false;
 
+	_UnsetCache();
 	fChangeCount++;
 	return true;
 }
@@ -332,4 +351,47 @@ BSolverRepository::ChangeCount() const
 }
 
 
+/*!	Returns the entry and the checksum of the repository cache the packages
+	have been added from, if any. Solvers can use them to cache data derived
+	from the packages. The checksum is the one the repository published for
+	the cache.
+*/
+status_t
+BSolverRepository::GetCache(BEntry& _entry, BString& _checksum) const
+{
+	if (fCacheInfo == NULL)
+		return B_ENTRY_NOT_FOUND;
+
+	_entry = fCacheInfo->entry;
+	_checksum = fCacheInfo->checksum;
+	return _entry.InitCheck();
+}
+
+
+void
+BSolverRepository::_SetCache(const BRepositoryCache& cache)
+{
+	_UnsetCache();
+
+	BString checksum;
+	if (cache.GetChecksum(checksum) != B_OK)
+		return;
+
+	fCacheInfo = new(std::nothrow) CacheInfo;
+	if (fCacheInfo == NULL)
+		return;
+
+	fCacheInfo->entry = cache.Entry();
+	fCacheInfo->checksum = checksum;
+}
+
+
+void
+BSolverRepository::_UnsetCache()
+{
+	delete fCacheInfo;
+	fCacheInfo = NULL;
+}
+
+
 }	// namespace BPackageKit
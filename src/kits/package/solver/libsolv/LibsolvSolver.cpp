@@ -10,6 +10,8 @@
 #include "LibsolvSolver.h"
 
 #include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
 #include <sys/utsname.h>
 
 #include <new>
@@ -18,9 +20,13 @@
 #include <solv/poolarch.h>
 #include <solv/repo.h>
 #include <solv/repo_haiku.h>
+#include <solv/repo_solv.h>
+#include <solv/repo_write.h>
 #include <solv/selection.h>
 #include <solv/solverdebug.h>
 
+#include <Path.h>
+
 #include <package/PackageResolvableExpression.h>
 #include <package/RepositoryCache.h>
 #include <package/solver/SolverPackage.h>
@@ -38,6 +44,44 @@
 // abort()s. Obviously that isn't good behavior for a library.
 
 
+// The pool data of a repository are cached in libsolv's own format in a file
+// next to the repository cache, since creating them from the package infos
+// takes quite some time for large repositories. The file starts with a line
+// containing the checksum the repository published for the cache it has been
+// created from.
+static const char* const kSolvFileSuffix = ".solv";
+
+
+typedef CObjectDeleter<FILE, int, fclose> FileCloser;
+
+
+/*!	Returns the path of the solv file of the given repository and the checksum
+	of the repository cache its packages have been added from. Only
+	repositories that have been set to a repository cache have a solv file.
+*/
+static status_t
+get_solv_file(BSolverRepository* repository, BPath& _path, BString& _checksum)
+{
+#ifdef HAIKU_TARGET_PLATFORM_HAIKU
+	if (repository->IsInstalled())
+		return B_NOT_SUPPORTED;
+
+	BEntry cacheEntry;
+	status_t error = repository->GetCache(cacheEntry, _checksum);
+	if (error == B_OK)
+		error = cacheEntry.GetPath(&_path);
+	if (error != B_OK)
+		return error;
+
+	BString path(_path.Path());
+	path << kSolvFileSuffix;
+	return _path.SetTo(path);
+#else
+	return B_NOT_SUPPORTED;
+#endif
+}
+
+
 BSolver*
 BPackageKit::create_solver()
 {
@@ -748,21 +792,36 @@ LibsolvSolver::_AddRepositories()
 		repo->priority = -1 - repository->Priority();
 		repo->appdata = (void*)repositoryInfo;
 
-		int32 packageCount = repository->CountPackages();
-		for (int32 k = 0; k < packageCount; k++) {
-			BSolverPackage* package = repository->PackageAt(k);
-			Id solvableId = repo_add_haiku_package_info(repo, package->Info(),
-				REPO_REUSE_REPODATA | REPO_NO_INTERNALIZE);
+		BPath solvFilePath;
+		BString checksum;
+		bool hasSolvFile
+			= get_solv_file(repository, solvFilePath, checksum) == B_OK;
+		error = hasSolvFile
+			? _ReadSolvFile(repositoryInfo, solvFilePath, checksum)
+			: B_ENTRY_NOT_FOUND;
+		if (error == B_NO_MEMORY)
+			return error;
 
-			try {
-				fSolvablePackages[solvableId] = package;
-				fPackageSolvables[package] = solvableId;
-			} catch (std::bad_alloc&) {
-				return B_NO_MEMORY;
+		if (error != B_OK) {
+			int32 packageCount = repository->CountPackages();
+			for (int32 k = 0; k < packageCount; k++) {
+				BSolverPackage* package = repository->PackageAt(k);
+				Id solvableId = repo_add_haiku_package_info(repo,
+					package->Info(), REPO_REUSE_REPODATA | REPO_NO_INTERNALIZE);
+
+				try {
+					fSolvablePackages[solvableId] = package;
+					fPackageSolvables[package] = solvableId;
+				} catch (std::bad_alloc&) {
+					return B_NO_MEMORY;
+				}
 			}
-		}
 
-		repo_internalize(repo);
+			repo_internalize(repo);
+
+			if (hasSolvFile)
+				_WriteSolvFile(repositoryInfo, solvFilePath, checksum);
+		}
 
 		if (repository->IsInstalled()) {
 			fInstalledRepository = repositoryInfo;
@@ -779,6 +838,123 @@ LibsolvSolver::_AddRepositories()
 }
 
 
+/*!	Adds the packages of the repository to its pool repo from its solv file
+	at \a path, if the file has been created from the repository cache with
+	the given \a checksum.
+*/
+status_t
+LibsolvSolver::_ReadSolvFile(RepositoryInfo* repositoryInfo,
+	const BPath& path, const BString& checksum)
+{
+	BSolverRepository* repository = repositoryInfo->Repository();
+	Repo* repo = repositoryInfo->SolvRepo();
+
+	FILE* file = fopen(path.Path(), "r");
+	if (file == NULL)
+		return errno;
+	FileCloser fileCloser(file);
+
+	char line[B_FILE_NAME_LENGTH];
+	if (fgets(line, sizeof(line), file) == NULL)
+		return B_BAD_DATA;
+	BString fileChecksum(line);
+	fileChecksum.RemoveAll("\n");
+	if (fileChecksum != checksum)
+		return B_BAD_DATA;
+
+	if (repo_add_solv(repo, file, 0) != 0)
+		return B_BAD_DATA;
+
+	// The solvables have been written in the order of the repository's
+	// packages. Make sure they still match.
+	int32 packageCount = repository->CountPackages();
+	bool matches = repo->nsolvables == packageCount;
+	if (matches) {
+		int32 index = 0;
+		Id solvableId;
+		Solvable* solvable;
+		FOR_REPO_SOLVABLES(repo, solvableId, solvable) {
+			BSolverPackage* package = repository->PackageAt(index++);
+			if (!_SolvableMatches(solvable, package)) {
+				matches = false;
+				break;
+			}
+		}
+	}
+
+	if (!matches) {
+		repo_empty(repo, 1);
+		return B_BAD_DATA;
+	}
+
+	int32 index = 0;
+	Id solvableId;
+	Solvable* solvable;
+	FOR_REPO_SOLVABLES(repo, solvableId, solvable) {
+		BSolverPackage* package = repository->PackageAt(index++);
+		try {
+			fSolvablePackages[solvableId] = package;
+			fPackageSolvables[package] = solvableId;
+		} catch (std::bad_alloc&) {
+			return B_NO_MEMORY;
+		}
+	}
+
+	return B_OK;
+}
+
+
+/*!	Returns whether the name and version of the given solvable read from a
+	solv file are those of \a package.
+*/
+bool
+LibsolvSolver::_SolvableMatches(Solvable* solvable, BSolverPackage* package)
+	const
+{
+	const BPackageInfo& info = package->Info();
+	if (info.Name() != pool_id2str(fPool, solvable->name))
+		return false;
+
+	// cut off the empty epoch, like _GetResolvableExpression() does
+	const char* versionString = pool_id2str(fPool, solvable->evr);
+	if (versionString == NULL)
+		return false;
+	if (versionString[0] == ':')
+		versionString++;
+
+	BPackageVersion version;
+	return version.SetTo(versionString, true) == B_OK
+		&& version.Compare(info.Version()) == 0;
+}
+
+
+/*!	Writes the pool repo of the repository to its solv file. Failing to do so
+	is not an error, since the file is only a cache.
+*/
+void
+LibsolvSolver::_WriteSolvFile(RepositoryInfo* repositoryInfo,
+	const BPath& path, const BString& checksum)
+{
+	// write a temporary file first, so that no one reads a partial one
+	BString temporaryPath;
+	temporaryPath.SetToFormat("%s.%" B_PRId32, path.Path(), (int32)getpid());
+	if (temporaryPath.IsEmpty())
+		return;
+
+	FILE* file = fopen(temporaryPath.String(), "w");
+	if (file == NULL)
+		return;
+
+	bool success = fprintf(file, "%s\n", checksum.String()) > 0
+		&& repo_write(repositoryInfo->SolvRepo(), file) == 0;
+	if (fclose(file) != 0)
+		success = false;
+
+	if (!success || rename(temporaryPath.String(), path.Path()) != 0)
+		unlink(temporaryPath.String());
+}
+
+
 LibsolvSolver::RepositoryInfo*
 LibsolvSolver::_InstalledRepository() const
 {
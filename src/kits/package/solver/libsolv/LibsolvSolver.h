@@ -19,6 +19,8 @@
 using namespace BPackageKit;
 
 
+class BPath;
+
 namespace BPackageKit {
 	class BPackageResolvableExpression;
 	class BSolverPackage;
@@ -95,6 +97,14 @@ private:
 
 			bool				_HaveRepositoriesChanged() const;
 			status_t			_AddRepositories();
+			status_t			_ReadSolvFile(RepositoryInfo* repositoryInfo,
+									const BPath& path,
+									const BString& checksum);
+			bool				_SolvableMatches(Solvable* solvable,
+									BSolverPackage* package) const;
+			void				_WriteSolvFile(RepositoryInfo* repositoryInfo,
+									const BPath& path,
+									const BString& checksum);
 			RepositoryInfo*		_InstalledRepository() const;
 			RepositoryInfo*		_GetRepositoryInfo(
 									BSolverRepository* repository) const;
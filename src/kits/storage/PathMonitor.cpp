@@ -29,6 +29,8 @@
 #include <util/OpenHashTable.h>
 #include <util/SinglyLinkedList.h>
 
+#include "node_monitor_private.h"
+
 
 #undef TRACE
 //#define TRACE_PATH_MONITOR
@@ -186,7 +188,8 @@ public:
 			// ancestor. In practice this complicates the transitions when an
 			// ancestor is created/removed/moved.
 		if (flags != 0) {
-			error = sWatchingInterface->WatchNode(&fNodeRef, flags, target);
+			error = sWatchingInterface->WatchNode(&fNodeRef,
+				flags | B_WATCH_BATCHED, target);
 			TRACE("  started to watch ancestor %p (\"%s\", %#" B_PRIx32
 				") -> %s\n", this, Name(), flags, strerror(error));
 			if (error != B_OK)
@@ -904,6 +907,16 @@ PathHandler::MessageReceived(BMessage* message)
 					_EntryMoved(message);
 					break;
 
+				case B_BATCHED_EVENTS:
+				{
+					BMessage event;
+					for (int32 i = 0; message->FindMessage("event", i, &event)
+							== B_OK; i++) {
+						MessageReceived(&event);
+					}
+					break;
+				}
+
 				default:
 					_UnsetDuplicateEntryNotification();
 					_NodeChanged(message);
@@ -1675,7 +1688,8 @@ PathHandler::_AddNode(const node_ref& nodeRef, bool isDirectory, bool notify,
 	// start watching (don't do that for the base node, since we watch it
 	// already via fBaseAncestor)
 	if (nodeRef != fBaseAncestor->NodeRef()) {
-		uint32 flags = (fFlags & WATCH_NODE_FLAG_MASK) | B_WATCH_DIRECTORY;
+		uint32 flags = (fFlags & WATCH_NODE_FLAG_MASK) | B_WATCH_DIRECTORY
+			| B_WATCH_BATCHED;
 		status_t error = sWatchingInterface->WatchNode(&nodeRef, flags, this);
 		if (error != B_OK)
 			return error;
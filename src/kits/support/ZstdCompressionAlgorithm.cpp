@@ -24,6 +24,7 @@
 // build compression support only for userland
 #if defined(ZSTD_ENABLED) && !defined(_KERNEL_MODE) && !defined(_BOOT_MODE)
 #	define B_ZSTD_COMPRESSION_SUPPORT 1
+#	include <zdict.h>
 #endif
 
 
@@ -49,13 +50,17 @@ BZstdCompressionParameters::BZstdCompressionParameters(
 	:
 	BCompressionParameters(),
 	fCompressionLevel(compressionLevel),
-	fBufferSize(kDefaultBufferSize)
+	fBufferSize(kDefaultBufferSize),
+	fDictionary(NULL)
 {
 }
 
 
 BZstdCompressionParameters::~BZstdCompressionParameters()
 {
+#ifdef B_ZSTD_COMPRESSION_SUPPORT
+	ZSTD_freeCDict(fDictionary);
+#endif
 }
 
 
@@ -87,19 +92,48 @@ BZstdCompressionParameters::SetBufferSize(size_t size)
 }
 
 
+/*!	Sets the dictionary to compress with. The dictionary is prepared for the
+	current compression level, so the level must be set before.
+	The data are copied, and may be freed afterwards. Passing \c NULL removes
+	the dictionary again.
+*/
+status_t
+BZstdCompressionParameters::SetDictionary(const void* dictionary, size_t size)
+{
+#ifdef B_ZSTD_COMPRESSION_SUPPORT
+	ZSTD_CDict* newDictionary = NULL;
+	if (dictionary != NULL) {
+		newDictionary = ZSTD_createCDict(dictionary, size, fCompressionLevel);
+		if (newDictionary == NULL)
+			return B_NO_MEMORY;
+	}
+
+	ZSTD_freeCDict(fDictionary);
+	fDictionary = newDictionary;
+	return B_OK;
+#else
+	return B_NOT_SUPPORTED;
+#endif
+}
+
+
 // #pragma mark - BZstdDecompressionParameters
 
 
 BZstdDecompressionParameters::BZstdDecompressionParameters()
 	:
 	BDecompressionParameters(),
-	fBufferSize(kDefaultBufferSize)
+	fBufferSize(kDefaultBufferSize),
+	fDictionary(NULL)
 {
 }
 
 
 BZstdDecompressionParameters::~BZstdDecompressionParameters()
 {
+#ifdef ZSTD_ENABLED
+	ZSTD_freeDDict(fDictionary);
+#endif
 }
 
 
@@ -117,6 +151,31 @@ BZstdDecompressionParameters::SetBufferSize(size_t size)
 }
 
 
+/*!	Sets the dictionary the data have been compressed with.
+	The data are copied, and may be freed afterwards. Passing \c NULL removes
+	the dictionary again.
+*/
+status_t
+BZstdDecompressionParameters::SetDictionary(const void* dictionary,
+	size_t size)
+{
+#ifdef ZSTD_ENABLED
+	ZSTD_DDict* newDictionary = NULL;
+	if (dictionary != NULL) {
+		newDictionary = ZSTD_createDDict(dictionary, size);
+		if (newDictionary == NULL)
+			return B_NO_MEMORY;
+	}
+
+	ZSTD_freeDDict(fDictionary);
+	fDictionary = newDictionary;
+	return B_OK;
+#else
+	return B_NOT_SUPPORTED;
+#endif
+}
+
+
 // #pragma mark - CompressionStrategy
 
 
@@ -137,7 +196,12 @@ struct BZstdCompressionAlgorithm::CompressionStrategy {
 		}
 
 		*stream = ZSTD_createCStream();
-		return ZSTD_initCStream(*stream, compressionLevel);
+		size_t zstdError = ZSTD_initCStream(*stream, compressionLevel);
+		if (!ZSTD_isError(zstdError) && parameters != NULL
+			&& parameters->Dictionary() != NULL) {
+			zstdError = ZSTD_CCtx_refCDict(*stream, parameters->Dictionary());
+		}
+		return zstdError;
 	}
 
 	static void Uninit(ZSTD_CStream *stream)
@@ -171,10 +235,15 @@ struct BZstdCompressionAlgorithm::DecompressionStrategy {
 	static const bool kNeedsFinalFlush = false;
 
 	static size_t Init(ZSTD_DStream **stream,
-		const BZstdDecompressionParameters* /*parameters*/)
+		const BZstdDecompressionParameters* parameters)
 	{
 		*stream = ZSTD_createDStream();
-		return ZSTD_initDStream(*stream);
+		size_t zstdError = ZSTD_initDStream(*stream);
+		if (!ZSTD_isError(zstdError) && parameters != NULL
+			&& parameters->Dictionary() != NULL) {
+			zstdError = ZSTD_DCtx_refDDict(*stream, parameters->Dictionary());
+		}
+		return zstdError;
 	}
 
 	static void Uninit(ZSTD_DStream *stream)
@@ -378,8 +447,19 @@ BZstdCompressionAlgorithm::CompressBuffer(const void* input,
 		? zstdParameters->CompressionLevel()
 		: B_ZSTD_COMPRESSION_DEFAULT;
 
-	size_t zstdError = ZSTD_compress(output, outputSize, input,
-		inputSize, compressionLevel);
+	size_t zstdError;
+	if (zstdParameters != NULL && zstdParameters->Dictionary() != NULL) {
+		ZSTD_CCtx* context = ZSTD_createCCtx();
+		if (context == NULL)
+			return B_NO_MEMORY;
+
+		zstdError = ZSTD_compress_usingCDict(context, output, outputSize,
+			input, inputSize, zstdParameters->Dictionary());
+		ZSTD_freeCCtx(context);
+	} else {
+		zstdError = ZSTD_compress(output, outputSize, input, inputSize,
+			compressionLevel);
+	}
 	if (ZSTD_isError(zstdError))
 		return _TranslateZstdError(zstdError);
 
@@ -397,8 +477,24 @@ BZstdCompressionAlgorithm::DecompressBuffer(const void* input,
 	size_t& _uncompressedSize, const BDecompressionParameters* parameters)
 {
 #ifdef ZSTD_ENABLED
-	size_t zstdError = ZSTD_decompress(output, outputSize, input,
-		inputSize);
+	const BZstdDecompressionParameters* zstdParameters
+#ifdef _BOOT_MODE
+		= static_cast<const BZstdDecompressionParameters*>(parameters);
+#else
+		= dynamic_cast<const BZstdDecompressionParameters*>(parameters);
+#endif
+
+	size_t zstdError;
+	if (zstdParameters != NULL && zstdParameters->Dictionary() != NULL) {
+		ZSTD_DCtx* context = ZSTD_createDCtx();
+		if (context == NULL)
+			return B_NO_MEMORY;
+
+		zstdError = ZSTD_decompress_usingDDict(context, output, outputSize,
+			input, inputSize, zstdParameters->Dictionary());
+		ZSTD_freeDCtx(context);
+	} else
+		zstdError = ZSTD_decompress(output, outputSize, input, inputSize);
 	if (ZSTD_isError(zstdError))
 		return _TranslateZstdError(zstdError);
 
@@ -410,6 +506,29 @@ BZstdCompressionAlgorithm::DecompressBuffer(const void* input,
 }
 
 
+/*!	Trains a dictionary for data similar to the given samples, which are
+	stored one after the other in \a samples. On input \a _dictionarySize is
+	the maximum size of the dictionary, on output its actual size.
+*/
+/*static*/ status_t
+BZstdCompressionAlgorithm::TrainDictionary(const void* samples,
+	const size_t* sampleSizes, uint32 sampleCount, void* dictionary,
+	size_t& _dictionarySize)
+{
+#ifdef B_ZSTD_COMPRESSION_SUPPORT
+	size_t zstdError = ZDICT_trainFromBuffer(dictionary, _dictionarySize,
+		samples, sampleSizes, sampleCount);
+	if (ZDICT_isError(zstdError))
+		return B_BAD_DATA;
+
+	_dictionarySize = zstdError;
+	return B_OK;
+#else
+	return B_NOT_SUPPORTED;
+#endif
+}
+
+
 /*static*/ status_t
 BZstdCompressionAlgorithm::_TranslateZstdError(size_t error)
 {
@@ -421,6 +540,8 @@ BZstdCompressionAlgorithm::_TranslateZstdError(size_t error)
 			return B_BAD_VALUE;
 		case ZSTD_error_corruption_detected:
 		case ZSTD_error_checksum_wrong:
+		case ZSTD_error_dictionary_corrupted:
+		case ZSTD_error_dictionary_wrong:
 			return B_BAD_DATA;
 		case ZSTD_error_version_unsupported:
 			return B_BAD_VALUE;
@@ -27,6 +27,7 @@
 #include "Constants.h"
 #include "DebugSupport.h"
 #include "Exception.h"
+#include "JobGraph.h"
 #include "PackageFileManager.h"
 #include "VolumeState.h"
 
@@ -106,6 +107,174 @@ private:
 };
 
 
+// #pragma mark - TransactionJob
+
+
+/*!	Base class of the jobs run concurrently while reading the packages to
+	activate. An exception thrown by the job is kept, so that it can be rethrown
+	in the thread handling the transaction.
+*/
+struct CommitTransactionHandler::TransactionJob : BJob {
+	TransactionJob(CommitTransactionHandler* handler, const BString& title)
+		:
+		BJob(title),
+		fHandler(handler),
+		fException(B_TRANSACTION_INTERNAL_ERROR),
+		fFailed(false)
+	{
+	}
+
+	void RethrowException() const
+	{
+		if (fFailed)
+			throw Exception(fException);
+	}
+
+protected:
+	virtual void Do() = 0;
+		// throws Exception
+
+	virtual status_t Execute()
+	{
+		try {
+			Do();
+			return B_OK;
+		} catch (Exception& exception) {
+			fException = exception;
+		} catch (std::bad_alloc&) {
+			fException = Exception(B_TRANSACTION_NO_MEMORY);
+		}
+
+		fFailed = true;
+		return B_ERROR;
+	}
+
+protected:
+	CommitTransactionHandler*	fHandler;
+
+private:
+	Exception					fException;
+	bool						fFailed;
+};
+
+
+// #pragma mark - ReadPackageJob
+
+
+struct CommitTransactionHandler::ReadPackageJob : TransactionJob {
+	ReadPackageJob(CommitTransactionHandler* handler,
+		const BString& packageName, int32 index)
+		:
+		TransactionJob(handler, packageName),
+		fPackageName(packageName),
+		fIndex(index),
+		fPackage(NULL)
+	{
+	}
+
+	virtual ~ReadPackageJob()
+	{
+		delete fPackage;
+	}
+
+	int32 Index() const
+	{
+		return fIndex;
+	}
+
+	Package* GetPackage() const
+	{
+		return fPackage;
+	}
+
+	Package* DetachPackage()
+	{
+		Package* package = fPackage;
+		fPackage = NULL;
+		return package;
+	}
+
+protected:
+	virtual void Do()
+	{
+		fPackage = fHandler->_ReadPackage(fPackageName);
+	}
+
+private:
+	BString						fPackageName;
+	int32						fIndex;
+	Package*					fPackage;
+};
+
+
+// #pragma mark - OpenWritableFilesDirectoryJob
+
+
+/*!	Opens the writable-files directory, if any of the read packages has global
+	writable files. Must depend on all ReadPackageJobs.
+*/
+struct CommitTransactionHandler::OpenWritableFilesDirectoryJob
+	: TransactionJob {
+	OpenWritableFilesDirectoryJob(CommitTransactionHandler* handler,
+		const ReadPackageJobList& readJobs)
+		:
+		TransactionJob(handler, "open writable-files directory"),
+		fReadJobs(readJobs)
+	{
+	}
+
+protected:
+	virtual void Do()
+	{
+		BStringList contentPaths;
+		for (int32 i = 0; ReadPackageJob* job = fReadJobs.ItemAt(i); i++) {
+			_GetGlobalWritableFilePaths(job->GetPackage(), contentPaths);
+			if (!contentPaths.IsEmpty()) {
+				fHandler->_OpenWritableFilesDirectory(job->GetPackage());
+				return;
+			}
+		}
+	}
+
+private:
+	const ReadPackageJobList&	fReadJobs;
+};
+
+
+// #pragma mark - ExtractWritableFilesJob
+
+
+/*!	Extracts the global writable files of a read package into the
+	writable-files directory. Must depend on the OpenWritableFilesDirectoryJob.
+*/
+struct CommitTransactionHandler::ExtractWritableFilesJob : TransactionJob {
+	ExtractWritableFilesJob(CommitTransactionHandler* handler,
+		ReadPackageJob* readJob)
+		:
+		TransactionJob(handler, readJob->Title()),
+		fReadJob(readJob)
+	{
+	}
+
+protected:
+	virtual void Do()
+	{
+		Package* package = fReadJob->GetPackage();
+		BStringList contentPaths;
+		_GetGlobalWritableFilePaths(package, contentPaths);
+		if (contentPaths.IsEmpty())
+			return;
+
+		BDirectory extractedFilesDirectory;
+		_ExtractPackageContent(package, contentPaths,
+			fHandler->fWritableFilesDirectory, extractedFilesDirectory);
+	}
+
+private:
+	ReadPackageJob*				fReadJob;
+};
+
+
 // #pragma mark - CommitTransactionHandler
 
 
@@ -354,7 +523,20 @@ CommitTransactionHandler::_ReadPackagesToActivate(
 			.SetSystemError(error);
 	}
 
-	// read the packages
+	// Check the packages and create the jobs reading the new ones and
+	// extracting their global writable files. Those don't depend on each other
+	// for different packages, so they are run concurrently afterwards.
+	JobGraph jobGraph;
+	if (jobGraph.Init() != B_OK)
+		throw Exception(B_TRANSACTION_NO_MEMORY);
+
+	ReadPackageJobList readJobs;
+	BObjectList<TransactionJob> extractJobs;
+	OpenWritableFilesDirectoryJob* openDirectoryJob
+		= new(std::nothrow) OpenWritableFilesDirectoryJob(this, readJobs);
+	if (openDirectoryJob == NULL || !jobGraph.AddJob(openDirectoryJob))
+		throw std::bad_alloc();
+
 	for (int32 i = 0; i < packagesToActivateCount; i++) {
 		BString packageName = packagesToActivate.StringAt(i);
 		// make sure it doesn't clash with an already existing package,
@@ -385,24 +567,42 @@ CommitTransactionHandler::_ReadPackagesToActivate(
 			}
 		}
 
-		// read the package
-		error = fPackageFileManager->CreatePackage(
-			NotOwningEntryRef(fTransactionDirectoryRef, packageName),
-			package);
-		if (error != B_OK) {
-			if (error == B_NO_MEMORY)
-				throw Exception(B_TRANSACTION_NO_MEMORY);
-			throw Exception(B_TRANSACTION_FAILED_TO_READ_PACKAGE_FILE)
-				.SetPackageName(packageName)
-				.SetPath1(_GetPath(
-					FSUtils::Entry(
-						NotOwningEntryRef(fTransactionDirectoryRef,
-							packageName)),
-					packageName))
-				.SetSystemError(error);
+		ReadPackageJob* readJob = new(std::nothrow) ReadPackageJob(this,
+			packageName, i);
+		if (readJob == NULL || !jobGraph.AddJob(readJob)
+			|| !readJobs.AddItem(readJob)
+			|| openDirectoryJob->AddDependency(readJob) != B_OK) {
+			throw std::bad_alloc();
 		}
 
-		if (!fPackagesToActivate.AddItem(package)) {
+		ExtractWritableFilesJob* extractJob
+			= new(std::nothrow) ExtractWritableFilesJob(this, readJob);
+		if (extractJob == NULL || !jobGraph.AddJob(extractJob)
+			|| !extractJobs.AddItem(extractJob)
+			|| extractJob->AddDependency(openDirectoryJob) != B_OK) {
+			throw std::bad_alloc();
+		}
+	}
+
+	if (readJobs.IsEmpty())
+		return;
+
+	// read the packages
+	error = jobGraph.Run();
+
+	// report the failure of the first job in order of the transaction
+	for (int32 i = 0; ReadPackageJob* job = readJobs.ItemAt(i); i++)
+		job->RethrowException();
+	openDirectoryJob->RethrowException();
+	for (int32 i = 0; TransactionJob* job = extractJobs.ItemAt(i); i++)
+		job->RethrowException();
+	if (error != B_OK)
+		throw Exception(B_TRANSACTION_INTERNAL_ERROR);
+
+	// insert the read packages in order of the transaction
+	for (int32 i = 0; ReadPackageJob* job = readJobs.ItemAt(i); i++) {
+		Package* package = job->DetachPackage();
+		if (!fPackagesToActivate.AddItem(package, job->Index())) {
 			delete package;
 			throw Exception(B_TRANSACTION_NO_MEMORY);
 		}
@@ -410,6 +610,30 @@ CommitTransactionHandler::_ReadPackagesToActivate(
 }
 
 
+Package*
+CommitTransactionHandler::_ReadPackage(const BString& packageName)
+{
+	Package* package;
+	status_t error = fPackageFileManager->CreatePackage(
+		NotOwningEntryRef(fTransactionDirectoryRef, packageName),
+		package);
+	if (error != B_OK) {
+		if (error == B_NO_MEMORY)
+			throw Exception(B_TRANSACTION_NO_MEMORY);
+		throw Exception(B_TRANSACTION_FAILED_TO_READ_PACKAGE_FILE)
+			.SetPackageName(packageName)
+			.SetPath1(_GetPath(
+				FSUtils::Entry(
+					NotOwningEntryRef(fTransactionDirectoryRef,
+						packageName)),
+				packageName))
+			.SetSystemError(error);
+	}
+
+	return package;
+}
+
+
 void
 CommitTransactionHandler::_ApplyChanges()
 {
@@ -819,12 +1043,7 @@ CommitTransactionHandler::_AddGlobalWritableFiles(Package* package)
 	const BObjectList<BGlobalWritableFileInfo>& files
 		= package->Info().GlobalWritableFileInfos();
 	BStringList contentPaths;
-	for (int32 i = 0; const BGlobalWritableFileInfo* file = files.ItemAt(i);
-		i++) {
-		if (file->IsIncluded() && !contentPaths.Add(file->Path()))
-			throw std::bad_alloc();
-	}
-
+	_GetGlobalWritableFilePaths(package, contentPaths);
 	if (contentPaths.IsEmpty())
 		return;
 
@@ -840,29 +1059,16 @@ CommitTransactionHandler::_AddGlobalWritableFiles(Package* package)
 			.SetSystemError(error);
 	}
 
-	// Open writable-files directory in the administrative directory.
-	if (fWritableFilesDirectory.InitCheck() != B_OK) {
-		RelativePath directoryPath(kAdminDirectoryName,
-			kWritableFilesDirectoryName);
-		error = _OpenPackagesSubDirectory(directoryPath, true,
-			fWritableFilesDirectory);
-
-		if (error != B_OK) {
-			throw Exception(B_TRANSACTION_FAILED_TO_OPEN_DIRECTORY)
-				.SetPath1(_GetPath(
-					FSUtils::Entry(fVolume->PackagesDirectoryRef(),
-						directoryPath.ToString()),
-					directoryPath.ToString()))
-				.SetPackageName(package->FileName())
-				.SetSystemError(error);
-		}
-	}
+	_OpenWritableFilesDirectory(package);
 
 	// extract files into a subdir of the writable-files directory
 	BDirectory extractedFilesDirectory;
 	_ExtractPackageContent(package, contentPaths,
 		fWritableFilesDirectory, extractedFilesDirectory);
 
+	// Unlike the extraction, installing the files is not done concurrently:
+	// packages may ship the same file, the FSTransaction is not thread-safe,
+	// and comparing and copying a few small settings files is cheap.
 	for (int32 i = 0; const BGlobalWritableFileInfo* file = files.ItemAt(i);
 		i++) {
 		if (file->IsIncluded()) {
@@ -873,6 +1079,30 @@ CommitTransactionHandler::_AddGlobalWritableFiles(Package* package)
 }
 
 
+void
+CommitTransactionHandler::_OpenWritableFilesDirectory(Package* package)
+{
+	// Open writable-files directory in the administrative directory.
+	if (fWritableFilesDirectory.InitCheck() == B_OK)
+		return;
+
+	RelativePath directoryPath(kAdminDirectoryName,
+		kWritableFilesDirectoryName);
+	status_t error = _OpenPackagesSubDirectory(directoryPath, true,
+		fWritableFilesDirectory);
+
+	if (error != B_OK) {
+		throw Exception(B_TRANSACTION_FAILED_TO_OPEN_DIRECTORY)
+			.SetPath1(_GetPath(
+				FSUtils::Entry(fVolume->PackagesDirectoryRef(),
+					directoryPath.ToString()),
+				directoryPath.ToString()))
+			.SetPackageName(package->FileName())
+			.SetSystemError(error);
+	}
+}
+
+
 void
 CommitTransactionHandler::_AddGlobalWritableFile(Package* package,
 	const BGlobalWritableFileInfo& file, const BDirectory& rootDirectory,
@@ -1509,7 +1739,24 @@ CommitTransactionHandler::_QueuePostInstallScripts()
 }
 
 
-void
+/*static*/ void
+CommitTransactionHandler::_GetGlobalWritableFilePaths(Package* package,
+	BStringList& _paths)
+{
+	const BObjectList<BGlobalWritableFileInfo>& files
+		= package->Info().GlobalWritableFileInfos();
+	for (int32 i = 0; const BGlobalWritableFileInfo* file = files.ItemAt(i);
+		i++) {
+		if (file->IsIncluded() && !_paths.Add(file->Path()))
+			throw std::bad_alloc();
+	}
+}
+
+
+/*!	Doesn't use the FSTransaction, since the directory is kept anyway and this
+	may be called concurrently for different packages.
+*/
+/*static*/ void
 CommitTransactionHandler::_ExtractPackageContent(Package* package,
 	const BStringList& contentPaths, BDirectory& targetDirectory,
 	BDirectory& _extractedFilesDirectory)
@@ -1574,9 +1821,6 @@ CommitTransactionHandler::_ExtractPackageContent(Package* package,
 	}
 
 	BDirectory& subDirectory = _extractedFilesDirectory;
-	FSTransaction::CreateOperation createSubDirectoryOperation(
-		&fFSTransaction,
-		FSUtils::Entry(targetDirectory, temporaryTargetName));
 	error = targetDirectory.CreateDirectory(temporaryTargetName,
 		&subDirectory);
 	if (error != B_OK) {
@@ -1588,43 +1832,42 @@ CommitTransactionHandler::_ExtractPackageContent(Package* package,
 			.SetSystemError(error);
 	}
 
-	createSubDirectoryOperation.Finished();
+	// extract and rename the subdirectory, removing it again on error
+	try {
+		NotOwningEntryRef packageRef(package->EntryRef());
 
-	// extract
-	NotOwningEntryRef packageRef(package->EntryRef());
+		int32 contentPathCount = contentPaths.CountStrings();
+		for (int32 i = 0; i < contentPathCount; i++) {
+			const char* contentPath = contentPaths.StringAt(i);
 
-	int32 contentPathCount = contentPaths.CountStrings();
-	for (int32 i = 0; i < contentPathCount; i++) {
-		const char* contentPath = contentPaths.StringAt(i);
+			error = FSUtils::ExtractPackageContent(FSUtils::Entry(packageRef),
+				contentPath, FSUtils::Entry(subDirectory));
+			if (error != B_OK) {
+				throw Exception(B_TRANSACTION_FAILED_TO_EXTRACT_PACKAGE_FILE)
+					.SetPath1(contentPath)
+					.SetPackageName(package->FileName())
+					.SetSystemError(error);
+			}
+		}
+
+		// tag all entries with the package attribute
+		_TagPackageEntriesRecursively(subDirectory, targetName, true);
 
-		error = FSUtils::ExtractPackageContent(FSUtils::Entry(packageRef),
-			contentPath, FSUtils::Entry(subDirectory));
+		error = targetEntry.Rename(targetName);
 		if (error != B_OK) {
-			throw Exception(B_TRANSACTION_FAILED_TO_EXTRACT_PACKAGE_FILE)
-				.SetPath1(contentPath)
+			throw Exception(B_TRANSACTION_FAILED_TO_MOVE_FILE)
+				.SetPath1(_GetPath(
+					FSUtils::Entry(targetDirectory, temporaryTargetName),
+					temporaryTargetName))
+				.SetPath2(targetName)
 				.SetPackageName(package->FileName())
 				.SetSystemError(error);
 		}
+	} catch (...) {
+		BRemoveEngine().RemoveEntry(
+			FSUtils::Entry(targetDirectory, temporaryTargetName));
+		throw;
 	}
-
-	// tag all entries with the package attribute
-	_TagPackageEntriesRecursively(subDirectory, targetName, true);
-
-	// rename the subdirectory
-	error = targetEntry.Rename(targetName);
-	if (error != B_OK) {
-		throw Exception(B_TRANSACTION_FAILED_TO_MOVE_FILE)
-			.SetPath1(_GetPath(
-				FSUtils::Entry(targetDirectory, temporaryTargetName),
-				temporaryTargetName))
-			.SetPath2(targetName)
-			.SetPackageName(package->FileName())
-			.SetSystemError(error);
-	}
-
-	// keep the directory, regardless of whether the transaction is rolled
-	// back
-	createSubDirectoryOperation.Unregister();
 }
 
 
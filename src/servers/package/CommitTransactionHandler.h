@@ -65,12 +65,19 @@ private:
 			typedef FSUtils::RelativePath RelativePath;
 
 			struct TransactionIssueBuilder;
+			struct TransactionJob;
+			struct ReadPackageJob;
+			struct OpenWritableFilesDirectoryJob;
+			struct ExtractWritableFilesJob;
+
+			typedef BObjectList<ReadPackageJob> ReadPackageJobList;
 
 private:
 			void				_GetPackagesToDeactivate(
 									const BActivationTransaction& transaction);
 			void				_ReadPackagesToActivate(
 									const BActivationTransaction& transaction);
+			Package*			_ReadPackage(const BString& packageName);
 			void				_ApplyChanges();
 			void				_CreateOldStateDirectory();
 			void				_RemovePackagesToDeactivate();
@@ -81,6 +88,7 @@ private:
 									const BString& groupName);
 			void				_AddUser(Package* package, const BUser& user);
 			void				_AddGlobalWritableFiles(Package* package);
+			void				_OpenWritableFilesDirectory(Package* package);
 			void				_AddGlobalWritableFile(Package* package,
 									const BGlobalWritableFileInfo& file,
 									const BDirectory& rootDirectory,
@@ -104,7 +112,9 @@ private:
 
 			void				_QueuePostInstallScripts();
 
-			void				_ExtractPackageContent(Package* package,
+	static	void				_GetGlobalWritableFilePaths(Package* package,
+									BStringList& _paths);
+	static	void				_ExtractPackageContent(Package* package,
 									const BStringList& contentPaths,
 									BDirectory& targetDirectory,
 									BDirectory& _extractedFilesDirectory);
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "JobGraph.h"
+
+#include <OS.h>
+
+#include <PthreadMutexLocker.h>
+
+#include "DebugSupport.h"
+
+
+JobGraph::JobGraph()
+	:
+	fMutexInitialized(false),
+	fJobDoneConditionInitialized(false),
+	fJobs(20, true),
+	fWaitingJobs(20, false),
+	fRunningJobs(0),
+	fError(B_OK)
+{
+}
+
+
+JobGraph::~JobGraph()
+{
+	if (fJobDoneConditionInitialized)
+		pthread_cond_destroy(&fJobDoneCondition);
+
+	if (fMutexInitialized)
+		pthread_mutex_destroy(&fMutex);
+}
+
+
+status_t
+JobGraph::Init()
+{
+	status_t error = pthread_mutex_init(&fMutex, NULL);
+	if (error != B_OK)
+		return error;
+	fMutexInitialized = true;
+
+	error = pthread_cond_init(&fJobDoneCondition, NULL);
+	if (error != B_OK)
+		return error;
+	fJobDoneConditionInitialized = true;
+
+	return B_OK;
+}
+
+
+bool
+JobGraph::AddJob(BJob* job)
+{
+	if (!fJobs.AddItem(job)) {
+		delete job;
+		return false;
+	}
+
+	return fWaitingJobs.AddItem(job);
+}
+
+
+/*!	Runs all jobs and returns when they are done. The calling thread is one of
+	the at most \a maxThreads threads running jobs.
+*/
+status_t
+JobGraph::Run(int32 maxThreads)
+{
+	if (!fMutexInitialized || !fJobDoneConditionInitialized)
+		return B_NO_INIT;
+
+	system_info info;
+	int32 threadCount = get_system_info(&info) == B_OK
+		? (int32)info.cpu_count : 1;
+	if (threadCount > maxThreads)
+		threadCount = maxThreads;
+	if (threadCount > kMaxThreads)
+		threadCount = kMaxThreads;
+	if (threadCount > fWaitingJobs.CountItems())
+		threadCount = fWaitingJobs.CountItems();
+
+	thread_id threads[kMaxThreads];
+	int32 spawnedThreads = 0;
+	while (spawnedThreads < threadCount - 1) {
+		thread_id thread = spawn_thread(&_WorkerEntry, "transaction worker",
+			B_NORMAL_PRIORITY, this);
+		if (thread < 0)
+			break;
+		resume_thread(thread);
+		threads[spawnedThreads++] = thread;
+	}
+
+	_Work();
+
+	for (int32 i = 0; i < spawnedThreads; i++) {
+		status_t result;
+		wait_for_thread(threads[i], &result);
+	}
+
+	PthreadMutexLocker mutexLocker(fMutex);
+	if (fError != B_OK)
+		return fError;
+
+	if (!fWaitingJobs.IsEmpty()) {
+		ERROR("JobGraph::Run(): jobs with circular dependencies\n");
+		return B_ERROR;
+	}
+
+	return B_OK;
+}
+
+
+/*static*/ status_t
+JobGraph::_WorkerEntry(void* data)
+{
+	((JobGraph*)data)->_Work();
+	return B_OK;
+}
+
+
+void
+JobGraph::_Work()
+{
+	PthreadMutexLocker mutexLocker(fMutex);
+
+	while (fError == B_OK) {
+		BJob* job = _PopRunnableJob();
+		if (job == NULL) {
+			// If no other job is running, the remaining ones can't become
+			// runnable anymore.
+			if (fRunningJobs == 0)
+				break;
+
+			pthread_cond_wait(&fJobDoneCondition, &fMutex);
+			continue;
+		}
+
+		fRunningJobs++;
+		mutexLocker.Unlock();
+
+		status_t error = job->Run();
+
+		mutexLocker.Lock();
+		fRunningJobs--;
+
+		if (error == B_OK) {
+			while (BJob* dependantJob = job->DependantJobAt(0))
+				dependantJob->RemoveDependency(job);
+		} else if (fError == B_OK)
+			fError = error;
+
+		pthread_cond_broadcast(&fJobDoneCondition);
+	}
+}
+
+
+BJob*
+JobGraph::_PopRunnableJob()
+{
+	int32 count = fWaitingJobs.CountItems();
+	for (int32 i = 0; i < count; i++) {
+		BJob* job = fWaitingJobs.ItemAt(i);
+		if (job->IsRunnable())
+			return fWaitingJobs.RemoveItemAt(i);
+	}
+
+	return NULL;
+}
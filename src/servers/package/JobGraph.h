@@ -0,0 +1,55 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef JOB_GRAPH_H
+#define JOB_GRAPH_H
+
+
+#include <pthread.h>
+
+#include <Job.h>
+#include <ObjectList.h>
+
+
+using BSupportKit::BJob;
+
+
+/*!	Runs a set of BJobs concurrently, respecting the dependencies between
+	them. No further jobs are started after one has failed.
+*/
+class JobGraph {
+public:
+								JobGraph();
+								~JobGraph();
+
+			status_t			Init();
+
+			bool				AddJob(BJob* job);
+									// takes ownership
+			status_t			Run(int32 maxThreads = kMaxThreads);
+									// returns the first job error
+
+	static	const int32			kMaxThreads = 8;
+
+private:
+			typedef BObjectList<BJob> JobList;
+
+private:
+	static	status_t			_WorkerEntry(void* data);
+			void				_Work();
+			BJob*				_PopRunnableJob();
+
+private:
+			pthread_mutex_t		fMutex;
+			pthread_cond_t		fJobDoneCondition;
+			bool				fMutexInitialized;
+			bool				fJobDoneConditionInitialized;
+			JobList				fJobs;
+			JobList				fWaitingJobs;
+			int32				fRunningJobs;
+			status_t			fError;
+};
+
+
+#endif	// JOB_GRAPH_H
@@ -34,23 +34,23 @@ PackageFileManager::Init()
 }
 
 
+/*!	The package file is read without holding the lock, so that several packages
+	can be read concurrently.
+*/
 status_t
 PackageFileManager::GetPackageFile(const entry_ref& entryRef,
 	PackageFile*& _file)
 {
 	AutoLocker<BLocker> locker(fLock);
 
-	PackageFile* file = fFilesByEntryRef.Lookup(entryRef);
+	PackageFile* file = _AcquireFile(entryRef);
 	if (file != NULL) {
-		if (file->AcquireReference() > 0) {
-			_file = file;
-			return B_OK;
-		}
-
-		// File already full dereferenced. It is about to be deleted.
-		fFilesByEntryRef.Remove(file);
+		_file = file;
+		return B_OK;
 	}
 
+	locker.Unlock();
+
 	file = new(std::nothrow) PackageFile;
 	if (file == NULL)
 		RETURN_ERROR(B_NO_MEMORY);
@@ -61,6 +61,16 @@ PackageFileManager::GetPackageFile(const entry_ref& entryRef,
 		return error;
 	}
 
+	// someone else might have read the file in the meantime
+	locker.Lock();
+
+	PackageFile* otherFile = _AcquireFile(entryRef);
+	if (otherFile != NULL) {
+		delete file;
+		_file = otherFile;
+		return B_OK;
+	}
+
 	fFilesByEntryRef.Insert(file);
 
 	_file = file;
@@ -104,3 +114,19 @@ PackageFileManager::RemovePackageFile(PackageFile* file)
 
 	fFilesByEntryRef.Remove(file);
 }
+
+
+PackageFile*
+PackageFileManager::_AcquireFile(const entry_ref& entryRef)
+{
+	PackageFile* file = fFilesByEntryRef.Lookup(entryRef);
+	if (file == NULL)
+		return NULL;
+
+	if (file->AcquireReference() > 0)
+		return file;
+
+	// File already full dereferenced. It is about to be deleted.
+	fFilesByEntryRef.Remove(file);
+	return NULL;
+}
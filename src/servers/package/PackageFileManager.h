@@ -36,6 +36,9 @@ public:
 private:
 			typedef PackageFileEntryRefHashTable EntryRefTable;
 
+private:
+			PackageFile*		_AcquireFile(const entry_ref& entryRef);
+
 private:
 			BLocker&			fLock;
 			EntryRefTable		fFilesByEntryRef;
@@ -292,6 +292,38 @@ Stream::FindBlockRun(off_t pos, block_run& run, off_t& offset)
 }
 
 
+/*!	Reads the data of a file that is stored in the small_data section of its
+	inode. Since only the bfs_inode structure itself is kept in memory, the
+	whole inode block is read for this.
+*/
+status_t
+Stream::ReadInlineData(off_t pos, uint8* buffer, size_t* _length)
+{
+	CachedBlock cached(fVolume);
+	bfs_inode* node = (bfs_inode*)cached.SetTo(inode_num);
+	if (node == NULL) {
+		*_length = 0;
+		return B_IO_ERROR;
+	}
+
+	const small_data* smallData = node->SmallDataStart();
+	for (; !smallData->IsLast(node); smallData = smallData->Next()) {
+		if (*smallData->Name() != INLINE_DATA_NAME
+			|| smallData->NameSize() != INLINE_DATA_NAME_LENGTH)
+			continue;
+
+		if (pos + (off_t)*_length > smallData->DataSize())
+			break;
+
+		memcpy(buffer, smallData->Data() + pos, *_length);
+		return B_OK;
+	}
+
+	*_length = 0;
+	return B_BAD_DATA;
+}
+
+
 status_t
 Stream::ReadAt(off_t pos, uint8* buffer, size_t* _length)
 {
@@ -309,6 +341,11 @@ Stream::ReadAt(off_t pos, uint8* buffer, size_t* _length)
 	if (pos + (off_t)length > data.Size())
 		length = data.Size() - pos;
 
+	if ((Flags() & INODE_INLINE_DATA) != 0) {
+		*_length = length;
+		return ReadInlineData(pos, buffer, _length);
+	}
+
 	block_run run;
 	off_t offset;
 	if (FindBlockRun(pos, run, offset) < B_OK) {
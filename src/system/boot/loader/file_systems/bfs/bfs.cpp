@@ -89,7 +89,8 @@ bool
 Volume::IsValidSuperBlock()
 {
 	if (fSuperBlock.Magic1() != (int32)SUPER_BLOCK_MAGIC1
-		|| fSuperBlock.Magic2() != (int32)SUPER_BLOCK_MAGIC2
+		|| (fSuperBlock.Magic2() != (int32)SUPER_BLOCK_MAGIC2
+			&& fSuperBlock.Magic2() != (int32)SUPER_BLOCK_MAGIC2_INCOMPAT)
 		|| fSuperBlock.Magic3() != (int32)SUPER_BLOCK_MAGIC3
 		|| (int32)fSuperBlock.block_size != fSuperBlock.inode_size
 		|| fSuperBlock.ByteOrder() != SUPER_BLOCK_FS_LENDIAN
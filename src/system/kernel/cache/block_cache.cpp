@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/uio.h>
 
 #include <KernelExport.h>
 #include <fs_cache.h>
@@ -53,6 +54,15 @@
 
 static const bigtime_t kTransactionIdleTime = 2000000LL;
 	// a transaction is considered idle after 2 seconds of inactivity
+static const bigtime_t kWriterTimeout = 2000000LL;
+	// the block writer of a cache runs at least every 2 seconds
+static const uint32 kWriterBatchTransactions = 8;
+	// number of ended transactions that wake up the block writer early
+static const uint32 kMaxWriteRunBlocks = 32;
+	// maximum number of consecutive blocks written with a single request
+static const uint32 kBlockShardShift = 4;
+static const uint32 kBlockShards = 1 << kBlockShardShift;
+	// number of independently locked parts of the block hash
 
 
 namespace {
@@ -170,12 +180,13 @@ struct BlockHash {
 
 	size_t HashKey(KeyType key) const
 	{
-		return key;
+		// the lower bits select the shard
+		return key >> kBlockShardShift;
 	}
 
 	size_t Hash(ValueType* block) const
 	{
-		return block->block_number;
+		return block->block_number >> kBlockShardShift;
 	}
 
 	bool Compare(KeyType key, ValueType* block) const
@@ -189,7 +200,84 @@ struct BlockHash {
 	}
 };
 
-typedef BOpenHashTable<BlockHash> BlockTable;
+typedef BOpenHashTable<BlockHash> BlockHashTable;
+
+
+/*!	The block hash of a cache, split into shards by block number. Each shard
+	has its own lock.
+	Changing a shard requires both the cache lock and the shard lock, while
+	looking up blocks only requires either of them. This allows Acquire() and
+	Release() to hand out additional references to blocks that are already in
+	use without having to take the cache lock; everything else still goes
+	through the cache lock.
+*/
+class BlockTable {
+public:
+								BlockTable();
+								~BlockTable();
+
+			status_t			Init(size_t initialSize);
+
+			cached_block*		Lookup(off_t blockNumber) const;
+			void				Insert(cached_block* block);
+			void				Remove(cached_block* block);
+			cached_block*		Clear();
+
+			void				SetBusyReading(cached_block* block,
+									bool busy);
+
+			cached_block*		Acquire(off_t blockNumber);
+			bool				Release(off_t blockNumber);
+
+	class Iterator {
+	public:
+		Iterator(BlockTable* table)
+			:
+			fTable(table),
+			fIndex(0),
+			fIterator(&table->fShards[0].table)
+		{
+			_Skip();
+		}
+
+		bool HasNext() const
+		{
+			return fIterator.HasNext();
+		}
+
+		cached_block* Next()
+		{
+			cached_block* block = fIterator.Next();
+			_Skip();
+			return block;
+		}
+
+	private:
+		void _Skip()
+		{
+			while (!fIterator.HasNext() && ++fIndex < kBlockShards) {
+				fIterator = BlockHashTable::Iterator(
+					&fTable->fShards[fIndex].table);
+			}
+		}
+
+		BlockTable*				fTable;
+		uint32					fIndex;
+		BlockHashTable::Iterator fIterator;
+	};
+
+private:
+	struct shard {
+		mutex					lock;
+		BlockHashTable			table;
+	};
+
+	inline	shard&				_ShardFor(off_t blockNumber)
+									{ return fShards[blockNumber
+										& (kBlockShards - 1)]; }
+
+			shard				fShards[kBlockShards];
+};
 
 
 struct TransactionHash {
@@ -240,6 +328,18 @@ struct block_cache : DoublyLinkedListLinkImpl<block_cache> {
 	NotificationList pending_notifications;
 	ConditionVariable condition_variable;
 
+	thread_id		writer_thread;
+	ConditionVariable writer_condition;
+	uint32			writer_batch;
+	bool			writer_quit;
+
+	// statistics
+	uint64			write_requests;
+	uint64			blocks_written;
+	uint32			sync_count;
+	bigtime_t		sync_time_total;
+	bigtime_t		sync_time_max;
+
 					block_cache(int fd, off_t numBlocks, size_t blockSize,
 						bool readOnly);
 					~block_cache();
@@ -256,6 +356,11 @@ struct block_cache : DoublyLinkedListLinkImpl<block_cache> {
 	void			RemoveBlock(cached_block* block);
 	void			DiscardBlock(cached_block* block);
 
+	status_t		StartWriter();
+	void			StopWriter();
+	void			TransactionEnded();
+	void			SyncDone(bigtime_t startTime);
+
 private:
 	static void		_LowMemoryHandler(void* data, uint32 resources,
 						int32 level);
@@ -303,6 +408,8 @@ public:
 private:
 			void*				_Data(cached_block* block) const;
 			status_t			_WriteBlock(cached_block* block);
+			status_t			_WriteBlocks(cached_block** blocks,
+									uint32 count);
 			void				_BlockDone(cached_block* block,
 									cache_transaction* transaction);
 			void				_UnmarkWriting(cached_block* block);
@@ -322,6 +429,7 @@ private:
 			size_t				fMax;
 			status_t			fStatus;
 			bool				fDeletedTransaction;
+			uint32				fRequests;
 };
 
 
@@ -769,11 +877,13 @@ static size_t sUsedMemory;
 static sem_id sEventSemaphore;
 static mutex sNotificationsLock
 	= MUTEX_INITIALIZER("block cache notifications");
-static thread_id sNotifierWriterThread;
+static thread_id sNotifierThread;
 static DoublyLinkedListLink<block_cache> sMarkCache;
 	// TODO: this only works if the link is the first entry of block_cache
 static object_cache* sBlockCache;
 
+static status_t block_writer(void* _cache);
+
 
 //	#pragma mark - notifications/listener
 
@@ -1101,7 +1211,8 @@ BlockWriter::BlockWriter(block_cache* cache, size_t max)
 	fCapacity(kBufferSize),
 	fMax(max),
 	fStatus(B_OK),
-	fDeletedTransaction(false)
+	fDeletedTransaction(false),
+	fRequests(0)
 {
 }
 
@@ -1212,17 +1323,39 @@ BlockWriter::Write(cache_transaction* transaction, bool canUnlock)
 	fDeletedTransaction = false;
 
 	bigtime_t start = system_time();
+	uint32 blocksWritten = 0;
+	fRequests = 0;
+
+	for (uint32 i = 0; i < fCount;) {
+		// Coalesce consecutive blocks into a single vectored write
+		uint32 count = 1;
+		while (i + count < fCount && count < kMaxWriteRunBlocks
+			&& fBlocks[i + count]->block_number
+				== fBlocks[i]->block_number + count) {
+			count++;
+		}
 
-	for (uint32 i = 0; i < fCount; i++) {
-		status_t status = _WriteBlock(fBlocks[i]);
-		if (status != B_OK) {
-			// propagate to global error handling
-			if (fStatus == B_OK)
-				fStatus = status;
+		if (count > 1 && _WriteBlocks(fBlocks + i, count) == B_OK) {
+			blocksWritten += count;
+			i += count;
+			continue;
+		}
 
-			_UnmarkWriting(fBlocks[i]);
-			fBlocks[i] = NULL;
-				// This block will not be marked clean
+		// Either this is a single block, or the combined write failed; in the
+		// latter case, retry block by block, so that an error only affects
+		// the blocks that actually could not be written.
+		for (uint32 end = i + count; i < end; i++) {
+			status_t status = _WriteBlock(fBlocks[i]);
+			if (status != B_OK) {
+				// propagate to global error handling
+				if (fStatus == B_OK)
+					fStatus = status;
+
+				_UnmarkWriting(fBlocks[i]);
+				fBlocks[i] = NULL;
+					// This block will not be marked clean
+			} else
+				blocksWritten++;
 		}
 	}
 
@@ -1231,6 +1364,9 @@ BlockWriter::Write(cache_transaction* transaction, bool canUnlock)
 	if (canUnlock)
 		mutex_lock(&fCache->lock);
 
+	fCache->write_requests += fRequests;
+	fCache->blocks_written += blocksWritten;
+
 	if (fStatus == B_OK && fCount >= 8) {
 		fCache->last_block_write = finish;
 		fCache->last_block_write_duration = (fCache->last_block_write - start)
@@ -1283,6 +1419,7 @@ BlockWriter::_WriteBlock(cached_block* block)
 
 	ssize_t written = write_pos(fCache->fd,
 		block->block_number * blockSize, _Data(block), blockSize);
+	fRequests++;
 
 	if (written != (ssize_t)blockSize) {
 		TB(Error(fCache, block->block_number, "write failed", written));
@@ -1298,6 +1435,46 @@ BlockWriter::_WriteBlock(cached_block* block)
 }
 
 
+/*!	Writes back \a count blocks that must be consecutive on disk with a single
+	vectored write request. Errors are not reported to the global error
+	handling, as the caller will retry the blocks one by one.
+*/
+status_t
+BlockWriter::_WriteBlocks(cached_block** blocks, uint32 count)
+{
+	ASSERT(count <= kMaxWriteRunBlocks);
+
+	TRACE(("BlockWriter::_WriteBlocks(block %" B_PRIdOFF ", count %" B_PRIu32
+		")\n", blocks[0]->block_number, count));
+
+	size_t blockSize = fCache->block_size;
+	iovec vecs[kMaxWriteRunBlocks];
+
+	for (uint32 i = 0; i < count; i++) {
+		ASSERT(blocks[i]->busy_writing);
+		TB(Write(fCache, blocks[i]));
+		TB2(BlockData(fCache, blocks[i], "before write"));
+
+		vecs[i].iov_base = _Data(blocks[i]);
+		vecs[i].iov_len = blockSize;
+	}
+
+	ssize_t written = writev_pos(fCache->fd,
+		blocks[0]->block_number * blockSize, vecs, count);
+	fRequests++;
+
+	if (written != (ssize_t)(blockSize * count)) {
+		TB(Error(fCache, blocks[0]->block_number, "write failed", written));
+		if (written < 0)
+			return errno;
+
+		return B_IO_ERROR;
+	}
+
+	return B_OK;
+}
+
+
 void
 BlockWriter::_BlockDone(cached_block* block,
 	cache_transaction* transaction)
@@ -1391,6 +1568,161 @@ BlockWriter::_CompareBlocks(const void* _blockA, const void* _blockB)
 }
 
 
+//	#pragma mark - BlockTable
+
+
+BlockTable::BlockTable()
+{
+	for (uint32 i = 0; i < kBlockShards; i++)
+		mutex_init(&fShards[i].lock, "block cache shard");
+}
+
+
+BlockTable::~BlockTable()
+{
+	for (uint32 i = 0; i < kBlockShards; i++)
+		mutex_destroy(&fShards[i].lock);
+}
+
+
+status_t
+BlockTable::Init(size_t initialSize)
+{
+	for (uint32 i = 0; i < kBlockShards; i++) {
+		status_t status = fShards[i].table.Init(
+			max_c(initialSize / kBlockShards, 8));
+		if (status != B_OK)
+			return status;
+	}
+
+	return B_OK;
+}
+
+
+cached_block*
+BlockTable::Lookup(off_t blockNumber) const
+{
+	return const_cast<BlockTable*>(this)->_ShardFor(blockNumber).table.Lookup(
+		blockNumber);
+}
+
+
+/*!	The cache must be locked. */
+void
+BlockTable::Insert(cached_block* block)
+{
+	shard& shard = _ShardFor(block->block_number);
+	MutexLocker _(shard.lock);
+	shard.table.Insert(block);
+}
+
+
+/*!	The cache must be locked. */
+void
+BlockTable::Remove(cached_block* block)
+{
+	shard& shard = _ShardFor(block->block_number);
+	MutexLocker _(shard.lock);
+	shard.table.Remove(block);
+}
+
+
+/*!	Removes all blocks, and returns them as a list linked via their
+	cached_block::next member.
+	The cache must be locked, and must not be used by anyone else anymore.
+*/
+cached_block*
+BlockTable::Clear()
+{
+	cached_block* first = NULL;
+
+	for (uint32 i = 0; i < kBlockShards; i++) {
+		cached_block* block = fShards[i].table.Clear(true);
+		while (block != NULL) {
+			cached_block* next = block->next;
+			block->next = first;
+			first = block;
+			block = next;
+		}
+	}
+
+	return first;
+}
+
+
+/*!	Changes the busy reading state of the \a block; this has to be done with
+	the shard locked, so that Acquire() won't hand out the block while it is
+	being changed. The cache must be locked.
+*/
+void
+BlockTable::SetBusyReading(cached_block* block, bool busy)
+{
+	MutexLocker _(_ShardFor(block->block_number).lock);
+	block->busy_reading = busy;
+}
+
+
+/*!	Adds a reference to the block \a blockNumber, but only if it is already
+	in use, and not busy. Returns \c NULL if that's not the case, and the
+	caller will need to use get_cached_block() instead.
+	The cache does not need to be locked.
+*/
+cached_block*
+BlockTable::Acquire(off_t blockNumber)
+{
+	shard& shard = _ShardFor(blockNumber);
+	MutexLocker _(shard.lock);
+
+	cached_block* block = shard.table.Lookup(blockNumber);
+	if (block == NULL || block->busy_reading)
+		return NULL;
+
+	// A block without references may be in the unused list, or about to be
+	// freed, so only the cache lock may revive it
+	int32 count = atomic_get(&block->ref_count);
+	while (count > 0) {
+		int32 previous = atomic_test_and_set(&block->ref_count, count + 1,
+			count);
+		if (previous == count) {
+			block->last_accessed = system_time() / 1000000L;
+			return block;
+		}
+		count = previous;
+	}
+
+	return NULL;
+}
+
+
+/*!	Removes a reference from the block \a blockNumber, unless it is the last
+	one, as that may require moving the block to the unused list. Returns
+	\c false in that case, and the caller will need to use put_cached_block()
+	instead.
+	The cache does not need to be locked.
+*/
+bool
+BlockTable::Release(off_t blockNumber)
+{
+	shard& shard = _ShardFor(blockNumber);
+	MutexLocker _(shard.lock);
+
+	cached_block* block = shard.table.Lookup(blockNumber);
+	if (block == NULL)
+		return false;
+
+	int32 count = atomic_get(&block->ref_count);
+	while (count > 1) {
+		int32 previous = atomic_test_and_set(&block->ref_count, count - 1,
+			count);
+		if (previous == count)
+			return true;
+		count = previous;
+	}
+
+	return false;
+}
+
+
 //	#pragma mark - block_cache
 
 
@@ -1413,7 +1745,15 @@ block_cache::block_cache(int _fd, off_t numBlocks, size_t blockSize,
 	last_block_write(0),
 	last_block_write_duration(0),
 	num_dirty_blocks(0),
-	read_only(readOnly)
+	read_only(readOnly),
+	writer_thread(-1),
+	writer_batch(0),
+	writer_quit(false),
+	write_requests(0),
+	blocks_written(0),
+	sync_count(0),
+	sync_time_total(0),
+	sync_time_max(0)
 {
 }
 
@@ -1438,6 +1778,7 @@ block_cache::Init()
 	busy_reading_condition.Init(this, "cache block busy_reading");
 	busy_writing_condition.Init(this, "cache block busy writing");
 	condition_variable.Init(this, "cache transaction sync");
+	writer_condition.Init(this, "block cache writer");
 	mutex_init(&lock, "block cache");
 
 	buffer_cache = create_object_cache_etc("block cache buffers", block_size,
@@ -1632,6 +1973,74 @@ block_cache::DiscardBlock(cached_block* block)
 }
 
 
+/*!	Starts the background writer thread of this cache. Read-only caches do
+	not get one.
+*/
+status_t
+block_cache::StartWriter()
+{
+	if (read_only)
+		return B_OK;
+
+	writer_thread = spawn_kernel_thread(&block_writer, "block writer",
+		B_LOW_PRIORITY, this);
+	if (writer_thread < 0)
+		return writer_thread;
+
+	resume_thread(writer_thread);
+	return B_OK;
+}
+
+
+/*!	Stops the background writer thread, and waits until it is gone.
+	Must be called without the cache's lock held.
+*/
+void
+block_cache::StopWriter()
+{
+	if (writer_thread < 0)
+		return;
+
+	mutex_lock(&lock);
+	writer_quit = true;
+	writer_condition.NotifyAll();
+	mutex_unlock(&lock);
+
+	status_t result;
+	wait_for_thread(writer_thread, &result);
+	writer_thread = -1;
+}
+
+
+/*!	Called when a transaction has been closed. After a batch of transactions
+	has been ended, the writer is woken up early, so that their blocks are
+	written back in one go, and the log space they occupy is released early.
+	Must be called with the cache's lock held.
+*/
+void
+block_cache::TransactionEnded()
+{
+	if (++writer_batch == kWriterBatchTransactions)
+		writer_condition.NotifyOne();
+}
+
+
+/*!	Accounts a completed synchronous write back that was started at
+	\a startTime. Must be called without the cache's lock held.
+*/
+void
+block_cache::SyncDone(bigtime_t startTime)
+{
+	bigtime_t duration = system_time() - startTime;
+
+	MutexLocker _(lock);
+	sync_count++;
+	sync_time_total += duration;
+	if (duration > sync_time_max)
+		sync_time_max = duration;
+}
+
+
 void
 block_cache::_LowMemoryHandler(void* data, uint32 resources, int32 level)
 {
@@ -1723,7 +2132,7 @@ block_cache::_GetUnusedBlock()
 static void
 mark_block_busy_reading(block_cache* cache, cached_block* block)
 {
-	block->busy_reading = true;
+	cache->hash->SetBusyReading(block, true);
 	cache->busy_reading_count++;
 }
 
@@ -1733,7 +2142,7 @@ mark_block_busy_reading(block_cache* cache, cached_block* block)
 static void
 mark_block_unbusy_reading(block_cache* cache, cached_block* block)
 {
-	block->busy_reading = false;
+	cache->hash->SetBusyReading(block, false);
 	cache->busy_reading_count--;
 
 	if ((cache->busy_reading_waiters && cache->busy_reading_count == 0)
@@ -1854,7 +2263,7 @@ put_cached_block(block_cache* cache, cached_block* block)
 		return;
 	}
 
-	if (--block->ref_count == 0
+	if (atomic_add(&block->ref_count, -1) == 1
 		&& block->transaction == NULL && block->previous_transaction == NULL) {
 		// This block is not used anymore, and not part of any transaction
 		block->is_writing = false;
@@ -1963,7 +2372,7 @@ retry:
 		mark_block_unbusy_reading(cache, block);
 	}
 
-	block->ref_count++;
+	atomic_add(&block->ref_count, 1);
 	block->last_accessed = system_time() / 1000000L;
 
 	*_block = block;
@@ -2262,6 +2671,16 @@ dump_cache(int argc, char** argv)
 		cache->busy_reading_waiters ? "has" : "no");
 	kprintf(" busy_writing: %" B_PRIu32 ", %s waiters\n", cache->busy_writing_count,
 		cache->busy_writing_waiters ? "has" : "no");
+	kprintf(" writer:       %" B_PRId32 ", %" B_PRIu32 " ended transactions\n",
+		cache->writer_thread, cache->writer_batch);
+	kprintf(" writes:       %" B_PRIu64 " requests, %" B_PRIu64 " blocks, %"
+		B_PRIu64 " blocks per write\n", cache->write_requests,
+		cache->blocks_written, cache->write_requests > 0
+			? cache->blocks_written / cache->write_requests : 0);
+	kprintf(" syncs:        %" B_PRIu32 ", latency avg %" B_PRIdBIGTIME
+		" us, max %" B_PRIdBIGTIME " us\n", cache->sync_count,
+		cache->sync_count > 0 ? cache->sync_time_total / cache->sync_count : 0,
+		cache->sync_time_max);
 
 	if (!cache->pending_notifications.IsEmpty()) {
 		kprintf(" pending notifications:\n");
@@ -2558,10 +2977,11 @@ get_next_locked_block_cache(block_cache* last)
 
 /*!	Background thread that continuously checks for pending notifications of
 	all caches.
-	Every two seconds, it will also write back up to 64 blocks per cache.
+	Every two seconds, it will also update the memory usage of the caches, and
+	trim them if they use too much memory.
 */
 static status_t
-block_notifier_and_writer(void* /*data*/)
+block_notifier(void* /*data*/)
 {
 	const bigtime_t kDefaultTimeout = 2000000LL;
 	bigtime_t timeout = kDefaultTimeout;
@@ -2577,82 +2997,16 @@ block_notifier_and_writer(void* /*data*/)
 			continue;
 		}
 
-		// Write 64 blocks of each block_cache roughly every 2 seconds,
-		// potentially more or less depending on congestion and drive speeds
-		// (usually much less.) We do not want to queue everything at once
-		// because a future transaction might then get held up waiting for
-		// a specific block to be written.
 		timeout = kDefaultTimeout;
 		size_t usedMemory;
 		object_cache_get_usage(sBlockCache, &usedMemory);
 
 		block_cache* cache = NULL;
 		while ((cache = get_next_locked_block_cache(cache)) != NULL) {
-			// Give some breathing room: wait 2x the length of the potential
-			// maximum block count-sized write between writes, and also skip
-			// if there are more than 16 blocks currently being written.
-			const bigtime_t next = cache->last_block_write
-					+ cache->last_block_write_duration * 2 * 64;
-			if (cache->busy_writing_count > 16 || system_time() < next) {
-				if (cache->last_block_write_duration > 0) {
-					timeout = min_c(timeout,
-						cache->last_block_write_duration * 2 * 64);
-				}
-				continue;
-			}
-
-			BlockWriter writer(cache, 64);
-			bool hasMoreBlocks = false;
-
 			size_t cacheUsedMemory;
 			object_cache_get_usage(cache->buffer_cache, &cacheUsedMemory);
 			usedMemory += cacheUsedMemory;
 
-			if (cache->num_dirty_blocks) {
-				// This cache is not using transactions, we'll scan the blocks
-				// directly
-				BlockTable::Iterator iterator(cache->hash);
-
-				while (iterator.HasNext()) {
-					cached_block* block = iterator.Next();
-					if (block->CanBeWritten() && !writer.Add(block)) {
-						hasMoreBlocks = true;
-						break;
-					}
-				}
-			} else {
-				TransactionTable::Iterator iterator(cache->transaction_hash);
-
-				while (iterator.HasNext()) {
-					cache_transaction* transaction = iterator.Next();
-					if (transaction->open) {
-						if (system_time() > transaction->last_used
-								+ kTransactionIdleTime) {
-							// Transaction is open but idle
-							notify_transaction_listeners(cache, transaction,
-								TRANSACTION_IDLE);
-						}
-						continue;
-					}
-
-					bool hasLeftOvers;
-						// we ignore this one
-					if (!writer.Add(transaction, hasLeftOvers)) {
-						hasMoreBlocks = true;
-						break;
-					}
-				}
-			}
-
-			writer.Write();
-
-			if (hasMoreBlocks && cache->last_block_write_duration > 0) {
-				// There are probably still more blocks that we could write, so
-				// see if we can decrease the timeout.
-				timeout = min_c(timeout,
-					cache->last_block_write_duration * 2 * 64);
-			}
-
 			if ((block_cache_used_memory() / B_PAGE_SIZE)
 					> vm_page_num_pages() / 2) {
 				// Try to reduce memory usage to half of the available
@@ -2670,6 +3024,119 @@ block_notifier_and_writer(void* /*data*/)
 }
 
 
+/*!	Collects the blocks the writer of \a cache should write back next, and
+	writes them. Returns the time the writer should wait before the next run.
+	Must be called with the cache's lock held; it will be unlocked while the
+	blocks are written.
+*/
+static bigtime_t
+write_back_cache(block_cache* cache)
+{
+	bigtime_t timeout = kWriterTimeout;
+
+	// Give some breathing room: wait 2x the length of the potential
+	// maximum block count-sized write between writes, and also skip
+	// if there are more than 16 blocks currently being written.
+	const bigtime_t next = cache->last_block_write
+			+ cache->last_block_write_duration * 2 * 64;
+	if (cache->busy_writing_count > 16 || system_time() < next) {
+		if (cache->last_block_write_duration > 0) {
+			timeout = min_c(timeout,
+				cache->last_block_write_duration * 2 * 64);
+		}
+		return timeout;
+	}
+
+	BlockWriter writer(cache, 64);
+	bool hasMoreBlocks = false;
+
+	if (cache->num_dirty_blocks) {
+		// This cache is not using transactions, we'll scan the blocks
+		// directly
+		BlockTable::Iterator iterator(cache->hash);
+
+		while (iterator.HasNext()) {
+			cached_block* block = iterator.Next();
+			if (block->CanBeWritten() && !writer.Add(block)) {
+				hasMoreBlocks = true;
+				break;
+			}
+		}
+	} else {
+		TransactionTable::Iterator iterator(cache->transaction_hash);
+
+		while (iterator.HasNext()) {
+			cache_transaction* transaction = iterator.Next();
+			if (transaction->open) {
+				if (system_time() > transaction->last_used
+						+ kTransactionIdleTime) {
+					// Transaction is open but idle
+					notify_transaction_listeners(cache, transaction,
+						TRANSACTION_IDLE);
+				}
+				continue;
+			}
+
+			bool hasLeftOvers;
+				// we ignore this one
+			if (!writer.Add(transaction, hasLeftOvers)) {
+				hasMoreBlocks = true;
+				break;
+			}
+		}
+	}
+
+	writer.Write();
+
+	if (hasMoreBlocks && cache->last_block_write_duration > 0) {
+		// There are probably still more blocks that we could write, so
+		// see if we can decrease the timeout.
+		timeout = min_c(timeout, cache->last_block_write_duration * 2 * 64);
+	}
+
+	return timeout;
+}
+
+
+/*!	Background thread that writes back the blocks of a single cache.
+	Roughly every two seconds, or when woken up after a batch of transactions
+	has been ended, it will write back up to 64 blocks, potentially more or
+	less often depending on congestion and drive speeds. We do not want to
+	queue everything at once because a future transaction might then get held
+	up waiting for a specific block to be written.
+	Since every cache has its own writer, a slow device does not delay the
+	write back of the others.
+*/
+static status_t
+block_writer(void* _cache)
+{
+	block_cache* cache = (block_cache*)_cache;
+	bigtime_t timeout = kWriterTimeout;
+
+	MutexLocker locker(cache->lock);
+
+	while (true) {
+		if (!cache->writer_quit
+			&& cache->writer_batch < kWriterBatchTransactions) {
+			ConditionVariableEntry entry;
+			cache->writer_condition.Add(&entry);
+
+			locker.Unlock();
+			entry.Wait(B_RELATIVE_TIMEOUT, timeout);
+			locker.Lock();
+		}
+
+		if (cache->writer_quit)
+			break;
+
+		cache->writer_batch = 0;
+		timeout = write_back_cache(cache);
+	}
+
+	return B_OK;
+}
+
+
 /*!	Notify function for wait_for_notifications(). */
 static void
 notify_sync(int32 transactionID, int32 event, void* _cache)
@@ -2705,7 +3172,7 @@ wait_for_notifications(block_cache* cache)
 {
 	MutexLocker locker(sCachesLock);
 
-	if (find_thread(NULL) == sNotifierWriterThread) {
+	if (find_thread(NULL) == sNotifierThread) {
 		// We're the notifier thread, don't wait, but flush all pending
 		// notifications directly.
 		if (is_valid_cache(cache))
@@ -2749,10 +3216,10 @@ block_cache_init(void)
 	if (sEventSemaphore < B_OK)
 		return sEventSemaphore;
 
-	sNotifierWriterThread = spawn_kernel_thread(&block_notifier_and_writer,
-		"block notifier/writer", B_LOW_PRIORITY, NULL);
-	if (sNotifierWriterThread >= B_OK)
-		resume_thread(sNotifierWriterThread);
+	sNotifierThread = spawn_kernel_thread(&block_notifier,
+		"block notifier", B_LOW_PRIORITY, NULL);
+	if (sNotifierThread >= B_OK)
+		resume_thread(sNotifierThread);
 
 #if DEBUG_BLOCK_CACHE
 	add_debugger_command_etc("block_caches", &dump_caches,
@@ -2833,6 +3300,8 @@ cache_sync_transaction(void* _cache, int32 id)
 
 	TRACE(("cache_sync_transaction(id %" B_PRId32 ")\n", id));
 
+	bigtime_t startTime = system_time();
+
 	do {
 		TransactionLocker locker(cache);
 		hadBusy = false;
@@ -2871,6 +3340,8 @@ cache_sync_transaction(void* _cache, int32 id)
 	wait_for_notifications(cache);
 		// make sure that all pending TRANSACTION_WRITTEN notifications
 		// are handled after we return
+
+	cache->SyncDone(startTime);
 	return B_OK;
 }
 
@@ -2938,6 +3409,7 @@ cache_end_transaction(void* _cache, int32 id,
 	}
 
 	transaction->open = false;
+	cache->TransactionEnded();
 	return B_OK;
 }
 
@@ -3412,6 +3884,8 @@ block_cache_delete(void* _cache, bool allowWrites)
 	if (allowWrites)
 		block_cache_sync(cache);
 
+	cache->StopWriter();
+
 	mutex_lock(&sCachesLock);
 	sCaches.Remove(cache);
 	mutex_unlock(&sCachesLock);
@@ -3424,7 +3898,7 @@ block_cache_delete(void* _cache, bool allowWrites)
 
 	// free all blocks
 
-	cached_block* block = cache->hash->Clear(true);
+	cached_block* block = cache->hash->Clear();
 	while (block != NULL) {
 		cached_block* next = block->next;
 		cache->FreeBlock(block);
@@ -3452,7 +3926,7 @@ block_cache_create(int fd, off_t numBlocks, size_t blockSize, bool readOnly)
 	if (cache == NULL)
 		return NULL;
 
-	if (cache->Init() != B_OK) {
+	if (cache->Init() != B_OK || cache->StartWriter() != B_OK) {
 		delete cache;
 		return NULL;
 	}
@@ -3472,6 +3946,7 @@ block_cache_sync(void* _cache)
 	// We will sync all dirty blocks to disk that have a completed
 	// transaction or no transaction only
 
+	bigtime_t startTime = system_time();
 	MutexLocker locker(&cache->lock);
 
 	BlockWriter writer(cache);
@@ -3490,6 +3965,8 @@ block_cache_sync(void* _cache)
 	wait_for_notifications(cache);
 		// make sure that all pending TRANSACTION_WRITTEN notifications
 		// are handled after we return
+
+	cache->SyncDone(startTime);
 	return status;
 }
 
@@ -3509,6 +3986,7 @@ block_cache_sync_etc(void* _cache, off_t blockNumber, size_t numBlocks)
 		return B_BAD_VALUE;
 	}
 
+	bigtime_t startTime = system_time();
 	MutexLocker locker(&cache->lock);
 	BlockWriter writer(cache);
 
@@ -3528,6 +4006,8 @@ block_cache_sync_etc(void* _cache, off_t blockNumber, size_t numBlocks)
 	wait_for_notifications(cache);
 		// make sure that all pending TRANSACTION_WRITTEN notifications
 		// are handled after we return
+
+	cache->SyncDone(startTime);
 	return status;
 }
 
@@ -3661,10 +4141,22 @@ block_cache_get_etc(void* _cache, off_t blockNumber, off_t base, off_t length,
 	const void** _block)
 {
 	block_cache* cache = (block_cache*)_cache;
+
+#if !BLOCK_CACHE_DEBUG_CHANGED
+	// Try to get an additional reference to a block already in use first
+	cached_block* block = cache->hash->Acquire(blockNumber);
+	if (block != NULL) {
+		TB(Get(cache, block));
+		*_block = block->current_data;
+		return B_OK;
+	}
+#else
+	cached_block* block;
+#endif
+
 	MutexLocker locker(&cache->lock);
 	bool allocated;
 
-	cached_block* block;
 	status_t status = get_cached_block(cache, blockNumber, &allocated, true,
 		&block);
 	if (status != B_OK)
@@ -3729,6 +4221,12 @@ void
 block_cache_put(void* _cache, off_t blockNumber)
 {
 	block_cache* cache = (block_cache*)_cache;
+
+#if !BLOCK_CACHE_DEBUG_CHANGED
+	if (cache->hash->Release(blockNumber))
+		return;
+#endif
+
 	MutexLocker locker(&cache->lock);
 
 	put_cached_block(cache, blockNumber);
@@ -19,6 +19,7 @@
 #include <low_resource_manager.h>
 #include <thread.h>
 #include <util/AutoLock.h>
+#include <util/OpenHashTable.h>
 #include <util/kernel_cpp.h>
 #include <vfs.h>
 #include <vm/vm.h>
@@ -41,6 +42,13 @@
 #define BYPASS_IO_SIZE		65536
 #define LAST_ACCESSES		3
 
+// writers are throttled in between chunks of this size
+#define WRITE_BALANCE_CHUNK_SIZE	(256 * B_PAGE_SIZE)	// 1 MB
+
+// pages around the last write position that are considered for write-back
+// when a writer is throttled
+#define WRITE_BALANCE_PAGES			1024
+
 struct file_cache_ref {
 	VMCache			*cache;
 	struct vnode	*vnode;
@@ -96,6 +104,53 @@ private:
 #endif
 };
 
+/*!	Dirty page accounting for all files of a device (ie. a mounted volume).
+	The counters are maintained by the VM whenever a page of one of the
+	device's file caches enters or leaves the modified state, and whenever
+	one of them has been written back.
+	The write-back rate is sampled by whoever holds \c sampling; all fields
+	but the hash link and the reference count are accessed atomically.
+*/
+struct file_cache_device {
+	file_cache_device*	hash_link;
+	dev_t				device;
+	int32				ref_count;
+	int32				dirty_pages;
+	int32				written_pages;
+		// pages written back since the last sample
+	int32				write_back_rate;
+		// pages per second, smoothed; 0 if unknown yet
+	int32				sampling;
+	bigtime_t			last_sample;
+};
+
+struct FileCacheDeviceHashDefinition {
+	typedef dev_t				KeyType;
+	typedef	file_cache_device	ValueType;
+
+	size_t HashKey(dev_t key) const
+	{
+		return key;
+	}
+
+	size_t Hash(file_cache_device* value) const
+	{
+		return HashKey(value->device);
+	}
+
+	bool Compare(dev_t key, file_cache_device* value) const
+	{
+		return value->device == key;
+	}
+
+	file_cache_device*& GetLink(file_cache_device* value) const
+	{
+		return value->hash_link;
+	}
+};
+
+typedef BOpenHashTable<FileCacheDeviceHashDefinition> FileCacheDeviceTable;
+
 typedef status_t (*cache_func)(file_cache_ref* ref, void* cookie, off_t offset,
 	int32 pageOffset, addr_t buffer, size_t bufferSize, bool useBuffer,
 	vm_page_reservation* reservation, size_t reservePages);
@@ -112,6 +167,18 @@ static const size_t kZeroVecSize = kZeroVecCount * B_PAGE_SIZE;
 static phys_addr_t sZeroPage;
 static generic_io_vec sZeroVecs[kZeroVecCount];
 
+static FileCacheDeviceTable sDevices;
+static mutex sDevicesLock = MUTEX_INITIALIZER("file cache devices");
+static int32 sDirtyPages;
+	// dirty pages of all devices
+static cache_write_back_limits sWriteBackLimits = {
+	20,		// dirty_ratio
+	5,		// device_dirty_seconds
+	2048,	// device_min_dirty_pages
+	100,	// max_writer_pause
+	64		// cluster_pages
+};
+
 
 //	#pragma mark -
 
@@ -281,6 +348,157 @@ push_access(file_cache_ref* ref, off_t offset, generic_size_t bytes,
 }
 
 
+static file_cache_device*
+acquire_device(dev_t device)
+{
+	MutexLocker locker(sDevicesLock);
+
+	file_cache_device* info = sDevices.Lookup(device);
+	if (info == NULL) {
+		info = new(std::nothrow) file_cache_device;
+		if (info == NULL)
+			return NULL;
+
+		info->device = device;
+		info->ref_count = 0;
+		info->dirty_pages = 0;
+		info->written_pages = 0;
+		info->write_back_rate = 0;
+		info->sampling = 0;
+		info->last_sample = system_time();
+
+		if (sDevices.Insert(info) != B_OK) {
+			delete info;
+			return NULL;
+		}
+	}
+
+	info->ref_count++;
+	return info;
+}
+
+
+static uint32
+global_dirty_limit()
+{
+	return (uint64)vm_page_num_pages() * sWriteBackLimits.dirty_ratio / 100;
+}
+
+
+/*!	Returns the number of dirty pages the \a device may have. This depends
+	on how fast the device has been able to write back its pages recently: it
+	should not lag behind more than \c device_dirty_seconds. As long as its
+	speed is unknown, the global limit applies.
+*/
+static uint32
+device_dirty_limit(file_cache_device* device, uint32 globalLimit)
+{
+	bigtime_t now = system_time();
+	bigtime_t elapsed = now - atomic_get64(&device->last_sample);
+
+	if (elapsed >= 1000000 && atomic_get_and_set(&device->sampling, 1) == 0) {
+		// another writer might have taken the sample in the mean time
+		elapsed = now - atomic_get64(&device->last_sample);
+		if (elapsed >= 1000000) {
+			int32 written = atomic_get_and_set(&device->written_pages, 0);
+			if (written > 0) {
+				// Only take samples while write-back happens, so that idle
+				// times don't count as slowness
+				int32 rate = (int64)written * 1000000 / elapsed;
+				int32 previousRate = atomic_get(&device->write_back_rate);
+				if (previousRate != 0)
+					rate = (3 * previousRate + rate) / 4;
+				atomic_set(&device->write_back_rate, rate);
+			}
+
+			atomic_set64(&device->last_sample, now);
+		}
+		atomic_set(&device->sampling, 0);
+	}
+
+	int32 rate = atomic_get(&device->write_back_rate);
+	if (rate == 0)
+		return globalLimit;
+
+	uint64 limit = (uint64)rate * sWriteBackLimits.device_dirty_seconds;
+	if (limit < sWriteBackLimits.device_min_dirty_pages)
+		limit = sWriteBackLimits.device_min_dirty_pages;
+	if (limit > globalLimit)
+		limit = globalLimit;
+
+	return limit;
+}
+
+
+/*!	Returns how far \a dirty is beyond the background write-back threshold,
+	which is half of \a limit, in units of 1/1024 of the remaining distance
+	to the \a limit.
+*/
+static inline uint32
+dirty_excess(int32 dirty, uint32 limit)
+{
+	uint32 threshold = limit / 2;
+	if (dirty <= 0 || (uint32)dirty <= threshold)
+		return 0;
+
+	return (uint64)(dirty - threshold) * 1024 / max_c(limit - threshold, 1);
+}
+
+
+/*!	Throttles a writer whose device has more dirty pages than it can write
+	back in time, or when too much memory is dirty in total.
+	Beyond the background threshold, the page writer is asked to write back
+	the file, and the writer is paused in proportion to the excess. Beyond the
+	limit, the writer has to write back the pages it dirtied itself. Writers to
+	other, faster devices are not slowed down this way.
+	The cache must not be locked.
+*/
+static void
+balance_dirty_pages(file_cache_ref* ref)
+{
+	file_cache_device* device
+		= ((VMVnodeCache*)ref->cache)->FileCacheDevice();
+	if (device == NULL)
+		return;
+
+	uint32 globalLimit = global_dirty_limit();
+	uint32 excess = max_c(
+		dirty_excess(atomic_get(&device->dirty_pages),
+			device_dirty_limit(device, globalLimit)),
+		dirty_excess(atomic_get(&sDirtyPages), globalLimit));
+	if (excess == 0)
+		return;
+
+	VMCache* cache = ref->cache;
+	AutoLocker<VMCache> locker(cache);
+
+	uint32 endPage = (cache->virtual_end + B_PAGE_SIZE - 1) >> PAGE_SHIFT;
+	uint32 firstPage = 0;
+	if (access_is_sequential(ref)) {
+		// concentrate on the pages just written
+		int32 previous = ref->last_access_index - 1;
+		if (previous < 0)
+			previous = LAST_ACCESSES - 1;
+
+		endPage = min_c(endPage,
+			ref->LastAccessPageOffset(previous, true) + 1);
+		if (endPage > WRITE_BALANCE_PAGES)
+			firstPage = endPage - WRITE_BALANCE_PAGES;
+	}
+
+	if (excess >= 1024) {
+		// Write back our pages ourselves, at the speed of the device
+		vm_page_write_modified_page_range(cache, firstPage, endPage);
+		return;
+	}
+
+	vm_page_schedule_write_page_range(cache, firstPage, endPage);
+	locker.Unlock();
+
+	snooze((bigtime_t)sWriteBackLimits.max_writer_pause * 1000 * excess / 1024);
+}
+
+
 static void
 reserve_pages(file_cache_ref* ref, vm_page_reservation* reservation,
 	size_t reservePages, bool isWrite)
@@ -941,6 +1159,35 @@ file_cache_control(const char* subsystem, uint32 function, void* buffer,
 
 			return status;
 		}
+
+		case CACHE_GET_WRITE_BACK_LIMITS:
+			if (bufferSize != sizeof(cache_write_back_limits))
+				return B_BAD_VALUE;
+			if (!IS_USER_ADDRESS(buffer)
+				|| user_memcpy(buffer, &sWriteBackLimits,
+						sizeof(cache_write_back_limits)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return B_OK;
+
+		case CACHE_SET_WRITE_BACK_LIMITS:
+		{
+			cache_write_back_limits limits;
+			if (bufferSize != sizeof(cache_write_back_limits))
+				return B_BAD_VALUE;
+			if (!IS_USER_ADDRESS(buffer)
+				|| user_memcpy(&limits, buffer,
+						sizeof(cache_write_back_limits)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			if (limits.dirty_ratio == 0 || limits.dirty_ratio > 90
+				|| limits.device_dirty_seconds == 0
+				|| limits.cluster_pages == 0 || limits.cluster_pages > 256)
+				return B_BAD_VALUE;
+
+			sWriteBackLimits = limits;
+			return B_OK;
+		}
 	}
 
 	return B_BAD_HANDLER;
@@ -1125,11 +1372,52 @@ file_cache_init(void)
 		sZeroVecs[i].length = B_PAGE_SIZE;
 	}
 
+	status_t status = sDevices.Init();
+	if (status != B_OK)
+		return status;
+
 	register_generic_syscall(CACHE_SYSCALLS, file_cache_control, 1, 0);
 	return B_OK;
 }
 
 
+extern "C" void
+file_cache_device_pages_modified(file_cache_device* device, int32 count)
+{
+	atomic_add(&device->dirty_pages, count);
+	atomic_add(&sDirtyPages, count);
+}
+
+
+extern "C" void
+file_cache_device_pages_written(file_cache_device* device, int32 count)
+{
+	atomic_add(&device->written_pages, count);
+}
+
+
+extern "C" void
+file_cache_put_device(file_cache_device* device)
+{
+	MutexLocker locker(sDevicesLock);
+
+	if (--device->ref_count > 0)
+		return;
+
+	sDevices.Remove(device);
+	locker.Unlock();
+
+	delete device;
+}
+
+
+extern "C" uint32
+file_cache_write_back_cluster_pages(void)
+{
+	return sWriteBackLimits.cluster_pages;
+}
+
+
 //	#pragma mark - public FS API
 
 
@@ -1168,6 +1456,24 @@ file_cache_create(dev_t mountID, ino_t vnodeID, off_t size)
 
 	ref->cache->virtual_end = size;
 	((VMVnodeCache*)ref->cache)->SetFileCacheRef(ref);
+
+	{
+		// Dirty pages are only accounted to the device if the cache has not
+		// been in use before
+		file_cache_device* device = acquire_device(mountID);
+		if (device != NULL) {
+			VMVnodeCache* cache = (VMVnodeCache*)ref->cache;
+			AutoLocker<VMCache> _(cache);
+
+			if (cache->FileCacheDevice() == NULL && cache->page_count == 0) {
+				cache->SetFileCacheDevice(device);
+				device = NULL;
+			}
+		}
+		if (device != NULL)
+			file_cache_put_device(device);
+	}
+
 	return ref;
 
 err1:
@@ -1352,8 +1658,32 @@ file_cache_write(void* _cacheRef, void* cookie, off_t offset,
 		return write_zeros_to_file(ref->vnode, cookie, offset, _size);
 	}
 
-	status_t status = cache_io(ref, cookie, offset,
-		(addr_t)const_cast<void*>(buffer), _size, true);
+	// Write in chunks, so that writers that dirty pages faster than their
+	// device can write them back can be throttled in between
+	size_t size = *_size;
+	size_t written = 0;
+	status_t status = B_OK;
+
+	while (written < size) {
+		balance_dirty_pages(ref);
+
+		size_t chunkSize = min_c(size - written, WRITE_BALANCE_CHUNK_SIZE);
+		addr_t chunkBuffer = buffer != NULL
+			? (addr_t)const_cast<void*>(buffer) + written : 0;
+
+		status = cache_io(ref, cookie, offset + written, chunkBuffer,
+			&chunkSize, true);
+		if (status != B_OK) {
+			// report the chunks written so far
+			if (written > 0)
+				status = B_OK;
+			break;
+		}
+
+		written += chunkSize;
+	}
+
+	*_size = written;
 
 	TRACE(("file_cache_write(ref = %p, offset = %Ld, buffer = %p, size = %lu)"
 		" = %ld\n", ref, offset, buffer, *_size, status));
@@ -12,6 +12,9 @@
 #	include "vfs.h"
 #	include "fssh_api_wrapper.h"
 
+#	include "DoublyLinkedList.h"
+#	include "SplayTree.h"
+
 using namespace FSShell;
 #else
 #	include <unistd.h>
@@ -24,6 +27,7 @@ using namespace FSShell;
 #	include <generic_syscall.h>
 #	include <util/AutoLock.h>
 #	include <util/DoublyLinkedList.h>
+#	include <util/SplayTree.h>
 #	include <vfs.h>
 #	include <vm/vm.h>
 #	include <vm/vm_page.h>
@@ -40,26 +44,68 @@ using namespace FSShell;
 #	define TRACE(x...) ;
 #endif
 
-// TODO: use a sparse array - eventually, the unused BlockMap would be something
-//	to reuse for this. We could also have an upperbound of memory consumption
-//	for the whole map.
 // TODO: it would be nice if we could free a file map in low memory situations.
 
 
-#define CACHED_FILE_EXTENTS	2
-	// must be smaller than MAX_FILE_IO_VECS
-	// TODO: find out how much of these are typically used
+#define MAX_CACHED_FILE_EXTENTS	4096
+	// Upper bound of extents a single map keeps around; when it is exceeded,
+	// the least recently used extents are evicted again (unless the map is in
+	// FILE_MAP_CACHE_ALL mode).
+#define MAX_FILE_MAP_VECS		8
+	// number of vecs retrieved from the file system at once
+
+struct file_extent : DoublyLinkedListLinkImpl<file_extent> {
+	off_t						offset;
+	file_io_vec					disk;
+	SplayTreeLink<file_extent>	treeLink;
+	file_extent*				treeNext;
+
+	off_t End() const
+	{
+		return offset + disk.length;
+	}
 
-struct file_extent {
-	off_t			offset;
-	file_io_vec		disk;
+	bool IsContiguousWith(off_t diskOffset) const
+	{
+		if (disk.offset == -1)
+			return diskOffset == -1;
+		return disk.offset + disk.length == diskOffset;
+	}
 };
 
-struct file_extent_array {
-	file_extent*	array;
-	size_t			max_count;
+struct FileExtentTreeDefinition {
+	typedef off_t		KeyType;
+	typedef file_extent	NodeType;
+
+	static KeyType GetKey(const NodeType* node)
+	{
+		return node->offset;
+	}
+
+	static SplayTreeLink<NodeType>* GetLink(NodeType* node)
+	{
+		return &node->treeLink;
+	}
+
+	static int Compare(KeyType key, const NodeType* node)
+	{
+		// extents never overlap, so an offset within an extent matches it
+		if (key < node->offset)
+			return -1;
+		if (key >= node->End())
+			return 1;
+		return 0;
+	}
+
+	static NodeType** GetListLink(NodeType* node)
+	{
+		return &node->treeNext;
+	}
 };
 
+typedef IteratableSplayTree<FileExtentTreeDefinition> FileExtentTree;
+typedef DoublyLinkedList<file_extent> FileExtentList;
+
 class FileMap
 #if DEBUG_FILE_MAP
 	: public DoublyLinkedListLinkImpl<FileMap>
@@ -76,7 +122,8 @@ public:
 								file_io_vec* vecs, size_t* _count,
 								size_t align);
 
-			file_extent*	ExtentAt(uint32 index);
+			FileExtentTree::Iterator GetIterator()
+								{ return fExtents.GetIterator(); }
 
 			size_t			Count() const { return fCount; }
 			struct vnode*	Vnode() const { return fVnode; }
@@ -85,18 +132,20 @@ public:
 			status_t		SetMode(uint32 mode);
 
 private:
-			file_extent*	_FindExtent(off_t offset, uint32* _index);
-			status_t		_MakeSpace(size_t count);
+			status_t		_Insert(off_t offset, const file_io_vec& disk);
+			void			_Remove(file_extent* extent);
 			status_t		_Add(file_io_vec* vecs, size_t vecCount,
-								off_t& lastOffset);
+								off_t& offset, off_t end);
 			status_t		_Cache(off_t offset, off_t size);
+			void			_InvalidateRange(off_t offset, off_t end);
 			void			_InvalidateAfter(off_t offset);
+			void			_Touch(file_extent* extent);
+			void			_Evict();
 			void			_Free();
 
-	union {
-		file_extent	fDirect[CACHED_FILE_EXTENTS];
-		file_extent_array fIndirect;
-	};
+	FileExtentTree	fExtents;
+	FileExtentList	fUsage;
+		// most recently used extents first
 	mutex			fLock;
 	size_t			fCount;
 	struct vnode*	fVnode;
@@ -140,173 +189,166 @@ FileMap::~FileMap()
 }
 
 
-file_extent*
-FileMap::ExtentAt(uint32 index)
-{
-	if (index >= fCount)
-		return NULL;
-
-	if (fCount > CACHED_FILE_EXTENTS)
-		return &fIndirect.array[index];
-
-	return &fDirect[index];
-}
-
-
-file_extent*
-FileMap::_FindExtent(off_t offset, uint32 *_index)
+/*!	Adds a new extent to the map, and merges it with its neighbours in case
+	they are contiguous on disk as well.
+	The range must not be part of the map yet.
+*/
+status_t
+FileMap::_Insert(off_t offset, const file_io_vec& disk)
 {
-	int32 left = 0;
-	int32 right = fCount - 1;
-
-	while (left <= right) {
-		int32 index = (left + right) / 2;
-		file_extent* extent = ExtentAt(index);
-
-		if (extent->offset > offset) {
-			// search in left part
-			right = index - 1;
-		} else if (extent->offset + extent->disk.length <= offset) {
-			// search in right part
-			left = index + 1;
-		} else {
-			// found extent
-			if (_index)
-				*_index = index;
-
-			return extent;
+	file_extent* previous = NULL;
+	if (offset > 0)
+		previous = fExtents.Lookup(offset - 1);
+	file_extent* next = fExtents.Lookup(offset + disk.length);
+
+	if (previous != NULL && previous->IsContiguousWith(disk.offset)) {
+		previous->disk.length += disk.length;
+		_Touch(previous);
+
+		if (next != NULL && previous->IsContiguousWith(next->disk.offset)) {
+			off_t length = next->disk.length;
+			_Remove(next);
+			previous->disk.length += length;
 		}
+		return B_OK;
 	}
 
-	return NULL;
-}
+	if (next != NULL && (disk.offset == -1 ? next->disk.offset == -1
+			: disk.offset + disk.length == next->disk.offset)) {
+		// Grow the next extent to the front; this does not change its
+		// position in the tree
+		next->offset = offset;
+		next->disk.offset = disk.offset;
+		next->disk.length += disk.length;
+		_Touch(next);
+		return B_OK;
+	}
 
+	file_extent* extent = new(std::nothrow) file_extent;
+	if (extent == NULL)
+		return B_NO_MEMORY;
 
-status_t
-FileMap::_MakeSpace(size_t count)
-{
-	if (count <= CACHED_FILE_EXTENTS) {
-		// just use the reserved area in the file_cache_ref structure
-		if (fCount > CACHED_FILE_EXTENTS) {
-			// the new size is smaller than the minimal array size
-			file_extent *array = fIndirect.array;
-			memcpy(fDirect, array, sizeof(file_extent) * count);
-			free(array);
-		}
-	} else {
-		// resize array if needed
-		file_extent* oldArray = NULL;
-		size_t maxCount = CACHED_FILE_EXTENTS;
-		if (fCount > CACHED_FILE_EXTENTS) {
-			oldArray = fIndirect.array;
-			maxCount = fIndirect.max_count;
-		}
+	extent->offset = offset;
+	extent->disk = disk;
 
-		if (count > maxCount) {
-			// allocate new array
-			while (maxCount < count) {
-				if (maxCount < 32768)
-					maxCount <<= 1;
-				else
-					maxCount += 32768;
-			}
-
-			file_extent* newArray = (file_extent *)realloc(oldArray,
-				maxCount * sizeof(file_extent));
-			if (newArray == NULL)
-				return B_NO_MEMORY;
+	fExtents.Insert(extent);
+	fUsage.Add(extent, false);
+	fCount++;
+	return B_OK;
+}
 
-			if (fCount > 0 && fCount <= CACHED_FILE_EXTENTS)
-				memcpy(newArray, fDirect, sizeof(file_extent) * fCount);
 
-			fIndirect.array = newArray;
-			fIndirect.max_count = maxCount;
-		}
-	}
+void
+FileMap::_Remove(file_extent* extent)
+{
+	fExtents.Remove(extent);
+	fUsage.Remove(extent);
+	fCount--;
 
-	fCount = count;
-	return B_OK;
+	delete extent;
 }
 
 
+/*!	Adds the \a vecs retrieved from the file system starting at file
+	\a offset to the map, but only up to \a end, as the map already contains
+	the range after that; if \a end is negative, all vecs are added.
+	\a offset is moved to the end of the last added extent.
+*/
 status_t
-FileMap::_Add(file_io_vec* vecs, size_t vecCount, off_t& lastOffset)
+FileMap::_Add(file_io_vec* vecs, size_t vecCount, off_t& offset, off_t end)
 {
 	TRACE("FileMap@%p::Add(vecCount = %ld)\n", this, vecCount);
 
-	uint32 start = fCount;
-	off_t offset = 0;
-
-	status_t status = _MakeSpace(fCount + vecCount);
-	if (status != B_OK)
-		return status;
-
-	file_extent* lastExtent = NULL;
-	if (start != 0) {
-		lastExtent = ExtentAt(start - 1);
-		offset = lastExtent->offset + lastExtent->disk.length;
-	}
-
-	for (uint32 i = 0; i < vecCount; i++) {
-		if (lastExtent != NULL) {
-			if (lastExtent->disk.offset + lastExtent->disk.length
-					== vecs[i].offset
-				|| (lastExtent->disk.offset == -1 && vecs[i].offset == -1)) {
-
-				lastExtent->disk.length += vecs[i].length;
-				offset += vecs[i].length;
-
-				_MakeSpace(fCount - 1);
-				if (fCount == CACHED_FILE_EXTENTS) {
-					// We moved the indirect array into the direct one, making
-					// lastExtent a stale pointer, re-get it.
-					lastExtent = ExtentAt(start - 1);
-				}
-
-				continue;
-			}
-		}
+	for (uint32 i = 0; i < vecCount && (end < 0 || offset < end); i++) {
+		file_io_vec disk = vecs[i];
+		if (disk.length <= 0)
+			continue;
+		if (end >= 0 && disk.length > end - offset)
+			disk.length = end - offset;
 
-		file_extent* extent = ExtentAt(start++);
-		extent->offset = offset;
-		extent->disk = vecs[i];
+		status_t status = _Insert(offset, disk);
+		if (status != B_OK)
+			return status;
 
-		offset += extent->disk.length;
-		lastExtent = extent;
+		offset += disk.length;
 	}
 
 #ifdef TRACE_FILE_MAP
-	for (uint32 i = 0; i < fCount; i++) {
-		file_extent* extent = ExtentAt(i);
+	FileExtentTree::Iterator iterator = fExtents.GetIterator();
+	for (uint32 i = 0; iterator.HasNext(); i++) {
+		file_extent* extent = iterator.Next();
 		TRACE("[%ld] extent offset %Ld, disk offset %Ld, length %Ld\n",
 			i, extent->offset, extent->disk.offset, extent->disk.length);
 	}
 #endif
 
-	lastOffset = offset;
 	return B_OK;
 }
 
 
+/*!	Removes the file range from \a offset to \a end from the map. Extents
+	that only partially overlap the range are cut, or split in two.
+*/
 void
-FileMap::_InvalidateAfter(off_t offset)
+FileMap::_InvalidateRange(off_t offset, off_t end)
 {
-	uint32 index;
-	file_extent* extent = _FindExtent(offset, &index);
-	if (extent != NULL) {
-		uint32 resizeTo = index + 1;
+	while (true) {
+		file_extent* extent = fExtents.FindClosest(offset, true, true);
+		if (extent == NULL || extent->offset >= end)
+			break;
+
+		if (extent->offset < offset) {
+			// the extent starts before the range
+			if (extent->End() > end) {
+				// the range is in the middle of the extent - split it
+				file_io_vec tail;
+				tail.offset = extent->disk.offset == -1
+					? -1 : extent->disk.offset + end - extent->offset;
+				tail.length = extent->End() - end;
+
+				extent->disk.length = offset - extent->offset;
+
+				file_extent* tailExtent = new(std::nothrow) file_extent;
+				if (tailExtent != NULL) {
+					tailExtent->offset = end;
+					tailExtent->disk = tail;
+
+					fExtents.Insert(tailExtent);
+					fUsage.Insert(fUsage.GetNext(extent), tailExtent);
+					fCount++;
+				}
+				break;
+			}
 
-		if (extent->offset + extent->disk.length > offset) {
 			extent->disk.length = offset - extent->offset;
-			if (extent->disk.length == 0)
-				resizeTo = index;
+			continue;
+		}
+
+		if (extent->End() > end) {
+			// the extent reaches beyond the range - cut its head; this does
+			// not change its position in the tree
+			off_t diff = end - extent->offset;
+			extent->offset = end;
+			if (extent->disk.offset != -1)
+				extent->disk.offset += diff;
+			extent->disk.length -= diff;
+			break;
 		}
 
-		_MakeSpace(resizeTo);
+		_Remove(extent);
 	}
 }
 
 
+void
+FileMap::_InvalidateAfter(off_t offset)
+{
+	file_extent* last = fExtents.FindMax();
+	if (last != NULL)
+		_InvalidateRange(offset, last->End());
+}
+
+
 /*!	Invalidates or removes the specified part of the file map.
 */
 void
@@ -314,13 +356,15 @@ FileMap::Invalidate(off_t offset, off_t size)
 {
 	MutexLocker _(fLock);
 
-	// TODO: honour size, we currently always remove everything after "offset"
-	if (offset == 0) {
+	if (offset <= 0 && (size < 0 || size >= fSize)) {
 		_Free();
 		return;
 	}
 
-	_InvalidateAfter(offset);
+	if (size < 0 || offset + size < offset)
+		_InvalidateAfter(offset);
+	else
+		_InvalidateRange(offset, offset + size);
 }
 
 
@@ -336,45 +380,89 @@ FileMap::SetSize(off_t size)
 }
 
 
+void
+FileMap::_Touch(file_extent* extent)
+{
+	if (fUsage.Head() == extent)
+		return;
+
+	fUsage.Remove(extent);
+	fUsage.Add(extent, false);
+}
+
+
+/*!	Makes sure the map does not grow beyond MAX_CACHED_FILE_EXTENTS by
+	dropping the extents that have been used least recently. Those are
+	retrieved from the file system again when needed.
+*/
+void
+FileMap::_Evict()
+{
+	if (fCacheAll)
+		return;
+
+	while (fCount > MAX_CACHED_FILE_EXTENTS)
+		_Remove(fUsage.Tail());
+}
+
+
 void
 FileMap::_Free()
 {
-	if (fCount > CACHED_FILE_EXTENTS)
-		free(fIndirect.array);
+	while (file_extent* extent = fUsage.RemoveHead()) {
+		fExtents.Remove(extent);
+		delete extent;
+	}
 
 	fCount = 0;
 }
 
 
+/*!	Makes sure the map contains all extents of the file range starting at
+	\a offset with \a size bytes. Only the gaps in the map are retrieved from
+	the file system.
+*/
 status_t
 FileMap::_Cache(off_t offset, off_t size)
 {
-	file_extent* lastExtent = NULL;
-	if (fCount > 0)
-		lastExtent = ExtentAt(fCount - 1);
+	off_t end = offset + size;
 
-	off_t mapEnd = 0;
-	if (lastExtent != NULL)
-		mapEnd = lastExtent->offset + lastExtent->disk.length;
+	while (offset < end) {
+		file_extent* extent = fExtents.FindClosest(offset, true, true);
+		if (extent != NULL && extent->offset <= offset) {
+			// this part is already cached
+			offset = extent->End();
+			continue;
+		}
 
-	off_t end = offset + size;
+		if (fCacheAll)
+			return B_ERROR;
 
-	if (fCacheAll && mapEnd < end)
-		return B_ERROR;
+		// We don't have the requested extents yet, retrieve them up to the
+		// next extent we already know
+		size_t length = ~(size_t)0;
+		if (extent != NULL && extent->offset - offset < (off_t)(length >> 1))
+			length = extent->offset - offset;
 
-	status_t status = B_OK;
-	file_io_vec vecs[8];
-	const size_t kMaxVecs = 8;
+		file_io_vec vecs[MAX_FILE_MAP_VECS];
+		size_t vecCount = MAX_FILE_MAP_VECS;
+		status_t status = vfs_get_file_map(Vnode(), offset, length, vecs,
+			&vecCount);
+		if (status != B_OK && status != B_BUFFER_OVERFLOW)
+			return status;
 
-	while (status == B_OK && mapEnd < end) {
-		// We don't have the requested extents yet, retrieve them
-		size_t vecCount = kMaxVecs;
-		status = vfs_get_file_map(Vnode(), mapEnd, ~0UL, vecs, &vecCount);
-		if (status == B_OK || status == B_BUFFER_OVERFLOW)
-			status = _Add(vecs, vecCount, mapEnd);
+		off_t previousOffset = offset;
+		status = _Add(vecs, vecCount, offset,
+			extent != NULL ? extent->offset : -1);
+		if (status != B_OK)
+			return status;
+		if (offset == previousOffset) {
+			// the file system did not provide a mapping for this range
+			return B_ERROR;
+		}
 	}
 
-	return status;
+	return B_OK;
 }
 
 
@@ -438,8 +526,8 @@ FileMap::Translate(off_t offset, size_t size, file_io_vec* vecs, size_t* _count,
 	// We now have cached the map of this file as far as we need it, now
 	// we need to translate it for the requested access.
 
-	uint32 index;
-	file_extent* fileExtent = _FindExtent(offset, &index);
+	file_extent* fileExtent = fExtents.Lookup(offset);
+	_Touch(fileExtent);
 
 	offset -= fileExtent->offset;
 	if (fileExtent->disk.offset != -1)
@@ -451,6 +539,7 @@ FileMap::Translate(off_t offset, size_t size, file_io_vec* vecs, size_t* _count,
 	if (vecs[0].length >= (off_t)size) {
 		vecs[0].length = size + padLastVec;
 		*_count = 1;
+		_Evict();
 		return B_OK;
 	}
 
@@ -460,7 +549,8 @@ FileMap::Translate(off_t offset, size_t size, file_io_vec* vecs, size_t* _count,
 	uint32 vecIndex = 1;
 
 	while (true) {
-		fileExtent++;
+		fileExtent = fileExtent->treeNext;
+		_Touch(fileExtent);
 
 		vecs[vecIndex++] = fileExtent->disk;
 
@@ -471,6 +561,7 @@ FileMap::Translate(off_t offset, size_t size, file_io_vec* vecs, size_t* _count,
 
 		if (vecIndex >= maxVecs) {
 			*_count = vecIndex;
+			_Evict();
 			return B_BUFFER_OVERFLOW;
 		}
 
@@ -478,6 +569,7 @@ FileMap::Translate(off_t offset, size_t size, file_io_vec* vecs, size_t* _count,
 	}
 
 	*_count = vecIndex;
+	_Evict();
 	return B_OK;
 }
 
@@ -512,8 +604,9 @@ dump_file_map(int argc, char** argv)
 	if (!printExtents)
 		return 0;
 
-	for (uint32 i = 0; i < map->Count(); i++) {
-		file_extent* extent = map->ExtentAt(i);
+	FileExtentTree::Iterator iterator = map->GetIterator();
+	for (uint32 i = 0; iterator.HasNext(); i++) {
+		file_extent* extent = iterator.Next();
 
 		kprintf("  [%" B_PRIu32 "] offset %" B_PRIdOFF ", disk offset %"
 			B_PRIdOFF ", length %" B_PRIdOFF "\n", i, extent->offset,
@@ -551,9 +644,9 @@ dump_file_map_stats(int argc, char** argv)
 			continue;
 
 		if (map->Count() != 0) {
-			file_extent* extent = map->ExtentAt(map->Count() - 1);
-			if (extent != NULL)
-				mapSize += extent->offset + extent->disk.length;
+			FileExtentTree::Iterator extentIterator = map->GetIterator();
+			while (extentIterator.HasNext())
+				mapSize += extentIterator.Next()->disk.length;
 
 			extents += map->Count();
 		} else
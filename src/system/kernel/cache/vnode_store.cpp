@@ -26,6 +26,7 @@ VMVnodeCache::Init(struct vnode* vnode, uint32 allocationFlags)
 
 	fVnode = vnode;
 	fFileCacheRef = NULL;
+	fFileCacheDevice = NULL;
 	fVnodeDeleted = false;
 
 	vfs_vnode_to_node_ref(fVnode, &fDevice, &fInode);
@@ -170,5 +171,8 @@ VMVnodeCache::Dump(bool showPages) const
 void
 VMVnodeCache::DeleteObject()
 {
+	if (fFileCacheDevice != NULL)
+		file_cache_put_device(fFileCacheDevice);
+
 	object_cache_delete(gVnodeCacheObjectCache, this);
 }
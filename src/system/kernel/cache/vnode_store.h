@@ -10,6 +10,7 @@
 #include <vm/VMCache.h>
 
 
+struct file_cache_device;
 struct file_cache_ref;
 
 
@@ -46,6 +47,12 @@ public:
 			file_cache_ref*		FileCacheRef() const
 									{ return fFileCacheRef; }
 
+			void				SetFileCacheDevice(
+									file_cache_device* device)
+									{ fFileCacheDevice = device; }
+			file_cache_device*	FileCacheDevice() const
+									{ return fFileCacheDevice; }
+
 			void				VnodeDeleted()	{ fVnodeDeleted = true; }
 
 			dev_t				DeviceId() const
@@ -61,6 +68,7 @@ protected:
 private:
 			struct vnode*		fVnode;
 			file_cache_ref*		fFileCacheRef;
+			file_cache_device*	fFileCacheDevice;
 			ino_t				fInode;
 			dev_t				fDevice;
 	volatile bool				fVnodeDeleted;
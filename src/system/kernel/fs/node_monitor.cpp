@@ -13,8 +13,11 @@
 #include <stdlib.h>
 
 #include <AppDefs.h>
+#include <KernelExport.h>
 #include <NodeMonitor.h>
+#include <TypeConstants.h>
 
+#include <condition_variable.h>
 #include <fd.h>
 #include <lock.h>
 #include <messaging.h>
@@ -68,13 +71,393 @@ struct interested_monitor_listener_list {
 	uint32				flags;
 };
 
+static const bigtime_t kDefaultBatchLatency = 50000;
+static const int32 kMaxBatchedEvents = 128;
+static const int32 kMaxBatchMessageSize = 8192;
+	// the messaging service cannot deliver much larger messages
+
+struct batched_event : DoublyLinkedListLinkImpl<batched_event> {
+	KMessage			message;
+	int32				opcode;
+	dev_t				device;
+	ino_t				directory;
+	ino_t				node;
+	const char*			name;
+		// the entry or attribute name, points into the message
+};
+
+typedef DoublyLinkedList<batched_event> BatchedEventList;
+
+/*!	Collects the events for a single user target that asked for batched
+	delivery via B_WATCH_BATCHED. The events are coalesced where possible, and
+	sent in a single B_BATCHED_EVENTS message once the latency of the batch
+	is reached, or once it is full.
+	All members must only be accessed with sBatchesLock held.
+*/
+struct node_monitor_batch : DoublyLinkedListLinkImpl<node_monitor_batch> {
+	port_id				port;
+	int32				token;
+	int32				reference_count;
+	bigtime_t			latency;
+	bigtime_t			deadline;
+	BatchedEventList	events;
+	int32				event_count;
+};
+
+typedef DoublyLinkedList<node_monitor_batch> BatchList;
+
 static UserMessagingMessageSender sNodeMonitorSender;
+static BatchList sBatches;
+static mutex sBatchesLock = MUTEX_INITIALIZER("node monitor batches");
+static ConditionVariable sBatchesCondition;
+static thread_id sBatchThread = -1;
+
+
+/*!	Sends out all pending events of \a batch.
+	sBatchesLock must be held; sending the events with the lock held makes
+	sure they arrive in order.
+*/
+static void
+send_batched_events(node_monitor_batch* batch)
+{
+	messaging_target target;
+	target.port = batch->port;
+	target.token = batch->token;
+
+	BatchedEventList& events = batch->events;
+	batch->event_count = 0;
+
+	KMessage message;
+	while (!events.IsEmpty()) {
+		message.SetTo(B_NODE_MONITOR);
+		message.AddInt32("opcode", B_BATCHED_EVENTS);
+
+		while (batched_event* event = events.Head()) {
+			int32 size = event->message.ContentSize();
+			if (!message.IsEmpty()
+				&& message.ContentSize() + size > kMaxBatchMessageSize) {
+				break;
+			}
+
+			message.AddData("event", B_MESSAGE_TYPE, event->message.Buffer(),
+				size, false);
+			events.Remove(event);
+			delete event;
+		}
+
+		send_message(&message, &target, 1);
+	}
+}
+
+
+/*!	Returns the most recent event of the given kind for the node, if there
+	is no entry event for the node after it. \a name is only compared if
+	given, \a directory only if not -1.
+	sBatchesLock must be held.
+*/
+static batched_event*
+find_batched_event(node_monitor_batch* batch, int32 opcode, dev_t device,
+	ino_t node, ino_t directory, const char* name)
+{
+	BatchedEventList::ReverseIterator iterator
+		= batch->events.GetReverseIterator();
+	while (batched_event* event = iterator.Next()) {
+		if (event->device != device || event->node != node)
+			continue;
+
+		if (event->opcode == opcode
+			&& (directory == -1 || event->directory == directory)
+			&& (name == NULL || (event->name != NULL
+				&& strcmp(event->name, name) == 0))) {
+			return event;
+		}
+
+		if (event->opcode == B_ENTRY_CREATED
+			|| event->opcode == B_ENTRY_REMOVED
+			|| event->opcode == B_ENTRY_MOVED) {
+			// don't coalesce beyond the life time of an entry
+			return NULL;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*!	Tries to merge \a event into the pending events of \a batch. Returns
+	\c true if nothing needs to be added for it anymore.
+	sBatchesLock must be held.
+*/
+static bool
+coalesce_batched_event(node_monitor_batch* batch, const KMessage* event,
+	int32 opcode, dev_t device, ino_t directory, ino_t node, const char* name)
+{
+	switch (opcode) {
+		case B_STAT_CHANGED:
+		{
+			batched_event* previous = find_batched_event(batch,
+				B_STAT_CHANGED, device, node, -1, NULL);
+			if (previous == NULL)
+				return false;
+
+			// The merged update is only interim if both of them were
+			uint32 fields = event->GetInt32("fields", 0);
+			uint32 previousFields = previous->message.GetInt32("fields", 0);
+			uint32 interim = fields & previousFields & B_STAT_INTERIM_UPDATE;
+			previous->message.SetInt32("fields",
+				((fields | previousFields) & ~B_STAT_INTERIM_UPDATE)
+					| interim);
+			return true;
+		}
+
+		case B_ATTR_CHANGED:
+		{
+			if (event->GetInt32("cause", B_ATTR_CHANGED) != B_ATTR_CHANGED)
+				return false;
+
+			batched_event* previous = find_batched_event(batch,
+				B_ATTR_CHANGED, device, node, -1, name);
+			return previous != NULL
+				&& previous->message.GetInt32("cause", B_ATTR_CHANGED)
+					== B_ATTR_CHANGED;
+		}
+
+		case B_ENTRY_REMOVED:
+		{
+			batched_event* created = find_batched_event(batch,
+				B_ENTRY_CREATED, device, node, directory, name);
+			if (created == NULL)
+				return false;
+
+			// The entry has been created and removed again within this
+			// batch: the listener does not need to hear about it at all
+			batched_event* other = created;
+			while (other != NULL) {
+				batched_event* next = batch->events.GetNext(other);
+				if (other->device == device && other->node == node) {
+					batch->events.Remove(other);
+					batch->event_count--;
+					delete other;
+				}
+				other = next;
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*!	Adds \a event to \a batch, and sends the pending events if the batch is
+	full. sBatchesLock must be held.
+	Returns \c false if the event could not be added at all.
+*/
+static bool
+add_batched_event(node_monitor_batch* batch, const KMessage* event)
+{
+	int32 opcode = event->GetInt32("opcode", -1);
+	dev_t device = event->GetInt32("device", -1);
+	ino_t node = event->GetInt64("node", -1);
+	ino_t directory = event->GetInt64("directory", -1);
+	const char* name = event->GetString(
+		opcode == B_ATTR_CHANGED ? "attr" : "name", NULL);
+
+	if (coalesce_batched_event(batch, event, opcode, device, directory, node,
+			name)) {
+		return true;
+	}
+
+	batched_event* batchedEvent = new(std::nothrow) batched_event;
+	if (batchedEvent == NULL)
+		return false;
+
+	if (batchedEvent->message.SetTo(const_cast<void*>(event->Buffer()),
+			event->ContentSize(), 0,
+			KMessage::KMESSAGE_INIT_FROM_BUFFER
+				| KMessage::KMESSAGE_CLONE_BUFFER) != B_OK) {
+		delete batchedEvent;
+		return false;
+	}
+
+	batchedEvent->opcode = opcode;
+	batchedEvent->device = device;
+	batchedEvent->directory = directory;
+	batchedEvent->node = node;
+	batchedEvent->name = batchedEvent->message.GetString(
+		opcode == B_ATTR_CHANGED ? "attr" : "name", NULL);
+
+	if (batch->events.IsEmpty()) {
+		batch->deadline = system_time() + batch->latency;
+		sBatchesCondition.NotifyOne();
+	}
+
+	batch->events.Add(batchedEvent);
+	if (++batch->event_count >= kMaxBatchedEvents)
+		send_batched_events(batch);
+
+	return true;
+}
+
+
+/*!	Sends out the pending events of all batches whose latency is reached. */
+static status_t
+node_monitor_batcher(void* /*data*/)
+{
+	MutexLocker locker(sBatchesLock);
+
+	while (true) {
+		bigtime_t now = system_time();
+		bigtime_t next = B_INFINITE_TIMEOUT;
+
+		BatchList::Iterator iterator = sBatches.GetIterator();
+		node_monitor_batch* batch;
+		while ((batch = iterator.Next()) != NULL) {
+			if (batch->events.IsEmpty())
+				continue;
+			if (batch->deadline <= now)
+				break;
+			if (batch->deadline < next)
+				next = batch->deadline;
+		}
+
+		if (batch != NULL) {
+			send_batched_events(batch);
+			continue;
+		}
+
+		ConditionVariableEntry entry;
+		sBatchesCondition.Add(&entry);
+		locker.Unlock();
+
+		if (next == B_INFINITE_TIMEOUT)
+			entry.Wait();
+		else
+			entry.Wait(B_ABSOLUTE_TIMEOUT, next);
+
+		locker.Lock();
+	}
+
+	return B_OK;
+}
+
+
+/*!	Returns the batch for the specified target, and creates it if needed.
+	The latency of an existing batch is lowered to \a latency if it is
+	larger.
+*/
+static node_monitor_batch*
+get_node_monitor_batch(port_id port, int32 token, bigtime_t latency)
+{
+	MutexLocker _(sBatchesLock);
+
+	if (sBatchThread < 0) {
+		sBatchThread = spawn_kernel_thread(&node_monitor_batcher,
+			"node monitor batcher", B_NORMAL_PRIORITY, NULL);
+		if (sBatchThread < 0)
+			return NULL;
+		resume_thread(sBatchThread);
+	}
+
+	BatchList::Iterator iterator = sBatches.GetIterator();
+	while (node_monitor_batch* batch = iterator.Next()) {
+		if (batch->port == port && batch->token == token) {
+			batch->reference_count++;
+			if (latency < batch->latency)
+				batch->latency = latency;
+			return batch;
+		}
+	}
+
+	node_monitor_batch* batch = new(std::nothrow) node_monitor_batch;
+	if (batch == NULL)
+		return NULL;
+
+	batch->port = port;
+	batch->token = token;
+	batch->reference_count = 1;
+	batch->latency = latency;
+	batch->deadline = 0;
+	batch->event_count = 0;
+
+	sBatches.Add(batch);
+	return batch;
+}
+
+
+/*!	Releases a reference to \a batch. When the last reference is gone, the
+	pending events are sent, and the batch is deleted.
+*/
+static void
+put_node_monitor_batch(node_monitor_batch* batch)
+{
+	MutexLocker _(sBatchesLock);
+
+	if (--batch->reference_count > 0)
+		return;
+
+	send_batched_events(batch);
+
+	sBatches.Remove(batch);
+	delete batch;
+}
+
+
+static bigtime_t
+batch_latency(uint32 flags)
+{
+	bigtime_t latency = ((flags & B_WATCH_BATCH_LATENCY_MASK)
+		>> B_WATCH_BATCH_LATENCY_SHIFT) * 10000LL;
+	return latency > 0 ? latency : kDefaultBatchLatency;
+}
+
 
 class UserNodeListener : public UserMessagingListener {
 	public:
 		UserNodeListener(port_id port, int32 token)
-			: UserMessagingListener(sNodeMonitorSender, port, token)
+			: UserMessagingListener(sNodeMonitorSender, port, token),
+			fBatch(NULL)
+		{
+		}
+
+		UserNodeListener(const UserNodeListener& other)
+			: UserMessagingListener(sNodeMonitorSender, other.Port(),
+				other.Token()),
+			fBatch(NULL)
+		{
+		}
+
+		~UserNodeListener()
+		{
+			if (fBatch != NULL)
+				put_node_monitor_batch(fBatch);
+		}
+
+		bool IsBatched() const
+		{
+			return fBatch != NULL;
+		}
+
+		status_t SetBatched(uint32 flags)
+		{
+			if (fBatch != NULL)
+				return B_OK;
+
+			fBatch = get_node_monitor_batch(Port(), Token(),
+				batch_latency(flags));
+			return fBatch != NULL ? B_OK : B_NO_MEMORY;
+		}
+
+		virtual void EventOccurred(NotificationService& service,
+			const KMessage* event)
 		{
+			if (fBatch != NULL) {
+				MutexLocker _(sBatchesLock);
+				if (add_batched_event(fBatch, event))
+					return;
+			}
+
+			UserMessagingListener::EventOccurred(service, event);
 		}
 
 		bool operator==(const NotificationListener& _other) const
@@ -84,6 +467,9 @@ class UserNodeListener : public UserMessagingListener {
 			return other != NULL && other->Port() == Port()
 				&& other->Token() == Token();
 		}
+
+	private:
+		node_monitor_batch* fBatch;
 };
 
 class NodeMonitorService : public NotificationService {
@@ -1059,17 +1445,27 @@ NodeMonitorService::UpdateUserListener(io_context *context, dev_t device,
 	if (status < B_OK)
 		return status;
 
+	uint32 batchFlags = flags;
+	bool batched = (flags & B_WATCH_BATCHED) != 0;
+	flags &= ~(B_WATCH_BATCHED | B_WATCH_BATCH_LATENCY_MASK);
+
 	MonitorListenerList::Iterator iterator = monitor->listeners.GetIterator();
 	while (monitor_listener* listener = iterator.Next()) {
 		if (*listener->listener == userListener) {
 			listener->flags |= flags;
+			if (batched) {
+				return static_cast<UserNodeListener*>(listener->listener)
+					->SetBatched(batchFlags);
+			}
 			return B_OK;
 		}
 	}
 
 	UserNodeListener* copiedListener = new(std::nothrow) UserNodeListener(
 		userListener);
-	if (copiedListener == NULL) {
+	if (copiedListener == NULL
+		|| (batched && copiedListener->SetBatched(batchFlags) != B_OK)) {
+		delete copiedListener;
 		if (monitor->listeners.IsEmpty())
 			_RemoveMonitor(monitor, flags);
 		return B_NO_MEMORY;
@@ -1098,6 +1494,8 @@ node_monitor_init(void)
 {
 	new(&sNodeMonitorSender) UserMessagingMessageSender();
 	new(&sNodeMonitorService) NodeMonitorService();
+	new(&sBatches) BatchList;
+	sBatchesCondition.Init(&sBatches, "node monitor batches");
 
 	if (sNodeMonitorService.InitCheck() < B_OK)
 		panic("initializing node monitor failed\n");
@@ -24,6 +24,7 @@
 #include <boot/kernel_args.h>
 #include <condition_variable.h>
 #include <elf.h>
+#include <file_cache.h>
 #include <heap.h>
 #include <kernel.h>
 #include <low_resource_manager.h>
@@ -38,6 +39,7 @@
 #include <vm/VMArea.h>
 #include <vm/VMCache.h>
 
+#include "../cache/vnode_store.h"
 #include "IORequest.h"
 #include "PageCacheLocker.h"
 #include "VMAnonymousCache.h"
@@ -1518,6 +1520,18 @@ unreserve_pages(uint32 count)
 }
 
 
+/*!	Updates the dirty page accounting of the device a vnode \a cache belongs
+	to, if the file cache maintains one for it.
+*/
+static inline void
+update_file_cache_device(VMCache* cache, int32 count)
+{
+	file_cache_device* device = ((VMVnodeCache*)cache)->FileCacheDevice();
+	if (device != NULL)
+		file_cache_device_pages_modified(device, count);
+}
+
+
 static void
 free_page(vm_page* page, bool clear)
 {
@@ -1662,6 +1676,14 @@ set_page_state(vm_page *page, int pageState)
 			atomic_add(&sModifiedTemporaryPages, 1);
 		else if (page->State() == PAGE_STATE_MODIFIED)
 			atomic_add(&sModifiedTemporaryPages, -1);
+	} else if (cache != NULL && cache->type == CACHE_TYPE_VNODE) {
+		if (pageState == PAGE_STATE_MODIFIED
+			&& page->State() != PAGE_STATE_MODIFIED) {
+			update_file_cache_device(cache, 1);
+		} else if (pageState != PAGE_STATE_MODIFIED
+			&& page->State() == PAGE_STATE_MODIFIED) {
+			update_file_cache_device(cache, -1);
+		}
 	}
 
 	// move the page
@@ -2055,6 +2077,15 @@ PageWriteWrapper::Done(status_t result)
 	bool success = true;
 
 	if (result == B_OK) {
+		// Only completed writes count for the write-back rate of the device;
+		// pages also leave the modified state when they are wired, or freed
+		if (fCache->type == CACHE_TYPE_VNODE) {
+			file_cache_device* device
+				= ((VMVnodeCache*)fCache)->FileCacheDevice();
+			if (device != NULL)
+				file_cache_device_pages_written(device, 1);
+		}
+
 		// put it into the active/inactive queue
 		move_page_to_appropriate_queue(fPage);
 		fPage->busy_writing = false;
@@ -2324,6 +2355,46 @@ PageWriterRun::PageWritten(PageWriteTransfer* transfer, status_t status,
 }
 
 
+/*!	Adds up to \a maxPages modified pages that follow \a page in its
+	\a cache to the \a run, so that they can be written back in one go.
+	The cache must be locked.
+	\return The number of pages added.
+*/
+static uint32
+add_modified_page_cluster(PageWriterRun& run, VMCache* cache, vm_page* page,
+	uint32 maxPages)
+{
+	off_t offset = (off_t)page->cache_offset << PAGE_SHIFT;
+	uint32 added = 0;
+
+	while (added < maxPages) {
+		offset += B_PAGE_SIZE;
+
+		vm_page* next = cache->LookupPage(offset);
+		if (next == NULL || next->busy
+			|| next->State() != PAGE_STATE_MODIFIED
+			|| next->WiredCount() > 0) {
+			break;
+		}
+
+		DEBUG_PAGE_ACCESS_START(next);
+
+		// the run releases a store and a cache reference for each page
+		cache->AcquireStoreRef();
+		run.AddPage(next);
+
+		DEBUG_PAGE_ACCESS_END(next);
+
+		TPW(WritePage(next));
+
+		cache->AcquireRefLocked();
+		added++;
+	}
+
+	return added;
+}
+
+
 /*!	The page writer continuously takes some pages from the modified
 	queue, writes them back, and moves them back to the active queue.
 	It runs in its own thread, and is only there to keep the number
@@ -2468,6 +2539,14 @@ page_writer(void* /*unused*/)
 
 			cache->AcquireRefLocked();
 			numPages++;
+
+			// Files are written back in larger sequential clusters, if the
+			// following pages are modified as well
+			if (cache->type == CACHE_TYPE_VNODE) {
+				numPages += add_modified_page_cluster(run, cache, page,
+					std::min(kNumPages - numPages,
+						file_cache_write_back_cluster_pages() - 1));
+			}
 		}
 
 #ifdef TRACE_VM_PAGE
@@ -4019,8 +4098,12 @@ vm_page_free_etc(VMCache* cache, vm_page* page,
 	PAGE_ASSERT(page, page->State() != PAGE_STATE_FREE
 		&& page->State() != PAGE_STATE_CLEAR);
 
-	if (page->State() == PAGE_STATE_MODIFIED && cache->temporary)
-		atomic_add(&sModifiedTemporaryPages, -1);
+	if (page->State() == PAGE_STATE_MODIFIED) {
+		if (cache->temporary)
+			atomic_add(&sModifiedTemporaryPages, -1);
+		else if (cache->type == CACHE_TYPE_VNODE)
+			update_file_cache_device(cache, -1);
+	}
 
 	free_page(page, false);
 	if (reservation == NULL)
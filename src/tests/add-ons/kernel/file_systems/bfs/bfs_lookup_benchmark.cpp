@@ -0,0 +1,201 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * This file may be used under the terms of the MIT License.
+ */
+
+
+/*!	Measures how lookups in a large BFS directory scale with the number of
+	threads. Every lookup walks the directory's B+tree, and thus mostly
+	consists of block_cache_get()/block_cache_put() calls for blocks that are
+	already cached.
+*/
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <OS.h>
+
+
+static const char* kDefaultDirectory = "/boot/home/bfs_lookup_benchmark";
+
+static int32 sFileCount = 20000;
+static bigtime_t sDuration = 2000000;
+static const char* sDirectory = kDefaultDirectory;
+static volatile bool sQuit;
+
+
+struct thread_data {
+	pthread_t	thread;
+	uint32		seed;
+	uint64		lookups;
+};
+
+
+static void
+file_name(char* buffer, size_t size, int32 index)
+{
+	snprintf(buffer, size, "%s/file-%08" B_PRId32, sDirectory, index);
+}
+
+
+static int
+create_files()
+{
+	if (mkdir(sDirectory, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Could not create %s: %s\n", sDirectory,
+			strerror(errno));
+		return 1;
+	}
+
+	for (int32 i = 0; i < sFileCount; i++) {
+		char name[B_PATH_NAME_LENGTH];
+		file_name(name, sizeof(name), i);
+
+		int fd = open(name, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0) {
+			fprintf(stderr, "Could not create %s: %s\n", name,
+				strerror(errno));
+			return 1;
+		}
+		close(fd);
+	}
+
+	sync();
+	return 0;
+}
+
+
+static void
+remove_files()
+{
+	for (int32 i = 0; i < sFileCount; i++) {
+		char name[B_PATH_NAME_LENGTH];
+		file_name(name, sizeof(name), i);
+		unlink(name);
+	}
+
+	rmdir(sDirectory);
+}
+
+
+static void*
+lookup_thread(void* _data)
+{
+	thread_data* data = (thread_data*)_data;
+
+	while (!sQuit) {
+		char name[B_PATH_NAME_LENGTH];
+		file_name(name, sizeof(name), rand_r(&data->seed) % sFileCount);
+
+		struct stat stat;
+		if (::stat(name, &stat) != 0) {
+			fprintf(stderr, "Could not stat %s: %s\n", name, strerror(errno));
+			exit(1);
+		}
+
+		data->lookups++;
+	}
+
+	return NULL;
+}
+
+
+static double
+run(int32 threadCount)
+{
+	thread_data* threads = new thread_data[threadCount];
+
+	sQuit = false;
+	for (int32 i = 0; i < threadCount; i++) {
+		threads[i].seed = i + 1;
+		threads[i].lookups = 0;
+		pthread_create(&threads[i].thread, NULL, &lookup_thread, &threads[i]);
+	}
+
+	snooze(sDuration);
+	sQuit = true;
+
+	uint64 lookups = 0;
+	for (int32 i = 0; i < threadCount; i++) {
+		pthread_join(threads[i].thread, NULL);
+		lookups += threads[i].lookups;
+	}
+
+	delete[] threads;
+	return lookups * 1000000.0 / sDuration;
+}
+
+
+static void
+usage(const char* programName)
+{
+	fprintf(stderr, "usage: %s [-d <directory>] [-f <files>] [-t <threads>] "
+		"[-s <seconds>] [-k]\n"
+		"Creates <files> entries in <directory>, which must be on a BFS "
+		"volume,\nand looks them up with 1 to <threads> threads.\n"
+		"  -k  keep the files after the run\n", programName);
+	exit(1);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	int32 maxThreads = 8;
+	bool keepFiles = false;
+
+	int option;
+	while ((option = getopt(argc, argv, "d:f:t:s:kh")) != -1) {
+		switch (option) {
+			case 'd':
+				sDirectory = optarg;
+				break;
+			case 'f':
+				sFileCount = strtol(optarg, NULL, 0);
+				break;
+			case 't':
+				maxThreads = strtol(optarg, NULL, 0);
+				break;
+			case 's':
+				sDuration = strtol(optarg, NULL, 0) * 1000000LL;
+				break;
+			case 'k':
+				keepFiles = true;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if (sFileCount <= 0 || maxThreads <= 0 || sDuration <= 0)
+		usage(argv[0]);
+
+	if (create_files() != 0)
+		return 1;
+
+	// warm up the block cache
+	run(1);
+
+	double single = 0;
+	for (int32 threads = 1; threads <= maxThreads; threads *= 2) {
+		double lookups = run(threads);
+		if (threads == 1)
+			single = lookups;
+
+		printf("%3" B_PRId32 " threads: %10.0f lookups/s (%.2fx)\n", threads,
+			lookups, single > 0 ? lookups / single : 0);
+	}
+
+	if (!keepFiles)
+		remove_files();
+
+	return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <Entry.h>
+#include <File.h>
+#include <Job.h>
+#include <String.h>
+
+#include <package/Context.h>
+#include <package/DownloadFileRequest.h>
+#include <package/hpkg/PackageChunkIndex.h>
+
+
+// Creates an old and a new version of a file in a directory serving as a
+// repository, and checks that the new version is correctly created from the
+// old one and the chunk index of the new one. It also checks that the complete
+// file is downloaded, if the chunk index is missing or belongs to a different
+// version of the file.
+
+
+using namespace BPackageKit;
+using BPackageKit::BHPKG::BPrivate::PackageChunkIndex;
+
+
+static const size_t kFileSize = 4 * 1024 * 1024;
+
+
+struct JobStateListener : BSupportKit::BJobStateListener {
+	virtual void JobFailed(BSupportKit::BJob* job)
+	{
+		fprintf(stderr, "%s failed\n", job->Title().String());
+	}
+};
+
+
+static bool
+write_file(const BString& path, const char* data, size_t size)
+{
+	BFile file(path.String(), B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE);
+	return file.InitCheck() == B_OK && file.WriteExactly(data, size) == B_OK;
+}
+
+
+static status_t
+write_chunk_index(const BString& path, const BString& indexPath)
+{
+	BFile file(path.String(), B_READ_ONLY);
+	PackageChunkIndex index;
+	status_t error = index.Compute(&file);
+	if (error != B_OK)
+		return error;
+
+	BFile indexFile(indexPath.String(),
+		B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE);
+	error = indexFile.InitCheck();
+	if (error != B_OK)
+		return error;
+
+	return index.Write(&indexFile);
+}
+
+
+static status_t
+download(const BString& directory, const char* basisName, const char* name,
+	const char* targetName, const char* expected, size_t expectedSize)
+{
+	BString url("file://");
+	url << directory << "/" << name;
+	BString targetPath = BString(directory) << "/" << targetName;
+	BString basisPath = BString(directory) << "/" << basisName;
+	BEntry targetEntry(targetPath.String());
+	BEntry basisEntry(basisPath.String());
+	targetEntry.Remove();
+
+	BDecisionProvider decisionProvider;
+	JobStateListener listener;
+	BContext context(decisionProvider, listener);
+	DownloadFileRequest request(context, url, targetEntry);
+	request.SetBasisEntry(basisEntry);
+	status_t error = request.Process();
+	if (error != B_OK)
+		return error;
+
+	BFile file(&targetEntry, B_READ_ONLY);
+	off_t size;
+	error = file.GetSize(&size);
+	if (error != B_OK)
+		return error;
+	if ((size_t)size != expectedSize)
+		return B_BAD_DATA;
+
+	char* data = (char*)malloc(expectedSize);
+	if (data == NULL)
+		return B_NO_MEMORY;
+	error = file.ReadAtExactly(0, data, expectedSize);
+	if (error == B_OK && memcmp(data, expected, expectedSize) != 0)
+		error = B_BAD_DATA;
+	free(data);
+
+	return error;
+}
+
+
+int
+main(int argc, const char* const* argv)
+{
+	BString directory = "/tmp/delta_update_test";
+	if (argc > 1)
+		directory = argv[1];
+	if (mkdir(directory.String(), 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Failed to create \"%s\": %s\n", directory.String(),
+			strerror(errno));
+		return 1;
+	}
+
+	// the new version has some data inserted and some changed, which must
+	// only affect the chunks around the changes
+	char* oldData = (char*)malloc(kFileSize);
+	char* newData = (char*)malloc(kFileSize + 100);
+	srand(42);
+	for (size_t i = 0; i < kFileSize; i++)
+		oldData[i] = rand() >> 7;
+	memcpy(newData, oldData, 1000000);
+	memset(newData + 1000000, 'x', 100);
+	memcpy(newData + 1000100, oldData + 1000000, kFileSize - 1000000);
+	memset(newData + 3000000, 'y', 10);
+	size_t newSize = kFileSize + 100;
+
+	// another version the chunk index might have been created for
+	char* otherData = (char*)malloc(kFileSize);
+	memcpy(otherData, oldData, kFileSize);
+	memset(otherData + 2000000, 'z', 10);
+
+	BString oldPath = BString(directory) << "/old.hpkg";
+	BString newPath = BString(directory) << "/new.hpkg";
+	BString otherPath = BString(directory) << "/other.hpkg";
+	BString indexPath = BString(newPath) << ".chunks";
+	if (!write_file(oldPath, oldData, kFileSize)
+		|| !write_file(newPath, newData, newSize)
+		|| !write_file(otherPath, otherData, kFileSize)) {
+		fprintf(stderr, "Failed to create the test files in \"%s\"\n",
+			directory.String());
+		return 1;
+	}
+
+	struct {
+		const char*	description;
+		const char*	indexSource;
+	} tests[] = {
+		{ "delta", newPath.String() },
+		{ "missing chunk index", NULL },
+		{ "mismatching chunk index", otherPath.String() }
+	};
+
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		status_t error = B_OK;
+		BEntry(indexPath.String()).Remove();
+		if (tests[i].indexSource != NULL)
+			error = write_chunk_index(tests[i].indexSource, indexPath);
+		if (error == B_OK) {
+			error = download(directory, "old.hpkg", "new.hpkg",
+				"downloaded.hpkg", newData, newSize);
+		}
+		if (error != B_OK) {
+			fprintf(stderr, "Test \"%s\" failed: %s\n", tests[i].description,
+				strerror(error));
+			return 1;
+		}
+		printf("%s: ok\n", tests[i].description);
+	}
+
+	free(oldData);
+	free(newData);
+	free(otherData);
+
+	printf("All tests passed.\n");
+	return 0;
+}
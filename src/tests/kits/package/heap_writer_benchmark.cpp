@@ -0,0 +1,216 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <DataIO.h>
+#include <OS.h>
+
+#include <package/hpkg/DataReader.h>
+#include <package/hpkg/ErrorOutput.h>
+#include <package/hpkg/PackageFileHeapWriter.h>
+#include <package/hpkg/StandardErrorOutput.h>
+#include <ZlibCompressionAlgorithm.h>
+#include <ZstdCompressionAlgorithm.h>
+
+
+using namespace BPackageKit::BHPKG;
+using BPackageKit::BHPKG::BPrivate::CompressionAlgorithmOwner;
+using BPackageKit::BHPKG::BPrivate::DecompressionAlgorithmOwner;
+using BPackageKit::BHPKG::BPrivate::PackageFileHeapWriter;
+
+
+static uint8* sData;
+static size_t sDataSize;
+static size_t sDataCapacity;
+
+
+static bool
+add_file(const char* path, off_t size)
+{
+	if (sDataSize + size > sDataCapacity) {
+		size_t capacity = (sDataSize + size) * 2;
+		uint8* data = (uint8*)realloc(sData, capacity);
+		if (data == NULL)
+			return false;
+
+		sData = data;
+		sDataCapacity = capacity;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return true;
+
+	ssize_t bytesRead = read(fd, sData + sDataSize, size);
+	if (bytesRead > 0)
+		sDataSize += bytesRead;
+
+	close(fd);
+	return true;
+}
+
+
+static bool
+add_directory(const char* path)
+{
+	DIR* dir = opendir(path);
+	if (dir == NULL)
+		return true;
+
+	bool success = true;
+	while (dirent* entry = readdir(dir)) {
+		if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+			continue;
+
+		char entryPath[PATH_MAX];
+		snprintf(entryPath, sizeof(entryPath), "%s/%s", path, entry->d_name);
+
+		struct stat st;
+		if (lstat(entryPath, &st) != 0)
+			continue;
+
+		if (S_ISDIR(st.st_mode))
+			success = add_directory(entryPath);
+		else if (S_ISREG(st.st_mode))
+			success = add_file(entryPath, st.st_size);
+
+		if (!success)
+			break;
+	}
+
+	closedir(dir);
+	return success;
+}
+
+
+static status_t
+write_heap(CompressionAlgorithmOwner* compressionAlgorithm,
+	DecompressionAlgorithmOwner* decompressionAlgorithm, int32 threadCount,
+	BMallocIO& output, bigtime_t& _time)
+{
+	BStandardErrorOutput errorOutput;
+	PackageFileHeapWriter writer(&errorOutput, &output, 0,
+		compressionAlgorithm, decompressionAlgorithm);
+
+	try {
+		writer.Init();
+	} catch (std::bad_alloc&) {
+		return B_NO_MEMORY;
+	}
+	writer.SetThreadCount(threadCount);
+
+	bigtime_t startTime = system_time();
+
+	BBufferDataReader reader(sData, sDataSize);
+	uint64 offset;
+	status_t error = writer.AddData(reader, sDataSize, offset);
+	if (error == B_OK)
+		error = writer.Finish();
+
+	_time = system_time() - startTime;
+	return error;
+}
+
+
+int
+main(int argc, const char* const* argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <directory> [zlib|zstd] [max threads]\n",
+			argv[0]);
+		return 1;
+	}
+
+	bool zstd = argc > 2 && !strcmp(argv[2], "zstd");
+	int32 maxThreads = argc > 3 ? atoi(argv[3]) : 0;
+	if (maxThreads <= 0) {
+		system_info info;
+		get_system_info(&info);
+		maxThreads = info.cpu_count;
+	}
+
+	if (!add_directory(argv[1])) {
+		fprintf(stderr, "Out of memory reading \"%s\"\n", argv[1]);
+		return 1;
+	}
+
+	CompressionAlgorithmOwner* compressionAlgorithm;
+	DecompressionAlgorithmOwner* decompressionAlgorithm;
+	if (zstd) {
+		compressionAlgorithm = CompressionAlgorithmOwner::Create(
+			new(std::nothrow) BZstdCompressionAlgorithm,
+			new(std::nothrow) BZstdCompressionParameters(
+				B_ZSTD_COMPRESSION_BEST));
+		decompressionAlgorithm = DecompressionAlgorithmOwner::Create(
+			new(std::nothrow) BZstdCompressionAlgorithm,
+			new(std::nothrow) BZstdDecompressionParameters);
+	} else {
+		compressionAlgorithm = CompressionAlgorithmOwner::Create(
+			new(std::nothrow) BZlibCompressionAlgorithm,
+			new(std::nothrow) BZlibCompressionParameters(
+				B_ZLIB_COMPRESSION_BEST));
+		decompressionAlgorithm = DecompressionAlgorithmOwner::Create(
+			new(std::nothrow) BZlibCompressionAlgorithm,
+			new(std::nothrow) BZlibDecompressionParameters);
+	}
+	if (compressionAlgorithm == NULL || decompressionAlgorithm == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	printf("%s: %.1f MB, %s\n", argv[1], sDataSize / 1048576.0,
+		zstd ? "zstd" : "zlib");
+	printf("threads     time       MB/s  compressed\n");
+
+	BMallocIO firstOutput;
+	int32 threads = 1;
+	while (true) {
+		BMallocIO output;
+		output.SetBlockSize(1024 * 1024);
+
+		bigtime_t time;
+		status_t error = write_heap(compressionAlgorithm,
+			decompressionAlgorithm, threads, output, time);
+		if (error != B_OK) {
+			fprintf(stderr, "Writing the heap failed: %s\n", strerror(error));
+			return 1;
+		}
+
+		printf("%7" B_PRId32 " %7.2f s %10.1f %11" B_PRIuSIZE "\n", threads,
+			time / 1000000.0, sDataSize / 1048576.0 / (time / 1000000.0),
+			output.BufferLength());
+
+		// the heap must not depend on the number of threads
+		if (threads == 1) {
+			firstOutput.Write(output.Buffer(), output.BufferLength());
+		} else if (output.BufferLength() != firstOutput.BufferLength()
+			|| memcmp(output.Buffer(), firstOutput.Buffer(),
+				output.BufferLength()) != 0) {
+			fprintf(stderr, "The heap differs from the one written by a single "
+				"thread!\n");
+			return 1;
+		}
+
+		if (threads >= maxThreads)
+			break;
+		threads = std::min(threads * 2, maxThreads);
+	}
+
+	compressionAlgorithm->ReleaseReference();
+	decompressionAlgorithm->ReleaseReference();
+	free(sData);
+	return 0;
+}
@@ -0,0 +1,410 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ByteOrder.h>
+#include <DataIO.h>
+#include <String.h>
+
+#include <package/hpkg/HPKGDefsPrivate.h>
+#include <package/hpkg/PackageContentHandler.h>
+#include <package/hpkg/PackageData.h>
+#include <package/hpkg/PackageDataReader.h>
+#include <package/hpkg/PackageEntry.h>
+#include <package/hpkg/PackageReader.h>
+#include <package/hpkg/PackageWriter.h>
+#include <package/hpkg/StandardErrorOutput.h>
+
+
+// Creates packages from a directory of many small files with all heap
+// compression types, and checks that they can be read back correctly. It also
+// checks that packages compressed without a dictionary are still written and
+// read as before, and that updating a package keeps its dictionary.
+
+
+using namespace BPackageKit::BHPKG;
+using BPackageKit::BHPKG::BPrivate::hpkg_header;
+using BPackageKit::BHPKG::BPrivate::kHPKGMinorVersionWithoutDictionary;
+
+
+static const char* const kPackageInfo =
+	"name			dicttest\n"
+	"version			1.0-1\n"
+	"architecture	any\n"
+	"summary			\"Heap dictionary test package\"\n"
+	"description		\"Contains many small files.\"\n"
+	"packager		\"Haiku <haiku@example.com>\"\n"
+	"vendor			\"Haiku Project\"\n"
+	"copyrights		\"2026 Haiku, Inc.\"\n"
+	"licenses		\"MIT\"\n"
+	"provides		{ dicttest = 1.0-1 }\n";
+
+static const int32 kFileCount = 1000;
+
+static BString sContentDirectory;
+static int32 sFilesChecked;
+
+
+class WriterListener : public BPackageWriterListener {
+public:
+	virtual void PrintErrorVarArgs(const char* format, va_list args)
+	{
+		vfprintf(stderr, format, args);
+	}
+
+	virtual void OnEntryAdded(const char* path)
+	{
+	}
+
+	virtual void OnTOCSizeInfo(uint64 uncompressedStringsSize,
+		uint64 uncompressedMainSize, uint64 uncompressedTOCSize)
+	{
+	}
+
+	virtual void OnPackageAttributesSizeInfo(uint32 stringCount,
+		uint32 uncompressedSize)
+	{
+	}
+
+	virtual void OnPackageSizeInfo(uint32 headerSize, uint64 heapSize,
+		uint64 tocSize, uint32 packageAttributesSize, uint64 totalSize)
+	{
+	}
+};
+
+
+class ContentChecker : public BPackageContentHandler {
+public:
+	ContentChecker(BAbstractBufferedDataReader* heapReader)
+		:
+		fHeapReader(heapReader)
+	{
+	}
+
+	virtual status_t HandleEntry(BPackageEntry* entry)
+	{
+		if (!S_ISREG(entry->Mode()))
+			return B_OK;
+
+		BString path;
+		for (const BPackageEntry* parent = entry; parent != NULL;
+				parent = parent->Parent()) {
+			path.Prepend(parent->Name()).Prepend("/");
+		}
+		path.Prepend(sContentDirectory);
+
+		// read the original file
+		int fd = open(path.String(), O_RDONLY);
+		if (fd < 0) {
+			fprintf(stderr, "Failed to open \"%s\": %s\n", path.String(),
+				strerror(errno));
+			return errno;
+		}
+
+		struct stat st;
+		fstat(fd, &st);
+		char* expected = (char*)malloc(st.st_size + 1);
+		ssize_t expectedSize = read(fd, expected, st.st_size);
+		close(fd);
+
+		// read the file from the package
+		BPackageData& data = entry->Data();
+		char* actual = (char*)malloc(data.Size() + 1);
+		BAbstractBufferedDataReader* reader;
+		status_t error = BPackageDataReaderFactory().CreatePackageDataReader(
+			fHeapReader, data, reader);
+		if (error == B_OK) {
+			error = reader->ReadData(0, actual, data.Size());
+			delete reader;
+		}
+
+		if (error == B_OK && ((off_t)data.Size() != expectedSize
+				|| memcmp(actual, expected, expectedSize) != 0)) {
+			fprintf(stderr, "Contents of \"%s\" differ\n", path.String());
+			error = B_BAD_DATA;
+		}
+
+		free(actual);
+		free(expected);
+
+		sFilesChecked++;
+		return error;
+	}
+
+	virtual status_t HandleEntryAttribute(BPackageEntry* entry,
+		BPackageEntryAttribute* attribute)
+	{
+		return B_OK;
+	}
+
+	virtual status_t HandleEntryDone(BPackageEntry* entry)
+	{
+		return B_OK;
+	}
+
+	virtual status_t HandlePackageAttribute(
+		const BPackageInfoAttributeValue& value)
+	{
+		return B_OK;
+	}
+
+	virtual void HandleErrorOccurred()
+	{
+	}
+
+private:
+	BAbstractBufferedDataReader* fHeapReader;
+};
+
+
+static bool
+write_file(const BString& path, const BString& content)
+{
+	int fd = open(path.String(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+
+	ssize_t written = write(fd, content.String(), content.Length());
+	close(fd);
+	return written == content.Length();
+}
+
+
+static bool
+create_content(const char* directory)
+{
+	if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+		return false;
+
+	BString path(directory);
+	if (!write_file(BString(path) << "/.PackageInfo", kPackageInfo))
+		return false;
+
+	path << "/headers";
+	if (mkdir(path.String(), 0755) != 0 && errno != EEXIST)
+		return false;
+
+	// many small, similar, but not identical files, like a development
+	// package would contain
+	for (int32 i = 0; i < kFileCount; i++) {
+		int32 id = i * 7919 % 10007;
+		BString content;
+		content.SetToFormat(
+			"/*\n"
+			" * Copyright 2026, Haiku, Inc. All rights reserved.\n"
+			" * Distributed under the terms of the MIT License.\n"
+			" */\n"
+			"#ifndef _CLASS_%" B_PRId32 "_H\n"
+			"#define _CLASS_%" B_PRId32 "_H\n"
+			"\n"
+			"\n"
+			"#include <SupportDefs.h>\n"
+			"\n"
+			"\n"
+			"class BClass%" B_PRId32 " {\n"
+			"public:\n"
+			"\t\t\t\t\t\t\t\tBClass%" B_PRId32 "(int32 value = %" B_PRId32
+				");\n"
+			"\tvirtual\t\t\t\t\t\t~BClass%" B_PRId32 "();\n"
+			"\n"
+			"\t\t\tstatus_t\t\t\tInitCheck() const;\n"
+			"};\n"
+			"\n"
+			"\n"
+			"#endif\t// _CLASS_%" B_PRId32 "_H\n",
+			id, id, id, id, i, id, id);
+
+		BString filePath;
+		filePath.SetToFormat("%s/Class%" B_PRId32 ".h", path.String(), id);
+		if (!write_file(filePath, content))
+			return false;
+	}
+
+	return true;
+}
+
+
+static status_t
+create_package(const char* packagePath, uint32 compression, uint32 flags,
+	const char* entry)
+{
+	WriterListener listener;
+	BPackageWriterParameters parameters;
+	parameters.SetCompression(compression);
+	parameters.SetFlags(flags);
+
+	BPackageWriter writer(&listener);
+	status_t error = writer.Init(packagePath, &parameters);
+	if (error != B_OK)
+		return error;
+
+	writer.SetCheckLicenses(false);
+
+	if (chdir(sContentDirectory.String()) != 0)
+		return errno;
+
+	if (entry != NULL) {
+		error = writer.AddEntry(entry);
+	} else {
+		error = writer.AddEntry(".PackageInfo");
+		if (error == B_OK)
+			error = writer.AddEntry("headers");
+	}
+	if (error != B_OK)
+		return error;
+
+	return writer.Finish();
+}
+
+
+static status_t
+check_package(const char* packagePath, uint32 expectedCompression,
+	int32 expectedFileCount)
+{
+	// check the header
+	int fd = open(packagePath, O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	hpkg_header header;
+	ssize_t bytesRead = read(fd, &header, sizeof(header));
+	struct stat st;
+	fstat(fd, &st);
+	close(fd);
+	if (bytesRead != (ssize_t)sizeof(header))
+		return B_BAD_DATA;
+
+	uint32 compression = B_BENDIAN_TO_HOST_INT16(header.heap_compression);
+	uint32 headerSize = B_BENDIAN_TO_HOST_INT16(header.header_size);
+	uint32 minorVersion = B_BENDIAN_TO_HOST_INT16(header.minor_version);
+	if (compression != expectedCompression) {
+		fprintf(stderr, "%s: compression %" B_PRIu32 ", expected %" B_PRIu32
+			"\n", packagePath, compression, expectedCompression);
+		return B_BAD_DATA;
+	}
+	if ((compression == B_HPKG_COMPRESSION_ZSTD_DICTIONARY)
+			!= (headerSize > sizeof(hpkg_header))) {
+		fprintf(stderr, "%s: unexpected header size %" B_PRIu32 "\n",
+			packagePath, headerSize);
+		return B_BAD_DATA;
+	}
+	uint32 expectedMinorVersion
+		= compression == B_HPKG_COMPRESSION_ZSTD_DICTIONARY
+			? B_HPKG_MINOR_VERSION : kHPKGMinorVersionWithoutDictionary;
+	if (minorVersion != expectedMinorVersion) {
+		fprintf(stderr, "%s: minor version %" B_PRIu32 ", expected %" B_PRIu32
+			"\n", packagePath, minorVersion, expectedMinorVersion);
+		return B_BAD_DATA;
+	}
+
+	// check the contents
+	BStandardErrorOutput errorOutput;
+	BPackageReader reader(&errorOutput);
+	status_t error = reader.Init(packagePath);
+	if (error != B_OK)
+		return error;
+
+	sFilesChecked = 0;
+	ContentChecker checker(reader.HeapReader());
+	error = reader.ParseContent(&checker);
+	if (error != B_OK)
+		return error;
+
+	if (sFilesChecked != expectedFileCount) {
+		fprintf(stderr, "%s: found %" B_PRId32 " files, expected %" B_PRId32
+			"\n", packagePath, sFilesChecked, expectedFileCount);
+		return B_BAD_DATA;
+	}
+
+	printf("%-28s %8" B_PRIdOFF " bytes, header %4" B_PRIu32 " bytes\n",
+		packagePath, st.st_size, headerSize);
+	return B_OK;
+}
+
+
+int
+main(int argc, const char* const* argv)
+{
+	// the directory must be absolute, since the packages are created from
+	// within the content directory
+	BString directory = "/tmp/hpkg_dictionary_test";
+	if (argc > 1) {
+		directory = argv[1];
+		if (argv[1][0] != '/') {
+			char currentDirectory[PATH_MAX];
+			if (getcwd(currentDirectory, sizeof(currentDirectory)) == NULL)
+				return 1;
+			directory.SetToFormat("%s/%s", currentDirectory, argv[1]);
+		}
+	}
+
+	BString contentDirectory = BString(directory) << "/content";
+	if ((mkdir(directory.String(), 0755) != 0 && errno != EEXIST)
+		|| !create_content(contentDirectory.String())) {
+		fprintf(stderr, "Failed to create the test files in \"%s\"\n",
+			directory.String());
+		return 1;
+	}
+	sContentDirectory = contentDirectory;
+
+	struct {
+		const char*	name;
+		uint32		compression;
+	} tests[] = {
+		{ "zlib.hpkg", B_HPKG_COMPRESSION_ZLIB },
+		{ "zstd.hpkg", B_HPKG_COMPRESSION_ZSTD },
+		{ "zstd-dict.hpkg", B_HPKG_COMPRESSION_ZSTD_DICTIONARY }
+	};
+
+	int32 expectedFileCount = kFileCount + 1;
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		BString packagePath = BString(directory) << "/" << tests[i].name;
+		status_t error = create_package(packagePath.String(),
+			tests[i].compression, 0, NULL);
+		if (error == B_OK) {
+			error = check_package(packagePath.String(), tests[i].compression,
+				expectedFileCount);
+		}
+		if (error != B_OK) {
+			fprintf(stderr, "%s failed: %s\n", tests[i].name, strerror(error));
+			return 1;
+		}
+	}
+
+	// update the dictionary compressed package -- the new data must be
+	// compressed with the dictionary that is already there
+	BString packagePath = BString(directory) << "/zstd-dict.hpkg";
+	if (!write_file(BString(contentDirectory) << "/added.h",
+			"#define ADDED_LATER 1\n")) {
+		fprintf(stderr, "Failed to create the test files in \"%s\"\n",
+			directory.String());
+		return 1;
+	}
+	status_t error = create_package(packagePath.String(),
+		B_HPKG_COMPRESSION_ZSTD_DICTIONARY, B_HPKG_WRITER_UPDATE_PACKAGE,
+		"added.h");
+	if (error == B_OK) {
+		error = check_package(packagePath.String(),
+			B_HPKG_COMPRESSION_ZSTD_DICTIONARY, expectedFileCount + 1);
+	}
+	if (error != B_OK) {
+		fprintf(stderr, "Updating zstd-dict.hpkg failed: %s\n",
+			strerror(error));
+		return 1;
+	}
+
+	printf("All tests passed.\n");
+	return 0;
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <OS.h>
+#include <String.h>
+
+#include <package/PackageInfo.h>
+#include <package/PackageInfoContentHandler.h>
+#include <package/RepositoryInfo.h>
+#include <package/hpkg/RepositoryContentHandler.h>
+#include <package/hpkg/RepositoryReader.h>
+#include <package/hpkg/RepositoryWriter.h>
+#include <package/hpkg/StandardErrorOutput.h>
+
+
+// Creates a repository with many synthetic packages and compares the time it
+// takes to create the infos of all packages, which is what BRepositoryCache
+// does, with the time it takes to index the repository and to create the
+// infos of a few packages only. It also checks that the infos created on
+// demand match the ones created for the whole repository.
+
+
+using namespace BPackageKit;
+using namespace BPackageKit::BHPKG;
+
+
+static const int32 kDefaultPackageCount = 40000;
+static const int32 kOnDemandPackageCount = 100;
+
+
+struct RepositoryWriterListener : BRepositoryWriterListener {
+	virtual void PrintErrorVarArgs(const char* format, va_list args)
+	{
+		vfprintf(stderr, format, args);
+	}
+
+	virtual void OnPackageAdded(const BPackageInfo& packageInfo)
+	{
+	}
+
+	virtual void OnRepositoryInfoSectionDone(uint32 uncompressedSize)
+	{
+	}
+
+	virtual void OnPackageAttributesSectionDone(uint32 stringCount,
+		uint32 uncompressedSize)
+	{
+	}
+
+	virtual void OnRepositoryDone(uint32 headerSize,
+		uint32 repositoryInfoLength, uint32 licenseCount, uint32 packageCount,
+		uint32 packageAttributesSize, uint64 totalSize)
+	{
+		printf("repository: %" B_PRIu32 " packages, %" B_PRIu32 " bytes of "
+			"package attributes, %" B_PRIu64 " bytes total\n", packageCount,
+			packageAttributesSize, totalSize);
+	}
+};
+
+
+// Collects the infos of all packages like BRepositoryCache does.
+struct PackageInfoCollector : BRepositoryContentHandler {
+	PackageInfoCollector(BPackageInfo* infos, int32 maxCount,
+		BErrorOutput* errorOutput)
+		:
+		fInfos(infos),
+		fMaxCount(maxCount),
+		fCount(0),
+		fPackageInfo(),
+		fPackageInfoContentHandler(fPackageInfo, errorOutput)
+	{
+	}
+
+	int32 Count() const
+	{
+		return fCount;
+	}
+
+	virtual status_t HandlePackage(const char* packageName)
+	{
+		fPackageInfo.Clear();
+		return B_OK;
+	}
+
+	virtual status_t HandlePackageAttribute(
+		const BPackageInfoAttributeValue& value)
+	{
+		return fPackageInfoContentHandler.HandlePackageAttribute(value);
+	}
+
+	virtual status_t HandlePackageDone(const char* packageName)
+	{
+		status_t error = fPackageInfo.InitCheck();
+		if (error != B_OK)
+			return error;
+		if (fCount == fMaxCount)
+			return B_BAD_DATA;
+
+		fInfos[fCount++] = fPackageInfo;
+		return B_OK;
+	}
+
+	virtual status_t HandleRepositoryInfo(const BRepositoryInfo& repositoryInfo)
+	{
+		return B_OK;
+	}
+
+	virtual void HandleErrorOccurred()
+	{
+	}
+
+private:
+	BPackageInfo*				fInfos;
+	int32						fMaxCount;
+	int32						fCount;
+	BPackageInfo				fPackageInfo;
+	BPackageInfoContentHandler	fPackageInfoContentHandler;
+};
+
+
+static status_t
+create_repository(const char* path, int32 packageCount)
+{
+	BRepositoryInfo repositoryInfo;
+	repositoryInfo.SetName("benchmark");
+	repositoryInfo.SetIdentifier("tag:haiku-os.org,2026:benchmark");
+	repositoryInfo.SetBaseURL("https://example.org/benchmark");
+	repositoryInfo.SetVendor("Haiku");
+	repositoryInfo.SetSummary("Synthetic repository");
+	repositoryInfo.SetPriority(1);
+	repositoryInfo.SetArchitecture(B_PACKAGE_ARCHITECTURE_X86_64);
+
+	RepositoryWriterListener listener;
+	BRepositoryWriter writer(&listener, &repositoryInfo);
+	status_t error = writer.Init(path);
+	if (error != B_OK)
+		return error;
+
+	srand(42);
+	for (int32 i = 0; i < packageCount; i++) {
+		BString name;
+		name.SetToFormat("package%" B_PRId32, i);
+		BPackageVersion version(BString() << 1 + i % 7, BString() << i % 13,
+			BString() << i % 100, "", 1 + i % 3);
+
+		BPackageInfo info;
+		info.SetName(name);
+		info.SetVersion(version);
+		info.SetSummary(BString("The synthetic package ") << name);
+		info.SetDescription(BString("A package with a longer description, ")
+			<< "like most packages have. This is " << name << ".");
+		info.SetVendor("Haiku");
+		info.SetPackager("Benchmark <benchmark@example.org>");
+		info.SetArchitecture(B_PACKAGE_ARCHITECTURE_X86_64);
+		info.AddCopyright("2026 Haiku, Inc.");
+		info.AddLicense("MIT");
+		info.AddURL("https://example.org");
+		info.AddProvides(BPackageResolvable(name, version));
+		info.AddProvides(BPackageResolvable(BString("cmd:") << name));
+		info.AddProvides(BPackageResolvable(BString("lib:lib") << name,
+			version));
+		if (i > 0) {
+			for (int32 k = rand() % 5; k > 0; k--) {
+				BString requiredName;
+				requiredName.SetToFormat("lib:libpackage%d", rand() % i);
+				info.AddRequires(BPackageResolvableExpression(requiredName));
+			}
+		}
+
+		error = writer.AddPackageInfo(info);
+		if (error != B_OK)
+			return error;
+	}
+
+	return writer.Finish();
+}
+
+
+int
+main(int argc, const char* const* argv)
+{
+	int32 packageCount = kDefaultPackageCount;
+	if (argc > 1)
+		packageCount = atoi(argv[1]);
+	BString directory = "/tmp/repository_reader_benchmark";
+	if (argc > 2)
+		directory = argv[2];
+	if (packageCount < kOnDemandPackageCount) {
+		fprintf(stderr, "usage: %s [<package count>] [<directory>]\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (mkdir(directory.String(), 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Failed to create \"%s\": %s\n", directory.String(),
+			strerror(errno));
+		return 1;
+	}
+
+	BString path = BString(directory) << "/repo";
+	bigtime_t startTime = system_time();
+	status_t error = create_repository(path.String(), packageCount);
+	if (error != B_OK) {
+		fprintf(stderr, "Failed to create the repository: %s\n",
+			strerror(error));
+		return 1;
+	}
+	printf("created in %" B_PRId64 " ms\n", (system_time() - startTime) / 1000);
+
+	BStandardErrorOutput errorOutput;
+
+	// create the infos of all packages
+	BPackageInfo* infos = new BPackageInfo[packageCount];
+	startTime = system_time();
+	{
+		BRepositoryReader reader(&errorOutput);
+		PackageInfoCollector collector(infos, packageCount, &errorOutput);
+		error = reader.Init(path.String());
+		if (error == B_OK)
+			error = reader.ParseContent(&collector);
+		if (error == B_OK && collector.Count() != packageCount)
+			error = B_BAD_DATA;
+	}
+	if (error != B_OK) {
+		fprintf(stderr, "Failed to read the repository: %s\n",
+			strerror(error));
+		return 1;
+	}
+	printf("all package infos: %" B_PRId64 " ms\n",
+		(system_time() - startTime) / 1000);
+
+	// index the packages and create only some of their infos
+	startTime = system_time();
+	BRepositoryReader reader(&errorOutput);
+	error = reader.Init(path.String());
+	if (error == B_OK)
+		error = reader.InitPackageIndex();
+	if (error == B_OK && reader.CountPackages() != packageCount)
+		error = B_BAD_DATA;
+	if (error != B_OK) {
+		fprintf(stderr, "Failed to index the repository: %s\n",
+			strerror(error));
+		return 1;
+	}
+	bigtime_t indexTime = system_time() - startTime;
+
+	for (int32 i = 0; i < kOnDemandPackageCount; i++) {
+		int32 index = (int32)((int64)i * packageCount / kOnDemandPackageCount);
+		BPackageInfo info;
+		error = reader.GetPackageInfo(index, info);
+		if (error != B_OK) {
+			fprintf(stderr, "Failed to get the info of package %" B_PRId32
+				": %s\n", index, strerror(error));
+			return 1;
+		}
+
+		if (info.Name() != reader.PackageNameAt(index)
+			|| info.Name() != infos[index].Name()
+			|| info.Version() != infos[index].Version()
+			|| info.ProvidesList().CountItems()
+				!= infos[index].ProvidesList().CountItems()
+			|| info.RequiresList().CountItems()
+				!= infos[index].RequiresList().CountItems()) {
+			fprintf(stderr, "The info of package %" B_PRId32 " doesn't "
+				"match\n", index);
+			return 1;
+		}
+	}
+	printf("index: %" B_PRId64 " ms, with %" B_PRId32 " package infos: %"
+		B_PRId64 " ms\n", indexTime / 1000, kOnDemandPackageCount,
+		(system_time() - startTime) / 1000);
+
+	delete[] infos;
+	return 0;
+}
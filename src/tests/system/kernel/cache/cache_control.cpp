@@ -11,6 +11,7 @@
 #include <file_cache.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -20,7 +21,9 @@ extern const char *__progname;
 void
 usage()
 {
-	fprintf(stderr, "usage: %s [clear | unset | set <module-name>]\n", __progname);
+	fprintf(stderr, "usage: %s [clear | unset | set <module-name> | limits "
+		"[<dirty-percent> <device-seconds> <device-min-pages> <max-pause-ms> "
+		"<cluster-pages>]]\n", __progname);
 	exit(0);
 }
 
@@ -50,6 +53,31 @@ main(int argc, char **argv)
 		status = _kern_generic_syscall(CACHE_SYSCALLS, CACHE_SET_MODULE, argv[2], strlen(argv[2]));
 		if (status != B_OK)
 			fprintf(stderr, "%s: setting the module failed: %s\n", __progname, strerror(status));
+	} else if (!strcmp(argv[1], "limits")) {
+		cache_write_back_limits limits;
+		if (argc > 6) {
+			limits.dirty_ratio = strtoul(argv[2], NULL, 0);
+			limits.device_dirty_seconds = strtoul(argv[3], NULL, 0);
+			limits.device_min_dirty_pages = strtoul(argv[4], NULL, 0);
+			limits.max_writer_pause = strtoul(argv[5], NULL, 0);
+			limits.cluster_pages = strtoul(argv[6], NULL, 0);
+
+			status = _kern_generic_syscall(CACHE_SYSCALLS, CACHE_SET_WRITE_BACK_LIMITS, &limits, sizeof(limits));
+			if (status != B_OK)
+				fprintf(stderr, "%s: setting the limits failed: %s\n", __progname, strerror(status));
+		} else if (argc == 2) {
+			status = _kern_generic_syscall(CACHE_SYSCALLS, CACHE_GET_WRITE_BACK_LIMITS, &limits, sizeof(limits));
+			if (status != B_OK)
+				fprintf(stderr, "%s: getting the limits failed: %s\n", __progname, strerror(status));
+			else {
+				printf("dirty memory:        %" B_PRIu32 "%%\n", limits.dirty_ratio);
+				printf("device dirty time:   %" B_PRIu32 " s\n", limits.device_dirty_seconds);
+				printf("device minimum:      %" B_PRIu32 " pages\n", limits.device_min_dirty_pages);
+				printf("max. writer pause:   %" B_PRIu32 " ms\n", limits.max_writer_pause);
+				printf("write-back clusters: %" B_PRIu32 " pages\n", limits.cluster_pages);
+			}
+		} else
+			usage();
 	} else
 		usage();
 
@@ -332,5 +332,16 @@ main(int argc, char** argv)
 	map.SetSize(0);
 	map.Test();
 
+	map.SetTo("invalidate1", 16384);
+	map.Add(0, 4096, 40960).Add(4096, 4096, 8192).Add(8192, 8192, 100000);
+	map.Test();
+	map.Invalidate(2048, 8192);
+	map.Test();
+	map.Invalidate(12288, 1024);
+	map.Test();
+	map.Invalidate(0, 16384);
+	map.Clear().Add(0, 16384, 500000);
+	map.Test();
+
 	return 0;
 }
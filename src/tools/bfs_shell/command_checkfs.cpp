@@ -77,6 +77,8 @@ command_checkfs(int argc, const char* const* argv)
 					fssh_dprintf(", names don't match");
 				if ((result.errors & BFS_INVALID_BPLUSTREE) != 0)
 					fssh_dprintf(", invalid b+tree");
+				if ((result.errors & BFS_INVALID_INLINE_DATA) != 0)
+					fssh_dprintf(", invalid inline data");
 				fssh_dprintf("\n");
 			}
 
@@ -130,6 +132,12 @@ command_checkfs(int argc, const char* const* argv)
 		result.stats.double_indirect_block_runs,
 		result.stats.double_indirect_array_blocks,
 		result.stats.blocks_in_double_indirect * result.stats.block_size);
+	fssh_dprintf("\tinline files\t\t\t%" FSSH_B_PRIu64 "\n",
+		result.stats.inline_files);
+	if (result.stats.checksum_errors != 0) {
+		fssh_dprintf("\n\t%" FSSH_B_PRIu64 " blocks did not match their "
+			"checksum\n", result.stats.checksum_errors);
+	}
 
 	if (result.status == B_ENTRY_NOT_FOUND)
 		result.status = B_OK;
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "fssh_dirent.h"
+#include "fssh_stat.h"
+#include "fssh_stdio.h"
+#include "syscalls.h"
+
+#include "bfs.h"
+#include "bfs_control.h"
+
+
+namespace FSShell {
+
+
+static fssh_status_t
+run_query(fssh_dev_t volumeID, const char* query, uint32& _count,
+	bigtime_t& _time)
+{
+	bigtime_t startTime = system_time();
+
+	int fd = _kern_open_query(volumeID, query, strlen(query), 0, -1, -1);
+	if (fd < 0)
+		return fd;
+
+	char buffer[sizeof(fssh_dirent) + FSSH_B_FILE_NAME_LENGTH];
+	fssh_dirent* entry = (fssh_dirent*)buffer;
+	fssh_ssize_t entriesRead;
+
+	_count = 0;
+	while ((entriesRead = _kern_read_dir(fd, entry, sizeof(buffer), 1)) == 1)
+		_count++;
+
+	_kern_close(fd);
+	_time = system_time() - startTime;
+
+	return entriesRead < 0 ? entriesRead : B_OK;
+}
+
+
+/*!	Prints how BFS is going to evaluate the query, and measures how long
+	it takes to actually run it.
+*/
+fssh_status_t
+command_explainquery(int argc, const char* const* argv)
+{
+	int32 runs = 1;
+	int argi = 1;
+	if (argc == 4 && !strcmp(argv[1], "-r")) {
+		if (fssh_sscanf(argv[2], "%" B_SCNd32, &runs) < 1 || runs < 0) {
+			fssh_dprintf("Invalid number of runs\n");
+			return B_BAD_VALUE;
+		}
+		argi = 3;
+	} else if (argc != 2) {
+		fssh_dprintf("Usage: %s [-r <runs>] <query>\n"
+			"  -r  Run the query <runs> times, and report the time it "
+			"took (default 1)\n", argv[0]);
+		return B_ERROR;
+	}
+
+	const char* query = argv[argi];
+
+	int rootDir = _kern_open_dir(-1, "/myfs");
+	if (rootDir < 0) {
+		fssh_dprintf("Error: Couldn't open root directory\n");
+		return rootDir;
+	}
+
+	struct fssh_stat stat;
+	fssh_status_t status = _kern_read_stat(rootDir, NULL, false, &stat,
+		sizeof(stat));
+	if (status != B_OK) {
+		_kern_close(rootDir);
+		return status;
+	}
+
+	char plan[16384];
+	bfs_explain_query explain;
+	explain.predicate = query;
+	explain.flags = 0;
+	explain.buffer = plan;
+	explain.buffer_size = sizeof(plan);
+
+	status = _kern_ioctl(rootDir, BFS_IOCTL_EXPLAIN_QUERY, &explain,
+		sizeof(explain));
+	_kern_close(rootDir);
+
+	if (status != B_OK && status != B_BUFFER_OVERFLOW) {
+		fssh_dprintf("Explaining the query failed: %s\n",
+			fssh_strerror(status));
+		return status;
+	}
+
+	fssh_dprintf("%s", plan);
+
+	bigtime_t bestTime = 0;
+	bigtime_t totalTime = 0;
+	uint32 count = 0;
+
+	for (int32 i = 0; i < runs; i++) {
+		bigtime_t time;
+		status = run_query(stat.fssh_st_dev, query, count, time);
+		if (status != B_OK) {
+			fssh_dprintf("Running the query failed: %s\n",
+				fssh_strerror(status));
+			return status;
+		}
+
+		if (i == 0 || time < bestTime)
+			bestTime = time;
+		totalTime += time;
+	}
+
+	if (runs > 0) {
+		fssh_dprintf("\n%" B_PRIu32 " entries, best %" B_PRId64 " usecs, "
+			"average %" B_PRId64 " usecs (%" B_PRId32 " runs)\n", count,
+			bestTime, totalTime / runs, runs);
+	}
+
+	return B_OK;
+}
+
+
+}	// namespace FSShell
@@ -0,0 +1,21 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef EXPLAIN_QUERY_H
+#define EXPLAIN_QUERY_H
+
+
+#include "fssh_types.h"
+
+
+namespace FSShell {
+
+
+fssh_status_t command_explainquery(int argc, const char* const* argv);
+
+
+}	// namespace FSShell
+
+
+#endif	// EXPLAIN_QUERY_H